@@ -0,0 +1,69 @@
+#include "PluginEditor.h"
+
+MDAAmbienceAudioProcessorEditor::MDAAmbienceAudioProcessorEditor(MDAAmbienceAudioProcessor &p)
+: AudioProcessorEditor(p), _processor(p), _parameterEditor(p)
+{
+    addAndMakeVisible(_parameterEditor);
+    addAndMakeVisible(_loadButton);
+    addAndMakeVisible(_clearButton);
+    addAndMakeVisible(_fileLabel);
+
+    _loadButton.onClick = [this] { chooseFile(); };
+    _clearButton.onClick = [this] {
+        _processor.clearImpulseResponse();
+        updateFileLabel();
+    };
+
+    updateFileLabel();
+
+    // The generic editor picks its own size, based on the parameters.
+    setSize(_parameterEditor.getWidth(), _parameterEditor.getHeight() + _rowHeight);
+}
+
+void MDAAmbienceAudioProcessorEditor::paint(juce::Graphics &g)
+{
+    g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
+}
+
+void MDAAmbienceAudioProcessorEditor::resized()
+{
+    auto bounds = getLocalBounds();
+    auto row = bounds.removeFromBottom(_rowHeight).reduced(8);
+    _parameterEditor.setBounds(bounds);
+
+    _loadButton.setBounds(row.removeFromLeft(90));
+    row.removeFromLeft(8);
+    _clearButton.setBounds(row.removeFromLeft(60));
+    row.removeFromLeft(8);
+    _fileLabel.setBounds(row);
+}
+
+void MDAAmbienceAudioProcessorEditor::chooseFile()
+{
+    _fileChooser = std::make_unique<juce::FileChooser>("Load Impulse Response",
+                                                       _processor.getImpulseResponseFile(), "*.wav");
+
+    const int flags = juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles;
+    _fileChooser->launchAsync(flags, [this](const juce::FileChooser &chooser) {
+        const juce::File file = chooser.getResult();
+        if (file.getFullPathName().isEmpty()) {
+            return;  // cancelled
+        }
+        if (!_processor.loadImpulseResponse(file)) {
+            juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon,
+                "Could not load impulse response",
+                file.getFileName() + " is not a .wav file with 16, 24 or 32-bit samples.");
+        }
+        updateFileLabel();
+    });
+}
+
+void MDAAmbienceAudioProcessorEditor::updateFileLabel()
+{
+    const juce::File file = _processor.getImpulseResponseFile();
+    if (file.getFullPathName().isEmpty()) {
+        _fileLabel.setText("No impulse response", juce::dontSendNotification);
+    } else {
+        _fileLabel.setText(file.getFileName(), juce::dontSendNotification);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+/*
+  The usual generic editor for the parameters, with a row of controls below it
+  for choosing the impulse response of the Convolution mode. (Not part of the
+  original plug-in.)
+ */
+class MDAAmbienceAudioProcessorEditor : public juce::AudioProcessorEditor
+{
+public:
+    explicit MDAAmbienceAudioProcessorEditor(MDAAmbienceAudioProcessor &p);
+
+    void paint(juce::Graphics &g) override;
+    void resized() override;
+
+private:
+    void chooseFile();
+    void updateFileLabel();
+
+    MDAAmbienceAudioProcessor &_processor;
+
+    juce::GenericAudioProcessorEditor _parameterEditor;
+    juce::TextButton _loadButton { "Load IR..." };
+    juce::TextButton _clearButton { "Clear" };
+    juce::Label _fileLabel;
+
+    // Kept alive while the file dialog is open.
+    std::unique_ptr<juce::FileChooser> _fileChooser;
+
+    static constexpr int _rowHeight = 40;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDAAmbienceAudioProcessorEditor)
+};
@@ -1,14 +1,18 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
+#include "PluginEditor.h"
 
 MDAAmbienceAudioProcessor::MDAAmbienceAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(_parameters, apvts);
 }
 
 MDAAmbienceAudioProcessor::~MDAAmbienceAudioProcessor()
 {
+    cancelPendingUpdate();
 }
 
 const juce::String MDAAmbienceAudioProcessor::getName() const
@@ -41,20 +45,54 @@ void MDAAmbienceAudioProcessor::changeProgramName(int index, const juce::String
 
 void MDAAmbienceAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-    _buf1 = new float[1024];
-    _buf2 = new float[1024];
-    _buf3 = new float[1024];
-    _buf4 = new float[1024];
+    _dry.prepare(sampleRate);
+    _wet.prepare(sampleRate);
+    _damp.prepare(sampleRate);
+
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    _channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+    _pairs.resize(_channelPairs.size());
+    for (auto &state : _pairs) {
+        state.buf1.resize(1024);
+        state.buf2.resize(1024);
+        state.buf3.resize(1024);
+        state.buf4.resize(1024);
+    }
+
+    // Make the convolvers for the new sample rate and channel layout. The
+    // audio thread isn't running now, so they can be put in place directly.
+    _convolutionRate = sampleRate;
+    _numConvolvers = _pairs.size();
+    auto convolution = makeConvolution();
+    std::unique_ptr<MDAAmbienceConvolution> old, pending;
+    {
+        const std::lock_guard<std::mutex> lock(_convolutionLock);
+        old = std::move(_convolution);
+        pending = std::move(_pendingConvolution);
+        _convolution = std::move(convolution);
+        _hasPendingConvolution = false;
+    }
 
     resetState();
 }
 
 void MDAAmbienceAudioProcessor::releaseResources()
 {
-    delete [] _buf1; _buf1 = nullptr;
-    delete [] _buf2; _buf2 = nullptr;
-    delete [] _buf3; _buf3 = nullptr;
-    delete [] _buf4; _buf4 = nullptr;
+    _pairs.clear();
+
+    _convolutionRate = 0.0;
+    _numConvolvers = 0;
+    std::unique_ptr<MDAAmbienceConvolution> old, pending;
+    {
+        const std::lock_guard<std::mutex> lock(_convolutionLock);
+        old = std::move(_convolution);
+        pending = std::move(_pendingConvolution);
+        _hasPendingConvolution = false;
+    }
 }
 
 void MDAAmbienceAudioProcessor::reset()
@@ -64,22 +102,42 @@ void MDAAmbienceAudioProcessor::reset()
 
 bool MDAAmbienceAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDAAmbienceAudioProcessor::resetState()
 {
     flushBuffers();
-    _pos = 0;
-    _filter = 0.0f;
+    for (auto &state : _pairs) {
+        state.pos = 0;
+        state.filter = 0.0f;
+    }
+
+    if (_convolution != nullptr) {
+        for (auto &convolver : _convolution->convolvers) {
+            convolver->reset();
+        }
+    }
+
+    _dry.reset();
+    _wet.reset();
+    _damp.reset();
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
 }
 
 void MDAAmbienceAudioProcessor::flushBuffers()
 {
-    memset(_buf1, 0, 1024 * sizeof(float));
-    memset(_buf2, 0, 1024 * sizeof(float));
-    memset(_buf3, 0, 1024 * sizeof(float));
-    memset(_buf4, 0, 1024 * sizeof(float));
+    for (auto &state : _pairs) {
+        memset(state.buf1.data(), 0, 1024 * sizeof(float));
+        memset(state.buf2.data(), 0, 1024 * sizeof(float));
+        memset(state.buf3.data(), 0, 1024 * sizeof(float));
+        memset(state.buf4.data(), 0, 1024 * sizeof(float));
+    }
 }
 
 void MDAAmbienceAudioProcessor::update()
@@ -89,7 +147,7 @@ void MDAAmbienceAudioProcessor::update()
     // Convert the percentage to a filter coefficient between 0.05 - 0.95.
     // The higher HF Damp, the *less* filtering!
     float fParam1 = apvts.getRawParameterValue("HF Damp")->load() / 100.0f;
-    _damp = 0.05f + 0.9f * fParam1;
+    _damp.setTarget(0.05f + 0.9f * fParam1);
 
     // Convert the output from [-20, +20] dB into a gain of [0.1, 10.0].
     float fParam3 = apvts.getRawParameterValue("Output")->load();
@@ -100,8 +158,8 @@ void MDAAmbienceAudioProcessor::update()
     // For mix = 100%, wet is 0.8 and dry is 0. So this is slightly different
     // from a regular dry/wet mix that does dry = 100% - wet.
     float fParam2 = apvts.getRawParameterValue("Mix")->load() / 100.0f;
-    _dry = tmp - fParam2 * fParam2 * tmp;
-    _wet = (0.4f + 0.4f) * fParam2 * tmp;
+    _dry.setTarget(tmp - fParam2 * fParam2 * tmp);
+    _wet.setTarget((0.4f + 0.4f) * fParam2 * tmp);
 
     // Convert the size from 0 - 10 meters to a value between 0.025 - 2.69.
     // This size is used to set the delay times on the different delay lines:
@@ -113,6 +171,26 @@ void MDAAmbienceAudioProcessor::update()
     tmp = 0.025f + 2.665f * fParam0;
     if (_size != tmp) { flushBuffers(); }  // need to flush delay lines
     _size = tmp;
+
+    // Not part of the original plug-in, which reported no tail. The allpass
+    // filters keep ringing until the feedback of 0.8 has died down by 60 dB,
+    // which takes 31 trips around a delay line. The four delay lines are in
+    // series, so their tails add up.
+    _allpassTail = 31.0 * (107 + 142 + 277 + 379) * _size / getSampleRate();
+
+    // Not part of the original plug-in. When switching between the allpass
+    // filters and the convolution, clear out whatever the other one still
+    // had ringing from the last time it was used.
+    int mode = int(apvts.getRawParameterValue("Mode")->load());
+    if (mode != _mode) {
+        flushBuffers();
+        if (_convolution != nullptr) {
+            for (auto &convolver : _convolution->convolvers) {
+                convolver->reset();
+            }
+        }
+    }
+    _mode = mode;
 }
 
 void MDAAmbienceAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
@@ -126,14 +204,75 @@ void MDAAmbienceAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    // Pick up the convolvers for a newly loaded impulse response. If the
+    // message thread is still busy making them, try again next block.
+    {
+        std::unique_lock<std::mutex> lock(_convolutionLock, std::try_to_lock);
+        if (lock.owns_lock() && _hasPendingConvolution) {
+            std::swap(_convolution, _pendingConvolution);
+            _hasPendingConvolution = false;
+            triggerAsyncUpdate();
+        }
+    }
+
+    if (_parameters.changed()) {
+        update();
+    }
+
+    // All pairs start from the same wet/dry levels and damping, and ramp them
+    // the same way.
+    for (auto &state : _pairs) {
+        state.wet = _wet;
+        state.dry = _dry;
+        state.damp = _damp;
+    }
+
+    // Without an impulse response, the Convolution mode uses the allpass
+    // filters like the original.
+    MDAAmbienceConvolution *convolution = nullptr;
+    if (_mode == 1 && _convolution != nullptr && _convolution->convolvers.size() == _pairs.size()) {
+        convolution = _convolution.get();
+
+        // When rendering offline, the convolvers wait for their background
+        // thread, so the output doesn't depend on how busy the computer is.
+        for (auto &convolver : convolution->convolvers) {
+            convolver->setNonRealtime(isNonRealtime());
+        }
+    }
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    const double tailLength = (convolution != nullptr) ? convolution->tailLength : _allpassTail;
+    if (tailLength != _tailLength.load()) {
+        _tailLength = tailLength;
+        triggerAsyncUpdate();
+    }
 
-    int p = _pos;
+    mda::processChannelPairs(_channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this, convolution](int pair, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            if (convolution != nullptr) {
+                processConvolution(_pairs[size_t(pair)], *convolution->convolvers[size_t(pair)],
+                                   in1, in2, out1, out2, numSamples);
+            } else {
+                processPair(_pairs[size_t(pair)], in1, in2, out1, out2, numSamples);
+            }
+        });
+
+    if (!_pairs.empty()) {
+        _wet = _pairs[0].wet;
+        _dry = _pairs[0].dry;
+        _damp = _pairs[0].damp;
+    }
+}
+
+void MDAAmbienceAudioProcessor::processPair(MDAAmbienceState &state, const float *in1, const float *in2,
+                                            float *out1, float *out2, int numSamples)
+{
+    float *buf1 = state.buf1.data();
+    float *buf2 = state.buf2.data();
+    float *buf3 = state.buf3.data();
+    float *buf4 = state.buf4.data();
+
+    int p = state.pos;
 
     // The main structure of this effect is four allpass filters in series.
     // Each of these is made up of a delay line with a different delay length.
@@ -147,12 +286,9 @@ void MDAAmbienceAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
     int d4 = (p + int(379 * _size)) & 1023;
 
     const float feedback = _feedback;
-    const float damp = _damp;
-    const float dry = _dry;
-    const float wet = _wet;
-    float f = _filter;
+    float f = state.filter;
 
-    for (int i = 0; i < buffer.getNumSamples(); ++i) {
+    for (int i = 0; i < numSamples; ++i) {
         float a = in1[i];
         float b = in2[i];
 
@@ -160,6 +296,9 @@ void MDAAmbienceAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
         // Also multiply by the wetness amount. We can do this here already
         // because everything that follows are linear operations. Note that
         // the maximum value of wet is 0.8, not 1.0.
+        const float dry = state.dry.next();
+        const float wet = state.wet.next();
+        const float damp = state.damp.next();
         float x = wet * (a + b);
 
         // HF damping. This is a simple low-pass filter: f = a*x + (1 - a)*f.
@@ -186,21 +325,21 @@ void MDAAmbienceAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
          */
 
         // First allpass stage.
-        float t = _buf1[p];
+        float t = buf1[p];
         r -= feedback * t;
-        _buf1[d1] = r;
+        buf1[d1] = r;
         r += t;
 
         // Second allpass stage.
-        t = _buf2[p];
+        t = buf2[p];
         r -= feedback * t;
-        _buf2[d2] = r;
+        buf2[d2] = r;
         r += t;
 
         // Third allpass stage.
-        t = _buf3[p];
+        t = buf3[p];
         r -= feedback * t;
-        _buf3[d3] = r;
+        buf3[d3] = r;
         r += t;
 
         // The left channel output is a mix of the dry input with the allpass
@@ -211,9 +350,9 @@ void MDAAmbienceAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
         a = dry * a + r - f;
 
         // Fourth allpass stage.
-        t = _buf4[p];
+        t = buf4[p];
         r -= feedback * t;
-        _buf4[d4] = r;
+        buf4[d4] = r;
         r += t;
 
         // The right channel output. This has one more delay stage than the
@@ -234,8 +373,8 @@ void MDAAmbienceAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
         out2[i] = b;
     }
 
-    _pos = p;
-    _filter = f;
+    state.pos = p;
+    state.filter = f;
 
     // N.B. The original code had denormal handling on `f` here that also resets
     // the contents of the delay lines. That could interrupt the reverb tail if
@@ -244,9 +383,124 @@ void MDAAmbienceAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
     // all-pass filter sections. But we use juce::ScopedNoDenormals instead. :-)
 }
 
+void MDAAmbienceAudioProcessor::processConvolution(MDAAmbienceState &state, mda::Convolver &convolver,
+                                                   const float *in1, const float *in2,
+                                                   float *out1, float *out2, int numSamples)
+{
+    float f = state.filter;
+
+    // The convolver works on arrays, so go through the block in chunks.
+    const int chunkSize = 256;
+    float x[chunkSize], y1[chunkSize], y2[chunkSize], dry[chunkSize];
+
+    for (int start = 0; start < numSamples; start += chunkSize) {
+        const int n = std::min(chunkSize, numSamples - start);
+
+        // The same mono input as for the allpass filters, including the HF
+        // damping, so that the wet level and HF Damp work the same way.
+        for (int i = 0; i < n; ++i) {
+            dry[i] = state.dry.next();
+            const float wet = state.wet.next();
+            const float damp = state.damp.next();
+            f += damp * (wet * (in1[start + i] + in2[start + i]) - f);
+            x[i] = f;
+        }
+
+        convolver.process(x, y1, y2, n);
+
+        // The impulse response begins with the direct sound, so unlike with
+        // the allpass filters, there's nothing to subtract here.
+        for (int i = 0; i < n; ++i) {
+            const float a = in1[start + i];
+            const float b = in2[start + i];
+            out1[start + i] = dry[i] * a + y1[i];
+            out2[start + i] = dry[i] * b + y2[i];
+        }
+    }
+
+    state.filter = f;
+}
+
+bool MDAAmbienceAudioProcessor::loadImpulseResponse(const juce::File &file)
+{
+    auto ir = std::make_shared<mda::ImpulseResponse>();
+    if (!mda::ImpulseResponse::readWavFile(file.getFullPathName().toStdString(), *ir)) {
+        return false;
+    }
+    apvts.state.setProperty("ImpulseResponse", file.getFullPathName(), nullptr);
+    setImpulseResponse(std::move(ir));
+    return true;
+}
+
+void MDAAmbienceAudioProcessor::clearImpulseResponse()
+{
+    apvts.state.setProperty("ImpulseResponse", juce::String(), nullptr);
+    setImpulseResponse(nullptr);
+}
+
+juce::File MDAAmbienceAudioProcessor::getImpulseResponseFile() const
+{
+    const juce::String path = apvts.state.getProperty("ImpulseResponse").toString();
+    return path.isEmpty() ? juce::File() : juce::File(path);
+}
+
+void MDAAmbienceAudioProcessor::setImpulseResponse(std::shared_ptr<const mda::ImpulseResponse> ir)
+{
+    _impulseResponse = std::move(ir);
+
+    // Before prepareToPlay(), there's nothing to make yet.
+    if (_convolutionRate <= 0.0) {
+        return;
+    }
+
+    // Resampling the impulse response and making the partitions takes a
+    // while, so do that before taking the lock. Convolvers that the audio
+    // thread hasn't picked up yet are deleted when this function returns.
+    auto convolution = makeConvolution();
+    std::unique_ptr<MDAAmbienceConvolution> old;
+    {
+        const std::lock_guard<std::mutex> lock(_convolutionLock);
+        old = std::move(_pendingConvolution);
+        _pendingConvolution = std::move(convolution);
+        _hasPendingConvolution = true;
+    }
+}
+
+void MDAAmbienceAudioProcessor::handleAsyncUpdate()
+{
+    std::unique_ptr<MDAAmbienceConvolution> old;
+    {
+        const std::lock_guard<std::mutex> lock(_convolutionLock);
+        if (!_hasPendingConvolution) {
+            old = std::move(_pendingConvolution);
+        }
+    }
+    updateHostDisplay();
+}
+
+std::unique_ptr<MDAAmbienceConvolution> MDAAmbienceAudioProcessor::makeConvolution()
+{
+    if (_impulseResponse == nullptr || _convolutionRate <= 0.0) {
+        return nullptr;
+    }
+
+    // Every pair gets its own convolver, since they each have their own
+    // reverb tail, but they all use the same impulse response.
+    mda::ImpulseResponse ir = _impulseResponse->resampled(_convolutionRate);
+    ir.normalize();
+
+    auto convolution = std::make_unique<MDAAmbienceConvolution>();
+    for (size_t i = 0; i < _numConvolvers; ++i) {
+        convolution->convolvers.push_back(std::make_unique<mda::Convolver>(_convolverThread));
+        convolution->convolvers.back()->prepare(ir);
+    }
+    convolution->tailLength = double(ir.length()) / _convolutionRate;
+    return convolution;
+}
+
 juce::AudioProcessorEditor *MDAAmbienceAudioProcessor::createEditor()
 {
-    return new juce::GenericAudioProcessorEditor(*this);
+    return new MDAAmbienceAudioProcessorEditor(*this);
 }
 
 void MDAAmbienceAudioProcessor::getStateInformation(juce::MemoryBlock &destData)
@@ -259,6 +513,13 @@ void MDAAmbienceAudioProcessor::setStateInformation(const void *data, int sizeIn
     std::unique_ptr<juce::XmlElement> xml(getXmlFromBinary(data, sizeInBytes));
     if (xml.get() != nullptr && xml->hasTagName(apvts.state.getType())) {
         apvts.replaceState(juce::ValueTree::fromXml(*xml));
+
+        // Load the impulse response the state refers to. If the file has
+        // gone missing, the convolution mode falls back to the allpass filters.
+        const juce::String path = apvts.state.getProperty("ImpulseResponse").toString();
+        if (path.isEmpty() || !loadImpulseResponse(juce::File(path))) {
+            setImpulseResponse(nullptr);
+        }
     }
 }
 
@@ -294,6 +555,15 @@ juce::AudioProcessorValueTreeState::ParameterLayout MDAAmbienceAudioProcessor::c
         0.0f,
         juce::AudioParameterFloatAttributes().withLabel("dB")));
 
+    // Not part of the original plug-in. Convolution uses the impulse response
+    // that was loaded with the "Load IR..." button instead of the allpass
+    // filters. Size does nothing in this mode.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("Mode", 1),
+        "Mode",
+        juce::StringArray({ "Allpass", "Convolution" }),
+        0));
+
     return layout;
 }
 
@@ -1,8 +1,39 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAConvolver.h"
+#include "MDAParameters.h"
 
-class MDAAmbienceAudioProcessor : public juce::AudioProcessor
+// The state of the effect for one pair of channels.
+struct MDAAmbienceState
+{
+    // Delay lines. The maximum length of these is hardcoded to 1024 samples.
+    std::vector<float> buf1, buf2, buf3, buf4;
+
+    // Read position in the delay buffers.
+    int pos;
+
+    // Low-pass filter state value.
+    float filter;
+
+    // This pair's copies of the smoothed wet/dry mix and HF damping.
+    mda::SmoothedValue wet, dry, damp;
+};
+
+// The convolution reverb for every channel pair. A new set is made whenever an
+// impulse response is loaded, and handed over to the audio thread as a whole.
+// (Not part of the original plug-in.)
+struct MDAAmbienceConvolution
+{
+    std::vector<std::unique_ptr<mda::Convolver>> convolvers;
+
+    // Length of the impulse response in seconds.
+    double tailLength = 0.0;
+};
+
+class MDAAmbienceAudioProcessor : public juce::AudioProcessor,
+                                  private juce::AsyncUpdater
 {
 public:
     MDAAmbienceAudioProcessor();
@@ -24,7 +55,7 @@ public:
     bool acceptsMidi() const override { return false; }
     bool producesMidi() const override { return false; }
     bool isMidiEffect() const override { return false; }
-    double getTailLengthSeconds() const override { return 0.0; }
+    double getTailLengthSeconds() const override { return _tailLength.load(); }
 
     int getNumPrograms() override;
     int getCurrentProgram() override;
@@ -37,6 +68,13 @@ public:
 
     juce::AudioProcessorValueTreeState apvts { *this, nullptr, "Parameters", createParameterLayout() };
 
+    // Loads the impulse response for the Convolution mode from a .wav file.
+    // Returns false if the file can't be read. The path is saved with the
+    // plug-in's state. Call these from the message thread.
+    bool loadImpulseResponse(const juce::File &file);
+    void clearImpulseResponse();
+    juce::File getImpulseResponseFile() const;
+
 private:
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
@@ -45,11 +83,19 @@ private:
 
     void flushBuffers();
 
-    // Delay lines. The maximum length of these is hardcoded to 1024 samples.
-    float *_buf1, *_buf2, *_buf3, *_buf4;
+    void processPair(MDAAmbienceState &state, const float *in1, const float *in2,
+                     float *out1, float *out2, int numSamples);
 
-    // Read position in the delay buffers.
-    int _pos;
+    void processConvolution(MDAAmbienceState &state, mda::Convolver &convolver,
+                            const float *in1, const float *in2,
+                            float *out1, float *out2, int numSamples);
+
+    void setImpulseResponse(std::shared_ptr<const mda::ImpulseResponse> ir);
+    std::unique_ptr<MDAAmbienceConvolution> makeConvolution();
+
+    // Deletes the convolvers the audio thread swapped out, and tells the host
+    // about the new tail length.
+    void handleAsyncUpdate() override;
 
     // This sets the length of the delays.
     float _size;
@@ -57,14 +103,53 @@ private:
     // Feedback coefficient for the allpass filters.
     float _feedback;
 
-    // Low-pass filter coefficient for HF damping.
-    float _damp;
-
-    // Low-pass filter state value.
-    float _filter;
-
-    // Wet/dry mix.
-    float _wet, _dry;
+    // How long the allpass filters keep ringing, in seconds.
+    double _allpassTail = 0.0;
+
+    // Low-pass filter coefficient for HF damping. Smoothed like the mix.
+    mda::SmoothedValue _damp;
+
+    // Wet/dry mix. These are smoothed to avoid zipper noise.
+    mda::SmoothedValue _wet, _dry;
+
+    // 0 = the original allpass filters, 1 = convolution with an impulse response.
+    int _mode = 0;
+
+    // The impulse response as it was loaded, at its own sample rate, and the
+    // sample rate and number of channel pairs to make the convolvers for.
+    // These are only used on the message thread.
+    std::shared_ptr<const mda::ImpulseResponse> _impulseResponse;
+    double _convolutionRate = 0.0;
+    size_t _numConvolvers = 0;
+
+    // Does the long blocks of the convolution for all the channel pairs. This
+    // must outlive the convolvers, so it comes before them.
+    mda::ConvolverThread _convolverThread;
+
+    // The convolvers the audio thread is using. Newly loaded ones wait in
+    // _pendingConvolution until the audio thread swaps them in at the start of
+    // a block. The old ones end up in _pendingConvolution, and the audio
+    // thread triggers handleAsyncUpdate() to delete them on the message thread.
+    std::unique_ptr<MDAAmbienceConvolution> _convolution;
+    std::unique_ptr<MDAAmbienceConvolution> _pendingConvolution;
+    bool _hasPendingConvolution = false;
+
+    // Guards the pending convolvers. The audio thread never waits for this
+    // lock; if it's taken, it tries again on the next block. The convolvers
+    // are made before taking the lock, so it's only held very briefly.
+    std::mutex _convolutionLock;
+
+    // The tail of the current mode in seconds: the impulse response in the
+    // Convolution mode, the allpass filters otherwise.
+    std::atomic<double> _tailLength { 0.0 };
+
+    // How the channels are split into stereo pairs, and the state of the
+    // effect for each pair.
+    std::vector<mda::ChannelPair> _channelPairs;
+    std::vector<MDAAmbienceState> _pairs;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDAAmbienceAudioProcessor)
 };
@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDABandistoAudioProcessor::MDABandistoAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(parameters, apvts);
 }
 
 MDABandistoAudioProcessor::~MDABandistoAudioProcessor()
@@ -42,6 +44,15 @@ void MDABandistoAudioProcessor::changeProgramName(int index, const juce::String
 void MDABandistoAudioProcessor::prepareToPlay(double newSampleRate, int samplesPerBlock)
 {
     sampleRate = float(newSampleRate);
+
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+    pairs.resize(channelPairs.size());
+
     resetState();
 }
 
@@ -56,14 +67,22 @@ void MDABandistoAudioProcessor::reset()
 
 bool MDABandistoAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDABandistoAudioProcessor::resetState()
 {
-    fb1 = 0.0f;
-    fb2 = 0.0f;
-    fb3 = 0.0f;
+    for (auto &state : pairs) {
+        state.fb1 = 0.0f;
+        state.fb2 = 0.0f;
+        state.fb3 = 0.0f;
+    }
+
+    // Recalculate the parameters at the start of the next block.
+    parameters.invalidate();
 }
 
 void MDABandistoAudioProcessor::update()
@@ -137,14 +156,25 @@ void MDABandistoAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (parameters.changed()) {
+        update();
+    }
+
+    mda::processChannelPairs(channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this](int pair, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            processPair(pairs[size_t(pair)], in1, in2, out1, out2, numSamples);
+        });
+}
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+void MDABandistoAudioProcessor::processPair(MDABandistoState &state, const float *in1, const float *in2,
+                                            float *out1, float *out2, int numSamples)
+{
+    float &fb1 = state.fb1;
+    float &fb2 = state.fb2;
+    float &fb3 = state.fb3;
 
-    for (int i = 0; i < buffer.getNumSamples(); ++i) {
+    for (int i = 0; i < numSamples; ++i) {
         float a = in1[i];
         float b = in2[i];
 
@@ -1,6 +1,14 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAParameters.h"
+
+// The state of the effect for one pair of channels.
+struct MDABandistoState
+{
+    float fb1, fb2, fb3;  // filter delays
+};
 
 class MDABandistoAudioProcessor : public juce::AudioProcessor
 {
@@ -42,6 +50,8 @@ private:
 
     void update();
     void resetState();
+    void processPair(MDABandistoState &state, const float *in1, const float *in2,
+                     float *out1, float *out2, int numSamples);
 
     float sampleRate;
     float driv1, trim1;   // drive and gain for low band
@@ -49,9 +59,16 @@ private:
     float driv3, trim3;   // ... high band
     float fi1, fo1;       // filter coefficients
     float fi2, fo2;
-    float fb1, fb2, fb3;  // filter delays
     float sideLevel;      // output level for the stereo data
     int valve;            // 1 if unipolar mode, 0 if bipolar
 
+    // How the channels are split into stereo pairs, and the state of the
+    // effect for each pair.
+    std::vector<mda::ChannelPair> channelPairs;
+    std::vector<MDABandistoState> pairs;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher parameters;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDABandistoAudioProcessor)
 };
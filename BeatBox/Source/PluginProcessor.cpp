@@ -1,4 +1,5 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDABeatBoxAudioProcessor::MDABeatBoxAudioProcessor()
     : AudioProcessor(BusesProperties()
@@ -6,6 +7,8 @@ MDABeatBoxAudioProcessor::MDABeatBoxAudioProcessor()
                 .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
     sampleRate = 44100.0f;
+
+    mda::watchAllParameters(parameters, apvts);
 }
 
 MDABeatBoxAudioProcessor::~MDABeatBoxAudioProcessor()
@@ -172,6 +175,9 @@ void MDABeatBoxAudioProcessor::resetState()
     sfx = 0;
     sb1 = 0.0f;
     sb2 = 0.0f;
+
+    // Recalculate the parameters at the start of the next block.
+    parameters.invalidate();
 }
 
 void MDABeatBoxAudioProcessor::update()
@@ -250,7 +256,9 @@ void MDABeatBoxAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (parameters.changed()) {
+        update();
+    }
 
     const float *in1 = buffer.getReadPointer(0);
     const float *in2 = buffer.getReadPointer(1);
@@ -265,6 +273,8 @@ void MDABeatBoxAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
 
     // Key listen (snare). This turns off everything except the snare filter
     // output. This continues until two seconds worth of samples have elapsed.
+    // Because this overwrites some of the values that were calculated by
+    // update(), we need to call update() again on the next block.
     if (sfx > 0) {
         mix3 = 0.08f;
         slev = 0.0f;
@@ -272,6 +282,7 @@ void MDABeatBoxAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
         hlev = 0.0f;
         mix = 0.0f;
         sfx -= buffer.getNumSamples();
+        parameters.invalidate();
     }
 
     // Key listen (kick). This also uses the snare filter but swaps the coeffs
@@ -283,6 +294,7 @@ void MDABeatBoxAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
         hlev = 0.0f;
         mix = 0.0f;
         ksfx -= buffer.getNumSamples();
+        parameters.invalidate();
         sf1 = ksf1;
         sf2 = ksf2;
     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAParameters.h"
 
 class MDABeatBoxAudioProcessor : public juce::AudioProcessor
 {
@@ -89,5 +90,8 @@ private:
     int kbufpos;          // in kick buffer
     int sbufpos;          // in snare buffer
 
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher parameters;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDABeatBoxAudioProcessor)
 };
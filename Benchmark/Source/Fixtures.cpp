@@ -0,0 +1,185 @@
+#include "Fixtures.h"
+
+namespace
+{
+
+struct FixtureEvent
+{
+    double time;      // in seconds from the start of the loop
+    juce::uint8 data[3];
+};
+
+// The MIDI pattern. Must be sorted by time. Note-offs are sent as 0x80 events
+// rather than note-ons with velocity 0, since not every plug-in in this repo
+// treats them the same way.
+const FixtureEvent midiPattern[] = {
+    // Reset the controllers at the start of every loop.
+    { 0.000, { 0xB0, 0x01, 0 } },     // mod wheel
+    { 0.000, { 0xE0, 0x00, 0x40 } },  // pitch bend centered
+    { 0.000, { 0xB0, 0x40, 0 } },     // sustain pedal off
+
+    // Beat 1: a simple four-note chord.
+    { 0.000, { 0x90, 48, 100 } },
+    { 0.000, { 0x90, 55, 100 } },
+    { 0.000, { 0x90, 60, 100 } },
+    { 0.000, { 0x90, 64, 100 } },
+    { 0.900, { 0x80, 48, 0 } },
+    { 0.900, { 0x80, 55, 0 } },
+    { 0.900, { 0x80, 60, 0 } },
+    { 0.900, { 0x80, 64, 0 } },
+
+    // Beat 2: a five-note chord that is released while the sustain pedal
+    // is held down, so the voices keep ringing until the pedal comes up.
+    { 1.000, { 0x90, 50, 80 } },
+    { 1.000, { 0x90, 57, 80 } },
+    { 1.000, { 0x90, 62, 80 } },
+    { 1.000, { 0x90, 65, 80 } },
+    { 1.000, { 0x90, 69, 80 } },
+    { 1.500, { 0xB0, 0x40, 127 } },
+    { 1.900, { 0x80, 50, 0 } },
+    { 1.900, { 0x80, 57, 0 } },
+    { 1.900, { 0x80, 62, 0 } },
+    { 1.900, { 0x80, 65, 0 } },
+    { 1.900, { 0x80, 69, 0 } },
+
+    // Beat 3: a fast arpeggio of 16th notes with varying velocities.
+    { 2.000, { 0x90, 72, 110 } },
+    { 2.100, { 0x80, 72, 0 } },
+    { 2.125, { 0x90, 76, 60 } },
+    { 2.225, { 0x80, 76, 0 } },
+    { 2.250, { 0x90, 79, 90 } },
+    { 2.350, { 0x80, 79, 0 } },
+    { 2.375, { 0x90, 84, 40 } },
+    { 2.400, { 0xB0, 0x40, 0 } },
+    { 2.475, { 0x80, 84, 0 } },
+    { 2.500, { 0x90, 79, 120 } },
+    { 2.600, { 0x80, 79, 0 } },
+    { 2.625, { 0x90, 76, 70 } },
+    { 2.725, { 0x80, 76, 0 } },
+    { 2.750, { 0x90, 72, 100 } },
+    { 2.850, { 0x80, 72, 0 } },
+    { 2.875, { 0x90, 67, 50 } },
+    { 2.975, { 0x80, 67, 0 } },
+
+    // Beat 4: loud bass notes plus a cluster of ten notes, which is more than
+    // the synths have voices for, so some voices must be stolen. Meanwhile the
+    // mod wheel and pitch bend are swept.
+    { 3.000, { 0x90, 36, 127 } },
+    { 3.000, { 0x90, 43, 127 } },
+    { 3.010, { 0x90, 60, 64 } },
+    { 3.020, { 0x90, 61, 64 } },
+    { 3.030, { 0x90, 62, 64 } },
+    { 3.040, { 0x90, 63, 64 } },
+    { 3.050, { 0x90, 64, 64 } },
+    { 3.060, { 0x90, 65, 64 } },
+    { 3.070, { 0x90, 66, 64 } },
+    { 3.080, { 0x90, 67, 64 } },
+    { 3.100, { 0xB0, 0x01, 32 } },
+    { 3.100, { 0xE0, 0x00, 0x48 } },
+    { 3.200, { 0xB0, 0x01, 64 } },
+    { 3.200, { 0xE0, 0x00, 0x50 } },
+    { 3.300, { 0xB0, 0x01, 96 } },
+    { 3.300, { 0xE0, 0x00, 0x58 } },
+    { 3.400, { 0xB0, 0x01, 127 } },
+    { 3.400, { 0xE0, 0x00, 0x60 } },
+    { 3.500, { 0xE0, 0x00, 0x50 } },
+    { 3.600, { 0xE0, 0x00, 0x40 } },
+    { 3.800, { 0x80, 36, 0 } },
+    { 3.800, { 0x80, 43, 0 } },
+    { 3.800, { 0x80, 60, 0 } },
+    { 3.800, { 0x80, 61, 0 } },
+    { 3.800, { 0x80, 62, 0 } },
+    { 3.800, { 0x80, 63, 0 } },
+    { 3.800, { 0x80, 64, 0 } },
+    { 3.800, { 0x80, 65, 0 } },
+    { 3.800, { 0x80, 66, 0 } },
+    { 3.800, { 0x80, 67, 0 } },
+};
+
+// Stateless white noise: hashes the sample index and channel into a value
+// between -1 and 1. This way the noise doesn't depend on the block size.
+float noise(juce::int64 index, int channel)
+{
+    juce::uint64 x = juce::uint64(index) * 0x9E3779B97F4A7C15ull + juce::uint64(channel) * 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 31;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 29;
+    return float(juce::int64(x >> 40) - 0x800000) / float(0x800000);
+}
+
+// Returns the fractional part of the number of cycles at this sample, so that
+// the phase stays accurate even for very long renders.
+double phase(double frequency, juce::int64 index, double sampleRate)
+{
+    double cycles = frequency * double(index) / sampleRate;
+    return cycles - std::floor(cycles);
+}
+
+} // namespace
+
+namespace Fixtures
+{
+
+void renderAudio(juce::AudioBuffer<float> &buffer,
+                 int numChannels,
+                 int numSamples,
+                 juce::int64 startSample,
+                 double sampleRate)
+{
+    const double twoPi = juce::MathConstants<double>::twoPi;
+    const juce::int64 burstLength = juce::int64(sampleRate * 0.5);
+
+    numChannels = std::min(numChannels, buffer.getNumChannels());
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        float *out = buffer.getWritePointer(channel);
+
+        // Give each channel a slightly different signal so that stereo
+        // processors don't just see mono.
+        const double lowFreq = 110.0 + 0.5 * channel;
+        const double highFreq = 1234.5 * (1.0 + 0.25 * channel);
+
+        for (int i = 0; i < numSamples; ++i) {
+            juce::int64 n = startSample + i;
+
+            double low = std::sin(twoPi * phase(lowFreq, n, sampleRate));
+            double high = std::sin(twoPi * phase(highFreq, n, sampleRate));
+
+            // Decaying burst that restarts every half second.
+            double t = double(n % burstLength) / sampleRate;
+            double burst = std::exp(-8.0 * t);
+
+            out[i] = float(0.25 * low + 0.15 * high + 0.4 * burst * noise(n, channel)
+                           + 0.05 * noise(n, channel + 2));
+        }
+    }
+
+    for (int channel = numChannels; channel < buffer.getNumChannels(); ++channel) {
+        buffer.clear(channel, 0, numSamples);
+    }
+}
+
+void renderMidi(juce::MidiBuffer &midi,
+                int numSamples,
+                juce::int64 startSample,
+                double sampleRate)
+{
+    midi.clear();
+
+    const juce::int64 loopLength = juce::int64(std::llround(midiLoopSeconds * sampleRate));
+    const juce::int64 endSample = startSample + numSamples;
+
+    // A block may straddle the boundary between two loops.
+    for (juce::int64 loop = startSample / loopLength; loop * loopLength < endSample; ++loop) {
+        const juce::int64 loopStart = loop * loopLength;
+
+        for (auto &event : midiPattern) {
+            juce::int64 position = loopStart + juce::int64(std::llround(event.time * sampleRate));
+            if (position >= startSample && position < endSample) {
+                midi.addEvent(event.data, 3, int(position - startSample));
+            }
+        }
+    }
+}
+
+} // namespace Fixtures
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Deterministic audio and MIDI test signals for driving the plug-ins offline.
+//
+// Both fixtures are a pure function of the absolute sample index, so the same
+// signal comes out no matter how the render is chopped up into blocks. That
+// matters for the benchmark, which compares different block sizes, and for the
+// golden-output tests, which must be reproducible from run to run.
+namespace Fixtures
+{
+    // Length of one repetition of the MIDI pattern, in seconds.
+    constexpr double midiLoopSeconds = 4.0;
+
+    // Fills the first `numChannels` channels of `buffer` with the audio test
+    // signal for the samples [startSample, startSample + numSamples). Any other
+    // channels are cleared. The signal is a mix of a low sine, a high sine,
+    // white noise, and decaying bursts every half second, so that dynamics
+    // processors and envelope followers have something to react to.
+    void renderAudio(juce::AudioBuffer<float> &buffer,
+                     int numChannels,
+                     int numSamples,
+                     juce::int64 startSample,
+                     double sampleRate);
+
+    // Replaces the contents of `midi` with the MIDI events that fall inside the
+    // samples [startSample, startSample + numSamples). Timestamps are relative
+    // to the start of the block. The pattern loops every `midiLoopSeconds` and
+    // has chords, a sustain pedal section, a fast arpeggio, a dense cluster
+    // that forces voice stealing, and mod wheel and pitch bend sweeps.
+    void renderMidi(juce::MidiBuffer &midi,
+                    int numSamples,
+                    juce::int64 startSample,
+                    double sampleRate);
+}
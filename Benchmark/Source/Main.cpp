@@ -0,0 +1,309 @@
+/*
+  Offline render-and-benchmark harness for the MDA plug-ins.
+
+  Creates each plug-in's AudioProcessor without a host or UI, feeds it the
+  deterministic audio and MIDI fixtures from Fixtures.h, and measures how long
+  every call to processBlock() takes. The results are written as JSON.
+
+  Usage: mda-bench [options]
+
+    --list                   print the names of all plug-ins and exit
+    --plugins A,B,...        only benchmark these plug-ins (default: all)
+    --sample-rates R,...     sample rates to test (default: 44100,48000)
+    --block-sizes N,...      block sizes to test (default: 64,256,1024)
+    --seconds S              seconds of audio to render per run (default: 10)
+    --warmup S               seconds of audio to render before timing (default: 1)
+    --program N              select this factory program before rendering
+    --output FILE            write the JSON to FILE instead of stdout
+*/
+
+#include <JuceHeader.h>
+#include <chrono>
+#include "Fixtures.h"
+#include "PluginRegistry.h"
+
+namespace
+{
+
+struct Options
+{
+    juce::StringArray plugins;
+    juce::Array<double> sampleRates { 44100.0, 48000.0 };
+    juce::Array<int> blockSizes { 64, 256, 1024 };
+    double seconds = 10.0;
+    double warmup = 1.0;
+    int program = -1;
+    juce::String outputPath;
+    bool list = false;
+};
+
+struct Result
+{
+    juce::String plugin;
+    double sampleRate;
+    int blockSize;
+    int numChannels;
+    int numBlocks;
+    juce::int64 numSamples;
+    double nsPerSample;
+    double realtimeFactor;
+    double p50;   // block times in microseconds
+    double p99;
+    double max;
+};
+
+void printUsage()
+{
+    std::fprintf(stderr,
+        "usage: mda-bench [--list] [--plugins A,B] [--sample-rates 44100,48000]\n"
+        "                 [--block-sizes 64,256,1024] [--seconds 10] [--warmup 1]\n"
+        "                 [--program N] [--output results.json]\n");
+}
+
+juce::StringArray splitList(const juce::String &text)
+{
+    juce::StringArray items;
+    items.addTokens(text, ",", "");
+    items.trim();
+    items.removeEmptyStrings();
+    return items;
+}
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; ++i) {
+        juce::String arg(argv[i]);
+
+        // All options except --list take a value.
+        if (arg == "--list") {
+            options.list = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        juce::String value(argv[++i]);
+
+        if (arg == "--plugins") {
+            options.plugins = splitList(value);
+        } else if (arg == "--sample-rates") {
+            options.sampleRates.clear();
+            for (auto &item : splitList(value)) {
+                options.sampleRates.add(item.getDoubleValue());
+            }
+        } else if (arg == "--block-sizes") {
+            options.blockSizes.clear();
+            for (auto &item : splitList(value)) {
+                options.blockSizes.add(item.getIntValue());
+            }
+        } else if (arg == "--seconds") {
+            options.seconds = value.getDoubleValue();
+        } else if (arg == "--warmup") {
+            options.warmup = value.getDoubleValue();
+        } else if (arg == "--program") {
+            options.program = value.getIntValue();
+        } else if (arg == "--output") {
+            options.outputPath = value;
+        } else {
+            return false;
+        }
+    }
+
+    for (auto rate : options.sampleRates) {
+        if (rate <= 0.0) { return false; }
+    }
+    for (auto size : options.blockSizes) {
+        if (size <= 0) { return false; }
+    }
+    return options.seconds > 0.0 && options.warmup >= 0.0;
+}
+
+// Nearest-rank percentile of an already sorted array.
+double percentile(const std::vector<double> &sorted, double p)
+{
+    size_t rank = size_t(std::ceil(p * double(sorted.size())));
+    rank = std::clamp(rank, size_t(1), sorted.size());
+    return sorted[rank - 1];
+}
+
+Result runBenchmark(const PluginInfo &info, const Options &options, double sampleRate, int blockSize)
+{
+    std::unique_ptr<juce::AudioProcessor> processor(info.create());
+
+    if (options.program >= 0 && options.program < processor->getNumPrograms()) {
+        processor->setCurrentProgram(options.program);
+    }
+
+    // The synths only have outputs, the effects have stereo in and out.
+    const int numInputs = processor->getTotalNumInputChannels();
+    const int numChannels = std::max(numInputs, processor->getTotalNumOutputChannels());
+    const bool wantsMidi = processor->acceptsMidi();
+
+    // This renders offline, much faster than real time.
+    processor->setNonRealtime(true);
+    processor->setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processor->prepareToPlay(sampleRate, blockSize);
+
+    juce::AudioBuffer<float> buffer(numChannels, blockSize);
+    juce::MidiBuffer midi;
+    midi.ensureSize(1024);
+
+    const juce::int64 warmupSamples = juce::int64(options.warmup * sampleRate);
+    const juce::int64 timedSamples = juce::int64(options.seconds * sampleRate);
+    const int numBlocks = int((timedSamples + blockSize - 1) / blockSize);
+
+    std::vector<double> blockTimes;
+    blockTimes.reserve(size_t(numBlocks));
+
+    juce::int64 position = 0;
+    double totalNanos = 0.0;
+
+    auto renderBlock = [&](int numSamples, bool timed) {
+        // Preparing the fixtures is not part of the measurement.
+        Fixtures::renderAudio(buffer, numInputs, numSamples, position, sampleRate);
+        if (wantsMidi) {
+            Fixtures::renderMidi(midi, numSamples, position, sampleRate);
+        } else {
+            midi.clear();
+        }
+
+        // The last block may be shorter. Hosts do this too.
+        juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), numChannels, numSamples);
+
+        auto start = std::chrono::steady_clock::now();
+        processor->processBlock(block, midi);
+        auto end = std::chrono::steady_clock::now();
+
+        if (timed) {
+            double nanos = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            totalNanos += nanos;
+            blockTimes.push_back(nanos / 1000.0);
+        }
+        position += numSamples;
+    };
+
+    while (position < warmupSamples) {
+        renderBlock(int(std::min(juce::int64(blockSize), warmupSamples - position)), false);
+    }
+
+    const juce::int64 endPosition = position + timedSamples;
+    while (position < endPosition) {
+        renderBlock(int(std::min(juce::int64(blockSize), endPosition - position)), true);
+    }
+
+    processor->releaseResources();
+
+    std::sort(blockTimes.begin(), blockTimes.end());
+
+    Result result;
+    result.plugin = info.name;
+    result.sampleRate = sampleRate;
+    result.blockSize = blockSize;
+    result.numChannels = numChannels;
+    result.numBlocks = int(blockTimes.size());
+    result.numSamples = timedSamples;
+    result.nsPerSample = totalNanos / double(timedSamples);
+
+    // How many times faster than realtime. A value of 100 means the plug-in
+    // could render 100 seconds of audio in one second of CPU time.
+    result.realtimeFactor = totalNanos > 0.0 ? (options.seconds * 1.0e9) / totalNanos : 0.0;
+
+    result.p50 = percentile(blockTimes, 0.50);
+    result.p99 = percentile(blockTimes, 0.99);
+    result.max = blockTimes.back();
+    return result;
+}
+
+juce::String formatNumber(double value)
+{
+    return juce::String(value, 3);
+}
+
+juce::String toJSON(const Options &options, const std::vector<Result> &results)
+{
+    juce::String json;
+    json << "{\n";
+    json << "  \"seconds\": " << formatNumber(options.seconds) << ",\n";
+    json << "  \"warmup\": " << formatNumber(options.warmup) << ",\n";
+    json << "  \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto &r = results[i];
+        json << "    {\n";
+        json << "      \"plugin\": \"" << r.plugin << "\",\n";
+        json << "      \"sampleRate\": " << formatNumber(r.sampleRate) << ",\n";
+        json << "      \"blockSize\": " << r.blockSize << ",\n";
+        json << "      \"channels\": " << r.numChannels << ",\n";
+        json << "      \"blocks\": " << r.numBlocks << ",\n";
+        json << "      \"samples\": " << juce::String(r.numSamples) << ",\n";
+        json << "      \"nsPerSample\": " << formatNumber(r.nsPerSample) << ",\n";
+        json << "      \"realtimeFactor\": " << formatNumber(r.realtimeFactor) << ",\n";
+        json << "      \"blockTimeMicroseconds\": { "
+             << "\"p50\": " << formatNumber(r.p50) << ", "
+             << "\"p99\": " << formatNumber(r.p99) << ", "
+             << "\"max\": " << formatNumber(r.max) << " }\n";
+        json << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    json << "  ]\n";
+    json << "}\n";
+    return json;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    if (options.list) {
+        for (auto &info : getAllPlugins()) {
+            std::printf("%s\n", info.name);
+        }
+        return 0;
+    }
+
+    std::vector<const PluginInfo *> selected;
+    if (options.plugins.isEmpty()) {
+        for (auto &info : getAllPlugins()) {
+            selected.push_back(&info);
+        }
+    } else {
+        for (auto &name : options.plugins) {
+            auto info = findPlugin(name);
+            if (info == nullptr) {
+                std::fprintf(stderr, "unknown plug-in: %s\n", name.toRawUTF8());
+                return 1;
+            }
+            selected.push_back(info);
+        }
+    }
+
+    // The APVTS uses a timer, which needs a message manager to exist, even
+    // though we never run the message loop.
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    std::vector<Result> results;
+    for (auto info : selected) {
+        for (auto sampleRate : options.sampleRates) {
+            for (auto blockSize : options.blockSizes) {
+                std::fprintf(stderr, "%s @ %g Hz, %d samples\n", info->name, sampleRate, blockSize);
+                results.push_back(runBenchmark(*info, options, sampleRate, blockSize));
+            }
+        }
+    }
+
+    auto json = toJSON(options, results);
+
+    if (options.outputPath.isEmpty()) {
+        std::fputs(json.toRawUTF8(), stdout);
+    } else if (!juce::File::getCurrentWorkingDirectory().getChildFile(options.outputPath).replaceWithText(json)) {
+        std::fprintf(stderr, "could not write %s\n", options.outputPath.toRawUTF8());
+        return 1;
+    }
+    return 0;
+}
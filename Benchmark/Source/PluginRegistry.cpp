@@ -0,0 +1,33 @@
+#include "PluginRegistry.h"
+
+// Declare the renamed factory functions. These are defined at the bottom of
+// each plug-in's PluginProcessor.cpp as `createPluginFilter()`.
+#define MDA_DECLARE_FACTORY(name) \
+    juce::AudioProcessor *JUCE_CALLTYPE mdaCreate_##name();
+
+MDA_PLUGIN_LIST(MDA_DECLARE_FACTORY)
+
+#undef MDA_DECLARE_FACTORY
+
+const std::vector<PluginInfo> &getAllPlugins()
+{
+    #define MDA_PLUGIN_INFO(name) { #name, &mdaCreate_##name },
+
+    static const std::vector<PluginInfo> plugins = {
+        MDA_PLUGIN_LIST(MDA_PLUGIN_INFO)
+    };
+
+    #undef MDA_PLUGIN_INFO
+
+    return plugins;
+}
+
+const PluginInfo *findPlugin(const juce::String &name)
+{
+    for (auto &info : getAllPlugins()) {
+        if (name.equalsIgnoreCase(info.name)) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
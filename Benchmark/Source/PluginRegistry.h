@@ -0,0 +1,53 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// All the plug-ins in this repo. Each one is compiled into its own headless
+// static library. Normally every plug-in defines a `createPluginFilter()`
+// function that the JUCE wrapper calls to instantiate the AudioProcessor, but
+// since we link all 23 libraries into a single program, the CMake build renames
+// that function to `mdaCreate_<Folder>()` to avoid duplicate symbols.
+//
+// The folder names here must match the `mda_add_plugin()` calls in the
+// top-level CMakeLists.txt.
+#define MDA_PLUGIN_LIST(X) \
+    X(Ambience)  \
+    X(Bandisto)  \
+    X(BeatBox)   \
+    X(Degrade)   \
+    X(Delay)     \
+    X(Detune)    \
+    X(DX10)      \
+    X(Dynamics)  \
+    X(Envelope)  \
+    X(EPiano)    \
+    X(Image)     \
+    X(JX10)      \
+    X(Limiter)   \
+    X(Loudness)  \
+    X(Overdrive) \
+    X(Piano)     \
+    X(RezFilter) \
+    X(RingMod)   \
+    X(Shepard)   \
+    X(Splitter)  \
+    X(Stereo)    \
+    X(SubSynth)  \
+    X(TestTone)
+
+struct PluginInfo
+{
+    // The name of the plug-in's folder, for example "JX10" or "Ambience".
+    const char *name;
+
+    // Creates a new instance of the plug-in's AudioProcessor. The caller owns
+    // the returned object.
+    juce::AudioProcessor *(JUCE_CALLTYPE *create)();
+};
+
+// Returns the table of all plug-ins, in alphabetical order.
+const std::vector<PluginInfo> &getAllPlugins();
+
+// Looks up a plug-in by folder name (case-insensitive). Returns nullptr if
+// there is no such plug-in.
+const PluginInfo *findPlugin(const juce::String &name);
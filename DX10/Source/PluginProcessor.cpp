@@ -1,4 +1,38 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
+
+// Returns a bitmask with the lowest `n` bits set.
+static inline juce::uint64 voiceMask(int n)
+{
+    return (n >= 64) ? ~juce::uint64(0) : (juce::uint64(1) << n) - 1;
+}
+
+// Returns the index of the lowest bit that is set in `mask`, which must not be
+// zero. Isolating that bit and subtracting 1 leaves a mask of the bits below
+// it, so counting those gives the index without a loop.
+static inline int lowestSetBit(juce::uint64 mask)
+{
+    return juce::countNumberOfBits((mask & (~mask + 1)) - 1);
+}
+
+// The algorithms, in the order of the Algorithm parameter. In the names, "2>1"
+// means operator 2 modulates operator 1, and "+" means the modulators are added
+// together. The first algorithm is the original DX10.
+static const DX10Algorithm algorithms[NUM_ALGORITHMS] = {
+    { "1: 2>1",                 2, { 0, 0, 1, 0, 0, 0, 0 } },
+    { "2: (2+3)>1",             3, { 0, 0, 1, 1, 0, 0, 0 } },
+    { "3: 2>3>1",               3, { 0, 0, 3, 1, 0, 0, 0 } },
+    { "4: (2>3 + 4)>1",         4, { 0, 0, 3, 1, 1, 0, 0 } },
+    { "5: 2>3>4>1",             4, { 0, 0, 3, 4, 1, 0, 0 } },
+    { "6: (2+3+4)>1",           4, { 0, 0, 1, 1, 1, 0, 0 } },
+    { "7: (2>3 + 4>5 + 6)>1",   6, { 0, 0, 3, 1, 5, 1, 1 } },
+    { "8: 2>3>4>5>6>1",         6, { 0, 0, 3, 4, 5, 6, 1 } },
+};
+
+// Parameter IDs for operators 3 - 6.
+static const char *opRatioIDs[EXTRA_OPERATORS] = { "Op3 Ratio", "Op4 Ratio", "Op5 Ratio", "Op6 Ratio" };
+static const char *opLevelIDs[EXTRA_OPERATORS] = { "Op3 Level", "Op4 Level", "Op5 Level", "Op6 Level" };
+static const char *opDecayIDs[EXTRA_OPERATORS] = { "Op3 Decay", "Op4 Decay", "Op5 Decay", "Op6 Decay" };
 
 DX10Program::DX10Program(const char *name,
                          float p0,  float p1,  float p2,  float p3,
@@ -18,13 +52,25 @@ DX10AudioProcessor::DX10AudioProcessor()
 {
     _sampleRate = 44100.0f;
     _inverseSampleRate = 1.0f / _sampleRate;
+    _hostSampleRate = 44100.0;
+    _oversampling = 1;
+
+    _polyphony = 0;
+    _polyphonyMask = 0;
+    _algorithm = &algorithms[0];
 
     createPrograms();
     setCurrentProgram(0);
+
+    mda::watchAllParameters(_parameters, apvts);
+
+    apvts.addParameterListener("Oversampling", this);
 }
 
 DX10AudioProcessor::~DX10AudioProcessor()
 {
+    apvts.removeParameterListener("Oversampling", this);
+    cancelPendingUpdate();
 }
 
 const juce::String DX10AudioProcessor::getName() const
@@ -68,6 +114,9 @@ void DX10AudioProcessor::setCurrentProgram(int index)
     for (int i = 0; i < NPARAMS; ++i) {
         apvts.getParameter(paramNames[i])->setValueNotifyingHost(_programs[index].param[i]);
     }
+
+    // The factory presets were made for the original 2-operator synth.
+    apvts.getParameter("Algorithm")->setValueNotifyingHost(0.0f);
 }
 
 const juce::String DX10AudioProcessor::getProgramName(int index)
@@ -82,8 +131,17 @@ void DX10AudioProcessor::changeProgramName(int index, const juce::String &newNam
 
 void DX10AudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-    _sampleRate = sampleRate;
-    _inverseSampleRate = 1.0f / _sampleRate;
+    _hostSampleRate = sampleRate;
+    setOversampling(_oversampling);
+    reportLatency();
+
+    // Allocate the voice pool. This only does any work the first time.
+    _voices.resize(MAX_VOICES);
+    _oversampled.resize(OVERSAMPLE_CHUNK * 4);
+    _lanes.resize((MAX_VOICES + LANES - 1) / LANES);
+
+    // Preallocate room for the MIDI events.
+    _events.reserve(mda::EventQueue::DEFAULT_CAPACITY);
 
     resetState();
 }
@@ -142,7 +200,7 @@ void DX10AudioProcessor::createPrograms()
 void DX10AudioProcessor::resetState()
 {
     // Turn off all playing voices.
-    for (int v = 0; v < NVOICES; ++v) {
+    for (int v = 0; v < int(_voices.size()); ++v) {
         _voices[v].env = 0.0f;
         _voices[v].car = 0.0f;
         _voices[v].dcar = 0.0f;
@@ -150,11 +208,18 @@ void DX10AudioProcessor::resetState()
         _voices[v].mod1 = 0.0f;
         _voices[v].dmod = 0.0f;
         _voices[v].cdec = 0.99f;
+        for (int n = 0; n < EXTRA_OPERATORS; ++n) {
+            _voices[v].opPhase[n] = 0.0f;
+            _voices[v].opInc[n] = 0.0f;
+            _voices[v].opEnv[n] = 0.0f;
+            _voices[v].opDec[n] = 0.0f;
+        }
     }
+    _freeVoices = voiceMask(MAX_VOICES);
     _numActiveVoices = 0;
 
     // Clear out any pending MIDI events.
-    _notes[0] = EVENTS_DONE;
+    _events.clear();
 
     // These variables are changed by MIDI CC, reset to defaults.
     _modWheel = 0.0f;
@@ -167,10 +232,52 @@ void DX10AudioProcessor::resetState()
     _lfo0 = 0.0f;
     _lfo1 = 1.0f;
     _modulationAmount = 0.0f;
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
+}
+
+void DX10AudioProcessor::setOversampling(int factor)
+{
+    _oversampling = factor;
+    _sampleRate = float(_hostSampleRate * factor);
+    _inverseSampleRate = 1.0f / _sampleRate;
+
+    // The decimation filter delays the sound a little. The host is told about
+    // this by reportLatency(), which runs on the message thread.
+    _decimator.setFactor(factor);
+}
+
+void DX10AudioProcessor::reportLatency()
+{
+    // This uses the parameter rather than _oversampling, as the audio thread
+    // may not have picked up the new factor yet.
+    int oversampling = 1 << int(apvts.getRawParameterValue("Oversampling")->load());
+    setLatencySamples(int(std::round(_decimator.getLatency(oversampling))));
 }
 
 void DX10AudioProcessor::update()
 {
+    /*
+      With oversampling, the voices are rendered at 2x or 4x the sample rate,
+      which greatly reduces the aliasing from strong FM at high ratios. This
+      must be done first, because everything that depends on the sample rate
+      is calculated below using the oversampled rate.
+
+      The voices that are currently playing were set up for the old sample
+      rate and would play at the wrong pitch, so they are stopped.
+     */
+    int oversampling = 1 << int(apvts.getRawParameterValue("Oversampling")->load());
+    if (oversampling != _oversampling) {
+        setOversampling(oversampling);
+        for (int v = 0; v < int(_voices.size()); ++v) {
+            _voices[v].env = 0.0f;
+            _voices[v].cenv = 0.0f;
+        }
+        _freeVoices = voiceMask(MAX_VOICES);
+        _numActiveVoices = 0;
+    }
+
     /*
       Calculate a multiplier for the pitches of the notes based on the amount of
       tuning. The number of octaves is -3 to +3. To calculate a multiplier for N
@@ -274,116 +381,176 @@ void DX10AudioProcessor::update()
     // every 100 samples.
     float param15 = apvts.getRawParameterValue("LFO Rate")->load();
     _lfoInc = 628.3f * _inverseSampleRate * 25.0f * param15 * param15;
+
+    // The algorithm decides how many operators there are and how they are
+    // connected. Algorithm 1 is the original 2-operator synth.
+    int algorithm = int(apvts.getRawParameterValue("Algorithm")->load());
+    _algorithm = &algorithms[algorithm];
+
+    // The extra operators. Their ratio is the true ratio with the carrier, in
+    // steps of 0.5 from 0.5 to 16 (unlike the Coarse and Fine parameters, see
+    // above). The level uses the same curve as Mod Init, but the extra factor
+    // PI makes up for the sine approximation in renderLanes() only going from
+    // -1/PI to +1/PI. The decay uses the same curve as the carrier's decay, and
+    // at 100% the level doesn't decay at all.
+    for (int n = 0; n < EXTRA_OPERATORS; ++n) {
+        float ratio = apvts.getRawParameterValue(opRatioIDs[n])->load();
+        _opRatio[n] = 0.5f * std::floor(1.0f + 31.9f * ratio);
+
+        float level = apvts.getRawParameterValue(opLevelIDs[n])->load();
+        _opLevel[n] = 0.0002f * 3.141592654f * level * level;
+
+        float decay = apvts.getRawParameterValue(opDecayIDs[n])->load();
+        if (decay > 0.98f) {
+            _opDecay[n] = 1.0f;
+        } else {
+            _opDecay[n] = std::exp(-_inverseSampleRate * std::exp(5.0f - 8.0f * decay));
+        }
+    }
+
+    // Maximum number of voices. If this is lowered while notes are playing,
+    // the voices above the new limit are released.
+    int polyphony = int(apvts.getRawParameterValue("Polyphony")->load());
+    if (polyphony != _polyphony) {
+        _polyphony = polyphony;
+        _polyphonyMask = voiceMask(polyphony);
+
+        juce::uint64 mask = ~_freeVoices & ~_polyphonyMask & voiceMask(int(_voices.size()));
+        while (mask != 0) {
+            int v = lowestSetBit(mask);
+            mask &= mask - 1;
+            _voices[v].cdec = _release;
+            _voices[v].env  = _voices[v].cenv;
+            _voices[v].catt = 1.0f;
+            _voices[v].mlev = 0.0f;
+            _voices[v].mdec = _modRelease;
+            for (int n = 0; n < EXTRA_OPERATORS; ++n) {
+                _voices[v].opDec[n] = _release;
+            }
+        }
+    }
 }
 
 void DX10AudioProcessor::processEvents(juce::MidiBuffer &midiMessages)
 {
     // There are different ways a synth can handle MIDI events. This plug-in does
-    // it by copying the events it cares about -- note on and note off -- into an
-    // array. In the render loop, we step through this array to process the events
-    // one-by-one. Controllers such as the sustain pedal are processed right away,
-    // at the start of the block, so these are not sample accurate.
-
-    int npos = 0;
-    for (const auto metadata : midiMessages) {
-        if (metadata.numBytes != 3) continue;
-
-        const auto data0 = metadata.data[0];
-        const auto data1 = metadata.data[1];
-        const auto data2 = metadata.data[2];
-        const int deltaFrames = metadata.samplePosition;
-
-        switch (data0 & 0xf0) {  // status byte (all channels)
-            // Note off
-            case 0x80:
-                _notes[npos++] = deltaFrames;   // time offset
-                _notes[npos++] = data1 & 0x7F;  // note
-                _notes[npos++] = 0;             // vel
-                break;
-
-            // Note on
-            case 0x90:
-                _notes[npos++] = deltaFrames;   // time offset
-                _notes[npos++] = data1 & 0x7F;  // note
-                _notes[npos++] = data2 & 0x7F;  // vel
-                break;
-
-            // Controller
-            case 0xB0:
-                switch (data1) {
-                    case 0x01:  // mod wheel
-                        // This maps the position of the mod wheel to a
-                        // parabolic curve starting at 0.0 (position 0)
-                        // up to 0.000806 (position 127). This amount is
-                        // added to the LFO intensity for vibrato.
-                        _modWheel = 0.00000005f * float(data2 * data2);
-                        break;
-
-                    case 0x07:  // volume
-                        // Map the position of the volume control to a
-                        // parabolic curve starting at 0.0 (position 0)
-                        // up to 0.00564 (position 127).
-                        _volume = 0.00000035f * float(data2 * data2);
-                        break;
-
-                    case 0x40:  // sustain pedal
-                        // Make the variable 64 when the pedal is pressed
-                        // and 0 when released.
-                        _sustain = data2 & 0x40;
-
-                        // Pedal released? Then end all sustained notes.
-                        // This sends a fake note-off event with note = SUSTAIN,
-                        // meaning all sustained notes will be moved into their
-                        // envelope release stage.
-                        if (_sustain == 0) {
-                            _notes[npos++] = deltaFrames;
-                            _notes[npos++] = SUSTAIN;
-                            _notes[npos++] = 0;
-                        }
-                        break;
-
-                    default:  // all notes off
-                        if (data1 > 0x7A) {
-                            // Setting the decay to 0.99 will fade out
-                            // the voice very quickly.
-                            for (int v = 0; v < NVOICES; ++v) {
-                                _voices[v].cdec = 0.99f;
-                            }
-                            _sustain = 0;
-                        }
-                        break;
-                }
-                break;
+    // it by copying the events into a queue. In the render loop, we step through
+    // this queue and handle each event at the exact sample it belongs to. That
+    // includes controllers such as the sustain pedal and pitch bend.
+    //
+    // The queue has a fixed size
+, so that it never allocates on the audio
+    // thread. If the host sends more events than fit, the render loop calls
+    // fillEvents() again once the queue is empty, to get the next batch.
+    _midiIterator = midiMessages.cbegin();
+    _midiEnd = midiMessages.cend();
+    fillEvents();
+}
 
-            // Program change
-            case 0xC0:
-                if (data1 < _programs.size()) {
-                    setCurrentProgram(data1);
-                }
-                break;
-
-            // Pitch bend
-            case 0xE0:
-                // This maps the pitch bend value from [-8192, 8191] to [0.89, 1.12]
-                // where 1.0 means the pitch wheel is centered. This value is used to
-                // shift the carrier up or down 2 semitones (since 2^(-2/12) = 0.89
-                // and 2^(2/12) = 1.12).
-                _pitchBend = float(data1 + 128 * data2 - 8192);
-                if (_pitchBend > 0.0f) {
-                    _pitchBend = 1.0f + 0.000014951f * _pitchBend;
-                } else {
-                    _pitchBend = 1.0f + 0.000013318f * _pitchBend;
-                }
-                break;
+void DX10AudioProcessor::fillEvents()
+{
+    _events.clear();
+
+    while (_midiIterator != _midiEnd) {
+        const auto metadata = *_midiIterator;
 
-            default: break;
+        // Program change and channel aftertouch have only one data byte.
+        // Anything longer than three bytes is SysEx, which is ignored.
+        if (metadata.numBytes >= 2 && metadata.numBytes <= 3) {
+            const auto data2 = metadata.numBytes == 3 ? metadata.data[2] : juce::uint8(0);
+            if (!_events.add(metadata.samplePosition, metadata.data[0], metadata.data[1], data2)) {
+                break;  // the queue is full, continue from this event later
+            }
         }
+        ++_midiIterator;
+    }
+}
 
-        // Discard events if buffer full!
-        if (npos > EVENTBUFFER) npos -= 3;
+void DX10AudioProcessor::handleEvent(const mda::MidiEvent &event)
+{
+    const auto data0 = event.status;
+    const auto data1 = event.data1;
+    const auto data2 = event.data2;
+
+    switch (data0 & 0xf0) {  // status byte (all channels)
+        // Note off
+        case 0x80:
+            noteOn(data1 & 0x7F, 0);
+            break;
+
+        // Note on
+        case 0x90:
+            noteOn(data1 & 0x7F, data2 & 0x7F);
+            break;
+
+        // Controller
+        case 0xB0:
+            switch (data1) {
+                case 0x01:  // mod wheel
+                    // This maps the position of the mod wheel to a
+                    // parabolic curve starting at 0.0 (position 0)
+                    // up to 0.000806 (position 127). This amount is
+                    // added to the LFO intensity for vibrato.
+                    _modWheel = 0.00000005f * float(data2 * data2);
+                    break;
+
+                case 0x07:  // volume
+                    // Map the position of the volume control to a
+                    // parabolic curve starting at 0.0 (position 0)
+                    // up to 0.00564 (position 127).
+                    _volume = 0.00000035f * float(data2 * data2);
+                    break;
+
+                case 0x40:  // sustain pedal
+                    // Make the variable 64 when the pedal is pressed
+                    // and 0 when released.
+                    _sustain = data2 & 0x40;
+
+                    // Pedal released? Then end all sustained notes.
+                    // This sends a fake note-off event with note = SUSTAIN,
+                    // meaning all sustained notes will be moved into their
+                    // envelope release stage.
+                    if (_sustain == 0) {
+                        noteOn(SUSTAIN, 0);
+                    }
+                    break;
+
+                default:  // all notes off
+                    if (data1 > 0x7A) {
+                        // Setting the decay to 0.99 will fade out
+                        // the voice very quickly.
+                        for (int v = 0; v < MAX_VOICES; ++v) {
+                            _voices[v].cdec = 0.99f;
+                        }
+                        _sustain = 0;
+                    }
+                    break;
+            }
+            break;
+
+        // Program change
+        case 0xC0:
+            if (data1 < _programs.size()) {
+                setCurrentProgram(data1);
+            }
+            break;
+
+        // Pitch bend
+        case 0xE0:
+            // This maps the pitch bend value from [-8192, 8191] to [0.89, 1.12]
+            // where 1.0 means the pitch wheel is centered. This value is used to
+            // shift the carrier up or down 2 semitones (since 2^(-2/12) = 0.89
+            // and 2^(2/12) = 1.12).
+            _pitchBend = float(data1 + 128 * data2 - 8192);
+            if (_pitchBend > 0.0f) {
+                _pitchBend = 1.0f + 0.000014951f * _pitchBend;
+            } else {
+                _pitchBend = 1.0f + 0.000013318f * _pitchBend;
+            }
+            break;
+
+        default: break;
     }
-    _notes[npos] = EVENTS_DONE;
-    midiMessages.clear();
 }
 
 void DX10AudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
@@ -397,27 +564,25 @@ void DX10AudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::Mi
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (_parameters.changed()) {
+        update();
+    }
 
     processEvents(midiMessages);
 
     int sampleFrames = buffer.getNumSamples();
 
     float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
 
-    int event = 0;
     int frame = 0;  // how many samples are already rendered
 
     // Is there at least one active voice, or any pending MIDI event?
-    if (_numActiveVoices > 0 || _notes[event] < sampleFrames) {
+    if (_numActiveVoices > 0 || !_events.empty()) {
         while (frame < sampleFrames) {
-            // Get the timestamp of the next note on/off event. This is usually in the
-            // future, i.e. a number of samples after the current sample.
-            int frames = _notes[event++];
-
-            // This catches the EVENTS_DONE special event. There are no events left.
-            if (frames > sampleFrames) frames = sampleFrames;
+            // Get the timestamp of the next MIDI event. This is usually in the
+            // future, i.e. a number of samples after the current sample. If there
+            // are no more events, render until the end of the block.
+            int frames = _events.nextEventTime(sampleFrames);
 
             // The timestamp for the event is relative to the start of the block.
             // Make it relative to the previous event; this tells us how many samples
@@ -428,142 +593,380 @@ void DX10AudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::Mi
             // processed in total.
             frame += frames;
 
-            // Until it's time to process the upcoming event, render the active voices.
-            while (--frames >= 0) {
-                Voice *V = _voices;
+            // Copy the voices that are in use into the SIMD lanes.
+            gatherVoices();
 
-                // This variable adds up the output values of all the active voices.
-                // DX10 is a mono synth, so there is only one channel.
-                float o = 0.0f;
-
-                // The LFO and any things it modulates are updated every 100 samples.
-                if (--_lfoStep < 0) {
-                    // This formula is a simple method to approximate a sine wave, but
-                    // it only works for low frequencies such as with an LFO.
-                    _lfo0 += _lfoInc * _lfo1;
-                    _lfo1 -= _lfoInc * _lfo0;
-
-                    // Calculate the new amount of modulation. This value swings between
-                    // -0.001806 and +0.001806 and is directly added to the carrier phase.
-                    _modulationAmount = _lfo1 * (_modWheel + _vibrato);
-
-                    _lfoStep = 100;  // reset counter
-                }
-
-                // Loop through all the voices...
-                for (int v = 0; v < NVOICES; ++v) {
-                    // ...but only render the voices that have an active envelope.
-                    float e = V->env;
-                    if (e > SILENCE) {
-
-                        // The envelope is always decaying.
-                        V->env = e * V->cdec;
-
-                        // To add an attack to the envelope, apply a smoothing filter that
-                        // raises `cenv` from 0.0 to the current envelope level `env`.
-                        // The longer the attack, the smaller `catt` and the slower this
-                        // filter increments the level. All the while, `env` is decaying
-                        // and pulling things downward, so with a long attack the smoothed
-                        // envelope `cenv` never gets as high as with a shorter attack.
-                        // When the note is released, `catt` is set to 1 so that the attack
-                        // ends and `cenv` only decays from that point onwards.
-                        V->cenv += V->catt * (e - V->cenv);
-
-                        // Simple sine wave oscillator. This creates a sine wave that first
-                        // goes down and then goes up, i.e. it has been phase inverted.
-                        // The LFO also uses a sine wave oscillator but the one used for
-                        // the modulator wave is more reliable at higher frequencies.
-                        float y = V->dmod * V->mod0 - V->mod1;
-                        V->mod1 = V->mod0;
-                        V->mod0 = y;
-
-                        // The envelope for the modulator is a simple smoothing filter that
-                        // gradually moves from `menv` to the target level `mlev` in an
-                        // exponential fashion. Which is what we want because frequencies
-                        // are logarithmic, so to move through them at a constant speed we
-                        // must move in exponential steps.
-                        V->menv += V->mdec * (V->mlev - V->menv);
-
-                        // Could add more modulator blocks for a wider range of FM sounds.
-                        // Most FM synths allow for different configurations but DX10 keeps
-                        // it simple with just one modulator.
-
-                        // Calculate the new carrier phase. This phase is also changed by
-                        // the modulator wave (FM!) and also the mouse wheel and vibrato.
-                        float x = V->car + V->dcar + y * V->menv + _modulationAmount;
-
-                        // Wrap the phase if it goes out of bounds. Note that modulation
-                        // may cause the carrier phase to go backwards.
-                        while (x >  1.0f) x -= 2.0f;
-                        while (x < -1.0f) x += 2.0f;
-                        V->car = x;
-
-                        // Create a 5th-order sine approximation. If you plot this formula,
-                        // you'll get a sine-like shape between x = -1 and x = +1. That's
-                        // why the carrier phase is restricted to the range [-1, +1].
-                        // The richness parameter "distorts" this shape into something that
-                        // looks more like a saw wave (which also boosts its amplitude).
-                        float s = x + x * x * x * (_richness * x * x - 1.0f - _richness);
-
-                        // Mix in the modulator waveform and apply the amplitude envelope.
-                        o += V->cenv * (_modMix * V->mod1 + s);
-                    }
-
-                    // Go to the next active voice.
-                    V++;
+            // Until it's time to process the upcoming event, render the active voices.
+            renderVoices(out1, frames);
+            out1 += frames;
+
+            // Copy the new voice state back, so that noteOn() can use it.
+            scatterVoices();
+            _voiceTreeValid = false;
+
+            // It's time to handle the event, or events if there are several with
+            // the same timestamp. This starts or stops notes, but also handles the
+            // controllers, such as the sustain pedal and pitch bend.
+            while (_events.hasEventAt(frame)) {
+                handleEvent(_events.next());
+                if (_events.empty()) {
+                    fillEvents();
                 }
-
-                // Write the result into the output buffer.
-                *out1++ = o;
-                *out2++ = o;
-            }
-
-            // It's time to handle the event. This starts the new note, or stops the
-            // note if velocity is 0. Also handles the sustain pedal being lifted.
-            if (frame < sampleFrames) {
-                int note = _notes[event++];
-                int vel  = _notes[event++];
-                noteOn(note, vel);
             }
         }
 
-        // Turn off voices whose envelope has dropped below the minimum level.
-        _numActiveVoices = NVOICES;
-        for (int v = 0; v < NVOICES; ++v) {
+        // Turn off voices whose envelope has dropped below the minimum level,
+        // and put them back into the pool. Voices that are already free don't
+        // need to be looked at; noteOn() sets up their envelopes from scratch.
+        juce::uint64 inUse = ~_freeVoices & voiceMask(MAX_VOICES);
+        while (inUse != 0) {
+            int v = lowestSetBit(inUse);
+            inUse &= inUse - 1;
             if (_voices[v].env < SILENCE) {
                 _voices[v].env = 0.0f;
                 _voices[v].cenv = 0.0f;
-                _numActiveVoices--;
+                _freeVoices |= juce::uint64(1) << v;
             }
             if (_voices[v].menv < SILENCE) {  // stop modulation envelope
                 _voices[v].menv = 0.0f;
                 _voices[v].mlev = 0.0f;
             }
         }
+        _numActiveVoices = MAX_VOICES - juce::countNumberOfBits(_freeVoices);
     } else {
         // No voices playing and no events, so render an empty block.
         while (--sampleFrames >= 0) {
             *out1++ = 0.0f;
-            *out2++ = 0.0f;
         }
+
+        // Whatever is left in the decimation filter is too quiet to hear.
+        _decimator.reset();
+    }
+
+    // DX10 is a mono synth, so the right channel is a copy of the left.
+    buffer.copyFrom(1, 0, buffer, 0, 0, buffer.getNumSamples());
+
+    // All the events have been handled, so they're not passed on to the host.
+    midiMessages.clear();
+}
+
+void DX10AudioProcessor::renderVoices(float *out, int numFrames)
+{
+    if (_oversampling == 1) {
+        renderSamples(out, numFrames);
+        return;
     }
 
-    // Mark the events buffer as done.
-    _notes[0] = EVENTS_DONE;
+    // When oversampling, render `_oversampling` samples for every output
+    // sample, then filter and decimate them. This is done in chunks so that
+    // the buffer for the oversampled signal can be allocated ahead of time.
+    while (numFrames > 0) {
+        const int chunk = std::min(numFrames, OVERSAMPLE_CHUNK);
+        renderSamples(_oversampled.data(), chunk * _oversampling);
+        _decimator.process(_oversampled.data(), out, chunk);
+        out += chunk;
+        numFrames -= chunk;
+    }
+}
+
+void DX10AudioProcessor::renderSamples(float *out, int numSamples)
+{
+    for (int i = 0; i < numSamples; ++i) {
+        // This variable adds up the output values of all the active voices.
+        // DX10 is a mono synth, so there is only one channel.
+        float o = 0.0f;
+
+        // The LFO and any things it modulates are updated every 100 samples.
+        if (--_lfoStep < 0) {
+            // This formula is a simple method to approximate a sine wave, but
+            // it only works for low frequencies such as with an LFO.
+            _lfo0 += _lfoInc * _lfo1;
+            _lfo1 -= _lfoInc * _lfo0;
+
+            // Calculate the new amount of modulation. This value swings between
+            // -0.001806 and +0.001806 and is directly added to the carrier phase.
+            // When oversampling, it's added more often, so make it smaller.
+            _modulationAmount = _lfo1 * (_modWheel + _vibrato) / float(_oversampling);
+
+            _lfoStep = 100;  // reset counter
+        }
+
+        // Render all the voices, one group of lanes at a time.
+        for (int g = 0; g < _numLaneGroups; ++g) {
+            renderLanes(_lanes[g], o);
+        }
+
+        // Write the result into the output buffer.
+        out[i] = o;
+    }
+}
+
+void DX10AudioProcessor::gatherVoices()
+{
+    // Put the voices that are in use next to each other in the lanes, in the
+    // same order as they appear in the pool. If one note is playing, only one
+    // group needs to be rendered, no matter which voice it is using.
+    int activeVoices[MAX_VOICES];
+    int numActiveVoices = 0;
+    for (juce::uint64 inUse = ~_freeVoices & voiceMask(MAX_VOICES); inUse != 0; inUse &= inUse - 1) {
+        activeVoices[numActiveVoices++] = lowestSetBit(inUse);
+    }
+
+    _numLaneGroups = (numActiveVoices + LANES - 1) / LANES;
+
+    for (int g = 0; g < _numLaneGroups; ++g) {
+        DX10VoiceLanes &L = _lanes[g];
+        for (int i = 0; i < LANES; ++i) {
+            const int n = g * LANES + i;
+            if (n >= numActiveVoices) {
+                // Unused lane. With env = 0, it's always inactive. The other
+                // values only need to be something harmless.
+                L.voice[i] = -1;
+                L.car[i] = L.dcar[i] = L.dmod[i] = 0.0f;
+                L.mod0[i] = L.mod1[i] = 0.0f;
+                L.env[i] = L.cenv[i] = L.catt[i] = L.cdec[i] = 0.0f;
+                L.menv[i] = L.mlev[i] = L.mdec[i] = 0.0f;
+                for (int k = 0; k < EXTRA_OPERATORS; ++k) {
+                    L.opPhase[k][i] = L.opInc[k][i] = 0.0f;
+                    L.opEnv[k][i] = L.opDec[k][i] = 0.0f;
+                }
+                continue;
+            }
+
+            const DX10Voice &V = _voices[activeVoices[n]];
+            L.voice[i] = activeVoices[n];
+            L.car[i] = V.car;
+            L.dcar[i] = V.dcar;
+            L.dmod[i] = V.dmod;
+            L.mod0[i] = V.mod0;
+            L.mod1[i] = V.mod1;
+            L.env[i] = V.env;
+            L.cenv[i] = V.cenv;
+            L.catt[i] = V.catt;
+            L.cdec[i] = V.cdec;
+            L.menv[i] = V.menv;
+            L.mlev[i] = V.mlev;
+            L.mdec[i] = V.mdec;
+            for (int k = 0; k < EXTRA_OPERATORS; ++k) {
+                L.opPhase[k][i] = V.opPhase[k];
+                L.opInc[k][i] = V.opInc[k];
+                L.opEnv[k][i] = V.opEnv[k];
+                L.opDec[k][i] = V.opDec[k];
+            }
+        }
+    }
+}
+
+void DX10AudioProcessor::scatterVoices()
+{
+    // Only the values that renderLanes() changes need to be copied back. The
+    // others are set by noteOn() and the MIDI handlers, on the voices.
+    for (int g = 0; g < _numLaneGroups; ++g) {
+        const DX10VoiceLanes &L = _lanes[g];
+        for (int i = 0; i < LANES; ++i) {
+            if (L.voice[i] < 0) { continue; }
+
+            DX10Voice &V = _voices[L.voice[i]];
+            V.car = L.car[i];
+            V.mod0 = L.mod0[i];
+            V.mod1 = L.mod1[i];
+            V.env = L.env[i];
+            V.cenv = L.cenv[i];
+            V.menv = L.menv[i];
+            for (int k = 0; k < EXTRA_OPERATORS; ++k) {
+                V.opPhase[k] = L.opPhase[k][i];
+                V.opEnv[k] = L.opEnv[k][i];
+            }
+        }
+    }
+}
+
+// Returns `a` where the bits in `mask` are 1 and `b` where they are 0. With the
+// mask either all ones or all zeros, this picks one of the two values. Writing
+// it with bitwise operations rather than `mask ? a : b` is what allows GCC and
+// Clang to vectorize the loop in renderLanes() on SSE, which doesn't have
+// masked stores.
+static inline float select(int mask, float a, float b)
+{
+    int ia, ib;
+    std::memcpy(&ia, &a, sizeof(float));
+    std::memcpy(&ib, &b, sizeof(float));
+    const int ir = (ia & mask) | (ib & ~mask);
+    float r;
+    std::memcpy(&r, &ir, sizeof(float));
+    return r;
+}
+
+// Rounds up to the nearest integer, or returns 0 if `t` is negative. This is
+// std::max(0, std::ceil(t)), but written so that it becomes a few vector
+// instructions even without SSE4.1.
+static inline int ceilPositive(float t)
+{
+    const int n = int(t);
+    return (n + int(float(n) < t)) & -int(t > 0.0f);
+}
+
+// Wraps the carrier phase into the range [-1, +1].
+//
+// The original code did `while (x > 1) x -= 2` and `while (x < -1) x += 2`.
+// With a lot of FM, the phase can jump by more than one period per sample, so
+// this may need to subtract 2 several times. Here we count how many times the
+// loops would have run and subtract that many periods all at once. For these
+// values of x, subtracting 2 * k is exact, so the result is the same as the
+// loops, bit for bit.
+static inline float wrapPhase(float x)
+{
+    const int k = ceilPositive((x - 1.0f) * 0.5f) - ceilPositive((-1.0f - x) * 0.5f);
+    return x - 2.0f * float(k);
+}
+
+void DX10AudioProcessor::renderLanes(DX10VoiceLanes &L, float &mix)
+{
+    /*
+      Renders one sample for a group of LANES voices.
+
+      The loops below do the same thing to every lane. They are written without
+      `if` statements so that the compiler can vectorize them: instead of
+      skipping an inactive voice, it is computed anyway and then the old state
+      is kept using select(active, newValue, oldValue), which becomes a blend.
+
+      The operators are evaluated one at a time, from operator 2 to the last
+      operator of the algorithm, and then the carrier. Each operator adds its
+      output to the `fm` row of the operator it modulates.
+
+      The lanes are in the same order as the voices, and the voices are mixed
+      in that order too, so the output is exactly the same as when rendering
+      the voices one at a time.
+     */
+
+    const DX10Algorithm &A = *_algorithm;
+    const float modulationAmount = _modulationAmount;
+    const float richness = _richness;
+    const float modMix = _modMix;
+
+    alignas(32) int active[LANES];
+    alignas(32) float output[LANES];
+
+    // The amount of frequency modulation for each operator, by operator number.
+    alignas(32) float fm[MAX_OPERATORS + 1][LANES];
+    for (int op = 1; op <= A.numOperators; ++op) {
+        for (int i = 0; i < LANES; ++i) {
+            fm[op][i] = 0.0f;
+        }
+    }
+
+    // Operator 2, the modulator.
+    for (int i = 0; i < LANES; ++i) {
+        // Only render the voices that have an active envelope. The mask is all
+        // one bits for an active lane and all zero bits for an inactive lane.
+        active[i] = -int(L.env[i] > SILENCE);
+
+        // Simple sine wave oscillator. This creates a sine wave that first
+        // goes down and then goes up, i.e. it has been phase inverted.
+        // The LFO also uses a sine wave oscillator but the one used for
+        // the modulator wave is more reliable at higher frequencies.
+        const float y = L.dmod[i] * L.mod0[i] - L.mod1[i];
+
+        // The envelope for the modulator is a simple smoothing filter that
+        // gradually moves from `menv` to the target level `mlev` in an
+        // exponential fashion. Which is what we want because frequencies
+        // are logarithmic, so to move through them at a constant speed we
+        // must move in exponential steps.
+        const float menv = L.menv[i] + L.mdec[i] * (L.mlev[i] - L.menv[i]);
+
+        L.mod1[i] = select(active[i], L.mod0[i], L.mod1[i]);
+        L.mod0[i] = select(active[i], y, L.mod0[i]);
+        L.menv[i] = select(active[i], menv, L.menv[i]);
+    }
+
+    // The carrier adds the modulator's output itself, below. This keeps the
+    // math for algorithm 1 exactly the same as in the original plug-in.
+    const int modTarget = A.target[2];
+    const float modToCarrier = (modTarget == 1) ? 1.0f : 0.0f;
+    if (modTarget != 1) {
+        for (int i = 0; i < LANES; ++i) {
+            fm[modTarget][i] = L.mod0[i] * L.menv[i];
+        }
+    }
+
+    // Operators 3 and up. These work like the carrier: the phase goes from -1
+    // to +1 and is pushed around by the operators that modulate this one.
+    // The sine approximation is the carrier's formula with the Waveform knob
+    // at 0%, which gives sin(PI * x) / PI with a very small error.
+    for (int op = 3; op <= A.numOperators; ++op) {
+        const int n = op - 3;
+        const int target = A.target[op];
+        for (int i = 0; i < LANES; ++i) {
+            const float x = wrapPhase(L.opPhase[n][i] + L.opInc[n][i] + fm[op][i]);
+            const float s = x + x * x * x * (0.5f * x * x - 1.5f);
+            fm[target][i] += L.opEnv[n][i] * s;
+
+            L.opPhase[n][i] = select(active[i], x, L.opPhase[n][i]);
+            L.opEnv[n][i] = select(active[i], L.opEnv[n][i] * L.opDec[n][i], L.opEnv[n][i]);
+        }
+    }
+
+    // Operator 1, the carrier.
+    for (int i = 0; i < LANES; ++i) {
+        const float e = L.env[i];
+
+        // The envelope is always decaying.
+        const float env = e * L.cdec[i];
+
+        // To add an attack to the envelope, apply a smoothing filter that
+        // raises `cenv` from 0.0 to the current envelope level `env`.
+        // The longer the attack, the smaller `catt` and the slower this
+        // filter increments the level. All the while, `env` is decaying
+        // and pulling things downward, so with a long attack the smoothed
+        // envelope `cenv` never gets as high as with a shorter attack.
+        // When the note is released, `catt` is set to 1 so that the attack
+        // ends and `cenv` only decays from that point onwards.
+        const float cenv = L.cenv[i] + L.catt[i] * (e - L.cenv[i]);
+
+        // Calculate the new carrier phase. This phase is also changed by
+        // the modulator wave (FM!) and also the mouse wheel and vibrato.
+        // Note that modulation may cause the carrier phase to go backwards.
+        const float x = wrapPhase(L.car[i] + L.dcar[i] + modToCarrier * L.mod0[i] * L.menv[i]
+                                  + fm[1][i] + modulationAmount);
+
+        // Create a 5th-order sine approximation. If you plot this formula,
+        // you'll get a sine-like shape between x = -1 and x = +1. That's
+        // why the carrier phase is restricted to the range [-1, +1].
+        // The richness parameter "distorts" this shape into something that
+        // looks more like a saw wave (which also boosts its amplitude).
+        const float s = x + x * x * x * (richness * x * x - 1.0f - richness);
+
+        // Mix in the modulator waveform and apply the amplitude envelope.
+        output[i] = cenv * (modMix * L.mod1[i] + s);
+
+        L.env[i] = select(active[i], env, L.env[i]);
+        L.cenv[i] = select(active[i], cenv, L.cenv[i]);
+        L.car[i] = select(active[i], x, L.car[i]);
+    }
+
+    // Mix the voices in voice order so that the floating-point additions
+    // happen in the same order as in the original code.
+    for (int i = 0; i < LANES; ++i) {
+        if (active[i]) { mix += output[i]; }
+    }
 }
 
 void DX10AudioProcessor::noteOn(int note, int velocity)
 {
     if (velocity > 0) {
-        // Find quietest voice. Voices that are not playing have env = 0.
-        float l = 1.0f;
+        // Find a voice to use. If there is a free voice, take the one with the
+        // lowest index. The original plug-in did this by looking for the voice
+        // with the lowest envelope level, which is 0.0 for a free voice; this
+        // gives the same result without having to look at all the voices.
         int vl = 0;
-        for (int v = 0; v < NVOICES; v++) {
-            if (_voices[v].env < l) {
-                l = _voices[v].env;
-                vl = v;
-            }
+        juce::uint64 free = _freeVoices & _polyphonyMask;
+        if (free != 0) {
+            vl = lowestSetBit(free);
+        } else {
+            // All voices are in use, so steal the quietest one.
+            vl = stealVoice();
         }
+        _freeVoices &= ~(juce::uint64(1) << vl);
 
         /*
           Calculate the pitch for this MIDI note.
@@ -627,6 +1030,16 @@ void DX10AudioProcessor::noteOn(int note, int velocity)
         _voices[vl].mlev = _modSustain * p;
         _voices[vl].mdec = _modDecay;
 
+        // Set up the extra operators. These use the same key tracking and
+        // velocity scaling as the modulator. Their phase goes from -1 to +1,
+        // like the carrier's, so the ratio can be applied to `dcar` directly.
+        for (int n = 0; n < EXTRA_OPERATORS; ++n) {
+            _voices[vl].opPhase[n] = 0.0f;
+            _voices[vl].opInc[n] = _opRatio[n] * _voices[vl].dcar;
+            _voices[vl].opEnv[n] = _opLevel[n] * p;
+            _voices[vl].opDec[n] = _opDecay[n];
+        }
+
         // The phase increment for the modulator is based on that of the carrier.
         // As explained elsewhere, since `_ratio` contains the factor PI/2 instead
         // of PI, the true ratio is actually half the ratio shown in the UI, i.e.
@@ -655,13 +1068,15 @@ void DX10AudioProcessor::noteOn(int note, int velocity)
         // applied, and this is the actual envelope level that we'll use.
         _voices[vl].catt = _attack;
         _voices[vl].cenv = 0.0f;
+
+        updateVoiceTree(vl);
     }
 
     else {  // note off
         // We also get here when the sustain pedal is released. In that case,
         // the note number is SUSTAIN and any voices in SUSTAIN are released.
 
-        for (int v = 0; v < NVOICES; v++) {
+        for (int v = 0; v < MAX_VOICES; v++) {
             // Any voices playing this note?
             if (_voices[v].note == note) {
                 // If the sustain pedal is not pressed, then start envelope release.
@@ -671,6 +1086,10 @@ void DX10AudioProcessor::noteOn(int note, int velocity)
                     _voices[v].catt = 1.0f;  // finish attack, if any
                     _voices[v].mlev = 0.0f;
                     _voices[v].mdec = _modRelease;
+                    for (int n = 0; n < EXTRA_OPERATORS; ++n) {
+                        _voices[v].opDec[n] = _release;
+                    }
+                    updateVoiceTree(v);
                 } else {
                     // Sustain pedal is pressed, so put the note in sustain mode.
                     _voices[v].note = SUSTAIN;
@@ -680,6 +1099,37 @@ void DX10AudioProcessor::noteOn(int note, int velocity)
     }
 }
 
+int DX10AudioProcessor::stealVoice()
+{
+    // The envelope levels were changed by rendering, so the first voice that
+    // is stolen after that rebuilds the tree. This is O(polyphony), but only
+    // once per render segment. Stealing more voices for the notes of a chord
+    // is O(log polyphony) each, since noteOn() updates the tree.
+    if (!_voiceTreeValid) {
+        for (int v = 0; v < _polyphony; ++v) {
+            _voiceTree.setLevel(v, _voices[v].env);
+        }
+        _voiceTree.rebuild(_polyphony);
+        _voiceTreeValid = true;
+    }
+
+    // Like the original, only a voice whose level is below 1.0 is stolen.
+    // If they are all louder, voice 0 is used. If several voices are equally
+    // quiet, the one with the lowest index is used.
+    if (_voiceTree.quietestLevel() < 1.0f) {
+        return _voiceTree.quietest();
+    }
+    return 0;
+}
+
+void DX10AudioProcessor::updateVoiceTree(int v)
+{
+    // When the tree is not valid, the next rebuild picks up the new level.
+    if (_voiceTreeValid && v < _polyphony) {
+        _voiceTree.update(v, _voices[v].env);
+    }
+}
+
 juce::AudioProcessorEditor *DX10AudioProcessor::createEditor()
 {
     auto editor = new juce::GenericAudioProcessorEditor(*this);
@@ -930,6 +1380,73 @@ juce::AudioProcessorValueTreeState::ParameterLayout DX10AudioProcessor::createPa
                 }
             )));
 
+    // Not part of the original plug-in and not stored in the factory presets.
+    layout.add(std::make_unique<juce::AudioParameterInt>(
+        juce::ParameterID("Polyphony", 1),
+        "Polyphony",
+        1, MAX_VOICES, DEFAULT_VOICES,
+        juce::AudioParameterIntAttributes().withLabel("voices")));
+
+    // Not part of the original plug-in and not stored in the factory presets.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("Oversampling", 1),
+        "Oversampling",
+        juce::StringArray { "Off", "2x", "4x" },
+        0));
+
+    // The parameters below are for the multi-operator algorithms. They are not
+    // part of the original plug-in and not stored in the factory presets.
+    juce::StringArray algorithmNames;
+    for (int i = 0; i < NUM_ALGORITHMS; ++i) {
+        algorithmNames.add(algorithms[i].name);
+    }
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("Algorithm", 1),
+        "Algorithm",
+        algorithmNames,
+        0));
+
+    for (int n = 0; n < EXTRA_OPERATORS; ++n) {
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID(opRatioIDs[n], 1),
+            opRatioIDs[n],
+            juce::NormalisableRange<float>(),
+            0.05f,
+            juce::AudioParameterFloatAttributes()
+                .withLabel("ratio")
+                .withStringFromValueFunction(
+                    [](float value, int) {
+                        return juce::String(0.5f * std::floor(1.0f + 31.9f * value), 1);
+                    }
+                )));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID(opLevelIDs[n], 1),
+            opLevelIDs[n],
+            juce::NormalisableRange<float>(),
+            0.0f,
+            juce::AudioParameterFloatAttributes()
+                .withLabel("%")
+                .withStringFromValueFunction(
+                    [](float value, int) {
+                        return juce::String(int(value * 100.0f));
+                    }
+                )));
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID(opDecayIDs[n], 1),
+            opDecayIDs[n],
+            juce::NormalisableRange<float>(),
+            0.5f,
+            juce::AudioParameterFloatAttributes()
+                .withLabel("%")
+                .withStringFromValueFunction(
+                    [](float value, int) {
+                        return juce::String(int(value * 100.0f));
+                    }
+                )));
+    }
+
     return layout;
 }
 
@@ -1,12 +1,47 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAEventQueue.h"
+#include "MDAOversampling.h"
+#include "MDAParameters.h"
+#include "MDAVoiceTree.h"
 
 const int NPARAMS = 16;       // number of parameters
-const int NVOICES = 8;        // max polyphony
+const int MAX_VOICES = 64;    // max polyphony
+const int DEFAULT_VOICES = 8; // polyphony of the original plug-in
 
 const float SILENCE = 0.0003f;  // voice choking
 
+// Operator 1 is the carrier and operator 2 is the modulator of the original
+// plug-in. Operators 3 - 6 are extra modulators that are only used by some of
+// the algorithms.
+const int MAX_OPERATORS = 6;
+const int EXTRA_OPERATORS = MAX_OPERATORS - 2;
+
+// Describes how the operators are connected.
+//
+// The operators are evaluated from operator 2 up to the last one, and then the
+// carrier. Each operator adds its output to the phase of one operator that is
+// evaluated after it. Operator 2 is a simple sine oscillator that cannot itself
+// be modulated, so it's always at the top of a stack.
+struct DX10Algorithm
+{
+    const char *name;
+
+    // How many operators this algorithm uses, including the carrier.
+    int numOperators;
+
+    // For each operator, the operator that it modulates. Indexed by operator
+    // number, so the first two elements are not used.
+    int target[MAX_OPERATORS + 1];
+};
+
+const int NUM_ALGORITHMS = 8;
+
+// When oversampling, the voices are rendered in chunks of this many samples
+// (at the normal sample rate) before they are downsampled.
+const int OVERSAMPLE_CHUNK = 128;
+
 // Describes a factory preset.
 struct DX10Program
 {
@@ -20,7 +55,7 @@ struct DX10Program
 };
 
 // State for an active voice.
-struct Voice
+struct DX10Voice
 {
     // What note triggered this voice, or SUSTAIN when the key is released
     // but the sustain pedal is still held down. 0 if the voice is inactive.
@@ -45,9 +80,56 @@ struct Voice
     float menv;  // current envelope level
     float mlev;  // target level
     float mdec;  // decay multiplier
+
+    // Operators 3 - 6. Unlike operator 2, these have a phase that can itself
+    // be modulated, just like the carrier. They are always set up in noteOn(),
+    // even if the current algorithm doesn't use them, so that the algorithm
+    // can be changed while a note is playing.
+    float opPhase[EXTRA_OPERATORS];  // current phase
+    float opInc[EXTRA_OPERATORS];    // phase increment
+    float opEnv[EXTRA_OPERATORS];    // current envelope level
+    float opDec[EXTRA_OPERATORS];    // decay multiplier
+};
+
+// The voices are rendered in groups of this many SIMD lanes. Eight floats fill
+// one AVX register, or two SSE or NEON registers.
+const int LANES = 8;
+
+// Structure-of-arrays copy of the voice state, used while rendering.
+//
+// With the data laid out like this, the same operation can be done on all
+// lanes at once, and the compiler turns the loop in renderLanes() into SSE,
+// AVX or NEON instructions. Inactive lanes are computed like any other lane
+// but the results are thrown away, so that there are no branches in the loop.
+struct DX10VoiceLanes
+{
+    // Index into _voices of the voice that each lane belongs to, or -1 if
+    // the lane is not used.
+    int voice[LANES];
+
+    alignas(32) float car[LANES];
+    alignas(32) float dcar[LANES];
+    alignas(32) float dmod[LANES];
+    alignas(32) float mod0[LANES];
+    alignas(32) float mod1[LANES];
+    alignas(32) float env[LANES];
+    alignas(32) float cenv[LANES];
+    alignas(32) float catt[LANES];
+    alignas(32) float cdec[LANES];
+    alignas(32) float menv[LANES];
+    alignas(32) float mlev[LANES];
+    alignas(32) float mdec[LANES];
+
+    // Operators 3 - 6, one row of lanes per operator.
+    alignas(32) float opPhase[EXTRA_OPERATORS][LANES];
+    alignas(32) float opInc[EXTRA_OPERATORS][LANES];
+    alignas(32) float opEnv[EXTRA_OPERATORS][LANES];
+    alignas(32) float opDec[EXTRA_OPERATORS][LANES];
 };
 
-class DX10AudioProcessor : public juce::AudioProcessor
+class DX10AudioProcessor : public juce::AudioProcessor,
+                           private juce::AudioProcessorValueTreeState::Listener,
+                           private juce::AsyncUpdater
 {
 public:
     DX10AudioProcessor();
@@ -90,7 +172,31 @@ private:
 
     void createPrograms();
     void processEvents(juce::MidiBuffer &midiMessages);
+    void fillEvents();
+    void handleEvent(const mda::MidiEvent &event);
     void noteOn(int note, int velocity);
+    int stealVoice();
+    void updateVoiceTree(int v);
+    void gatherVoices();
+    void scatterVoices();
+    void renderLanes(DX10VoiceLanes &L, float &mix);
+    void renderVoices(float *out, int numFrames);
+    void renderSamples(float *out, int numSamples);
+    void setOversampling(int factor);
+    void reportLatency();
+
+    // The host must only be told about a new latency from the message thread,
+    // but it's the audio thread that switches the oversampling factor. This
+    // defers the call to setLatencySamples() to the message thread.
+    void parameterChanged(const juce::String &, float) override
+    {
+        triggerAsyncUpdate();
+    }
+
+    void handleAsyncUpdate() override
+    {
+        reportLatency();
+    }
 
     // The factory presets.
     std::vector<DX10Program> _programs;
@@ -98,28 +204,61 @@ private:
     // Index of the active preset.
     int _currentProgram;
 
-    // The current sample rate and 1 / sample rate.
+    // The sample rate that the voices are rendered at, and 1 / sample rate.
+    // This is higher than the host's sample rate when oversampling.
     float _sampleRate, _inverseSampleRate;
 
-    // MIDI note on / note off events for the current block. Each event is
-    // described by 3 values: delta time, note number, velocity.
-    static const int EVENTBUFFER = 120;
-    int _notes[EVENTBUFFER + 8];
+    // The host's sample rate.
+    double _hostSampleRate;
+
+    // Oversampling factor: 1, 2 or 4.
+    int _oversampling;
 
-    // Special event code that marks the end of the MIDI events list.
-    const int EVENTS_DONE = 99999999;
+    // Filters the oversampled signal and brings it back to the host's rate.
+    mda::Decimator _decimator;
+
+    // The oversampled signal for one chunk, before it is decimated.
+    std::vector<float> _oversampled;
+
+    // The MIDI events for the current block, in timestamp order.
+    mda::EventQueue _events;
+
+    // The host's MIDI events that haven't been copied into the queue yet.
+    juce::MidiBufferIterator _midiIterator, _midiEnd;
 
     // Special "note number" that says this voice is now kept alive by the
     // sustain pedal being pressed down. As soon as the pedal is released,
     // this voice will fade out.
     const int SUSTAIN = 128;
 
-    // List of the active voices.
-    Voice _voices[NVOICES] = { 0 };
+    // The pool of voices. This always has room for MAX_VOICES voices, so that
+    // changing the polyphony does not need to allocate memory. The pool is
+    // allocated in prepareToPlay().
+    std::vector<DX10Voice> _voices;
+
+    // Bitmask of the voices that are not in use. A voice becomes free when its
+    // envelope has dropped below SILENCE. Finding a free voice is O(1): it's
+    // the lowest bit that is set.
+    juce::uint64 _freeVoices;
+
+    // Bitmask of the voices that may be used for new notes, based on the
+    // Polyphony parameter. Voices above this limit are released.
+    juce::uint64 _polyphonyMask;
+
+    // Finds the quietest voice when all voices are in use. The envelope levels
+    // change while rendering, so the tree is only valid until the next render
+    // segment. It's rebuilt the first time a voice is stolen after that.
+    mda::QuietestVoiceTree _voiceTree { MAX_VOICES };
+    bool _voiceTreeValid = false;
 
     // How many voices are currently in use.
     int _numActiveVoices;
 
+    // The voice state in SIMD-friendly form, used while rendering. The voices
+    // that are in use are packed into the first _numLaneGroups groups.
+    std::vector<DX10VoiceLanes> _lanes;
+    int _numLaneGroups;
+
     // The LFO only updates every 100 samples. This counter keeps track of when
     // the next update is.
     int _lfoStep;
@@ -166,6 +305,18 @@ private:
     // Phase increment for the LFO.
     float _lfoInc;
 
+    // Maximum number of voices that can play at once.
+    int _polyphony;
+
+    // How the operators are connected.
+    const DX10Algorithm *_algorithm;
+
+    // Settings for operators 3 - 6: frequency as a multiple of the carrier
+    // frequency, initial modulation level, and decay multiplier.
+    float _opRatio[EXTRA_OPERATORS];
+    float _opLevel[EXTRA_OPERATORS];
+    float _opDecay[EXTRA_OPERATORS];
+
     // === MIDI CC values ===
 
     // Status of the damper pedal: 64 = pressed, 0 = released.
@@ -180,5 +331,8 @@ private:
     // Pitch bend value.
     float _pitchBend;
 
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DX10AudioProcessor)
 };
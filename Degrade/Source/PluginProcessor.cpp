@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDADegradeAudioProcessor::MDADegradeAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(_parameters, apvts);
 }
 
 MDADegradeAudioProcessor::~MDADegradeAudioProcessor()
@@ -41,6 +43,17 @@ void MDADegradeAudioProcessor::changeProgramName(int index, const juce::String &
 
 void MDADegradeAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    _g3.prepare(sampleRate);
+    _fo.prepare(sampleRate);
+
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    _channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+    _pairs.resize(_channelPairs.size());
+
     resetState();
 }
 
@@ -55,15 +68,27 @@ void MDADegradeAudioProcessor::reset()
 
 bool MDADegradeAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDADegradeAudioProcessor::resetState()
 {
-    _accum = 0.0f;
-    _currentSample = 0.0f;
-    _buf1 = _buf2 = _buf3 = _buf4 = _buf6 = _buf7 = _buf8 = _buf9 = 0.0f;
-    _sampleIndex = 1;
+    for (auto &state : _pairs) {
+        state.accum = 0.0f;
+        state.currentSample = 0.0f;
+        state.buf1 = state.buf2 = state.buf3 = state.buf4 = 0.0f;
+        state.buf6 = state.buf7 = state.buf8 = state.buf9 = 0.0f;
+        state.sampleIndex = 1;
+    }
+
+    _g3.reset();
+    _fo.reset();
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
 }
 
 float MDADegradeAudioProcessor::filterFreq(float hz)
@@ -110,14 +135,11 @@ void MDADegradeAudioProcessor::update()
     // We choose fi so that it keeps the amplitude of the unfiltered frequencies
     // at 0 dB (unity gain). Since fi = 1 - fo, that makes this an "exponentially
     // weighted moving average" or EWMA filter.
-    _fo = filterFreq(apvts.getRawParameterValue("PostFilter")->load());
-    _fi = 1.0f - _fo;
-
+    //
     // The filter stage actually consists of several identical filters in series.
-    // As an optimization, make the gain coefficient (1 - fo)^4, which will save
-    // doing a few multiplications.
-    _fi = _fi * _fi;
-    _fi = _fi * _fi;
+    // As an optimization, fi is (1 - fo)^4, which will save doing a few
+    // multiplications. Because fo is smoothed, processPair() calculates fi.
+    _fo.setTarget(filterFreq(apvts.getRawParameterValue("PostFilter")->load()));
 
     // The formula used for quantization is:
     //   x = int(x * 2^bits) / (2^bits) = int(x * g1) / g1 = int(x * g1) * g2
@@ -147,7 +169,7 @@ void MDADegradeAudioProcessor::update()
 
     // The output level is in dB, so convert to linear gain.
     float outputLevel = apvts.getRawParameterValue("Output")->load();
-    _g3 = juce::Decibels::decibelsToGain(outputLevel);
+    _g3.setTarget(juce::Decibels::decibelsToGain(outputLevel));
 
     // Non-linearity: 0 = x^1 ... 1 = x^0.707. The plug-in uses an exponential
     // curve between these two points but a linear interpolation using jmap()
@@ -174,29 +196,47 @@ void MDADegradeAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (_parameters.changed()) {
+        update();
+    }
+
+    // All pairs start from the same output gain and filter, and ramp them the
+    // same way.
+    for (auto &state : _pairs) {
+        state.g3 = _g3;
+        state.fo = _fo;
+    }
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    mda::processChannelPairs(_channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this](int pair, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            processPair(_pairs[size_t(pair)], in1, in2, out1, out2, numSamples);
+        });
 
+    if (!_pairs.empty()) {
+        _g3 = _pairs[0].g3;
+        _fo = _pairs[0].fo;
+    }
+}
+
+void MDADegradeAudioProcessor::processPair(MDADegradeState &state, const float *in1, const float *in2,
+                                           float *out1, float *out2, int numSamples)
+{
     // Make local copies for moar speeed!
     const float linNeg = _linNeg;
     const float linPos = _linPos;
     const float clip = _clip;
     const float mode = _mode;
-    const float fi = _fi, fo = _fo;
-    const float g1 = _g1, g2 = _g2, g3 = _g3;
+    const float g1 = _g1, g2 = _g2;
     const int sampleInterval = _sampleInterval;
 
-    int sampleIndex = _sampleIndex;
-    float accum = _accum;
-    float x = _currentSample;
-    float b1 = _buf1, b2 = _buf2, b3 = _buf3, b4 = _buf4,
-    b6 = _buf6, b7 = _buf7, b8 = _buf8, b9 = _buf9;
+    int sampleIndex = state.sampleIndex;
+    float accum = state.accum;
+    float x = state.currentSample;
+    float b1 = state.buf1, b2 = state.buf2, b3 = state.buf3, b4 = state.buf4,
+    b6 = state.buf6, b7 = state.buf7, b8 = state.buf8, b9 = state.buf9;
 
-    for (int i = 0; i < buffer.getNumSamples(); ++i) {
+    for (int i = 0; i < numSamples; ++i) {
         /*
           Order of the FX:
 
@@ -253,7 +293,11 @@ void MDADegradeAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
         // they're using is (1 - fo)^4. This saves some multiplications but is
         // otherwise equivalent. You could also do (1 - fo)^8 and only apply it
         // to b1, not b6, but that can get numerically unstable when fo is large.
-        b1 = fi * (x * g3) + fo * b1;
+        const float fo = state.fo.next();
+        float fi = 1.0f - fo;
+        fi = fi * fi;
+        fi = fi * fi;
+        b1 = fi * (x * state.g3.next()) + fo * b1;
         b2 =       b1      + fo * b2;
         b3 =       b2      + fo * b3;
         b4 =       b3      + fo * b4;
@@ -273,22 +317,22 @@ void MDADegradeAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
 
     // Reset the state if we have numeric underflow in the output.
     if (std::abs(b1) < 1.0e-10f) {
-        _buf1 = 0.0f; _buf2 = 0.0f; _buf3 = 0.0f; _buf4 = 0.0f;
-        _buf6 = 0.0f; _buf7 = 0.0f; _buf8 = 0.0f; _buf9 = 0.0f;
-        _accum = 0.0f;
-        _currentSample = 0.0f;
+        state.buf1 = 0.0f; state.buf2 = 0.0f; state.buf3 = 0.0f; state.buf4 = 0.0f;
+        state.buf6 = 0.0f; state.buf7 = 0.0f; state.buf8 = 0.0f; state.buf9 = 0.0f;
+        state.accum = 0.0f;
+        state.currentSample = 0.0f;
     } else {
-        // Copy the local variables back into the member variables, so we can
-        // resume from where we left off in the next call to processBlock.
-        _buf1 = b1; _buf2 = b2; _buf3 = b3; _buf4 = b4;
-        _buf6 = b6; _buf7 = b7; _buf8 = b8; _buf9 = b9;
+        // Copy the local variables back into the state, so we can resume
+        // from where we left off in the next call to processBlock.
+        state.buf1 = b1; state.buf2 = b2; state.buf3 = b3; state.buf4 = b4;
+        state.buf6 = b6; state.buf7 = b7; state.buf8 = b8; state.buf9 = b9;
 
         // We also keep track of x and accum in between calls to processBlock,
         // in case the sampleInterval is greater than 1.
-        _accum = accum;
-        _currentSample = x;
+        state.accum = accum;
+        state.currentSample = x;
     }
-    _sampleIndex = sampleIndex;
+    state.sampleIndex = sampleIndex;
 }
 
 juce::AudioProcessorEditor *MDADegradeAudioProcessor::createEditor()
@@ -1,6 +1,27 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAParameters.h"
+
+// The state of the effect for one pair of channels.
+struct MDADegradeState
+{
+    // Counts the samples in the current sampling interval.
+    int sampleIndex;
+
+    // Sum of the previous samples in sample-and-hold mode.
+    float accum;
+
+    // The most recently computed sample value, before filtering.
+    float currentSample;
+
+    // Delay units for the 8 filter stages.
+    float buf1, buf2, buf3, buf4, buf6, buf7, buf8, buf9;
+
+    // This pair's copies of the smoothed output gain and filter coefficient.
+    mda::SmoothedValue g3, fo;
+};
 
 class MDADegradeAudioProcessor : public juce::AudioProcessor
 {
@@ -43,10 +64,12 @@ private:
     void update();
     float filterFreq(float hz);
     void resetState();
+    void processPair(MDADegradeState &state, const float *in1, const float *in2,
+                     float *out1, float *out2, int numSamples);
 
     // To reduce the sampling rate, we only read from the input buffer every
     // sampleInterval samples.
-    int _sampleInterval, _sampleIndex;
+    int _sampleInterval;
 
     // This is 1.0 if sample-and-hold mode is active, 0.0 if not.
     float _mode;
@@ -60,20 +83,20 @@ private:
     // Level for headroom clipping.
     float _clip;
 
-    // Output gain.
-    float _g3;
+    // Output gain. This is smoothed to avoid zipper noise.
+    mda::SmoothedValue _g3;
 
-    // Filter coefficients.
-    float _fi, _fo;
+    // Filter coefficient, smoothed so that moving the PostFilter knob doesn't
+    // click. The other coefficient is derived from it in processPair().
+    mda::SmoothedValue _fo;
 
-    // Sum of the previous samples in sample-and-hold mode.
-    float _accum;
+    // How the channels are split into stereo pairs, and the state of the
+    // effect for each pair.
+    std::vector<mda::ChannelPair> _channelPairs;
+    std::vector<MDADegradeState> _pairs;
 
-    // The most recently computed sample value, before filtering.
-    float _currentSample;
-
-    // Delay units for the 8 filter stages.
-    float _buf1, _buf2, _buf3, _buf4, _buf6, _buf7, _buf8, _buf9;
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDADegradeAudioProcessor)
 };
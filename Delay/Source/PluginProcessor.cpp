@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDADelayAudioProcessor::MDADelayAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(_parameters, apvts);
 }
 
 MDADelayAudioProcessor::~MDADelayAudioProcessor()
@@ -41,11 +43,40 @@ void MDADelayAudioProcessor::changeProgramName(int index, const juce::String &ne
 
 void MDADelayAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    _wet.prepare(sampleRate);
+    _dry.prepare(sampleRate);
+    _feedback.prepare(sampleRate);
+    _filt.prepare(sampleRate);
+    _lmix.prepare(sampleRate);
+    _hmix.prepare(sampleRate);
+
     // Calculate how many samples we need for the delay buffer. This depends
     // on the sample rate and the maximum allowed delay time: the larger the
     // sample rate, the larger the buffer must be.
-    _delayMax = int(std::ceil(float(sampleRate) * _delayMaxMsec / 1000.0f));
-    _delayBuffer.resize(_delayMax);
+    _delayMax = int(std::ceil(float(sampleRate) * _bufferMaxMsec / 1000.0f));
+
+    // Round the length of the buffer up to a power of two. The interpolation
+    // reads two samples further back than the delay time, so leave some room.
+    int delayLength = 1;
+    while (delayLength < _delayMax + 3) {
+        delayLength *= 2;
+    }
+    _delayMask = delayLength - 1;
+
+    const int fadeLength = int(float(sampleRate) * _fadeMsec / 1000.0f);
+    _left.prepare(fadeLength);
+    _right.prepare(fadeLength);
+
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    _channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+    _pairs.resize(_channelPairs.size());
+    for (auto &state : _pairs) {
+        state.delayBuffer.resize(size_t(delayLength));
+    }
 
     resetState();
 }
@@ -61,82 +92,77 @@ void MDADelayAudioProcessor::reset()
 
 bool MDADelayAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDADelayAudioProcessor::resetState()
 {
-    _pos = 0;
-    _filt0 = 0.0f;
+    for (auto &state : _pairs) {
+        state.pos = 0;
+        state.filt0 = 0.0f;
+
+        // Clear out the delay buffer.
+        memset(state.delayBuffer.data(), 0, state.delayBuffer.size() * sizeof(float));
+    }
 
-    // Clear out the delay buffer.
-    memset(_delayBuffer.data(), 0, _delayMax * sizeof(float));
+    _wet.reset();
+    _dry.reset();
+    _feedback.reset();
+    _filt.reset();
+    _lmix.reset();
+    _hmix.reset();
+    _left.reset();
+    _right.reset();
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
 }
 
 void MDADelayAudioProcessor::update()
 {
-    const float samplesPerMsec = float(getSampleRate()) / 1000.0f;
-
-    // In the original plug-in, the parameter for the left channel delay length
-    // went from 0 to 1. To compute the number of samples of delay, it used the
-    // formula: ldel = int(delayMax * ldelParam * ldelParam).
-    // The reason the parameter got squared, is that this makes it easier to
-    // pick smaller delays. For example, at a sample rate of 44100, the maximum
-    // delay length is 22050 samples. With the parameter set to 0.5, the delay
-    // is not 11025 (= half) but 5512 samples (= half squared). In JUCE, we can
-    // simply have the parameter be in milliseconds and give the slider a skew.
-    float ldelParam = apvts.getRawParameterValue("L Delay")->load();
-    _ldel = int(ldelParam * samplesPerMsec);
-
-    // Make the minimum delay time 4 samples, not 0. A delay time of 0 would be
-    // equal to the maximum delay because of wrap-around, so that's not very
-    // useful. Although I'm not sure why the minimum delay is 4 samples, not 1.
-    // Notice that really short delays introduce a filtering effect.
-    if (_ldel < 4) _ldel = 4;
-
-    // This shouldn't happen, but a bit of defensive programming never hurts.
-    if (_ldel > _delayMax) _ldel = _delayMax;
-
-    // The right channel delay is a percentage of the left channel delay length.
-    float rdelParam = apvts.getRawParameterValue("R Delay")->load();
-    _rdel = int(ldelParam * samplesPerMsec * rightDelayRatio(rdelParam));
-
-    // Make sure the delay time does not become too large or too small.
-    if (_rdel > _delayMax) _rdel = _delayMax;
-    if (_rdel < 4) _rdel = 4;
+    _sync = int(apvts.getRawParameterValue("Sync")->load());
+    updateDelayTimes();
 
     // The "tone" control goes from -100 to +100. Moving to the left means
     // low-pass filtering and to the right means high-pass filtering. When the
     // tone control is centered, there is no filtering.
     float toneParam = apvts.getRawParameterValue("Fb Tone")->load();
-    _filt = toneParam / 200.0f + 0.5f;
+    float filt = toneParam / 200.0f + 0.5f;
+    float lmix, hmix;
 
     // Set the crossover frequency & high/low mix. Here, lmix determines how much
     // the low-pass filtered sample is combined with the unfiltered sample, whose
     // proportion is given by hmix.
-    if (_filt > 0.5f) {                 // high-pass:
-        _filt = 0.5f * _filt - 0.25f;   // filt now goes 0 to 0.25
-        _lmix = -2.0f * _filt;          // lmix goes from 0 to -0.5
-        _hmix = 1.0f;
+    if (filt > 0.5f) {                  // high-pass:
+        filt = 0.5f * filt - 0.25f;     // filt now goes 0 to 0.25
+        lmix = -2.0f * filt;            // lmix goes from 0 to -0.5
+        hmix = 1.0f;
     } else {                            // low-pass:
-        _hmix = 2.0f * _filt;           // hmix goes from 0 to 1
-        _lmix = 1.0f - _hmix;           // lmix goes from 1 to 0
+        hmix = 2.0f * filt;             // hmix goes from 0 to 1
+        lmix = 1.0f - hmix;             // lmix goes from 1 to 0
     }
+    _lmix.setTarget(lmix);
+    _hmix.setTarget(hmix);
 
-    // At this point, _filt is a value between 0 and 0.5 (low-pass) or 0.25
+    // At this point, filt is a value between 0 and 0.5 (low-pass) or 0.25
     // (high-pass). Turn this value into a cutoff frequency. On the left of
     // the slider, the frequency goes from 158 Hz - 28 kHz. On the right, it
     // goes from 158 Hz - 2113 Hz.
-    float hz = std::pow(10.0f, 2.2f + 4.5f * _filt);
+    float hz = std::pow(10.0f, 2.2f + 4.5f * filt);
 
     // The filter itself is a one-pole filter: y(n) = (1 - f)*x(n) + f*y(n - 1).
     // Calculate the coefficient f using the formula exp(-2pi * hz / sampleRate).
-    _filt = std::exp(-6.2831853f * hz / float(getSampleRate()));
+    // The ramp is linear in f rather than in Hz, which is close enough for
+    // 20 ms and keeps the std::exp() out of the render loop.
+    _filt.setTarget(std::exp(-6.2831853f * hz / float(getSampleRate())));
 
     // Feedback: value between 0 and 0.49. If this is 0, the delay repeats only
     // once. For higher values, the delay will keeping echoing.
     float feedbackParam = apvts.getRawParameterValue("Feedback")->load() / 100.0f;
-    _feedback = 0.495f * feedbackParam;
+    _feedback.setTarget(0.495f * feedbackParam);
 
     // Output gain is in decibels, so convert to a linear value.
     float gain = apvts.getRawParameterValue("Output")->load();
@@ -147,8 +173,8 @@ void MDADelayAudioProcessor::update()
     // mix = 0.5, but added together they increase the gain by +3 dB at 50% mix
     // (i.e. it's not an equal power curve).
     float mix = apvts.getRawParameterValue("FX Mix")->load() / 100.0f;
-    _wet = gain * (1.0f - (1.0f - mix) * (1.0f - mix)) * 0.5f;
-    _dry = gain * (1.0f - mix * mix);
+    _wet.setTarget(gain * (1.0f - (1.0f - mix) * (1.0f - mix)) * 0.5f);
+    _dry.setTarget(gain * (1.0f - mix * mix));
 
     // Note: the original plug-in had an additional factor 2.0 in the formula
     // for dry, which seems wrong. That would boost the signal by 6 dB if the
@@ -162,6 +188,66 @@ void MDADelayAudioProcessor::update()
     // 0 dB instead of +6 dB.
 }
 
+void MDADelayAudioProcessor::updateDelayTimes()
+{
+    const float samplesPerMsec = float(getSampleRate()) / 1000.0f;
+
+    // In the original plug-in, the parameter for the left channel delay length
+    // went from 0 to 1. To compute the number of samples of delay, it used the
+    // formula: ldel = int(delayMax * ldelParam * ldelParam).
+    // The reason the parameter got squared, is that this makes it easier to
+    // pick smaller delays. For example, at a sample rate of 44100, the maximum
+    // delay length is 22050 samples. With the parameter set to 0.5, the delay
+    // is not 11025 (= half) but 5512 samples (= half squared). In JUCE, we can
+    // simply have the parameter be in milliseconds and give the slider a skew.
+    float ldelParam = apvts.getRawParameterValue("L Delay")->load();
+
+    // With tempo sync, the delay time is a note length at the host's tempo
+    // instead, and the L Delay knob is ignored. (Not part of the original.)
+    if (_sync > 0) {
+        ldelParam = float(noteLength(_sync) * 60000.0 / _bpm);
+    }
+
+    // The original plug-in rounded the delay time down to a whole number of
+    // samples, but we can read in between two samples, see MDADelayTap.
+    _ldel = ldelParam * samplesPerMsec;
+
+    // Make the minimum delay time 4 samples, not 0. A delay time of 0 would be
+    // equal to the maximum delay because of wrap-around, so that's not very
+    // useful. Although I'm not sure why the minimum delay is 4 samples, not 1.
+    // Notice that really short delays introduce a filtering effect.
+    if (_ldel < 4.0f) _ldel = 4.0f;
+
+    // This can happen with tempo sync at very slow tempos.
+    if (_ldel > float(_delayMax)) _ldel = float(_delayMax);
+
+    // The right channel delay is a percentage of the left channel delay length.
+    float rdelParam = apvts.getRawParameterValue("R Delay")->load();
+    _rdel = ldelParam * samplesPerMsec * rightDelayRatio(rdelParam);
+
+    // Make sure the delay time does not become too large or too small.
+    if (_rdel > float(_delayMax)) _rdel = float(_delayMax);
+    if (_rdel < 4.0f) _rdel = 4.0f;
+
+    // Move the read positions. This crossfades to the new delay times, so
+    // that turning the knobs doesn't click.
+    _left.setTarget(_ldel);
+    _right.setTarget(_rdel);
+}
+
+double MDADelayAudioProcessor::hostTempo() const
+{
+    if (auto *playHead = getPlayHead()) {
+        const auto position = playHead->getPosition();
+        if (position.hasValue() && position->getBpm().hasValue() && *position->getBpm() > 0.0) {
+            return *position->getBpm();
+        }
+    }
+
+    // The host doesn't know, for example because it's not a DAW.
+    return 120.0;
+}
+
 void MDADelayAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
@@ -173,50 +259,81 @@ void MDADelayAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    // With tempo sync, the delay times also change when the tempo does.
+    const double bpm = hostTempo();
+    if (_parameters.changed()) {
+        _bpm = bpm;
+        update();
+    } else if (_sync > 0 && bpm != _bpm) {
+        _bpm = bpm;
+        updateDelayTimes();
+    }
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    // All pairs start from the same wet & dry levels, filter settings and
+    // delay times, and ramp and crossfade them the same way.
+    for (auto &state : _pairs) {
+        state.wet = _wet;
+        state.dry = _dry;
+        state.feedback = _feedback;
+        state.filt = _filt;
+        state.lmix = _lmix;
+        state.hmix = _hmix;
+        state.left = _left;
+        state.right = _right;
+    }
 
-    const float wet = _wet;
-    const float dry = _dry;
-    const float fb = _feedback;
-    const float f = _filt;
-    const float lmix = _lmix;
-    const float hmix = _hmix;
-    const int s = _delayMax;
+    mda::processChannelPairs(_channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this](int pair, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            processPair(_pairs[size_t(pair)], in1, in2, out1, out2, numSamples);
+        });
+
+    if (!_pairs.empty()) {
+        _wet = _pairs[0].wet;
+        _dry = _pairs[0].dry;
+        _feedback = _pairs[0].feedback;
+        _filt = _pairs[0].filt;
+        _lmix = _pairs[0].lmix;
+        _hmix = _pairs[0].hmix;
+        _left = _pairs[0].left;
+        _right = _pairs[0].right;
+    }
+}
 
-    float f0 = _filt0;
+void MDADelayAudioProcessor::processPair(MDADelayState &state, const float *in1, const float *in2,
+                                         float *out1, float *out2, int numSamples)
+{
+    const int mask = _delayMask;
+
+    float *delayBuffer = state.delayBuffer.data();
+    float f0 = state.filt0;
 
     // This keeps track of where we will write new values in the delay buffer.
-    int p = _pos;
-
-    // Get the read positions for the left and right channels. These need to
-    // wrap around when they reach the end of the buffer, which is why we use
-    // the modulo operator.
-    int l = (p + _ldel) % s;
-    int r = (p + _rdel) % s;
-
-    // Note: This logic cannot tell apart a delay of 0 from a delay of _delayMax
-    // samples. Due to the modulo operation these point to the same index in the
-    // delay buffer. So a delay of 0 samples is not possible.
-    // The original plug-in didn't so this, and I have not implemented it either,
-    // but we could allow the user to set the delay time to 0, and then simply
-    // bypass all of the delay logic in the loop.
-
-    for (int i = 0; i < buffer.getNumSamples(); ++i) {
+    int p = state.pos;
+
+    // The read positions for the left and right channels are relative to the
+    // write position: they read the sample that was written `_ldel` and
+    // `_rdel` samples ago. Local copies so they can be kept in registers.
+    MDADelayTap left = state.left;
+    MDADelayTap right = state.right;
+
+    for (int i = 0; i < numSamples; ++i) {
         float a = in1[i];
         float b = in2[i];
 
         // Read from the delay buffer.
-        float dl = _delayBuffer[l];
-        float dr = _delayBuffer[r];
+        float dl = left.read(delayBuffer, mask, p);
+        float dr = right.read(delayBuffer, mask, p);
 
         // Combine the left and right input samples into a mono signal.
         // Also add the delayed values but attenuated by the feedback factor.
         // The larger the feedback, the longer the sound will keep echoing.
+        const float wet = state.wet.next();
+        const float dry = state.dry.next();
+        const float fb = state.feedback.next();
+        const float f = state.filt.next();
+        const float lmix = state.lmix.next();
+        const float hmix = state.hmix.next();
         float tmp = wet * (a + b) + fb * (dl + dr);
 
         // Apply the low-pass filter. As seen in the other MDA plug-ins, this
@@ -246,16 +363,13 @@ void MDADelayAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce
         //
         // Note that the filtering only applies to the delayed signal, not to the
         // original (dry) signal.
-        _delayBuffer[p] = lmix * f0 + hmix * tmp;
+        delayBuffer[p] = lmix * f0 + hmix * tmp;
 
-        // Update the locations where we will write into and read from the delay
-        // buffer. Since l = p + ldel and r = p + rdel, it means older / delayed
-        // values are to the right in the buffer (higher indices) and newer values
-        // are to the left (lower indices). Therefore, we must decrement and wrap
-        // around when we have reached the end (well, beginning) of the buffer.
-        p--; if (p < 0) p = s - 1;
-        l--; if (l < 0) l = s - 1;
-        r--; if (r < 0) r = s - 1;
+        // Move the write position ahead. The read positions move along with
+        // it. Because the length of the buffer is a power of two, wrapping
+        // around is a bitwise AND instead of a comparison. (The original went
+        // backwards through the buffer, but that doesn't matter.)
+        p = (p + 1) & mask;
 
         // The output for this sample is the original sample mixed with the values
         // we read from the delay buffer. Note that the output is still stereo but
@@ -264,10 +378,12 @@ void MDADelayAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce
         out2[i] = dry * b + dr;
     }
 
-    _pos = p;
+    state.pos = p;
+    state.left = left;
+    state.right = right;
 
     // Trap denormals
-    if (std::abs(f0) < 1.0e-10f) _filt0 = 0.0f; else _filt0 = f0;
+    if (std::abs(f0) < 1.0e-10f) state.filt0 = 0.0f; else state.filt0 = f0;
 }
 
 juce::AudioProcessorEditor *MDADelayAudioProcessor::createEditor()
@@ -303,14 +419,41 @@ float MDADelayAudioProcessor::rightDelayRatio(float param) {
     }
 }
 
+double MDADelayAudioProcessor::noteLength(int sync)
+{
+    // In beats, i.e. quarter notes. T is a triplet, D is a dotted note.
+    switch (sync) {
+        case  1: return 0.125;      // 1/32
+        case  2: return 1.0 / 6.0;  // 1/16T
+        case  3: return 0.25;       // 1/16
+        case  4: return 0.375;      // 1/16D
+        case  5: return 1.0 / 3.0;  // 1/8T
+        case  6: return 0.5;        // 1/8
+        case  7: return 0.75;       // 1/8D
+        case  8: return 2.0 / 3.0;  // 1/4T
+        case  9: return 1.0;        // 1/4
+        case 10: return 1.5;        // 1/4D
+        case 11: return 4.0 / 3.0;  // 1/2T
+        case 12: return 2.0;        // 1/2
+        case 13: return 3.0;        // 1/2D
+        default: return 4.0;        // 1/1
+    }
+}
+
 juce::AudioProcessorValueTreeState::ParameterLayout MDADelayAudioProcessor::createParameterLayout()
 {
     juce::AudioProcessorValueTreeState::ParameterLayout layout;
 
+    // The knob goes up to the length of the delay line. The skew puts 500 ms,
+    // the longest delay of the original plug-in, in the middle of the knob,
+    // so the short delay times still get plenty of room.
+    juce::NormalisableRange<float> ldelRange(0.1f, _bufferMaxMsec, 0.01f);
+    ldelRange.setSkewForCentre(500.0f);
+
     layout.add(std::make_unique<juce::AudioParameterFloat>(
         juce::ParameterID("L Delay", 1),
         "L Delay",
-        juce::NormalisableRange<float>(0.1f, _delayMaxMsec, 0.01f, 0.4f),
+        ldelRange,
         250.0f,
         juce::AudioParameterFloatAttributes().withLabel("ms")));
 
@@ -363,6 +506,15 @@ juce::AudioProcessorValueTreeState::ParameterLayout MDADelayAudioProcessor::crea
         0.0f,
         juce::AudioParameterFloatAttributes().withLabel("dB")));
 
+    // Not part of the original plug-in. Sets the delay time to a note length
+    // at the host's tempo, instead of using L Delay.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("Sync", 1),
+        "Sync",
+        juce::StringArray({ "Off", "1/32", "1/16T", "1/16", "1/16D", "1/8T", "1/8",
+                            "1/8D", "1/4T", "1/4", "1/4D", "1/2T", "1/2", "1/2D", "1/1" }),
+        0));
+
     return layout;
 }
 
@@ -1,6 +1,135 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAParameters.h"
+
+/*
+  A read position in the delay line. (Not part of the original plug-in.)
+
+  The original plug-in jumps to the new read position as soon as the delay
+  time changes, which clicks. Gliding from the old delay time to the new one
+  doesn't click, but it bends the pitch of the echoes like a tape delay does.
+  Instead, this does what most digital delays do: for a short while it reads
+  from both the old and the new position, and crossfades between them. If the
+  delay time changes again during the crossfade, the next crossfade starts
+  when this one is done.
+
+  The delay time is in samples and can have a fractional part. The samples in
+  between are found with cubic interpolation.
+ */
+class MDADelayTap
+{
+public:
+    // Sets the length of the crossfade. Call this from prepareToPlay().
+    void prepare(int fadeLength) noexcept
+    {
+        _fadeLength = fadeLength;
+        reset();
+    }
+
+    // The next call to setTarget() jumps to the new delay time.
+    void reset() noexcept
+    {
+        _steps = 0;
+        _jump = true;
+    }
+
+    void setTarget(float delay) noexcept
+    {
+        _target = delay;
+        if (_jump) {
+            _current.set(delay);
+            _steps = 0;
+            _jump = false;
+        }
+    }
+
+    // Returns the delayed sample. `pos` is the index where the next sample
+    // will be written, `mask` is the length of the buffer minus one.
+    float read(const float *buffer, int mask, int pos) noexcept
+    {
+        if (_steps == 0 && _target != _current.delay) {
+            _next.set(_target);
+            _steps = _fadeLength;
+        }
+
+        float y = _current.read(buffer, mask, pos);
+        if (_steps > 0) {
+            const float mix = 1.0f - float(_steps) / float(_fadeLength);
+            y += mix * (_next.read(buffer, mask, pos) - y);
+            if (--_steps == 0) {
+                _current = _next;
+            }
+        }
+        return y;
+    }
+
+private:
+    struct Position
+    {
+        // The interpolation weights only depend on the fractional part of the
+        // delay time, so they're calculated once rather than for every sample.
+        void set(float newDelay) noexcept
+        {
+            delay = newDelay;
+            d = int(newDelay);
+            const float t = newDelay - float(d);
+
+            // Cubic Hermite (Catmull-Rom), see also MDAInterpolation.h.
+            w0 = t * (-0.5f + t * (1.0f - 0.5f * t));
+            w1 = 1.0f + t * t * (-2.5f + 1.5f * t);
+            w2 = t * (0.5f + t * (2.0f - 1.5f * t));
+            w3 = t * t * (-0.5f + 0.5f * t);
+        }
+
+        float read(const float *buffer, int mask, int pos) const noexcept
+        {
+            // The sample we want is in between the one that was written `d`
+            // samples ago (y1) and the one before that (y2). Wrapping around
+            // with a bitwise AND works for negative indices too.
+            const int i = pos - d;
+            const float y0 = buffer[(i + 1) & mask];
+            const float y1 = buffer[i & mask];
+            const float y2 = buffer[(i - 1) & mask];
+            const float y3 = buffer[(i - 2) & mask];
+            return (w0 * y0 + w1 * y1) + (w2 * y2 + w3 * y3);
+        }
+
+        float delay = 0.0f;
+        int d = 0;
+        float w0 = 0.0f, w1 = 1.0f, w2 = 0.0f, w3 = 0.0f;
+    };
+
+    Position _current;      // delay time being read
+    Position _next;         // delay time being faded in
+    float _target = 0.0f;   // delay time for the next crossfade
+    int _steps = 0;         // samples left in the crossfade
+    int _fadeLength = 1;
+    bool _jump = true;
+};
+
+// The state of the effect for one pair of channels.
+struct MDADelayState
+{
+    // This buffer stores the delayed samples. There is only one delay buffer
+    // per pair, which means any echos from the delayed signal are actually mono.
+    std::vector<float> delayBuffer;
+
+    // Write position in the delay buffer. This is where we will write the next
+    // new sample value.
+    int pos;
+
+    // This pair's copies of the read positions for the left & right channels.
+    MDADelayTap left, right;
+
+    // Delay unit for the low-pass filter.
+    float filt0;
+
+    // This pair's copies of the smoothed wet & dry mix and filter settings.
+    mda::SmoothedValue wet, dry;
+    mda::SmoothedValue feedback, filt, lmix, hmix;
+};
 
 class MDADelayAudioProcessor : public juce::AudioProcessor
 {
@@ -42,6 +171,9 @@ private:
 
     void update();
     void resetState();
+    void updateDelayTimes();
+    void processPair(MDADelayState &state, const float *in1, const float *in2,
+                     float *out1, float *out2, int numSamples);
 
     // Maps the position of the right delay slider to a percentage of the left
     // channel delay time. Moving the slider to the left gives you a variable
@@ -49,39 +181,62 @@ private:
     // set of fixed ratios. At the center position, the ratio is 200%.
     static float rightDelayRatio(float param);
 
-    // Maximum delay time in milliseconds. Feel free to make this smaller or
-    // larger. The original plug-in used a fixed number of samples, but that
-    // would make the maximum delay time different if the sample rate changed.
-    static constexpr float _delayMaxMsec = 500.0f;
+    // Length of the note for the Sync parameter, in beats.
+    static double noteLength(int sync);
+
+    // The tempo in beats per minute, from the host if it knows.
+    double hostTempo() const;
+
+    // Maximum delay time in milliseconds, for the L Delay knob, tempo sync,
+    // and the right channel, which can be up to twice as long as the left but
+    // is clamped to this. The original plug-in used a fixed number of samples
+    // (500 ms at 44100 Hz), but that would make the maximum delay time depend
+    // on the sample rate. Feel free to make this smaller or larger.
+    static constexpr float _bufferMaxMsec = 4000.0f;
+
+    // How long it takes to crossfade to a new delay time, in milliseconds.
+    static constexpr float _fadeMsec = 50.0f;
 
-    // Maximum length of the delay buffer in samples.
+    // Maximum delay time in samples.
     int _delayMax;
 
-    // This buffer stores the delayed samples. There is only one delay buffer,
-    // which means any echos from the delayed signal are actually mono.
-    std::vector<float> _delayBuffer;
+    // The length of the delay buffer is a power of two, so that the read and
+    // write positions can wrap around using a bitwise AND with this mask.
+    int _delayMask;
 
     // Delay time in samples for the left & right channels.
-    int _ldel, _rdel;
+    float _ldel, _rdel;
 
-    // Write position in the delay buffer. This is where we will write the next
-    // new sample value.
-    int _pos;
+    // The read positions. Like the wet & dry mix, the pairs start every block
+    // from a copy of these.
+    MDADelayTap _left, _right;
+
+    // Tempo sync: 0 is off, otherwise the note length, see noteLength().
+    int _sync;
 
-    // Wet & dry mix.
-    float _wet, _dry;
+    // The host's tempo that the delay times were calculated with.
+    double _bpm;
 
-    // Amount of echo feedback.
-    float _feedback;
+    // Wet & dry mix. These are smoothed to avoid zipper noise.
+    mda::SmoothedValue _wet, _dry;
+
+    // Amount of echo feedback. Like the mix, this and the filter settings
+    // below are smoothed, so turning the knobs doesn't click.
+    mda::SmoothedValue _feedback;
 
     // Low & high mix for the crossover filter.
-    float _lmix, _hmix;
+    mda::SmoothedValue _lmix, _hmix;
 
     // Low-pass filter coefficient.
-    float _filt;
+    mda::SmoothedValue _filt;
 
-    // Delay unit for the low-pass filter.
-    float _filt0;
+    // How the channels are split into stereo pairs, and the state of the
+    // effect for each pair.
+    std::vector<mda::ChannelPair> _channelPairs;
+    std::vector<MDADelayState> _pairs;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDADelayAudioProcessor)
 };
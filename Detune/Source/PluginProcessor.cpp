@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDADetuneAudioProcessor::MDADetuneAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(parameters, apvts);
 }
 
 MDADetuneAudioProcessor::~MDADetuneAudioProcessor()
@@ -42,6 +44,20 @@ void MDADetuneAudioProcessor::changeProgramName(int index, const juce::String &n
 void MDADetuneAudioProcessor::prepareToPlay(double newSampleRate, int samplesPerBlock)
 {
     sampleRate = float(newSampleRate);
+    wet.prepare(newSampleRate);
+    dry.prepare(newSampleRate);
+
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+    pairs.resize(channelPairs.size());
+    for (auto &state : pairs) {
+        state.buf.resize(BUFMAX);
+    }
+
     resetState();
 }
 
@@ -56,15 +72,27 @@ void MDADetuneAudioProcessor::reset()
 
 bool MDADetuneAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDADetuneAudioProcessor::resetState()
 {
-    std::memset(buf, 0, sizeof(buf));
     std::memset(win, 0, sizeof(win));
-    pos0 = 0;
-    pos1 = pos2 = 0.0f;
+    buflen = 0;  // so that update() recalculates the crossfade window
+    for (auto &state : pairs) {
+        std::memset(state.buf.data(), 0, BUFMAX * sizeof(float));
+        state.pos0 = 0;
+        state.pos1 = state.pos2 = 0.0f;
+    }
+
+    wet.reset();
+    dry.reset();
+
+    // Recalculate the parameters at the start of the next block.
+    parameters.invalidate();
 }
 
 void MDADetuneAudioProcessor::update()
@@ -90,8 +118,8 @@ void MDADetuneAudioProcessor::update()
     // Dry/wet curve of (1 - x^2) for dry and (2x - x^2) for wet, with the
     // output gain amount already multiplied into it.
     float param1 = apvts.getRawParameterValue("Mix")->load();
-    dry = gain - gain * param1 * param1;
-    wet = (gain + gain - gain * param1) * param1;
+    dry.setTarget(gain - gain * param1 * param1);
+    wet.setTarget((gain + gain - gain * param1) * param1);
 
     // The latency parameter determines the length of the delay line.
     // Since this parameter is a value between 0.0f and 1.0f, the expression
@@ -127,13 +155,31 @@ void MDADetuneAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juc
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (parameters.changed()) {
+        update();
+    }
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    // All pairs start from the same wet & dry levels and ramp them the same way.
+    for (auto &state : pairs) {
+        state.wet = wet;
+        state.dry = dry;
+    }
 
+    mda::processChannelPairs(channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this](int pair, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            processPair(pairs[size_t(pair)], in1, in2, out1, out2, numSamples);
+        });
+
+    if (!pairs.empty()) {
+        wet = pairs[0].wet;
+        dry = pairs[0].dry;
+    }
+}
+
+void MDADetuneAudioProcessor::processPair(MDADetuneState &state, const float *in1, const float *in2,
+                                          float *out1, float *out2, int numSamples)
+{
     /*
         How this works:
 
@@ -170,14 +216,20 @@ void MDADetuneAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juc
     // We'll read the second sample half the delay length ahead.
     const int halfLength = buflen >> 1;
 
-    for (int i = 0; i < buffer.getNumSamples(); ++i) {
+    float *buf = state.buf.data();
+    int &pos0 = state.pos0;
+    float &pos1 = state.pos1;
+    float &pos2 = state.pos2;
+
+    for (int i = 0; i < numSamples; ++i) {
         // Read the input samples.
         float a = in1[i];
         float b = in2[i];
 
         // Put the dry signal into the output variables already.
-        float c = dry * a;
-        float d = dry * b;
+        const float dryGain = state.dry.next();
+        float c = dryGain * a;
+        float d = dryGain * b;
 
         // Update the write position. For some reason this plug-in counts
         // backwards, but that shouldn't matter. The wrap-around is handled
@@ -186,7 +238,7 @@ void MDADetuneAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juc
 
         // Write the input as a mono signal into the delay line. This already
         // applies the wet gain, so we don't have to do this later.
-        buf[pos0] = wet * (a + b);
+        buf[pos0] = state.wet.next() * (a + b);
 
         // Update the read position for the left channel, wrapping around
         // if necessary. Note that this is a float because `dpos1` is the
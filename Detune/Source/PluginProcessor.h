@@ -1,6 +1,19 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAParameters.h"
+
+// The state of the effect for one pair of channels.
+struct MDADetuneState
+{
+    std::vector<float> buf;  // circular buffer for delay line (mono)
+
+    int pos0;                // write pointer in the circular buffer
+    float pos1, pos2;        // read pointers for left and right channel
+
+    mda::SmoothedValue wet, dry;  // this pair's copies of the output levels
+};
 
 class MDADetuneAudioProcessor : public juce::AudioProcessor
 {
@@ -42,20 +55,28 @@ private:
 
     void update();
     void resetState();
+    void processPair(MDADetuneState &state, const float *in1, const float *in2,
+                     float *out1, float *out2, int numSamples);
 
     static constexpr int BUFMAX = 4096;
 
-    float buf[BUFMAX];  // circular buffer for delay line (mono)
     float win[BUFMAX];  // crossfade window
 
     float sampleRate;
     int buflen;         // delay length
 
-    int pos0;           // write pointer in the circular buffer
-    float pos1, dpos1;  // read pointer and step size for left channel
-    float pos2, dpos2;  // and for right channel
+    float dpos1;        // read pointer step size for left channel
+    float dpos2;        // and for right channel
+
+    mda::SmoothedValue wet, dry;  // output levels, smoothed
+
+    // How the channels are split into stereo pairs, and the state of the
+    // effect for each pair.
+    std::vector<mda::ChannelPair> channelPairs;
+    std::vector<MDADetuneState> pairs;
 
-    float wet, dry;     // output levels
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher parameters;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDADetuneAudioProcessor)
 };
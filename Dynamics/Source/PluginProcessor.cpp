@@ -1,10 +1,14 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDADynamicsAudioProcessor::MDADynamicsAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    detection = mda::DETECTION_LINKED;
+
+    mda::watchAllParameters(parameters, apvts);
 }
 
 MDADynamicsAudioProcessor::~MDADynamicsAudioProcessor()
@@ -41,6 +45,12 @@ void MDADynamicsAudioProcessor::changeProgramName(int index, const juce::String
 
 void MDADynamicsAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    // Every channel gets its own detector, in case Detection is not Linked.
+    const int numChannels = std::max(getTotalNumInputChannels(), 1);
+    sidechains.resize(size_t(numChannels));
+    levels.resize(size_t(numChannels * CHUNK_SIZE));
+    gains.resize(size_t(numChannels * CHUNK_SIZE));
+
     resetState();
 }
 
@@ -55,14 +65,22 @@ void MDADynamicsAudioProcessor::reset()
 
 bool MDADynamicsAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDADynamicsAudioProcessor::resetState()
 {
-    env = 0.0f;
-    limiterEnv = 0.0f;
-    gateEnv = 0.0f;
+    for (auto &sidechain : sidechains) {
+        sidechain.env = 0.0f;
+        sidechain.limiterEnv = 0.0f;
+        sidechain.gateEnv = 0.0f;
+    }
+
+    // Recalculate the parameters at the start of the next block.
+    parameters.invalidate();
 }
 
 void MDADynamicsAudioProcessor::update()
@@ -136,6 +154,18 @@ void MDADynamicsAudioProcessor::update()
     float param10 = apvts.getRawParameterValue("Mix")->load() * 0.01f;
     dry = 1.0f - param10;
     trim *= param10;
+
+    // Detection mode. The envelopes start over when this changes, since the
+    // detectors now look at different signals.
+    int param11 = int(apvts.getRawParameterValue("Detection")->load());
+    if (param11 != detection) {
+        detection = param11;
+        for (auto &sidechain : sidechains) {
+            sidechain.env = 0.0f;
+            sidechain.limiterEnv = 0.0f;
+            sidechain.gateEnv = 0.0f;
+        }
+    }
 }
 
 void MDADynamicsAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
@@ -149,72 +179,128 @@ void MDADynamicsAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (parameters.changed()) {
+        update();
+    }
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    const int numChannels = std::min(buffer.getNumChannels(), int(sidechains.size()));
+    const int numSamples = buffer.getNumSamples();
+    const bool linked = (detection == mda::DETECTION_LINKED);
 
-    if (compressOnly) {
-        for (int s = 0; s < buffer.getNumSamples(); ++s) {
-            float a = in1[s];
-            float b = in2[s];
+    // In Mid/Side mode, the detectors and the gains work on mid and side
+    // instead of on left and right.
+    const bool midSide = (detection == mda::DETECTION_MID_SIDE && numChannels >= 2);
+    if (midSide) {
+        mda::encodeMidSide(buffer.getWritePointer(0), buffer.getWritePointer(1), numSamples);
+    }
 
-            // Rectify the level so it's always a positive value.
-            float i = (a < 0.0f) ? -a : a;
-            float j = (b < 0.0f) ? -b : b;
+    // First compute the gains for a chunk of samples, then apply them to the
+    // channels. Unlike the envelopes, which depend on the previous sample,
+    // applying the gains can be done with SIMD instructions.
+    for (int start = 0; start < numSamples; start += CHUNK_SIZE) {
+        const int n = std::min(CHUNK_SIZE, numSamples - start);
 
-            // Get peak level. There is only one envelope follower that works
-            // on both channels, using whichever channel is loudest.
-            i = (j > i) ? j : i;
+        computeGains(buffer, numChannels, start, n);
 
-            // Simple envelope follower.
-            env = (i > env) ? env + attack * (i - env) : env * release;
+        for (int c = 0; c < numChannels; ++c) {
+            const float *g = &gains[size_t((linked ? 0 : c) * CHUNK_SIZE)];
+            mda::applyGain(buffer.getWritePointer(c, start), g, n);
+        }
+    }
 
-            // Calculate the gain. If the envelope level is over the threshold,
-            // the ratio kicks in to reduce the gain. `trim` is makeup gain.
-            float g = (env > threshold) ? trim / (1.0f + ratio * (env/threshold - 1.0f)) : trim;
+    if (midSide) {
+        mda::decodeMidSide(buffer.getWritePointer(0), buffer.getWritePointer(1), numSamples);
+    }
+}
 
-            // Apply the same gain to both channels and mix in the dry signal.
-            out1[s] = a * (g + dry);
-            out2[s] = b * (g + dry);
+void MDADynamicsAudioProcessor::computeGains(const juce::AudioBuffer<float> &buffer, int numChannels, int start, int numSamples)
+{
+    const bool linked = (detection == mda::DETECTION_LINKED);
+    const int numSidechains = mda::numSidechains(detection, numChannels);
+
+    // Rectify the level so it's always a positive value. In Linked mode,
+    // there is only one envelope follower that works on all channels, using
+    // whichever channel is loudest.
+    if (linked) {
+        float *peaks = levels.data();
+        const float *in = buffer.getReadPointer(0, start);
+        for (int s = 0; s < numSamples; ++s) {
+            peaks[s] = std::abs(in[s]);
+        }
+        for (int c = 1; c < numChannels; ++c) {
+            in = buffer.getReadPointer(c, start);
+            for (int s = 0; s < numSamples; ++s) {
+                float j = std::abs(in[s]);
+                peaks[s] = (j > peaks[s]) ? j : peaks[s];
+            }
         }
     } else {
-        for (int s = 0; s < buffer.getNumSamples(); ++s) {
-            float a = in1[s];
-            float b = in2[s];
-
-            // Calculate the compressor's gain (same code as above).
-            float i = (a < 0.0f) ? -a : a;
-            float j = (b < 0.0f) ? -b : b;
-            i = (j > i) ? j : i;
-            env = (i > env) ? env + attack * (i - env) : env * release;
-            float g = (env > threshold) ? trim / (1.0f + ratio * (env/threshold - 1.0f)) : trim;
-
-            // Limiter envelope, this has no attack and uses the same
-            // release time as the compressor.
-            limiterEnv = (i > env) ? i : limiterEnv * release;
-
-            // Limit the gain. This applies the limiter envelope to the
-            // gain from the compressor.
-            if (g < 0.0f) {
-                g = 0.0f;
+        for (int c = 0; c < numChannels; ++c) {
+            float *peaks = &levels[size_t(c * CHUNK_SIZE)];
+            const float *in = buffer.getReadPointer(c, start);
+            for (int s = 0; s < numSamples; ++s) {
+                peaks[s] = std::abs(in[s]);
             }
-            if (g * limiterEnv > limiterThreshold) {
-                g = limiterThreshold / limiterEnv;
+        }
+    }
+
+    for (int k = 0; k < numSidechains; ++k) {
+        const float *peaks = &levels[size_t(k * CHUNK_SIZE)];
+        float *out = &gains[size_t(k * CHUNK_SIZE)];
+
+        float env = sidechains[size_t(k)].env;
+        float limiterEnv = sidechains[size_t(k)].limiterEnv;
+        float gateEnv = sidechains[size_t(k)].gateEnv;
+
+        if (compressOnly) {
+            for (int s = 0; s < numSamples; ++s) {
+                float i = peaks[s];
+
+                // Simple envelope follower.
+                env = (i > env) ? env + attack * (i - env) : env * release;
+
+                // Calculate the gain. If the envelope level is over the threshold,
+                // the ratio kicks in to reduce the gain. `trim` is makeup gain.
+                float g = (env > threshold) ? trim / (1.0f + ratio * (env/threshold - 1.0f)) : trim;
+
+                // The gain for the channels, with the dry signal mixed in.
+                out[s] = g + dry;
             }
+        } else {
+            for (int s = 0; s < numSamples; ++s) {
+                float i = peaks[s];
+
+                // Calculate the compressor's gain (same code as above).
+                env = (i > env) ? env + attack * (i - env) : env * release;
+                float g = (env > threshold) ? trim / (1.0f + ratio * (env/threshold - 1.0f)) : trim;
+
+                // Limiter envelope, this has no attack and uses the same
+                // release time as the compressor.
+                limiterEnv = (i > env) ? i : limiterEnv * release;
+
+                // Limit the gain. This applies the limiter envelope to the
+                // gain from the compressor.
+                if (g < 0.0f) {
+                    g = 0.0f;
+                }
+                if (g * limiterEnv > limiterThreshold) {
+                    g = limiterThreshold / limiterEnv;
+                }
 
-            // Gate. When the current envelope level exceeds the threshold,
-            // the gate envelope increases towards 1.0 using the attack rate.
-            // When the current envelope level falls below the threshold,
-            // the gate envelope decays towards 0.0 using the release rate.
-            gateEnv = (env > gateThreshold) ? gateEnv + gateAttack * (1.0f - gateEnv) : gateEnv * gateRelease;
+                // Gate. When the current envelope level exceeds the threshold,
+                // the gate envelope increases towards 1.0 using the attack rate.
+                // When the current envelope level falls below the threshold,
+                // the gate envelope decays towards 0.0 using the release rate.
+                gateEnv = (env > gateThreshold) ? gateEnv + gateAttack * (1.0f - gateEnv) : gateEnv * gateRelease;
 
-            // Apply the gated gain from the compressor and limiter.
-            out1[s] = a * (g * gateEnv + dry);
-            out2[s] = b * (g * gateEnv + dry);
+                // The gated gain from the compressor and limiter.
+                out[s] = g * gateEnv + dry;
+            }
         }
+
+        sidechains[size_t(k)].env = env;
+        sidechains[size_t(k)].limiterEnv = limiterEnv;
+        sidechains[size_t(k)].gateEnv = gateEnv;
     }
 }
 
@@ -387,6 +473,13 @@ juce::AudioProcessorValueTreeState::ParameterLayout MDADynamicsAudioProcessor::c
         100.0f,
         juce::AudioParameterFloatAttributes().withLabel("%")));
 
+    // Not part of the original plug-in.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("Detection", 1),
+        "Detection",
+        juce::StringArray({ "Linked", "Unlinked", "Mid/Side" }),
+        mda::DETECTION_LINKED));
+
     return layout;
 }
 
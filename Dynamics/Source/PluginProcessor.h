@@ -1,6 +1,20 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAParameters.h"
+#include "MDASidechain.h"
+
+// The plug-in works on chunks of at most this many samples.
+const int CHUNK_SIZE = 64;
+
+// The envelopes for one detector. In Linked mode there is one detector for
+// all channels, otherwise there is one per channel.
+struct MDADynamicsSidechain
+{
+    float env;               // current envelope level
+    float limiterEnv;        // envelope used by the limiter
+    float gateEnv;           // envelope used by the gate
+};
 
 class MDADynamicsAudioProcessor : public juce::AudioProcessor
 {
@@ -42,6 +56,7 @@ private:
 
     void update();
     void resetState();
+    void computeGains(const juce::AudioBuffer<float> &buffer, int numChannels, int start, int numSamples);
 
     float threshold;         // threshold for compressor
     float ratio;             // ratio for compressor
@@ -55,9 +70,18 @@ private:
     float dry;               // dry/wet mix amount
     bool compressOnly;       // if false, also apply limiter & gate
 
-    float env;               // current envelope level
-    float limiterEnv;        // envelope used by the limiter
-    float gateEnv;           // envelope used by the gate
+    int detection;           // linked, unlinked, or mid/side
+
+    // The detectors, one for each channel. Linked mode only uses the first.
+    std::vector<MDADynamicsSidechain> sidechains;
+
+    // Scratch buffers for one chunk, with CHUNK_SIZE levels and gains for
+    // every detector, one after the other.
+    std::vector<float> levels;
+    std::vector<float> gains;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher parameters;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDADynamicsAudioProcessor)
 };
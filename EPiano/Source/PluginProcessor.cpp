@@ -1,5 +1,9 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
+
+#if !MDA_EXTERNAL_SAMPLES
 #include "mdaEPianoData.h"
+#endif
 
 MDAEPianoProgram::MDAEPianoProgram(const char *name,
                                    float p0, float p1, float p2, float p3,
@@ -12,6 +16,24 @@ MDAEPianoProgram::MDAEPianoProgram(const char *name,
     param[8] = p8; param[9] = p9; param[10] = p10; param[11] = p11;
 }
 
+#if !MDA_EXTERNAL_SAMPLES
+// For more seamless looping, it can be a good idea to make the end and start
+// of the loop cross-fade into each other. This changes the waveforms in the
+// lookup table, so it must be done only once, no matter how many instances of
+// the plug-in there are. (When loading the waveforms from a sample file, the
+// cross-fade was already done when the file was made.)
+static const short *crossfadedSamples()
+{
+    static std::once_flag once;
+    std::call_once(once, [] {
+        for (int k = 0; k < 28; ++k) {
+            mda::crossfadeLoop(epianoData, epianoKeygroups[k]);
+        }
+    });
+    return epianoData;
+}
+#endif
+
 MDAEPianoAudioProcessor::MDAEPianoAudioProcessor()
     : AudioProcessor(BusesProperties().withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
@@ -22,74 +44,37 @@ MDAEPianoAudioProcessor::MDAEPianoAudioProcessor()
     createPrograms();
     setCurrentProgram(0);
 
-    _waves = epianoData;
-
-    // Fill it with zeros, just to make sure it's empty.
-    memset(_keygroups, 0, sizeof(_keygroups));
-
-    // Waveform data and keymapping
-    _keygroups[ 0].root = 36; _keygroups[ 0].high = 39;  // C1
-    _keygroups[ 3].root = 43; _keygroups[ 3].high = 45;  // G1
-    _keygroups[ 6].root = 48; _keygroups[ 6].high = 51;  // C2
-    _keygroups[ 9].root = 55; _keygroups[ 9].high = 57;  // G2
-    _keygroups[12].root = 60; _keygroups[12].high = 63;  // C3
-    _keygroups[15].root = 67; _keygroups[15].high = 69;  // G3
-    _keygroups[18].root = 72; _keygroups[18].high = 75;  // C4
-    _keygroups[21].root = 79; _keygroups[21].high = 81;  // G4
-    _keygroups[24].root = 84; _keygroups[24].high = 87;  // C5
-    _keygroups[27].root = 91; _keygroups[27].high = 93;  // G5
-    _keygroups[30].root = 96; _keygroups[30].high = 999; // C6
-
-    _keygroups[ 0].pos = 0;      _keygroups[ 0].end = 8476;   _keygroups[ 0].loop = 4400;
-    _keygroups[ 1].pos = 8477;   _keygroups[ 1].end = 16248;  _keygroups[ 1].loop = 4903;
-    _keygroups[ 2].pos = 16249;  _keygroups[ 2].end = 34565;  _keygroups[ 2].loop = 6398;
-    _keygroups[ 3].pos = 34566;  _keygroups[ 3].end = 41384;  _keygroups[ 3].loop = 3938;
-    _keygroups[ 4].pos = 41385;  _keygroups[ 4].end = 45760;  _keygroups[ 4].loop = 1633;  // was 1636
-    _keygroups[ 5].pos = 45761;  _keygroups[ 5].end = 65211;  _keygroups[ 5].loop = 5245;
-    _keygroups[ 6].pos = 65212;  _keygroups[ 6].end = 72897;  _keygroups[ 6].loop = 2937;
-    _keygroups[ 7].pos = 72898;  _keygroups[ 7].end = 78626;  _keygroups[ 7].loop = 2203;  // was 2204
-    _keygroups[ 8].pos = 78627;  _keygroups[ 8].end = 100387; _keygroups[ 8].loop = 6368;
-    _keygroups[ 9].pos = 100388; _keygroups[ 9].end = 116297; _keygroups[ 9].loop = 10452;
-    _keygroups[10].pos = 116298; _keygroups[10].end = 127661; _keygroups[10].loop = 5217;  // was 5220
-    _keygroups[11].pos = 127662; _keygroups[11].end = 144113; _keygroups[11].loop = 3099;
-    _keygroups[12].pos = 144114; _keygroups[12].end = 152863; _keygroups[12].loop = 4284;
-    _keygroups[13].pos = 152864; _keygroups[13].end = 173107; _keygroups[13].loop = 3916;
-    _keygroups[14].pos = 173108; _keygroups[14].end = 192734; _keygroups[14].loop = 2937;
-    _keygroups[15].pos = 192735; _keygroups[15].end = 204598; _keygroups[15].loop = 4732;
-    _keygroups[16].pos = 204599; _keygroups[16].end = 218995; _keygroups[16].loop = 4733;
-    _keygroups[17].pos = 218996; _keygroups[17].end = 233801; _keygroups[17].loop = 2285;
-    _keygroups[18].pos = 233802; _keygroups[18].end = 248011; _keygroups[18].loop = 4098;
-    _keygroups[19].pos = 248012; _keygroups[19].end = 265287; _keygroups[19].loop = 4099;
-    _keygroups[20].pos = 265288; _keygroups[20].end = 282255; _keygroups[20].loop = 3609;
-    _keygroups[21].pos = 282256; _keygroups[21].end = 293776; _keygroups[21].loop = 2446;
-    _keygroups[22].pos = 293777; _keygroups[22].end = 312566; _keygroups[22].loop = 6278;
-    _keygroups[23].pos = 312567; _keygroups[23].end = 330200; _keygroups[23].loop = 2283;
-    _keygroups[24].pos = 330201; _keygroups[24].end = 348889; _keygroups[24].loop = 2689;
-    _keygroups[25].pos = 348890; _keygroups[25].end = 365675; _keygroups[25].loop = 4370;
-    _keygroups[26].pos = 365676; _keygroups[26].end = 383661; _keygroups[26].loop = 5225;
-    _keygroups[27].pos = 383662; _keygroups[27].end = 393372; _keygroups[27].loop = 2811;
-    _keygroups[28].pos = 383662; _keygroups[28].end = 393372; _keygroups[28].loop = 2811;  // ghost
-    _keygroups[29].pos = 393373; _keygroups[29].end = 406045; _keygroups[29].loop = 4522;
-    _keygroups[30].pos = 406046; _keygroups[30].end = 414486; _keygroups[30].loop = 2306;
-    _keygroups[31].pos = 406046; _keygroups[31].end = 414486; _keygroups[31].loop = 2306;  // ghost
-    _keygroups[32].pos = 414487; _keygroups[32].end = 422408; _keygroups[32].loop = 2169;
-
-    // For more seamless looping, it can be a good idea to make the end and start
-    // of the loop cross-fade into each other. This code changes the waveforms in
-    // the lookup table.
-    for (int k = 0; k < 28; ++k) {
-        int p0 = _keygroups[k].end;
-        int p1 = _keygroups[k].end - _keygroups[k].loop;
-
-        float xf = 1.0f;
-        float dxf = -0.02f;
-        while (xf > 0.0f) {
-            _waves[p0] = short((1.0f - xf) * float(_waves[p0]) + xf * float(_waves[p1]));
-            p0--;
-            p1--;
-            xf += dxf;
-        }
+#if MDA_EXTERNAL_SAMPLES
+    // Load the waveforms from a sample file. This looks next to the plug-in's
+    // binary. The file is memory-mapped, so all instances of the plug-in share
+    // the same copy of the data.
+    auto folder = juce::File::getSpecialLocation(juce::File::currentExecutableFile).getParentDirectory();
+    _sampleStore = mda::SampleStore::find("mdaEPiano.samples", folder.getFullPathName().toStdString());
+#else
+    _sampleStore = mda::SampleStore::fromMemory(crossfadedSamples(), int(std::size(epianoData)), epianoKeygroups, 33);
+#endif
+
+    // Copy the keygroups, so that noteOn() does not need to go through the
+    // sample store to find them.
+    _waves = nullptr;
+    if (_sampleStore != nullptr && _sampleStore->numKeygroups() == 33) {
+        _waves = _sampleStore->samples();
+        std::memcpy(_keygroups, _sampleStore->keygroups(), sizeof(_keygroups));
+    } else {
+        DBG("Could not load mdaEPiano.samples");
+        std::memset(_keygroups, 0, sizeof(_keygroups));
     }
+
+    // Start out with the original waveforms.
+    _upsampledFactor = 1;
+    _waveFactor = 1;
+    _waveRate = RECORDED_RATE;
+
+    // Make the table for the sinc interpolation now, rather than on the audio
+    // thread when it is first used.
+    mda::SincTable::instance();
+
+    mda::watchAllParameters(_parameters, apvts);
 }
 
 MDAEPianoAudioProcessor::~MDAEPianoAudioProcessor()
@@ -131,7 +116,16 @@ void MDAEPianoAudioProcessor::setCurrentProgram(int index)
     };
 
     for (int i = 0; i < NPARAMS; ++i) {
-        apvts.getParameter(paramNames[i])->setValueNotifyingHost(_programs[index].param[i]);
+        auto *param = apvts.getParameter(paramNames[i]);
+        float value = _programs[index].param[i];
+
+        // The presets were made when Polyphony went from 1 to 32 voices, but
+        // now it goes up to NVOICES. Convert the preset's value to the new range
+        // so that it still gives the same number of voices.
+        if (i == 8) {
+            value = param->convertTo0to1(1.0f + 31.0f * value);
+        }
+        param->setValueNotifyingHost(value);
     }
 }
 
@@ -150,6 +144,29 @@ void MDAEPianoAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlo
     _sampleRate = sampleRate;
     _inverseSampleRate = 1.0f / _sampleRate;
 
+    // Waveform Rate: if this option is on, get the waveforms upsampled for
+    // this sample rate. Making them takes a moment, so this is done here and
+    // not on the audio thread. Instances that run at the same sample rate
+    // share the upsampled waveforms.
+    _upsampledFactor = mda::SampleStore::upsamplingFactor(RECORDED_RATE, sampleRate);
+    if (apvts.getRawParameterValue("Waveform Rate")->load() > 0.5f && _upsampledFactor > 1) {
+        _upsampledStore = mda::SampleStore::upsampled(_sampleStore, _upsampledFactor);
+    } else {
+        _upsampledStore = nullptr;
+    }
+
+    // The previous upsampled waveforms may be gone now, so always select the
+    // waveforms again.
+    _waves = nullptr;
+    selectWaveforms();
+
+    // Stolen voices fade out by 60 dB in 5 ms. That is quick enough to not
+    // get in the way of the new note, and slow enough to not click.
+    _ghostDecay = std::exp(-6.9f / (0.005f * _sampleRate));
+
+    // Preallocate room for the MIDI events.
+    _events.reserve(mda::EventQueue::DEFAULT_CAPACITY);
+
     resetState();
 }
 
@@ -194,9 +211,14 @@ void MDAEPianoAudioProcessor::resetState()
         _voices[v].decay = 0.99f;   // very quick fade out
     }
     _numActiveVoices = 0;
+    _numGhosts = 0;
 
     // Clear out any pending MIDI events.
-    _notes[0] = EVENTS_DONE;
+    _events.clear();
+
+    // Also clear the scratch buffers. Unused slots in the last group of voices
+    // still get processed, and this makes sure they never contain garbage.
+    std::memset(_voiceBuffers, 0, sizeof(_voiceBuffers));
 
     // These variables are changed by MIDI CC, reset to defaults.
     _volume = 0.2f;
@@ -208,6 +230,9 @@ void MDAEPianoAudioProcessor::resetState()
     // Reset the LFOs.
     _lfo0 = 0.0f;
     _lfo1 = 1.0f;
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
 }
 
 void MDAEPianoAudioProcessor::update()
@@ -258,6 +283,27 @@ void MDAEPianoAudioProcessor::update()
     float param5 = apvts.getRawParameterValue("LFO Rate")->load();
     _lfoRate = 6.283f * _inverseSampleRate * std::exp(6.22f * param5 - 2.61f);
 
+    // One step of the LFO (see applyEffects) does this:
+    //     lfo0 = lfo0 + rate*lfo1
+    //     lfo1 = lfo1 - rate*lfo0
+    // That is a multiplication by a 2x2 matrix. Doing k steps is the same as
+    // multiplying by that matrix k times, so work out those products now.
+    // This is done in double precision, so that the LFO's amplitude doesn't
+    // creep up or down over time.
+    double m00 = 1.0, m01 = 0.0, m10 = 0.0, m11 = 1.0;
+    for (int k = 0; k < RENDER_CHUNK; ++k) {
+        m00 += double(_lfoRate) * m10;
+        m01 += double(_lfoRate) * m11;
+        m10 -= double(_lfoRate) * m00;
+        m11 -= double(_lfoRate) * m01;
+        _lfoMatrix[k][0] = m00;
+        _lfoMatrix[k][1] = m01;
+        _lfoMatrix[k][2] = m10;
+        _lfoMatrix[k][3] = m11;
+        _lfoFrom0[k] = float(m10);
+        _lfoFrom1[k] = float(m11);
+    }
+
     // Velocity Sensitivity: The UI shows 0% to 100%. Convert this into a value
     // between 0.25 and 3.0. There are actually two curves: 0% to 25% is a steep
     // line from 0.25 to 1.5; 25% to 100% is a slightly less steep line that goes
@@ -270,9 +316,15 @@ void MDAEPianoAudioProcessor::update()
     float param7 = apvts.getRawParameterValue("Stereo Width")->load() / 200.0f;
     _width = 0.03f * param7;
 
-    // Polyphony is an integer number between 1 and 32.
+    // Polyphony is an integer number between 1 and NVOICES (128).
     _polyphony = int(apvts.getRawParameterValue("Polyphony")->load());
 
+    // CPU Budget: The UI shows -90 dB (off) to -30 dB. Convert to a linear
+    // envelope level. At the lowest setting this is 0, so no voice is quiet
+    // enough and the plug-in behaves like the original.
+    float budget = apvts.getRawParameterValue("CPU Budget")->load();
+    _stealThreshold = (budget <= -90.0f) ? 0.0f : std::pow(10.0f, budget / 20.0f);
+
     // Fine Tuning: The UI shows -50 to +50 cents. Convert this into -0.5 to
     // +0.5, which turns it from cents into semitones.
     _fine = apvts.getRawParameterValue("Fine Tuning")->load() / 100.0f;
@@ -285,104 +337,146 @@ void MDAEPianoAudioProcessor::update()
     // Overdrive: The UI shows 0% to 100%. Convert this into 0 - 1.8.
     float param11 = apvts.getRawParameterValue("Overdrive")->load() / 100.0f;
     _overdrive = 1.8f * param11;
+
+    _interpolation = int(apvts.getRawParameterValue("Interpolation")->load());
+
+    // Waveform Rate: switch between the original and the upsampled waveforms.
+    selectWaveforms();
+}
+
+void MDAEPianoAudioProcessor::selectWaveforms()
+{
+    // If the samples could not be loaded, there is nothing to choose from.
+    if (_sampleStore == nullptr || _sampleStore->numKeygroups() != 33) { return; }
+
+    // The upsampled waveforms are only available if the option was already on
+    // in prepareToPlay(). Turning it on while playing keeps the original
+    // waveforms until the host prepares the plug-in again.
+    bool upsampled = apvts.getRawParameterValue("Waveform Rate")->load() > 0.5f && _upsampledStore != nullptr;
+    const auto &store = upsampled ? _upsampledStore : _sampleStore;
+    if (store->samples() == _waves) { return; }
+
+    // The voices that are playing have read positions into the other table,
+    // so they are stopped.
+    for (int v = 0; v < NVOICES; ++v) {
+        _voices[v].env = 0.0f;
+    }
+    _numActiveVoices = 0;
+    _numGhosts = 0;
+
+    _waves = store->samples();
+    std::memcpy(_keygroups, store->keygroups(), sizeof(_keygroups));
+    _waveFactor = upsampled ? _upsampledFactor : 1;
+    _waveRate = RECORDED_RATE * float(_waveFactor);
 }
 
 void MDAEPianoAudioProcessor::processEvents(juce::MidiBuffer &midiMessages)
 {
     // There are different ways a synth can handle MIDI events. This plug-in does
-    // it by copying the events it cares about -- note on and note off -- into an
-    // array. In the render loop, we step through this array to process the events
-    // one-by-one. Controllers such as the sustain pedal are processed right away,
-    // at the start of the block, so these are not sample accurate.
-
-    int npos = 0;
-    for (const auto metadata : midiMessages) {
-        if (metadata.numBytes != 3) continue;
-
-        const auto data0 = metadata.data[0];
-        const auto data1 = metadata.data[1];
-        const auto data2 = metadata.data[2];
-        const int deltaFrames = metadata.samplePosition;
-
-        switch (data0 & 0xf0) {  // status byte (all channels)
-            // Note off
-            case 0x80:
-                _notes[npos++] = deltaFrames;   // time offset
-                _notes[npos++] = data1 & 0x7F;  // note
-                _notes[npos++] = 0;             // vel
-                break;
-
-            // Note on
-            case 0x90:
-                _notes[npos++] = deltaFrames;   // time offset
-                _notes[npos++] = data1 & 0x7F;  // note
-                _notes[npos++] = data2 & 0x7F;  // vel
-                break;
-
-            // Controller
-            case 0xB0:
-                switch (data1) {
-                    case 0x01: { // mod wheel
-                        // Convert the mod wheel position to a value between 0 and 1.
-                        float modwhl = 0.0078f * float(data2);
-
-                        // Override autopan/tremolo depth if the mod wheel is
-                        // used. This overwrites the "Modulation" parameter.
-                        // (It would be better if the mod wheel value was
-                        // stored in its own member variable, and then we add
-                        // that amount to the Modulation parameter amount.)
-                        if (modwhl > 0.05f) {
-                            _rmod = _lmod = modwhl;
-                            if (_modulation < 0.5f) _rmod = -_rmod;  // for panning mode
-                        }
-                        break;
-                    }
+    // it by copying the events into a queue. In the render loop, we step through
+    // this queue and handle each event at the exact sample it belongs to. That
+    // includes controllers such as the sustain pedal and the mod wheel.
+    //
+    // The queue has a fixed size, so that it never allocates on the audio
+    // thread. If the host sends more events than fit, the render loop calls
+    // fillEvents() again once the queue is empty, to get the next batch.
+    _midiIterator = midiMessages.cbegin();
+    _midiEnd = midiMessages.cend();
+    fillEvents();
+}
 
-                    case 0x07:  // volume
-                        // Map the position of the volume control to a
-                        // parabolic curve starting at 0.0 (position 0)
-                        // up to 0.323 (position 127).
-                        _volume = 0.00002f * float(data2 * data2);
-                        break;
-
-                    case 0x40:  // sustain pedal
-                    case 0x42:  // sustenuto pedal
-                        // Make the variable 64 when the pedal is pressed
-                        // and 0 when released.
-                        _sustain = data2 & 0x40;
-
-                        // Pedal released? Then end all sustained notes.
-                        if (_sustain == 0) {
-                            _notes[npos++] = deltaFrames;
-                            _notes[npos++] = SUSTAIN;
-                            _notes[npos++] = 0;
-                        }
-                        break;
-
-                    default:  // all notes off
-                        if (data1 > 0x7A) {
-                            // Setting the decay to 0.99 will fade out
-                            // the voice very quickly.
-                            for (int v = 0; v < NVOICES; ++v) _voices[v].decay = 0.99f;
-                            _sustain = 0;
-                        }
-                        break;
-                }
-                break;
+void MDAEPianoAudioProcessor::fillEvents()
+{
+    _events.clear();
 
-            // Program change
-            case 0xC0:
-                if (data1 < NPROGS) setCurrentProgram(data1);
-                break;
+    while (_midiIterator != _midiEnd) {
+        const auto metadata = *_midiIterator;
 
-            default: break;
+        // Program change and channel aftertouch have only one data byte.
+        // Anything longer than three bytes is SysEx, which is ignored.
+        if (metadata.numBytes >= 2 && metadata.numBytes <= 3) {
+            const auto data2 = metadata.numBytes == 3 ? metadata.data[2] : juce::uint8(0);
+            if (!_events.add(metadata.samplePosition, metadata.data[0], metadata.data[1], data2)) {
+                break;  // the queue is full, continue from this event later
+            }
         }
+        ++_midiIterator;
+    }
+}
+
+void MDAEPianoAudioProcessor::handleEvent(const mda::MidiEvent &event)
+{
+    const auto data0 = event.status;
+    const auto data1 = event.data1;
+    const auto data2 = event.data2;
+
+    switch (data0 & 0xf0) {  // status byte (all channels)
+        // Note off
+        case 0x80:
+            noteOn(data1 & 0x7F, 0);
+            break;
+
+        // Note on
+        case 0x90:
+            noteOn(data1 & 0x7F, data2 & 0x7F);
+            break;
+
+        // Controller
+        case 0xB0:
+            switch (data1) {
+                case 0x01: { // mod wheel
+                    // Convert the mod wheel position to a value between 0 and 1.
+                    float modwhl = 0.0078f * float(data2);
+
+                    // Override autopan/tremolo depth if the mod wheel is
+                    // used. This overwrites the "Modulation" parameter.
+                    // (It would be better if the mod wheel value was
+                    // stored in its own member variable, and then we add
+                    // that amount to the Modulation parameter amount.)
+                    if (modwhl > 0.05f) {
+                        _rmod = _lmod = modwhl;
+                        if (_modulation < 0.5f) _rmod = -_rmod;  // for panning mode
+                    }
+                    break;
+                }
+
+                case 0x07:  // volume
+                    // Map the position of the volume control to a
+                    // parabolic curve starting at 0.0 (position 0)
+                    // up to 0.323 (position 127).
+                    _volume = 0.00002f * float(data2 * data2);
+                    break;
+
+                case 0x40:  // sustain pedal
+                case 0x42:  // sustenuto pedal
+                    // Make the variable 64 when the pedal is pressed
+                    // and 0 when released.
+                    _sustain = data2 & 0x40;
+
+                    // Pedal released? Then end all sustained notes.
+                    if (_sustain == 0) {
+                        noteOn(SUSTAIN, 0);
+                    }
+                    break;
+
+                default:  // all notes off
+                    if (data1 > 0x7A) {
+                        // Setting the decay to 0.99 will fade out
+                        // the voice very quickly.
+                        for (int v = 0; v < NVOICES; ++v) _voices[v].decay = 0.99f;
+                        _sustain = 0;
+                    }
+                    break;
+            }
+            break;
+
+        // Program change
+        case 0xC0:
+            if (data1 < NPROGS) setCurrentProgram(data1);
+            break;
 
-        // Discard events if buffer full!
-        if (npos > EVENTBUFFER) npos -= 3;
+        default: break;
     }
-    _notes[npos] = EVENTS_DONE;
-    midiMessages.clear();
 }
 
 void MDAEPianoAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
@@ -396,26 +490,29 @@ void MDAEPianoAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juc
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (_parameters.changed()) {
+        update();
+    }
 
     processEvents(midiMessages);
 
+    // The voices may have changed since the last chunk was rendered: silent
+    // voices were removed at the end of the previous block, or the polyphony
+    // may have changed.
+    rebuildVoiceTree();
+
     const int sampleFrames = buffer.getNumSamples();
-    const float overdrive = _overdrive;
 
     float *out0 = buffer.getWritePointer(0);
     float *out1 = buffer.getWritePointer(1);
 
-    int event = 0;
     int frame = 0;  // how many samples are already rendered
 
     while (frame < sampleFrames) {
-        // Get the timestamp of the next note on/off event. This is usually in the
-        // future, i.e. a number of samples after the current sample.
-        int frames = _notes[event++];
-
-        // This catches the EVENTS_DONE special event. There are no events left.
-        if (frames > sampleFrames) frames = sampleFrames;
+        // Get the timestamp of the next MIDI event. This is usually in the
+        // future, i.e. a number of samples after the current sample. If there
+        // are no more events, render until the end of the block.
+        int frames = _events.nextEventTime(sampleFrames);
 
         // The timestamp for the event is relative to the start of the block.
         // Make it relative to the previous event; this tells us how many samples
@@ -427,168 +524,366 @@ void MDAEPianoAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juc
         frame += frames;
 
         // Until it's time to process the upcoming event, render the active voices.
-        while (--frames >= 0) {
-            Voice *V = _voices;
-
-            // Accumulators for the left and right channel. We will add the outputs
-            // of all the active voices to these.
-            float l = 0.0f, r = 0.0f;
-
-            for (int v = 0; v < _numActiveVoices; ++v) {
-                // Increment the read position in the waveform. The read position is
-                // split into `pos`, which is the integer part, and `frac`, which is
-                // the fractional part. To read the next sample value, we move the read
-                // position ahead by the step size `delta`, a fixed-point number, where
-                // the lowest 16 bits are the fractional part.
-                V->frac += V->delta;
-
-                // If the fractional part of the read position is now more than 1.0,
-                // or more than 65535, increment the integer part of the read position.
-                V->pos += V->frac >> 16;
-
-                // Remove the integer amount from `frac` (if any), since that just got
-                // added to `pos`. This is the same as doing `frac modulo 65536`.
-                V->frac &= 0xFFFF;
-
-                // If the read position has reached the end of the sample, wrap it
-                // around to where the loop begins. The attack portion of the sample is
-                // played just once, and from then on we just keep looping this region.
-                if (V->pos > V->end) V->pos -= V->loop;
+        while (frames > 0) {
+            const int chunk = std::min(frames, RENDER_CHUNK);
+            renderVoices(chunk);
+            applyEffects(out0, out1, chunk);
+            out0 += chunk;
+            out1 += chunk;
+            frames -= chunk;
+        }
 
-                // Integer-based linear interpolation. Together, `pos` and `frac` will
-                // point to a value in between two samples (unless frac is 0).
-                // Suppose pos = 3 and frac = 0.6 (or really 65536 * 0.6 = 39321). Then
-                // the interpolated sample should be 40% of the sample at index 3 and
-                // 60% of the sample at index 4. That's exactly what the formula below
-                // calculates: it takes the sample value at index 3, plus 0.6 times the
-                // sample at index 4, minus 0.6 times the sample at index 3. The >> 16
-                // is used to divide the result by 65536 because of how frac is stored.
-                int i = _waves[V->pos] + ((V->frac * (_waves[V->pos + 1] - _waves[V->pos])) >> 16);
+        // Reset the LFO phase for tremolo when the voices have stopped playing.
+        // The original plug-in had a comment here that said "reset LFO phase -
+        // good idea?", so maybe it isn't. ;-)
+        if (_events.hasEventAt(frame) && _numActiveVoices == 0 && _modulation > 0.5f) {
+            _lfo0 = -0.7071f;
+            _lfo1 = 0.7071f;
+        }
+
+        // It's time to handle the event, or events if there are several with
+        // the same timestamp. This starts or stops notes, but also handles the
+        // controllers, such as the sustain pedal and the mod wheel.
+        while (_events.hasEventAt(frame)) {
+            handleEvent(_events.next());
+            if (_events.empty()) {
+                fillEvents();
+            }
+        }
+    }
+
+    // Handle floating point underflow.
+    if (std::fabs(_filtL) < 1.0e-10f) _filtL = 0.0f;
+    if (std::fabs(_filtR) < 1.0e-10f) _filtR = 0.0f;
+
+    // Remove the ghost voices that have faded out.
+    int g = 0;
+    while (g < _numGhosts) {
+        if (_ghosts[g].env < SILENCE) {
+            _ghosts[g] = _ghosts[--_numGhosts];
+        } else {
+            ++g;
+        }
+    }
+
+    // Turn off voices whose envelope has dropped below the minimum level. In
+    // CPU budget mode, that level can be higher, and those voices can still
+    // be heard, so they fade out as ghosts.
+    const float silence = std::max(SILENCE, _stealThreshold);
+    for (int v = 0; v < _numActiveVoices; ++v) {
+        if (_voices[v].env < silence) {
+            fadeOutVoice(v);
+            _voices[v] = _voices[--_numActiveVoices];
+        }
+    }
 
+    // All the events have been handled, so they're not passed on to the host.
+    midiMessages.clear();
+}
+
+void MDAEPianoAudioProcessor::applyEffects(float *outL, float *outR, int numFrames)
+{
+    /*
+      The effects that work on the mix of all the voices: the treble boost and
+      the LFO modulation. The original plug-in did these in the same loop as
+      the voices, one sample at a time. Here they are separate passes over the
+      whole chunk, so they can be measured and optimized on their own.
+     */
+    const float filtCoef = _filtCoef;
+    const float trebleGain = _trebleGain;
+    float filtL = _filtL;
+    float filtR = _filtR;
+
+    for (int i = 0; i < numFrames; ++i) {
+        float l = _mixL[i];
+        float r = _mixR[i];
+
+        // Treble boost. This happens in 2 steps: First there is a basic low-pass
+        // filter with the difference equation y(n) = f*x(n) + (1 - f)*y(n - 1).
+        // The left and right channels have their own instance of this filter.
+        filtL += filtCoef * (l - filtL);
+        filtR += filtCoef * (r - filtR);
+
+        // Next, we subtract the low-pass filtered signal from the original signal,
+        // which leaves only the high / treble frequencies. Then, depending on
+        // whether the Treble Boost setting is + or -, we add or subtract these
+        // high frequencies using the "treble gain" factor. This creates a shelf:
+        // by subtracting the high freqs, we remove the high end (obviously).
+        // But when we add the high frequencies, the high end gets boosted.
+        outL[i] = l + trebleGain * (l - filtL);
+        outR[i] = r + trebleGain * (r - filtR);
+    }
+
+    _filtL = filtL;
+    _filtR = filtR;
+
+    // The original plug-in makes a sine wave in _lfo0 and a cosine wave in
+    // _lfo1, with amplitudes between -1 and +1, by doing this for every sample:
+    //
+    //     _lfo0 += _lfoRate * _lfo1;
+    //     _lfo1 -= _lfoRate * _lfo0;
+    //
+    // You might be wondering how, since we're not calling sin or cos anywhere?
+    // Plot it in a Python notebook and see for yourself. Note that this
+    // approximation only works on low frequencies, so it's only suitable for
+    // LFOs. Every step depends on the previous one, but update() has worked
+    // out what k steps in a row do, so every sample of the chunk can be
+    // computed directly from the LFO's current value. This is the same LFO,
+    // just with slightly different rounding.
+    const float lfo0 = _lfo0;
+    const float lfo1 = _lfo1;
+    const float lmod = _lmod;
+    const float rmod = _rmod;
+
+    // Apply the modulation to the left and right channels. Note that the
+    // modulation is applied to the mix of all voices -- in more advanced
+    // synths, each individual voice can have its own LFO.
+    // If this is tremolo, then we change the amplitude of both channels by
+    // the same amount. If it is panning modulation (autopanning), when the
+    // left channel amplitude goes up, the right channel amplitude goes down,
+    // and vice versa. There are no dependencies between the samples, so this
+    // loop becomes SIMD instructions.
+    for (int i = 0; i < numFrames; ++i) {
+        const float lfo = _lfoFrom0[i] * lfo0 + _lfoFrom1[i] * lfo1;
+        outL[i] += outL[i] * lmod * lfo;
+        outR[i] += outR[i] * rmod * lfo;
+    }
+
+    // Move the LFO ahead to the end of the chunk.
+    const double *m = _lfoMatrix[numFrames - 1];
+    _lfo0 = float(m[0] * double(lfo0) + m[1] * double(lfo1));
+    _lfo1 = float(m[2] * double(lfo0) + m[3] * double(lfo1));
+}
+
+void MDAEPianoAudioProcessor::renderVoices(int numFrames)
+{
+    /*
+      The original plug-in renders one sample at a time: for every sample, it
+      loops through all the active voices, and for every voice it reads the
+      waveform, applies the envelope and the overdrive, and adds the result to
+      the mix. Here, the voices render a whole chunk of samples in three steps,
+      each of which is a simple loop that the compiler can turn into SIMD
+      instructions:
+
+      1. Every voice reads its waveform for the whole chunk into its own buffer.
+
+      2. One sample at a time, the envelope and the overdrive are applied to
+         all voices. The envelope is a chain of multiplies, so it can't be
+         vectorized across samples, but it can be vectorized across voices.
+
+      3. Every voice is added into the mix for the whole chunk.
+
+      The voices are still added into the mix in the same order as before, and
+      all the math is the same, so the output is exactly the same as rendering
+      sample-by-sample.
+     */
+    // The voices to render: the active voices, followed by the ghosts of the
+    // voices that were stolen and are fading out.
+    const int numVoices = _numActiveVoices + _numGhosts;
+    MDAEPianoVoice *voices[NVOICES + NGHOSTS];
+    for (int v = 0; v < _numActiveVoices; ++v) {
+        voices[v] = &_voices[v];
+    }
+    for (int g = 0; g < _numGhosts; ++g) {
+        voices[_numActiveVoices + g] = &_ghosts[g];
+    }
+    const float overdrive = _overdrive;
+
+    // === Step 1: Read the waveforms ===
+
+    for (int v = 0; v < numVoices; ++v) {
+        MDAEPianoVoice &V = *voices[v];
+
+        // Step through the waveform. The read position is split into `pos`,
+        // which is the integer part, and `frac`, which is the fractional part.
+        // For every sample, the read position moves ahead by the step size
+        // `delta`, a fixed-point number where the lowest 16 bits are the
+        // fractional part. If the read position reaches the end of the sample,
+        // it wraps around to where the loop begins. The attack portion of the
+        // sample is played just once, and from then on we keep looping this
+        // region. This gives the read positions for every sample in the chunk.
+        mda::advanceReadPosition(V.pos, V.frac, V.delta, V.end, V.loop, _readPos, _readFrac, numFrames);
+
+        readVoice(V, _voiceBuffers[v], numFrames);
+    }
+
+    // === Step 2: Envelope and overdrive ===
+
+    // Copy the envelopes into arrays, so the loop over the voices can load
+    // them straight into SIMD registers.
+    float env[NVOICES + NGHOSTS], decay[NVOICES + NGHOSTS];
+    for (int v = 0; v < numVoices; ++v) {
+        env[v] = voices[v]->env;
+        decay[v] = voices[v]->decay;
+    }
+
+    // The voices go in groups of VOICE_GROUP. Because that number is fixed,
+    // the compiler turns the loop over the voices into a handful of SIMD
+    // instructions. The group at the end may be partly empty; those slots get
+    // an envelope of zero and their results are never used.
+    const int numSlots = (numVoices + VOICE_GROUP - 1) / VOICE_GROUP * VOICE_GROUP;
+    for (int v = numVoices; v < numSlots; ++v) {
+        env[v] = 0.0f;
+        decay[v] = 0.0f;
+    }
+
+    for (int g = 0; g < numSlots; g += VOICE_GROUP) {
+        for (int i = 0; i < numFrames; ++i) {
+            for (int v = g; v < g + VOICE_GROUP; ++v) {
                 // Apply the envelope and scale. The original sample data is 16-bit but
                 // we're working with floats here so divide by 32768 as well.
-                float x = V->env * float(i) / 32768.0f;
+                const float x = env[v] * _voiceBuffers[v][i] / 32768.0f;
 
                 // Update the envelope. Multiplying by a decay value that is less than
                 // 1.0 gives this an exponentially decaying curve.
-                V->env = V->env * V->decay;
+                env[v] *= decay[v];
 
                 // Simple distortion effect. For samples that are positive, subtract
                 // the square of that sample times the overdrive factor, which can be
                 // larger than 1. This "flattens" the top of the waveform. The louder
-                // you play, the more extreme the distortion is.
-                if (x > 0.0f) {
-                    x -= overdrive * x * x;
-                    if (x < -V->env) x = -V->env;   // but not too extreme!
-                }
+                // you play, the more extreme the distortion is. But not too extreme:
+                // it doesn't go below minus the envelope level. Both choices are
+                // computed and one is picked, so there are no branches.
+                float y = x - overdrive * x * x;
+                y = (y < -env[v]) ? -env[v] : y;
+                _voiceBuffers[v][i] = (x > 0.0f) ? y : x;
+            }
+        }
+    }
 
-                // Apply panning. The amount of panning was computed in noteOn().
-                l += V->outl * x;
-                r += V->outr * x;
+    for (int v = 0; v < numVoices; ++v) {
+        voices[v]->env = env[v];
+    }
 
-                // Ear protection: just in case the sound explodes, turn it off. Silly
-                // bugs (such as filter cutoff > Nyquist) can blow out your eardrums...
-                if ((l < -2.0f) || (l > 2.0f)) {
-                    l = 0.0f;
-                }
-                if ((r < -2.0f) || (r > 2.0f)) {
-                    r = 0.0f;
-                }
+    // The levels of all the voices have changed.
+    rebuildVoiceTree();
 
-                // Go to the next active voice.
-                V++;
-            }
+    // === Step 3: Mix ===
 
-            // Treble boost. This happens in 2 steps: First there is a basic low-pass
-            // filter with the difference equation y(n) = f*x(n) + (1 - f)*y(n - 1).
-            // The left and right channels have their own instance of this filter.
-            _filtL += _filtCoef * (l - _filtL);
-            _filtR += _filtCoef * (r - _filtR);
-
-            // Next, we subtract the low-pass filtered signal from the original signal,
-            // which leaves only the high / treble frequencies. Then, depending on
-            // whether the Treble Boost setting is + or -, we add or subtract these
-            // high frequencies using the "treble gain" factor. This creates a shelf:
-            // by subtracting the high freqs, we remove the high end (obviously).
-            // But when we add the high frequencies, the high end gets boosted.
-            l += _trebleGain * (l - _filtL);
-            r += _trebleGain * (r - _filtR);
-
-            // This formula creates a sine wave in _lfo0 and a cosine wave in _lfo1,
-            // with amplitudes between -1 and +1. You might be wondering how, since
-            // we're not calling sin or cos anywhere? Plot it in a Python notebook
-            // and see for yourself. Note that this approximation only works on low
-            // frequencies, so it's only suitable for LFOs.
-            _lfo0 += _lfoRate * _lfo1;
-            _lfo1 -= _lfoRate * _lfo0;
-
-            // Apply the modulation to the left and right channels. Note that the
-            // modulation is applied to the mix of all voices -- in more advanced
-            // synths, each individual voice can have its own LFO.
-            // If this is tremolo, then we change the amplitude of both channels by
-            // the same amount. If it is panning modulation (autopanning), when the
-            // left channel amplitude goes up, the right channel amplitude goes down,
-            // and vice versa.
-            l += l * _lmod * _lfo1;
-            r += r * _rmod * _lfo1;
-
-            // Write the result into the output buffer.
-            *out0++ = l;
-            *out1++ = r;
-        }
+    for (int i = 0; i < numFrames; ++i) {
+        _mixL[i] = 0.0f;
+        _mixR[i] = 0.0f;
+    }
 
-        // It's time to handle the event. This starts the new note, or stops the
-        // note if velocity is 0.
-        if (frame < sampleFrames) {
+    for (int v = 0; v < numVoices; ++v) {
+        const float *y = _voiceBuffers[v];
+        const float outl = voices[v]->outl;
+        const float outr = voices[v]->outr;
 
-            // Reset the LFO phase for tremolo when the voices have stopped playing.
-            // The original plug-in had a comment here that said "reset LFO phase -
-            // good idea?", so maybe it isn't. ;-)
-            if (_numActiveVoices == 0 && _modulation > 0.5f) {
-                _lfo0 = -0.7071f;
-                _lfo1 = 0.7071f;
-            }
+        for (int i = 0; i < numFrames; ++i) {
+            // Apply panning. The amount of panning was computed in noteOn().
+            const float l = _mixL[i] + outl * y[i];
+            const float r = _mixR[i] + outr * y[i];
 
-            int note = _notes[event++];
-            int vel  = _notes[event++];
-            noteOn(note, vel);
+            // Ear protection: just in case the sound explodes, turn it off. Silly
+            // bugs (such as filter cutoff > Nyquist) can blow out your eardrums...
+            _mixL[i] = ((l < -2.0f) || (l > 2.0f)) ? 0.0f : l;
+            _mixR[i] = ((r < -2.0f) || (r > 2.0f)) ? 0.0f : r;
         }
     }
+}
 
-    // Handle floating point underflow.
-    if (std::fabs(_filtL) < 1.0e-10f) _filtL = 0.0f;
-    if (std::fabs(_filtR) < 1.0e-10f) _filtR = 0.0f;
+void MDAEPianoAudioProcessor::rebuildVoiceTree()
+{
+    // Only the first _polyphony voices can be stolen. There can be more voices
+    // playing than that if the Polyphony setting was just lowered.
+    const int numVoices = std::min(_numActiveVoices, _polyphony);
+    for (int v = 0; v < numVoices; ++v) {
+        _voiceTree.setLevel(v, _voices[v].env);
+    }
+    _voiceTree.rebuild(numVoices);
+}
 
-    // Turn off voices whose envelope has dropped below the minimum level.
-    for (int v = 0; v < _numActiveVoices; ++v) {
-        if (_voices[v].env < SILENCE) {
-            _voices[v] = _voices[--_numActiveVoices];
+void MDAEPianoAudioProcessor::fadeOutVoice(int v)
+{
+    // The original plug-in simply overwrites a stolen voice, so its sound stops
+    // in the middle of a waveform, which clicks. Instead, move the voice into
+    // the pool of ghost voices. There it carries on where it was, but with an
+    // envelope that fades out in a few milliseconds.
+    const float env = _voices[v].env;
+    if (env < SILENCE) { return; }
+
+    // If all ghosts are busy, replace the quietest one. But if the voice that
+    // is being stolen is quieter still, cutting that one off is the lesser
+    // click.
+    int g = _numGhosts;
+    if (g == NGHOSTS) {
+        g = 0;
+        for (int i = 1; i < NGHOSTS; ++i) {
+            if (_ghosts[i].env < _ghosts[g].env) { g = i; }
         }
+        if (env < _ghosts[g].env) { return; }
+    } else {
+        _numGhosts++;
     }
 
-    // Mark the events buffer as done.
-    _notes[0] = EVENTS_DONE;
+    _ghosts[g] = _voices[v];
+    _ghosts[g].decay = std::min(_voices[v].decay, _ghostDecay);
+}
+
+void MDAEPianoAudioProcessor::readVoice(const MDAEPianoVoice &V, float *wave, int numFrames)
+{
+    // Reads the waveform at the positions from _readPos and _readFrac. Each
+    // interpolation method has its own loop, so that the choice is made once
+    // per chunk instead of once per sample.
+    switch (_interpolation) {
+        case 0:
+            for (int i = 0; i < numFrames; ++i) {
+                const int pos = _readPos[i];
+                const int frac = _readFrac[i];
+
+                // Integer-based linear interpolation. Together, `pos` and `frac` will
+                // point to a value in between two samples (unless frac is 0).
+                // Suppose pos = 3 and frac = 0.6 (or really 65536 * 0.6 = 39321). Then
+                // the interpolated sample should be 40% of the sample at index 3 and
+                // 60% of the sample at index 4. That's exactly what the formula below
+                // calculates: it takes the sample value at index 3, plus 0.6 times the
+                // sample at index 4, minus 0.6 times the sample at index 3. The >> 16
+                // is used to divide the result by 65536 because of how frac is stored.
+                int s = _waves[pos] + ((frac * (_waves[pos + 1] - _waves[pos])) >> 16);
+                wave[i] = float(s);
+            }
+            break;
+
+        case 1:
+            for (int i = 0; i < numFrames; ++i) {
+                wave[i] = mda::interpolateCubic(_waves, _readPos[i], _readFrac[i], V.start, V.end, V.loop);
+            }
+            break;
+
+        default: {
+            const mda::SincTable &table = mda::SincTable::instance();
+            for (int i = 0; i < numFrames; ++i) {
+                wave[i] = mda::interpolateSinc(table, _waves, _readPos[i], _readFrac[i], V.start, V.end, V.loop);
+            }
+            break;
+        }
+    }
 }
 
 void MDAEPianoAudioProcessor::noteOn(int note, int velocity)
 {
+    // Without waveforms there is nothing to play.
+    if (_waves == nullptr) { return; }
+
     if (velocity > 0) {
         // === Find voice ===
 
-        // If max polyphony is not reached yet, use a free voice.
+        // In CPU budget mode, a voice that has become too quiet to matter is
+        // reused first, so that fewer voices are playing at any time.
         int vl = 0;
-        if (_numActiveVoices < _polyphony) {
+        if (_voiceTree.quietestLevel() < _stealThreshold) {
+            vl = _voiceTree.quietest();
+            fadeOutVoice(vl);
+        } else if (_numActiveVoices < _polyphony) {
+            // If max polyphony is not reached yet, use a free voice.
             vl = _numActiveVoices;
             _numActiveVoices++;
         } else {
-            // Otherwise, find the quietest voice to steal.
-            float l = 99.0f;
-            for (int v = 0; v < _polyphony; ++v) {
-                if (_voices[v].env < l) {
-                    l = _voices[v].env;
-                    vl = v;
-                }
-            }
+            // Otherwise, steal the quietest voice. The original plug-in looked
+            // at every voice to find it; the voice tree already knows.
+            vl = _voiceTree.quietest();
+            fadeOutVoice(vl);
         }
 
         // === Calculate pitch ===
@@ -639,7 +934,9 @@ void MDAEPianoAudioProcessor::noteOn(int note, int velocity)
         // where "semitones" is the amount of pitch shifting. Here, the reference
         // "frequency" is 32000/sampleRate for the root note. To get the step size,
         // multiply by exp(0.05776226 * semitones) which is the same as 2^(semis/12).
-        l = 32000.0f * _inverseSampleRate * std::exp(0.05776226505f * l);
+        // With the Waveform Rate option, the waveforms have been upsampled and
+        // _waveRate is a multiple of 32000 Hz.
+        l = _waveRate * _inverseSampleRate * std::exp(0.05776226505f * l);
 
         // Instead of storing the step size as a float, this plug-in stores it as a
         // fixed point number, so it's multiplied by 65536 (shifted by 16 bits).
@@ -655,8 +952,11 @@ void MDAEPianoAudioProcessor::noteOn(int note, int velocity)
         // Copy the other keygroup info into this voice.
         _voices[vl].frac = 0;
         _voices[vl].pos = _keygroups[kg].pos;
-        _voices[vl].end = _keygroups[kg].end - 1;
+        // The voice loops one original sample before the keygroup's end. With
+        // upsampled waveforms, that is _waveFactor new samples.
+        _voices[vl].end = _keygroups[kg].end - _waveFactor;
         _voices[vl].loop = _keygroups[kg].loop;
+        _voices[vl].start = _keygroups[kg].pos;
         _voices[vl].note = note;
 
         // === Calculate panning based on the note number ===
@@ -704,11 +1004,15 @@ void MDAEPianoAudioProcessor::noteOn(int note, int velocity)
         // change, to say 0.999929, makes a big difference in the decay time!
         if (note < 44) note = 44;  // limit max decay length
         _voices[vl].decay = std::exp(-_inverseSampleRate * std::exp(-1.0f + 0.03f*float(note) - 2.0f*_envDecay));
+
+        // Let the voice tree know about the new voice's level, in case another
+        // note at the same time needs to steal a voice.
+        _voiceTree.update(vl, _voices[vl].env);
     }
 
     // Note off
     else {
-        for (int v = 0; v < NVOICES; ++v) {
+        for (int v = 0; v < _numActiveVoices; ++v) {
             // Any voices playing this note?
             if (_voices[v].note == note) {
                 // If the sustain pedal is not pressed...
@@ -822,7 +1126,7 @@ juce::AudioProcessorValueTreeState::ParameterLayout MDAEPianoAudioProcessor::cre
     layout.add(std::make_unique<juce::AudioParameterFloat>(
         juce::ParameterID("Polyphony", 1),
         "Polyphony",
-        juce::NormalisableRange<float>(1.0f, 32.0f, 1.0f),
+        juce::NormalisableRange<float>(1.0f, float(NVOICES), 1.0f),
         16.0f,
         juce::AudioParameterFloatAttributes().withLabel("voices")));
 
@@ -857,6 +1161,34 @@ juce::AudioProcessorValueTreeState::ParameterLayout MDAEPianoAudioProcessor::cre
         0.0f,
         juce::AudioParameterFloatAttributes().withLabel("%")));
 
+    // Not part of the original plug-in and not stored in the factory presets.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("Interpolation", 1),
+        "Interpolation",
+        juce::StringArray { "Linear", "Cubic", "Sinc" },
+        0));
+
+    // Not part of the original plug-in and not stored in the factory presets.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("Waveform Rate", 1),
+        "Waveform Rate",
+        juce::StringArray { "Original", "Upsampled" },
+        0));
+
+    // Not part of the original plug-in and not stored in the factory presets.
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        juce::ParameterID("CPU Budget", 1),
+        "CPU Budget",
+        juce::NormalisableRange<float>(-90.0f, -30.0f, 1.0f),
+        -90.0f,
+        juce::AudioParameterFloatAttributes()
+            .withLabel("dB")
+            .withStringFromValueFunction(
+                [](float value, int) {
+                    return (value <= -90.0f) ? juce::String("Off") : juce::String(int(value));
+                }
+            )));
+
     return layout;
 }
 
@@ -1,10 +1,25 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAEventQueue.h"
+#include "MDAInterpolation.h"
+#include "MDAParameters.h"
+#include "MDASampleStore.h"
+#include "MDAVoiceTree.h"
 
 const int NPARAMS = 12;       // number of parameters
 const int NPROGS = 8;        // number of programs
-const int NVOICES = 32;       // max polyphony
+const int NVOICES = 128;      // max polyphony
+const int NGHOSTS = 8;        // stolen voices that are still fading out
+
+// The voices are rendered in chunks of at most this many samples.
+const int RENDER_CHUNK = 64;
+
+// The envelopes are computed for this many voices at once, which fills up
+// one or two SIMD registers. NVOICES must be a multiple of this.
+const int VOICE_GROUP = 8;
+static_assert(NVOICES % VOICE_GROUP == 0, "NVOICES must be a multiple of VOICE_GROUP");
+static_assert(NGHOSTS % VOICE_GROUP == 0, "NGHOSTS must be a multiple of VOICE_GROUP");
 
 const float SILENCE = 0.0001f;  // voice choking
 
@@ -19,22 +34,8 @@ struct MDAEPianoProgram
     float param[NPARAMS];
 };
 
-// A keygroup maps notes to waveforms. All the waveforms are stored inside one
-// big lookup table (see mdaEPianoData.h). There are 15 keygroups, each covering
-// 4 semitones. That's 60 notes in total. A piano has 88 keys so very low notes
-// all share the same waveform; likewise for very high notes. The waveforms are
-// mono, 22050 Hz, and consist of an attack portion and a loop portion.
-struct Keygroup
-{
-    int root;  // MIDI root note (usually the note in the middle of the keygroup)
-    int high;  // highest note this waveform should be used for
-    int pos;   // index of the first sample in the lookup table
-    int end;   // index of the last sample in the lookup table
-    int loop;  // how far from end the first sample of the loop is
-};
-
 // State for an active voice.
-struct Voice
+struct MDAEPianoVoice
 {
     // What note triggered this voice, or SUSTAIN when the key is released
     // but the sustain pedal is held down.
@@ -57,6 +58,10 @@ struct Voice
     int end;
     int loop;
 
+    // The first sample of the waveform. Only needed by the interpolation
+    // methods that look at samples before the read position.
+    int start;
+
     // The current envelope level and the exponential decay value that the
     // envelope is multiplied with on every step. Setting the decay to 0.99
     // will fade out the sound almost immediately (used for all notes off).
@@ -111,7 +116,15 @@ private:
 
     void createPrograms();
     void processEvents(juce::MidiBuffer &midiMessages);
+    void fillEvents();
+    void handleEvent(const mda::MidiEvent &event);
     void noteOn(int note, int velocity);
+    void renderVoices(int numFrames);
+    void applyEffects(float *outL, float *outR, int numFrames);
+    void readVoice(const MDAEPianoVoice &voice, float *wave, int numFrames);
+    void rebuildVoiceTree();
+    void fadeOutVoice(int v);
+    void selectWaveforms();
 
     // The factory presets.
     std::vector<MDAEPianoProgram> _programs;
@@ -122,31 +135,62 @@ private:
     // The current sample rate and 1 / sample rate.
     float _sampleRate, _inverseSampleRate;
 
-    // MIDI note on / note off events for the current block. Each event is
-    // described by 3 values: delta time, note number, velocity.
-    static const int EVENTBUFFER = 120;
-    int _notes[EVENTBUFFER + 8];
+    // The MIDI events for the current block, in timestamp order.
+    mda::EventQueue _events;
 
-    // Special event code that marks the end of the MIDI events list.
-    const int EVENTS_DONE = 99999999;
+    // The host's MIDI events that haven't been copied into the queue yet.
+    juce::MidiBufferIterator _midiIterator, _midiEnd;
 
     // Special "note number" that says this voice is now kept alive by the
     // sustain pedal being pressed down. As soon as the pedal is released,
     // this voice will fade out.
     const int SUSTAIN = 128;
 
-    // Big lookup table with waveforms containing the piano samples.
-    short *_waves;
+    // The sample rate the waveforms were recorded at.
+    const float RECORDED_RATE = 32000.0f;
+
+    // Owns the waveform data and the keygroups. All instances of the plug-in
+    // share the same store.
+    std::shared_ptr<const mda::SampleStore> _sampleStore;
+
+    // Big lookup table with waveforms containing the piano samples. This points
+    // into the sample store. It is nullptr if the samples could not be loaded,
+    // in which case the plug-in stays silent.
+    const short *_waves;
 
-    // Maps the waveforms from the _waves lookup table to ranges of notes.
-    Keygroup _keygroups[33] = { 0 };
+    // Maps the waveforms from the _waves lookup table to ranges of notes. There
+    // are 11 ranges of notes, and each range has three keygroups: one for soft,
+    // one for medium, and one for hard velocities. The waveforms are mono and
+    // consist of an attack portion and a loop portion.
+    mda::Keygroup _keygroups[33] = {};
+
+    // The waveforms at a higher sample rate, for the Waveform Rate option.
+    // These are made by prepareToPlay() and are nullptr when not in use.
+    std::shared_ptr<const mda::SampleStore> _upsampledStore;
+    int _upsampledFactor;
+
+    // The sample rate of the waveforms that _waves points to, and how many
+    // times RECORDED_RATE that is.
+    float _waveRate;
+    int _waveFactor;
 
     // List of the active voices.
-    Voice _voices[NVOICES];
+    MDAEPianoVoice _voices[NVOICES];
 
     // How many voices are currently in use.
     int _numActiveVoices;
 
+    // When a voice is stolen for a new note, the sound it was making is not
+    // cut off, which would click, but moved here, where it fades out quickly.
+    // These "ghost" voices are rendered along with the active voices but they
+    // don't count towards the polyphony and don't respond to note-offs.
+    MDAEPianoVoice _ghosts[NGHOSTS];
+    int _numGhosts;
+
+    // Envelope decay for the ghost voices. This is fast enough to be gone in
+    // a few milliseconds.
+    float _ghostDecay;
+
     // Status of the damper pedal: 64 = pressed, 0 = released.
     int _sustain;
 
@@ -156,6 +200,13 @@ private:
     // Max number of voices of polyphony.
     int _polyphony;
 
+    // Finds the quietest voice when a voice needs to be stolen.
+    mda::QuietestVoiceTree _voiceTree { NVOICES };
+
+    // CPU budget mode: voices whose envelope level is below this are stopped
+    // early, and new notes take over such a voice first. 0 means off.
+    float _stealThreshold;
+
     // Envelope decay length (lower is shorter). Used when playing a new note.
     float _envDecay;
 
@@ -188,6 +239,14 @@ private:
     // cosine wave.
     float _lfo0, _lfo1;
 
+    // The LFO k + 1 samples from now, as a combination of _lfo0 and _lfo1.
+    // Row k holds the four entries of the LFO's step matrix to the power
+    // k + 1. The floats are for computing a chunk of LFO values at once, the
+    // doubles for moving the LFO ahead at the end of the chunk.
+    double _lfoMatrix[RENDER_CHUNK][4];
+    alignas(32) float _lfoFrom0[RENDER_CHUNK];
+    alignas(32) float _lfoFrom1[RENDER_CHUNK];
+
     // Used to set the envelope level for new notes. Value between 0.25 and 3.0.
     float _velocitySensitivity;
 
@@ -203,5 +262,21 @@ private:
     // Amount of overdrive.
     float _overdrive;
 
+    // How to read the waveforms in between samples: 0 = linear (the original),
+    // 1 = cubic, 2 = windowed sinc. See MDAInterpolation.h.
+    int _interpolation;
+
+    // Scratch buffers for renderVoices() and applyEffects(). The read positions are for one
+    // voice at a time. Every voice has its own buffer for its output, and the
+    // mix is for all of them together.
+    alignas(32) int _readPos[RENDER_CHUNK];
+    alignas(32) int _readFrac[RENDER_CHUNK];
+    alignas(32) float _voiceBuffers[NVOICES + NGHOSTS][RENDER_CHUNK];
+    alignas(32) float _mixL[RENDER_CHUNK];
+    alignas(32) float _mixR[RENDER_CHUNK];
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDAEPianoAudioProcessor)
 };
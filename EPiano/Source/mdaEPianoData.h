@@ -1,3 +1,45 @@
+#include "MDASampleStore.h"
+
+// Maps the waveforms in epianoData to ranges of notes. Every range of notes
+// has three waveforms, for soft, medium, and hard velocities. Only the first
+// keygroup of each range sets the root note and the highest note.
+const mda::Keygroup epianoKeygroups[33] = {
+//    root high  pos     end     loop
+    { 36,  39,      0,   8476,  4400 },  // C1
+    {  0,   0,   8477,  16248,  4903 },
+    {  0,   0,  16249,  34565,  6398 },
+    { 43,  45,  34566,  41384,  3938 },  // G1
+    {  0,   0,  41385,  45760,  1633 },  // was 1636
+    {  0,   0,  45761,  65211,  5245 },
+    { 48,  51,  65212,  72897,  2937 },  // C2
+    {  0,   0,  72898,  78626,  2203 },  // was 2204
+    {  0,   0,  78627, 100387,  6368 },
+    { 55,  57, 100388, 116297, 10452 },  // G2
+    {  0,   0, 116298, 127661,  5217 },  // was 5220
+    {  0,   0, 127662, 144113,  3099 },
+    { 60,  63, 144114, 152863,  4284 },  // C3
+    {  0,   0, 152864, 173107,  3916 },
+    {  0,   0, 173108, 192734,  2937 },
+    { 67,  69, 192735, 204598,  4732 },  // G3
+    {  0,   0, 204599, 218995,  4733 },
+    {  0,   0, 218996, 233801,  2285 },
+    { 72,  75, 233802, 248011,  4098 },  // C4
+    {  0,   0, 248012, 265287,  4099 },
+    {  0,   0, 265288, 282255,  3609 },
+    { 79,  81, 282256, 293776,  2446 },  // G4
+    {  0,   0, 293777, 312566,  6278 },
+    {  0,   0, 312567, 330200,  2283 },
+    { 84,  87, 330201, 348889,  2689 },  // C5
+    {  0,   0, 348890, 365675,  4370 },
+    {  0,   0, 365676, 383661,  5225 },
+    { 91,  93, 383662, 393372,  2811 },  // G5
+    {  0,   0, 383662, 393372,  2811 },  // ghost
+    {  0,   0, 393373, 406045,  4522 },
+    { 96, 999, 406046, 414486,  2306 },  // C6
+    {  0,   0, 406046, 414486,  2306 },  // ghost
+    {  0,   0, 414487, 422408,  2169 },
+};
+
 short epianoData[] = {
 -7,-23,-28,-16,-30,-17,-28,-16,-31,-15,-34,-12,-35,-6,-42,4,-58,44,-227,-1690,
 -1412,-1295,-1059,-908,-685,-518,-308,-152,31,182,368,531,731,948,1195,1439,1694,1950,2228,2487,
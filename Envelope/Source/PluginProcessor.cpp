@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDAEnvelopeAudioProcessor::MDAEnvelopeAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(parameters, apvts);
 }
 
 MDAEnvelopeAudioProcessor::~MDAEnvelopeAudioProcessor()
@@ -62,6 +64,9 @@ void MDAEnvelopeAudioProcessor::resetState()
 {
     env = 0.0f;
     releaseRate = 0.0f;
+
+    // Recalculate the parameters at the start of the next block.
+    parameters.invalidate();
 }
 
 void MDAEnvelopeAudioProcessor::update()
@@ -99,7 +104,9 @@ void MDAEnvelopeAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (parameters.changed()) {
+        update();
+    }
 
     const float *in1 = buffer.getReadPointer(0);
     const float *in2 = buffer.getReadPointer(1);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAParameters.h"
 
 class MDAEnvelopeAudioProcessor : public juce::AudioProcessor
 {
@@ -51,5 +52,8 @@ private:
     float env;          // current envelope level
     float releaseRate;  // release delta
 
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher parameters;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDAEnvelopeAudioProcessor)
 };
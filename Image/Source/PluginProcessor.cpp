@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDAImageAudioProcessor::MDAImageAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(parameters, apvts);
 }
 
 MDAImageAudioProcessor::~MDAImageAudioProcessor()
@@ -41,6 +43,13 @@ void MDAImageAudioProcessor::changeProgramName(int index, const juce::String &ne
 
 void MDAImageAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+
     resetState();
 }
 
@@ -55,7 +64,10 @@ void MDAImageAudioProcessor::reset()
 
 bool MDAImageAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDAImageAudioProcessor::resetState()
@@ -64,6 +76,9 @@ void MDAImageAudioProcessor::resetState()
     r2r = 1.0f;
     l2r = 0.0f;
     r2l = 0.0f;
+
+    // Recalculate the parameters at the start of the next block.
+    parameters.invalidate();
 }
 
 void MDAImageAudioProcessor::update()
@@ -142,14 +157,21 @@ void MDAImageAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (parameters.changed()) {
+        update();
+    }
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    mda::processChannelPairs(channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this](int, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            processPair(in1, in2, out1, out2, numSamples);
+        });
+}
 
-    for (int i = 0; i < buffer.getNumSamples(); ++i) {
+void MDAImageAudioProcessor::processPair(const float *in1, const float *in2,
+                                         float *out1, float *out2, int numSamples)
+{
+    for (int i = 0; i < numSamples; ++i) {
         float a = in1[i];
         float b = in2[i];
 
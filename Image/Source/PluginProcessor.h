@@ -1,6 +1,8 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAParameters.h"
 
 class MDAImageAudioProcessor : public juce::AudioProcessor
 {
@@ -42,8 +44,16 @@ private:
 
     void update();
     void resetState();
+    void processPair(const float *in1, const float *in2, float *out1, float *out2, int numSamples);
 
     float l2l, l2r, r2l, r2r;
 
+    // How the channels are split into stereo pairs. This plug-in has no state,
+    // so all pairs are processed the same way.
+    std::vector<mda::ChannelPair> channelPairs;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher parameters;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDAImageAudioProcessor)
 };
@@ -1,4 +1,61 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
+
+// Returns a bitmask with the lowest `n` bits set.
+static inline juce::uint64 voiceMask(int n)
+{
+    return (n >= 64) ? ~juce::uint64(0) : (juce::uint64(1) << n) - 1;
+}
+
+// Returns the index of the lowest bit that is set in `mask`, which must not be
+// zero. Isolating that bit and subtracting 1 leaves a mask of the bits below
+// it, so counting those gives the index without a loop.
+static inline int lowestSetBit(juce::uint64 mask)
+{
+    return juce::countNumberOfBits((mask & (~mask + 1)) - 1);
+}
+
+// The IDs of the parameters that are stored in the presets, in preset order.
+static const char *paramNames[NPARAMS] = {
+    "OSC Mix",
+    "OSC Tune",
+    "OSC Fine",
+    "Mode",
+    "Gld Rate",
+    "Gld Bend",
+    "VCF Freq",
+    "VCF Reso",
+    "VCF Env",
+    "VCF LFO",
+    "VCF Vel",
+    "VCF Att",
+    "VCF Dec",
+    "VCF Sus",
+    "VCF Rel",
+    "ENV Att",
+    "ENV Dec",
+    "ENV Sus",
+    "ENV Rel",
+    "LFO Rate",
+    "Vibrato",
+    "Noise",
+    "Octave",
+    "Tuning",
+};
+
+// The main output bus plays part 1, plus any part that doesn't have its own
+// output. The other buses are for parts 2 - 16 in multi-timbral mode. They are
+// disabled by default, so the host only sees them if the user asks for them.
+static juce::AudioProcessor::BusesProperties createBusesProperties()
+{
+    auto buses = juce::AudioProcessor::BusesProperties()
+        .withOutput("Output", juce::AudioChannelSet::stereo(), true);
+
+    for (int part = 1; part < NUM_PARTS; ++part) {
+        buses = buses.withOutput("Part " + juce::String(part + 1), juce::AudioChannelSet::stereo(), false);
+    }
+    return buses;
+}
 
 JX10Program::JX10Program()
 {
@@ -48,17 +105,42 @@ JX10Program::JX10Program(const char *name,
 }
 
 JX10AudioProcessor::JX10AudioProcessor()
-    : AudioProcessor(BusesProperties().withOutput("Output", juce::AudioChannelSet::stereo(), true))
+    : AudioProcessor(createBusesProperties())
 {
     _sampleRate = 44100.0f;
     _inverseSampleRate = 1.0f / _sampleRate;
 
+    _hostSampleRate = 44100.0;
+    _oversampling = 1;
+    _sawLeak = 0.997f;
+    _filterZipRate = 0.005f;
+
+    _polyphony = 0;
+    _polyphonyMask = 0;
+
+    _multiTimbral = false;
+    _numParts = 1;
+
+    // The other parts start out with the first preset. Their settings are
+    // calculated by update() once they are needed.
+    for (int part = 0; part < NUM_PARTS; ++part) {
+        _parts[part].program = 0;
+        _parts[part].activeProgram = -1;
+        _parts[part].output = 0;
+    }
+
     createPrograms();
     setCurrentProgram(0);
+
+    mda::watchAllParameters(_parameters, apvts);
+
+    apvts.addParameterListener("Oversampling", this);
 }
 
 JX10AudioProcessor::~JX10AudioProcessor()
 {
+    apvts.removeParameterListener("Oversampling", this);
+    cancelPendingUpdate();
 }
 
 const juce::String JX10AudioProcessor::getName() const
@@ -80,33 +162,6 @@ void JX10AudioProcessor::setCurrentProgram(int index)
 {
     _currentProgram = index;
 
-    const char *paramNames[] = {
-        "OSC Mix",
-        "OSC Tune",
-        "OSC Fine",
-        "Mode",
-        "Gld Rate",
-        "Gld Bend",
-        "VCF Freq",
-        "VCF Reso",
-        "VCF Env",
-        "VCF LFO",
-        "VCF Vel",
-        "VCF Att",
-        "VCF Dec",
-        "VCF Sus",
-        "VCF Rel",
-        "ENV Att",
-        "ENV Dec",
-        "ENV Sus",
-        "ENV Rel",
-        "LFO Rate",
-        "Vibrato",
-        "Noise",
-        "Octave",
-        "Tuning",
-    };
-
     for (int i = 0; i < NPARAMS; ++i) {
         apvts.getParameter(paramNames[i])->setValueNotifyingHost(_programs[index].param[i]);
     }
@@ -124,8 +179,24 @@ void JX10AudioProcessor::changeProgramName(int index, const juce::String &newNam
 
 void JX10AudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-    _sampleRate = sampleRate;
-    _inverseSampleRate = 1.0f / _sampleRate;
+    _hostSampleRate = sampleRate;
+    setOversampling(_oversampling);
+    reportLatency();
+
+    // Allocate the voice pool. This only does any work the first time.
+    _voices.resize(MAX_VOICES);
+    _lanes.resize((MAX_VOICES + LANES - 1) / LANES);
+
+    // Room for one chunk of every output at the highest oversampling factor.
+    _oversampled.resize(NUM_PARTS * OVERSAMPLE_CHUNK * 4);
+
+    // Preallocate room for the MIDI events.
+    _events.reserve(mda::EventQueue::DEFAULT_CAPACITY);
+
+    // The settings of the parts depend on the sample rate.
+    for (int part = 0; part < NUM_PARTS; ++part) {
+        _parts[part].activeProgram = -1;
+    }
 
     resetState();
 }
@@ -141,7 +212,18 @@ void JX10AudioProcessor::reset()
 
 bool JX10AudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo()) {
+        return false;
+    }
+
+    // The part outputs are either stereo or turned off.
+    for (int bus = 1; bus < int(layouts.outputBuses.size()); ++bus) {
+        const auto channelSet = layouts.getChannelSet(false, bus);
+        if (!channelSet.isDisabled() && channelSet != juce::AudioChannelSet::stereo()) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void JX10AudioProcessor::createPrograms()
@@ -204,7 +286,7 @@ void JX10AudioProcessor::createPrograms()
 void JX10AudioProcessor::resetState()
 {
     // Turn off all playing voices.
-    for (int v = 0; v < NVOICES; ++v) {
+    for (int v = 0; v < int(_voices.size()); ++v) {
         _voices[v].dp1   = 1.0f;
         _voices[v].dp2   = 1.0f;
         _voices[v].saw   = 0.0f;
@@ -221,41 +303,171 @@ void JX10AudioProcessor::resetState()
         _voices[v].f2    = 0.0f;
         _voices[v].ff    = 0.0f;
         _voices[v].note  = 0;
+        _voices[v].part  = 0;
     }
+    _freeVoices = voiceMask(MAX_VOICES);
     _numActiveVoices = 0;
+    _numLaneGroups = 0;
 
     // Clear out any pending MIDI events.
-    _notes[0] = EVENTS_DONE;
-
-    // These variables are changed by MIDI CC, reset to defaults.
-    _volume = 0.0005f;
-    _sustain = 0;
-    _modWheel = 0.0f;
-    _filterCtl = 0.0f;
-    _resonanceCtl = 1.0f;
-    _pressure = 0.0f;
-    _pitchBend = 1.0f;
-    _inversePitchBend = 1.0f;
-
-    // Reset other state.
-    _lfo = 0.0f;
+    _events.clear();
+
+    for (int part = 0; part < NUM_PARTS; ++part) {
+        JX10Part &P = _parts[part];
+
+        // These variables are changed by MIDI CC, reset to defaults.
+        P.volume = 0.0005f;
+        P.sustain = 0;
+        P.modWheel = 0.0f;
+        P.filterCtl = 0.0f;
+        P.resonanceCtl = 1.0f;
+        P.pressure = 0.0f;
+        P.pitchBend = 1.0f;
+        P.inversePitchBend = 1.0f;
+
+        // Reset other state.
+        P.lfo = 0.0f;
+        P.filterZip = 0.0f;
+        P.lastNote = 0;
+        P.monoVoice = 0;
+        P.numHeldNotes = 0;
+        for (int i = 0; i < MONO_QUEUE - 1; ++i) {
+            P.monoQueue[i] = 0;
+        }
+    }
+
     _lfoStep = 0;
-    _filterZip = 0.0f;
-    _lastNote = 0;
     _noiseSeed = 22222;
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
+}
+
+void JX10AudioProcessor::setOversampling(int factor)
+{
+    _oversampling = factor;
+    _sampleRate = float(_hostSampleRate * factor);
+    _inverseSampleRate = 1.0f / _sampleRate;
+
+    /*
+      Almost everything in this synth is derived from the sample rate, so it
+      automatically works at the higher rate. Only a few coefficients are
+      hardcoded. The leak of the saw integrator happens once per sample, so to
+      get the same cutoff at N times the rate, it must be the N-th root. The
+      de-zipper filter for the filter modulation runs every LFO_MAX samples,
+      which now happens N times as often, so it's made N times slower.
+
+      These are only changed when oversampling, so that the output is exactly
+      the same as before when oversampling is off.
+     */
+    if (factor > 1) {
+        _sawLeak = std::pow(0.997f, 1.0f / float(factor));
+        _filterZipRate = 0.005f / float(factor);
+    } else {
+        _sawLeak = 0.997f;
+        _filterZipRate = 0.005f;
+    }
+
+    // The decimation filters delay the sound a little. The host is told
+    // about this by reportLatency(), which runs on the message thread.
+    for (int n = 0; n < NUM_PARTS; ++n) {
+        _decimators[n].setFactor(factor);
+    }
+
+    // The settings of the parts depend on the sample rate.
+    for (int part = 0; part < NUM_PARTS; ++part) {
+        _parts[part].activeProgram = -1;
+    }
+}
+
+void JX10AudioProcessor::reportLatency()
+{
+    // This uses the parameter rather than _oversampling, as the audio thread
+    // may not have picked up the new factor yet.
+    int oversampling = 1 << int(apvts.getRawParameterValue("Oversampling")->load());
+    setLatencySamples(int(std::round(_decimators[0].getLatency(oversampling))));
 }
 
 void JX10AudioProcessor::update()
 {
+    // Changing the oversampling factor changes the sample rate that the voices
+    // are rendered at. Any playing notes would have the wrong pitch, so stop
+    // them. This must happen before the parts are updated.
+    int oversampling = 1 << int(apvts.getRawParameterValue("Oversampling")->load());
+    if (oversampling != _oversampling) {
+        setOversampling(oversampling);
+        for (int part = 0; part < NUM_PARTS; ++part) {
+            allNotesOff(part);
+        }
+    }
+
+    // Switch between the normal and the multi-timbral mode. The notes that are
+    // playing now may belong to a part that no longer exists, or that listens
+    // to a different MIDI channel, so stop them all.
+    bool multiTimbral = apvts.getRawParameterValue("MIDI Mode")->load() > 0.5f;
+    if (multiTimbral != _multiTimbral) {
+        _multiTimbral = multiTimbral;
+        _numParts = multiTimbral ? NUM_PARTS : 1;
+
+        for (int part = 0; part < NUM_PARTS; ++part) {
+            allNotesOff(part);
+        }
+    }
+
+    // Part 1 always uses the plug-in's parameters. Like the other plug-ins,
+    // it reads them at the start of every block.
+    float param[NPARAMS];
+    for (int i = 0; i < NPARAMS; ++i) {
+        param[i] = apvts.getRawParameterValue(paramNames[i])->load();
+    }
+    updatePart(_parts[0], param);
+
+    // The other parts play a factory preset. Their settings do not change
+    // unless a different preset is chosen, so they are only recalculated
+    // when needed. This is a lot cheaper than running 16 copies of the synth,
+    // which would each have to do all of this work on every block. A program
+    // loaded by setStateInformation() is also picked up here.
+    for (int part = 1; part < _numParts; ++part) {
+        JX10Part &P = _parts[part];
+        int program = P.program.load();
+        if (program != P.activeProgram) {
+            updatePart(P, _programs[program].param);
+            P.activeProgram = program;
+        }
+    }
+
+    // Maximum number of voices. If this is lowered while notes are playing,
+    // the voices above the new limit are released. This is done last because
+    // it needs the new release times.
+    int polyphony = int(apvts.getRawParameterValue("Polyphony")->load());
+    if (polyphony != _polyphony) {
+        _polyphony = polyphony;
+        _polyphonyMask = voiceMask(polyphony);
+
+        juce::uint64 mask = ~_freeVoices & ~_polyphonyMask & voiceMask(int(_voices.size()));
+        while (mask != 0) {
+            int v = lowestSetBit(mask);
+            mask &= mask - 1;
+            releaseVoice(v);
+        }
+    }
+}
+
+void JX10AudioProcessor::updatePart(JX10Part &P, const float *param)
+{
+    // Calculates the settings for one part from the 24 parameters of a preset.
+    // For part 1 these come from the plug-in's parameters; for the other parts
+    // from the preset they are playing.
+
     // Oscillator mix. Keep this as a value between 0 and 1.
-    _oscMix = apvts.getRawParameterValue("OSC Mix")->load();
+    P.oscMix = param[0];
 
     // Detune up or down by max 24 semitones, in steps of 1 semitone.
-    float param1 = apvts.getRawParameterValue("OSC Tune")->load();
+    float param1 = param[1];
     float semi = std::floor(48.0f * param1) - 24.0f;
 
     // Fine-tune by ±50 cents, in steps of 0.1 cent. This parameter is skewed.
-    float param2 = apvts.getRawParameterValue("OSC Fine")->load();
+    float param2 = param[2];
     float cent = 15.876f * param2 - 7.938f;
     cent = 0.1f * std::floor(cent * cent * cent);
 
@@ -271,11 +483,11 @@ void JX10AudioProcessor::update()
       detuning down is greater than 1, as lowering the pitch means the period
       becomes longer. And vice versa for going up in pitch.
      */
-    _detune = std::pow(1.059463094359f, -semi - 0.01f * cent);
+    P.detune = std::pow(1.059463094359f, -semi - 0.01f * cent);
 
     // Mono / poly / glide mode. This is an integer value from 0 to 7.
-    float param3 = apvts.getRawParameterValue("Mode")->load();
-    _mode = int(7.9f * param3);
+    float param3 = param[3];
+    P.mode = int(7.9f * param3);
 
     // Use a lower update rate for the glide and filter envelope, 32 times
     // (= LFO_MAX) slower than the sample rate.
@@ -284,19 +496,19 @@ void JX10AudioProcessor::update()
     // Just like the envelope, glide is implemented using a one-pole filter that
     // is updated every 32 samples. Here we set the filter coefficient. A smaller
     // coefficient means the glide takes longer.
-    float param4 = apvts.getRawParameterValue("Gld Rate")->load();
+    float param4 = param[4];
     if (param4 < 0.02f) {
-        _glideRate = 1.0f;  // no glide
+        P.glideRate = 1.0f;  // no glide
     } else {
-        _glideRate = 1.0f - std::exp(-inverseUpdateRate * std::exp(6.0f - 7.0f * param4));
+        P.glideRate = 1.0f - std::exp(-inverseUpdateRate * std::exp(6.0f - 7.0f * param4));
     }
 
     // Glide bend goes from -36 semitones to +36 semitones. The value is cubed
     // to skew the curve so that you can more easily choose small steps around
     // the center (e.g. steps of 0.01 semitones).
-    float param5 = apvts.getRawParameterValue("Gld Bend")->load();
-    _glideBend = 6.604f * param5 - 3.302f;
-    _glideBend *= _glideBend * _glideBend;
+    float param5 = param[5];
+    P.glideBend = 6.604f * param5 - 3.302f;
+    P.glideBend *= P.glideBend * P.glideBend;
 
     /*
       Adjusts the low-pass filter's cutoff frequency. The actual cutoff is set
@@ -311,30 +523,30 @@ void JX10AudioProcessor::update()
       By default this is 100%, which effectively turns off filter key tracking
       (but not the other modulators if they modulate downwards).
      */
-    float param6 = apvts.getRawParameterValue("VCF Freq")->load();
-    _filterMultiplier = 8.0f * param6 - 1.5f;
+    float param6 = param[6];
+    P.filterMultiplier = 8.0f * param6 - 1.5f;
 
     // Filter Q. Convert into a parabolic curve from 1 down to 0.
-    float param7 = apvts.getRawParameterValue("VCF Reso")->load();
-    _filterQ = (1.0f - param7) * (1.0f - param7);  // + 0.02f;
+    float param7 = param[7];
+    P.filterQ = (1.0f - param7) * (1.0f - param7);  // + 0.02f;
 
     // Filter envelope intensity. Linear curve from -6.0 to +6.0.
-    float param8 = apvts.getRawParameterValue("VCF Env")->load();
-    _filterEnvDepth = 12.0f * param8 - 6.0f;
+    float param8 = param[8];
+    P.filterEnvDepth = 12.0f * param8 - 6.0f;
 
     // Filter LFO intensity. Parabolic curve from 0 to 2.5.
-    float param9 = apvts.getRawParameterValue("VCF LFO")->load();
-    _filterLFODepth = 2.5f * param9 * param9;
+    float param9 = param[9];
+    P.filterLFODepth = 2.5f * param9 * param9;
 
     // Filter velocity sensitivity, a value between -0.05 and +0.05.
     // If disabled, the velocity is completely ignored.
-    float param10 = apvts.getRawParameterValue("VCF Vel")->load();
+    float param10 = param[10];
     if (param10 < 0.05f) {
-        _velocitySensitivity = 0.0f;  // turn off velocity
-        _ignoreVelocity = true;
+        P.velocitySensitivity = 0.0f;  // turn off velocity
+        P.ignoreVelocity = true;
     } else {
-        _velocitySensitivity = 0.1f * param10 - 0.05f;
-        _ignoreVelocity = false;
+        P.velocitySensitivity = 0.1f * param10 - 0.05f;
+        P.ignoreVelocity = false;
     }
 
     /*
@@ -359,39 +571,39 @@ void JX10AudioProcessor::update()
       we use a different sample rate in the exponential.
      */
 
-    float param11 = apvts.getRawParameterValue("VCF Att")->load();
-    _filterAttack = 1.0f - std::exp(-inverseUpdateRate * exp(5.5f - 7.5f * param11));
+    float param11 = param[11];
+    P.filterAttack = 1.0f - std::exp(-inverseUpdateRate * exp(5.5f - 7.5f * param11));
 
-    float param12 = apvts.getRawParameterValue("VCF Dec")->load();
-    _filterDecay = 1.0f - std::exp(-inverseUpdateRate * exp(5.5f - 7.5f * param12));
+    float param12 = param[12];
+    P.filterDecay = 1.0f - std::exp(-inverseUpdateRate * exp(5.5f - 7.5f * param12));
 
     // The sustain level for the filter envelope is exponential(ish) because
     // frequencies are logarithmic.
-    float param13 = apvts.getRawParameterValue("VCF Sus")->load();
-    _filterSustain = param13 * param13;
+    float param13 = param[13];
+    P.filterSustain = param13 * param13;
 
-    float param14 = apvts.getRawParameterValue("VCF Rel")->load();
-    _filterRelease = 1.0f - std::exp(-inverseUpdateRate * std::exp(5.5f - 7.5f * param14));
+    float param14 = param[14];
+    P.filterRelease = 1.0f - std::exp(-inverseUpdateRate * std::exp(5.5f - 7.5f * param14));
 
-    float param15 = apvts.getRawParameterValue("ENV Att")->load();
-    _envAttack = 1.0f - std::exp(-_inverseSampleRate * std::exp(5.5f - 7.5f * param15));
+    float param15 = param[15];
+    P.envAttack = 1.0f - std::exp(-_inverseSampleRate * std::exp(5.5f - 7.5f * param15));
 
-    float param16 = apvts.getRawParameterValue("ENV Dec")->load();
-    _envDecay = 1.0f - std::exp(-_inverseSampleRate * std::exp(5.5f - 7.5f * param16));
+    float param16 = param[16];
+    P.envDecay = 1.0f - std::exp(-_inverseSampleRate * std::exp(5.5f - 7.5f * param16));
 
-    float param17 = apvts.getRawParameterValue("ENV Sus")->load();
-    _envSustain = param17;
+    float param17 = param[17];
+    P.envSustain = param17;
 
-    float param18 = apvts.getRawParameterValue("ENV Rel")->load();
-    _envRelease = 1.0f - std::exp(-_inverseSampleRate * std::exp(5.5f - 7.5f * param18));
-    if (param18 < 0.01f) { _envRelease = 0.1f; }  // extra fast release
+    float param18 = param[18];
+    P.envRelease = 1.0f - std::exp(-_inverseSampleRate * std::exp(5.5f - 7.5f * param18));
+    if (param18 < 0.01f) { P.envRelease = 0.1f; }  // extra fast release
 
     // The LFO rate is an exponentional curve that maps the 0 - 1 parameter value
     // to 0.0183 Hz - 20.086 Hz. We use this to calculate the phase increment for
     // a sine wave running at 1/32th the sample rate.
-    float param19 = apvts.getRawParameterValue("LFO Rate")->load();
+    float param19 = param[19];
     float lfoRate = std::exp(7.0f * param19 - 4.0f);
-    _lfoInc = lfoRate * inverseUpdateRate * float(TWOPI);
+    P.lfoInc = lfoRate * inverseUpdateRate * float(TWOPI);
 
     // The vibrato / PWM setting is a parabolic curve going from 0.0 for 0% up to
     // 0.05 for 100%. You can choose between PWM mode (to the left) and vibrato
@@ -399,22 +611,30 @@ void JX10AudioProcessor::update()
     // wave that modulates the oscillator period. In PWM mode, the oscillators are
     // set up to form a pulse wave with a verying duty cycle. Note that to get the
     // PWM effect, the oscMix must be larger than 0.
-    float param20 = apvts.getRawParameterValue("Vibrato")->load();
-    _vibrato = 0.2f * (param20 - 0.5f) * (param20 - 0.5f);
-    _pwmDepth = _vibrato;
-    if (param20 < 0.5f) { _vibrato = 0.0f; }
+    float param20 = param[20];
+    P.vibrato = 0.2f * (param20 - 0.5f) * (param20 - 0.5f);
+    P.pwmDepth = P.vibrato;
+    if (param20 < 0.5f) { P.vibrato = 0.0f; }
+    P.pwmMode = (param20 < 0.5f);
 
     // How much noise to mix into the signal. This is a parabola from 0 to 1
     // (similar to skew = 2 in JUCE).
-    float param21 = apvts.getRawParameterValue("Noise")->load();
-    _noiseMix = param21 * param21;
+    float param21 = param[21];
+    P.noiseMix = param21 * param21;
 
     // When using both oscillators, and/or noise or more filter resonance, the
     // overall gain increases. This variable tries to compensate for that.
-    _volumeTrim = (3.2f - _oscMix - 1.5f * _noiseMix) * (1.5f - 0.5f * param7);
+    P.volumeTrim = (3.2f - P.oscMix - 1.5f * P.noiseMix) * (1.5f - 0.5f * param7);
 
     // Lower the noise level so that the maximum is roughly -24 dB.
-    _noiseMix *= 0.06f;
+    P.noiseMix *= 0.06f;
+
+    // When oversampling, the same noise power is spread out over a wider range
+    // of frequencies, and the decimation filter removes the part above the
+    // normal Nyquist frequency. Make the noise louder to make up for this.
+    if (_oversampling > 1) {
+        P.noiseMix *= std::sqrt(float(_oversampling));
+    }
 
     /*
       Master tuning. The octave parameter is ±2 octaves, while tuning is ±100%
@@ -423,160 +643,174 @@ void JX10AudioProcessor::update()
       shifts the pitch up by 2^(1/12) = 1.0594, or down by 2^(-1/12) = 1/1.0594.
 
       When a note is played, rather than the pitch frequency, we will actually
-      calculate its *period* in samples. That's why `_tune` is multiplied by the
-      sample rate. The higher the tuning, the smaller `_tune` will become because
+      calculate its *period* in samples. That's why `P.tune` is multiplied by the
+      sample rate. The higher the tuning, the smaller `P.tune` will become because
       higher notes have smaller periods.
 
       Why the extra -23.376? Note that if the tuning is 0 octaves and 0 cents,
-      `_tune` is actually -48.376. This offset is used to turn MIDI note numbers
+      `P.tune` is actually -48.376. This offset is used to turn MIDI note numbers
       into the correct pitch. More about this in noteOn().
      */
-    float param22 = apvts.getRawParameterValue("Octave")->load();
-    float param23 = apvts.getRawParameterValue("Tuning")->load();
-    _tune = -23.376f - 2.0f * param23 - 12.0f * std::floor(param22 * 4.9f);
-    _tune = _sampleRate * std::pow(1.059463094359f, _tune);
+    float param22 = param[22];
+    float param23 = param[23];
+    P.tune = -23.376f - 2.0f * param23 - 12.0f * std::floor(param22 * 4.9f);
+    P.tune = _sampleRate * std::pow(1.059463094359f, P.tune);
 }
 
 void JX10AudioProcessor::processEvents(juce::MidiBuffer &midiMessages)
 {
     // There are different ways a synth can handle MIDI events. This plug-in does
-    // it by copying the events it cares about -- note on and note off -- into an
-    // array. In the render loop, we step through this array to process the events
-    // one-by-one. Controllers such as the sustain pedal are processed right away,
-    // at the start of the block, so these are not sample accurate.
-
-    int npos = 0;
-    for (const auto metadata : midiMessages) {
-        if (metadata.numBytes != 3) continue;
-
-        const auto data0 = metadata.data[0];
-        const auto data1 = metadata.data[1];
-        const auto data2 = metadata.data[2];
-        const int deltaFrames = metadata.samplePosition;
-
-        switch (data0 & 0xf0) {  // status byte (all channels)
-            // Note off
-            case 0x80:
-                _notes[npos++] = deltaFrames;   // time offset
-                _notes[npos++] = data1 & 0x7F;  // note
-                _notes[npos++] = 0;             // vel
-                break;
-
-            // Note on
-            case 0x90:
-                _notes[npos++] = deltaFrames;   // time offset
-                _notes[npos++] = data1 & 0x7F;  // note
-                _notes[npos++] = data2 & 0x7F;  // vel
-                break;
-
-            // Controller
-            case 0xB0:
-                switch (data1) {
-                    case 0x01:  // mod wheel
-                        // This maps the position of the mod wheel to a
-                        // parabolic curve starting at 0.0 (position 0)
-                        // up to 0.0806 (position 127). This amount is added
-                        // to the LFO intensity for vibrato / PWM.
-                        _modWheel = 0.000005f * float(data2 * data2);
-                        break;
-
-                    case 0x02:  // filter +
-                    case 0x4A:
-                    //case 21:  // for testing
-                        // Maps the position of the controller from 0 to 2.54.
-                        _filterCtl = 0.02f * float(data2);
-                        break;
-
-                    case 0x03:  // filter -
-                    //case 22:  // for testing
-                        // Maps the position of the controller from 0 to -3.81.
-                        _filterCtl = -0.03f * float(data2);
-                        break;
-
-                    case 0x07:  // volume
-                        // Map the position of the volume control to a
-                        // parabolic curve starting at 0.0 (position 0)
-                        // up to 0.000806 (position 127).
-                        _volume = 0.00000005f * float(data2 * data2);
-                        break;
-
-                    case 0x10:  // resonance
-                    case 0x47:
-                    //case 23:  // for testing
-                        // This maps the position of the controller to a
-                        // linear curve from 1.001 (position 0) down to
-                        // 0.1755 (position 127).
-                        _resonanceCtl = 0.0065f * float(154 - data2);
-                        break;
-
-                    case 0x40:  // sustain pedal
-                        // Make the variable 64 when the pedal is pressed
-                        // and 0 when released.
-                        _sustain = data2 & 0x40;
-
-                        // Pedal released? Then end all sustained notes.
-                        // This sends a note-off event with note = -1, meaning
-                        // all sustained notes will be moved into their envelope
-                        // release stage.
-                        if (_sustain == 0) {
-                            _notes[npos++] = deltaFrames;
-                            _notes[npos++] = SUSTAIN;
-                            _notes[npos++] = 0;
-                        }
-                        break;
-
-                    default:  // all notes off
-                        if (data1 > 0x7A) {
-                            for (int v = 0; v < NVOICES; ++v) {
-                                // Setting the envelope to 0 immediately
-                                // turns off the voice.
-                                _voices[v].env  = 0.0f;
-                                _voices[v].envd = 0.0f;
-                                _voices[v].envl = 0.0f;
-                                _voices[v].note = 0;
-
-                                // Comment from the original code:
-                                // Could probably reset some more stuff here for safety!
-                            }
-                            _sustain = 0;
-                        }
-                        break;
-                }
-                break;
+    // it by copying the events into a queue. In the render loop, we step through
+    // this queue and handle each event at the exact sample it belongs to. That
+    // includes controllers such as the sustain pedal and pitch bend.
+    //
+    // The queue has a fixed size
+, so that it never allocates on the audio
+    // thread. If the host sends more events than fit, the render loop calls
+    // fillEvents() again once the queue is empty, to get the next batch.
+    _midiIterator = midiMessages.cbegin();
+    _midiEnd = midiMessages.cend();
+    fillEvents();
+}
 
-            // Program change
-            case 0xC0:
-                if (data1 < _programs.size()) {
-                    setCurrentProgram(data1);
-                }
-                break;
-
-            // Channel aftertouch
-            case 0xD0:
-                // This maps the pressure value to a parabolic curve starting
-                // at 0.0 (position 0) up to 0.161 (position 127).
-                _pressure = 0.00001f * float(data1 * data1);
-                break;
-
-            // Pitch bend
-            case 0xE0:
-                // This maps the pitch bend value from [-8192, 8191] to an exponential
-                // curve from 0.89 to 1.12 and its reciprocal from 1.12 down to 0.89.
-                // When the pitch wheel is centered, both values are 1.0. This value
-                // is used to multiply the oscillator period, a shift up or down of 2
-                // semitones (note: 2^(-2/12) = 0.89 and 2^(2/12) = 1.12).
-                _inversePitchBend = std::exp(0.000014102 * double(data1 + 128 * data2 - 8192));
-                _pitchBend = 1.0f / _inversePitchBend;
-                break;
-
-            default: break;
+void JX10AudioProcessor::fillEvents()
+{
+    _events.clear();
+
+    while (_midiIterator != _midiEnd) {
+        const auto metadata = *_midiIterator;
+
+        // Program change and channel aftertouch have only one data byte.
+        // Anything longer than three bytes is SysEx, which is ignored.
+        if (metadata.numBytes >= 2 && metadata.numBytes <= 3) {
+            const auto data2 = metadata.numBytes == 3 ? metadata.data[2] : juce::uint8(0);
+            if (!_events.add(metadata.samplePosition, metadata.data[0], metadata.data[1], data2)) {
+                break;  // the queue is full, continue from this event later
+            }
         }
+        ++_midiIterator;
+    }
+}
 
-        // Discard events if buffer full!
-        if (npos > EVENTBUFFER) npos -= 3;
+void JX10AudioProcessor::handleEvent(const mda::MidiEvent &event)
+{
+    const auto data0 = event.status;
+    const auto data1 = event.data1;
+    const auto data2 = event.data2;
+
+    // In multi-timbral mode, the MIDI channel decides which part the event is
+    // for. Otherwise all channels go to part 1, like in the original plug-in.
+    const int part = _multiTimbral ? (data0 & 0x0F) : 0;
+    JX10Part &P = _parts[part];
+
+    switch (data0 & 0xf0) {  // status byte (all channels)
+        // Note off
+        case 0x80:
+            noteOn(part, data1 & 0x7F, 0);
+            break;
+
+        // Note on
+        case 0x90:
+            noteOn(part, data1 & 0x7F, data2 & 0x7F);
+            break;
+
+        // Controller
+        case 0xB0:
+            switch (data1) {
+                case 0x01:  // mod wheel
+                    // This maps the position of the mod wheel to a
+                    // parabolic curve starting at 0.0 (position 0)
+                    // up to 0.0806 (position 127). This amount is added
+                    // to the LFO intensity for vibrato / PWM.
+                    P.modWheel = 0.000005f * float(data2 * data2);
+                    break;
+
+                case 0x02:  // filter +
+                case 0x4A:
+                //case 21:  // for testing
+                    // Maps the position of the controller from 0 to 2.54.
+                    P.filterCtl = 0.02f * float(data2);
+                    break;
+
+                case 0x03:  // filter -
+                //case 22:  // for testing
+                    // Maps the position of the controller from 0 to -3.81.
+                    P.filterCtl = -0.03f * float(data2);
+                    break;
+
+                case 0x07:  // volume
+                    // Map the position of the volume control to a
+                    // parabolic curve starting at 0.0 (position 0)
+                    // up to 0.000806 (position 127).
+                    P.volume = 0.00000005f * float(data2 * data2);
+                    break;
+
+                case 0x10:  // resonance
+                case 0x47:
+                //case 23:  // for testing
+                    // This maps the position of the controller to a
+                    // linear curve from 1.001 (position 0) down to
+                    // 0.1755 (position 127).
+                    P.resonanceCtl = 0.0065f * float(154 - data2);
+                    break;
+
+                case 0x40:  // sustain pedal
+                    // Make the variable 64 when the pedal is pressed
+                    // and 0 when released.
+                    P.sustain = data2 & 0x40;
+
+                    // Pedal released? Then end all sustained notes.
+                    // This sends a note-off event with note = -1, meaning
+                    // all sustained notes will be moved into their envelope
+                    // release stage.
+                    if (P.sustain == 0) {
+                        noteOn(part, SUSTAIN, 0);
+                    }
+                    break;
+
+                default:  // all notes off
+                    if (data1 > 0x7A) {
+                        allNotesOff(part);
+                    }
+                    break;
+            }
+            break;
+
+        // Program change
+        case 0xC0:
+            if (data1 < _programs.size()) {
+                if (part == 0) {
+                    setCurrentProgram(data1);
+                } else {
+                    // The other parts don't have parameters of their own, so
+                    // load the preset's settings into the part directly.
+                    P.program = data1;
+                    updatePart(P, _programs[data1].param);
+                    P.activeProgram = data1;
+                }
+            }
+            break;
+
+        // Channel aftertouch
+        case 0xD0:
+            // This maps the pressure value to a parabolic curve starting
+            // at 0.0 (position 0) up to 0.161 (position 127).
+            P.pressure = 0.00001f * float(data1 * data1);
+            break;
+
+        // Pitch bend
+        case 0xE0:
+            // This maps the pitch bend value from [-8192, 8191] to an exponential
+            // curve from 0.89 to 1.12 and its reciprocal from 1.12 down to 0.89.
+            // When the pitch wheel is centered, both values are 1.0. This value
+            // is used to multiply the oscillator period, a shift up or down of 2
+            // semitones (note: 2^(-2/12) = 0.89 and 2^(2/12) = 1.12).
+            P.inversePitchBend = std::exp(0.000014102 * double(data1 + 128 * data2 - 8192));
+            P.pitchBend = 1.0f / P.inversePitchBend;
+            break;
+
+        default: break;
     }
-    _notes[npos] = EVENTS_DONE;
-    midiMessages.clear();
 }
 
 void JX10AudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
@@ -590,43 +824,50 @@ void JX10AudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::Mi
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (_parameters.changed()) {
+        update();
+    }
 
     processEvents(midiMessages);
 
     int sampleFrames = buffer.getNumSamples();
 
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
-
-    // Q value for the filter. This ranges from 1.0 (no Q) down to 0.0 (full Q).
-    const float fq = _filterQ * _resonanceCtl;
-
-    // The SVF filter this synth uses may have stability issues when the cutoff
-    // frequency is too high, so we set an upper limit on the cutoff frequency.
-    // This also depends on the amount of Q. where more Q means the upper limit
-    // is raised, not lowered, as `fq` becomes smaller then.
-    const float fx = 1.97f - 0.85f * fq;
+    // Find the outputs to write into. Output 0 is the main bus. In multi-
+    // timbral mode, a part whose own bus is enabled by the host is written to
+    // that bus; the other parts are mixed into the main output.
+    float *out1[NUM_PARTS];
+    float *out2[NUM_PARTS];
+    out1[0] = buffer.getWritePointer(0);
+    out2[0] = buffer.getWritePointer(1);
+    int numOutputs = 1;
+
+    for (int part = 0; part < NUM_PARTS; ++part) {
+        _parts[part].output = 0;
+
+        auto bus = getBus(false, part);
+        if (part > 0 && part < _numParts && bus != nullptr && bus->isEnabled()) {
+            const int channel = getChannelIndexInProcessBlockBuffer(false, part, 0);
+            out1[numOutputs] = buffer.getWritePointer(channel);
+            out2[numOutputs] = buffer.getWritePointer(channel + 1);
+            _parts[part].output = numOutputs++;
+        }
+    }
 
     // Calculate the LFO-modulated things. We need to do this at the start of
     // the block, and also do this every 32 samples inside the loop (see below).
-    const float sine = std::sin(_lfo);
-    float fmod = _filterMultiplier + _filterCtl + (_filterLFODepth + _pressure) * sine;
-    float pwm = 1.0f + sine * (_modWheel + _pwmDepth);
-    float vib = 1.0f + sine * (_modWheel + _vibrato);
+    for (int part = 0; part < _numParts; ++part) {
+        updateModulation(_parts[part]);
+    }
 
-    int event = 0;
     int frame = 0;  // how many samples are already rendered
 
     // Is there at least one active voice, or any pending MIDI event?
-    if (_numActiveVoices > 0 || _notes[event] < sampleFrames) {
+    if (_numActiveVoices > 0 || !_events.empty()) {
         while (frame < sampleFrames) {
-            // Get the timestamp of the next note on/off event. This is usually in the
-            // future, i.e. a number of samples after the current sample.
-            int frames = _notes[event++];
-
-            // This catches the EVENTS_DONE special event. There are no events left.
-            if (frames > sampleFrames) frames = sampleFrames;
+            // Get the timestamp of the next MIDI event. This is usually in the
+            // future, i.e. a number of samples after the current sample. If there
+            // are no more events, render until the end of the block.
+            int frames = _events.nextEventTime(sampleFrames);
 
             // The timestamp for the event is relative to the start of the block.
             // Make it relative to the previous event; this tells us how many samples
@@ -637,264 +878,39 @@ void JX10AudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::Mi
             // processed in total.
             frame += frames;
 
-            // Until it's time to process the upcoming event, render the active voices.
-            while (--frames >= 0) {
-                Voice *V = _voices;
-
-                // This variable adds up the output values of all the active voices.
-                // JX10 is a mono synth, so there is only one channel.
-                float o = 0.0f;
-
-                // Generate the next integer pseudorandom number.
-                _noiseSeed = _noiseSeed * 196314165 + 907633515;
-
-                // Convert the integer to a float, to get a number between 2 and 4.
-                // That's because 32-bit floating point numbers from 2.0 to 4.0 have
-                // the hexadecimal values 0x40000000 - 0x407fffff.
-                unsigned int r = (_noiseSeed & 0x7FFFFF) + 0x40000000;
-                float noise = *(float *)&r;
-
-                // Subtract 3 to get the float into the range [-1, 1], then multiply
-                // by the noise level setting.
-                noise = _noiseMix * (noise - 3.0f);
-
-                // The LFO and any things it modulates are updated every 32 samples.
-                if (--_lfoStep < 0) {
-                    _lfo += _lfoInc;
-                    if (_lfo > PI) { _lfo -= TWOPI; }
-
-                    // The LFO is a basic sine wave.
-                    const float sine = std::sin(_lfo);
-
-                    // The low-pass filter cutoff is modulated by the combination of the
-                    // VCF Freq parameter set by the user, the MIDI CC, aftertouch, and
-                    // the LFO intensity. This value swings between approx -7.97 and 11.7.
-                    // Below, we will also add the filter envelope to this. (The reason
-                    // we don't add the envelope here is that we'll be smoothing `fmod`.)
-                    fmod = _filterMultiplier + _filterCtl + (_filterLFODepth + _pressure) * sine;
-
-                    // The modulation intensity for vibrato / PWM is set by the parameter
-                    // and by the modulation wheel. The `pwm` and `vib` values are used
-                    // to directly modulate the oscillator period. They are multipliers
-                    // that range between 0.869 and 1.131, so that's a bit more than two
-                    // semitones up and down. For some reason, the modulation wheel has a
-                    // slightly larger range than the vibrato / PWM intensity parameter.
-                    pwm = 1.0f + sine * (_modWheel + _pwmDepth);
-                    vib = 1.0f + sine * (_modWheel + _vibrato);
-
-                    _lfoStep = LFO_MAX;  // reset the counter
-                }
-
-                // Loop through all the voices...
-                for (int v = 0; v < NVOICES; ++v) {
-                    // ...but only render the voices that have an active envelope.
-                    if (V->env > SILENCE) {
-
-                        // Used by the oscillators.
-                        const float hpf = 0.997f;
-                        const float min = 1.0f;
-
-                        // Oscillator 1. This creates a sinc pulse every `period*2` samples.
-                        // This is why in noteOn() we calculate the half period rather than
-                        // the full period corresponding to the note's pitch.
-                        float x1 = V->p1 + V->dp1;
-                        if (x1 > min) {
-                            if (x1 > V->pmax1) {
-                                x1 = V->pmax1 + V->pmax1 - x1;
-                                V->dp1 = -V->dp1;
-                            }
-                            V->p1 = x1;
-
-                            // Sine wave approximation.
-                            x1 = V->sin01 * V->sinx1 - V->sin11;
-                            V->sin11 = V->sin01;
-                            V->sin01 = x1;
-
-                            // Sinc function: y = sin(x) / x.
-                            x1 = x1 / V->p1;
-                        } else {
-                            // This is executed the very first time and after every cycle.
-                            // Set the period for the next cycle. Even though the period can
-                            // be modulated (vibrato, pitch bend, glide), it's only changed
-                            // for the next cycle, never in the middle of an ongoing cycle.
-                            V->dp1 = V->period * vib * _pitchBend;
-                            V->p1 = x1 = -x1;
-                            V->pmax1 = std::floor(0.5f + V->dp1) - 0.5f;
-                            V->dc1 = -0.5f * V->lev1 / V->pmax1;
-                            V->pmax1 *= PI;
-                            V->dp1 = V->pmax1 / V->dp1;
-                            V->sin01 = V->lev1 * std::sin(x1);
-                            V->sin11 = V->lev1 * std::sin(x1 - V->dp1);
-                            V->sinx1 = 2.0f * std::cos(V->dp1);
-
-                            // Output the peak of the sinc pulse.
-                            if (x1*x1 > 0.1f) {
-                                x1 = V->sin01 / x1;
-                            } else {
-                                x1 = V->lev1;
-                            }
-                        }
-
-                        // Oscillator 2. This is the same algorithm as for osc 1, except
-                        // this uses PWM instead of vibrato, and can be slightly detuned.
-                        // Bit of code duplication going on here. This should really be a
-                        // method on Voice or a special Oscillator class.
-                        float x2 = V->p2 + V->dp2;
-                        if (x2 > min) {
-                            if (x2 > V->pmax2) {
-                                x2 = V->pmax2 + V->pmax2 - x2;
-                                V->dp2 = -V->dp2;
-                            }
-                            V->p2 = x2;
-                            x2 = V->sin02 * V->sinx2 - V->sin12;
-                            V->sin12 = V->sin02;
-                            V->sin02 = x2;
-                            x2 = x2 / V->p2;
-                        } else {
-                            V->dp2 = V->period * V->detune * pwm * _pitchBend;
-                            V->p2 = x2 = -x2;
-                            V->pmax2 = std::floor(0.5f + V->dp2) - 0.5f;
-                            V->dc2 = -0.5f * V->lev2 / V->pmax2;
-                            V->pmax2 *= PI;
-                            V->dp2 = V->pmax2 / V->dp2;
-                            V->sin02 = V->lev2 * std::sin(x2);
-                            V->sin12 = V->lev2 * std::sin(x2 - V->dp2);
-                            V->sinx2 = 2.0f * std::cos(V->dp2);
-                            if (x2*x2 > 0.1f) {
-                                x2 = V->sin02 / x2;
-                            } else {
-                                x2 = V->lev2;
-                            }
-                        }
-
-                        /*
-                          By adding up the sinc pulses over time, i.e. by integrating them,
-                          we create a bandlimited saw wave without much aliasing.
-
-                          Oscillator 2 is subtracted. In PWM mode, osc 2 is also flipped
-                          (and phase-locked with osc 1) to get a pulse wave.
-
-                          Note: It can be a little unpredictable how these two oscillators
-                          interact. The oscillator state is not reset when an old voice is
-                          reused for a new note, and so the phase difference between osc 1
-                          and 2 is never the same (I guess that's part of the fun).
-
-                          Also, if you don't detune osc 2, it eventually will completely
-                          cancel out with osc 1 and you end up with silence.
-                         */
-                        V->saw = V->saw * hpf + V->dc1 + x1 - V->dc2 - x2;
-
-                        // Combine the output from the oscillators with the noise.
-                        float x = V->saw + noise;
-
-                        // Update the amplitude envelope. This is basically a one-pole
-                        // filter creating an analog-style exponential envelope curve.
-                        // It does the same as: `env = (1 - envd)*env + envd*envl`.
-                        V->env += V->envd * (V->envl - V->env);
-
-                        // Do the following updates at the LFO update rate.
-                        if (_lfoStep == LFO_MAX) {
-                            // Done with the attack portion? Then go into decay. Notice that
-                            // envl is 2.0 when the envelope is in the attack stage; that is
-                            // how we tell apart the different stages.
-                            if (V->env + V->envl > 3.0f) {
-                                V->envd = _envDecay;
-                                V->envl = _envSustain;
-                            }
-
-                            // Update the filter envelope. This is the same equation as for
-                            // the amplitude envelope, but only performed every LFO_MAX steps.
-                            V->fenv += V->fenvd * (V->fenvl - V->fenv);
-
-                            // Done with the filter attack portion? Then go into decay.
-                            if (V->fenv + V->fenvl > 3.0f) {
-                                V->fenvd = _filterDecay;
-                                V->fenvl = _filterSustain;
-                            }
-
-                            // Use a basic one-pole smoothing filter to de-zipper changes to
-                            // the amount of filter modulation.
-                            _filterZip += 0.005f * (fmod - _filterZip);
-
-                            /*
-                              Calculate the filter cutoff. We multiply the base coefficient,
-                              `fc`, by the total amount of modulation. This also includes the
-                              filter envelope and any pitch bending.
-
-                              We use an exponent because frequencies are logarithmic, and so
-                              modulating them works best exponentially. Note that the exp()
-                              gives a multiplier with a possible range from 1e-6 to 1e+7,
-                              which seems excessive! The pitch bend adds another 2 semitones
-                              up or down.
-
-                              The final filter coefficient should be a value between 0.0 and
-                              2.0 (= Nyquist), but the filter is only stable up to 1.0 or so
-                              (depending on Q). The value of `y` may be larger than 2.0 but
-                              we'll limit this before actually applying the filter.
-                             */
-                            float y = V->fc * std::exp(_filterZip + _filterEnvDepth * V->fenv) * _inversePitchBend;
-
-                            // Don't set the cutoff too low either.
-                            if (y < 0.005f) { y = 0.005f; }
-
-                            // For debugging: print out the actual cutoff frequency.
-                            //if (y < 2.0f) { printf("cutoff = %f\n", std::asin(y / 2) * getSampleRate() / PI); }
-
-                            V->ff = y;
-
-                            /*
-                              Like so many things in this synth, glide between pitches is
-                              implemented as an exponential curve using a simple one-pole
-                              smoothing filter. If the voice's current period is not yet
-                              equal to the target value, this equation brings it a little
-                              closer with every update step.
-
-                              We always perform this calculation, even if glide is disabled.
-                              In that case, the `_glideRate` is 1, and so the voice's period
-                              is immediately set to the target value. (Note that this logic
-                              is only performed once every 32 samples, so there could be one
-                              or more cycles that get rendered using the old period length).
-                             */
-                            V->period += _glideRate * (V->target - V->period);
-                        }
-
-                        if (V->ff > fx) { V->ff = fx; }  // stability limit
-
-                        // State variable filter for low-pass filtering the sound.
-                        // This appears to be a modification of a Chamberlin SVF. I'm not
-                        // quite sure where this variation comes from but no doubt it's
-                        // done to make the filter behave better at higher frequencies.
-                        V->f0 += V->ff * V->f1;
-                        V->f1 -= V->ff * (V->f0 + fq * V->f1 - x - V->f2);
-                        V->f1 -= 0.2f * V->f1 * V->f1 * V->f1;  // soft limit
-                        V->f2 = x;
-
-                        // The output for this voice is the amplitude envelope times the
-                        // output from the filter.
-                        o += V->env * V->f0;
-                    }
-
-                    // Go to the next active voice.
-                    V++;
-                }
+            // Copy the voice state into the SIMD lanes.
+            gatherVoices();
 
-                // Write the result into the output buffer.
-                *out1++ = o;
-                *out2++ = o;
+            // Until it's time to process the upcoming event, render the active voices.
+            // JX10 is a mono synth, so both channels of an output are the same.
+            renderVoices(out1, numOutputs, frames);
+            for (int n = 0; n < numOutputs; ++n) {
+                std::memcpy(out2[n], out1[n], size_t(frames) * sizeof(float));
+                out1[n] += frames;
+                out2[n] += frames;
             }
 
-            // It's time to handle the event. This starts the new note, or stops the
-            // note if velocity is 0. Also handles the sustain pedal being lifted.
-            if (frame < sampleFrames) {
-                int note = _notes[event++];
-                int vel  = _notes[event++];
-                noteOn(note, vel);
+            // Copy the new voice state back, so that noteOn() can use it.
+            scatterVoices();
+            _voiceTreeValid = false;
+
+            // It's time to handle the event, or events if there are several with
+            // the same timestamp. This starts or stops notes, but also handles the
+            // controllers, such as the sustain pedal and pitch bend.
+            while (_events.hasEventAt(frame)) {
+                handleEvent(_events.next());
+                if (_events.empty()) {
+                    fillEvents();
+                }
             }
         }
 
-        // Turn off voices whose envelope has dropped below the minimum level.
-        _numActiveVoices = NVOICES;
-        for (int v = 0; v < NVOICES; ++v) {
+        // Turn off voices whose envelope has dropped below the minimum level,
+        // and put them back into the pool. The voices that are still playing
+        // are moved up in the list, so that it stays compact and sorted.
+        int numActive = 0;
+        for (int i = 0; i < _numActiveVoices; ++i) {
+            const int v = _activeVoices[i];
             if (_voices[v].env < SILENCE) {
                 _voices[v].env = 0.0f;
                 _voices[v].envl = 0.0f;
@@ -902,84 +918,578 @@ void JX10AudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::Mi
                 _voices[v].f1 = 0.0f;
                 _voices[v].f2 = 0.0f;
                 _voices[v].ff = 0.0f;
-                _numActiveVoices--;
+                _freeVoices |= juce::uint64(1) << v;
+            } else {
+                _activeVoices[numActive++] = v;
             }
         }
+        _numActiveVoices = numActive;
     } else {
         // No voices playing and no events, so render an empty block.
         while (--sampleFrames >= 0) {
-            *out1++ = 0.0f;
-            *out2++ = 0.0f;
+            *out1[0]++ = 0.0f;
+            *out2[0]++ = 0.0f;
+        }
+
+        // Whatever is left in the decimation filters is too quiet to hear.
+        for (int n = 0; n < NUM_PARTS; ++n) {
+            _decimators[n].reset();
         }
     }
 
-    // Mark the events buffer as done.
-    _notes[0] = EVENTS_DONE;
+    // All the events have been handled, so they're not passed on to the host.
+    midiMessages.clear();
 }
 
-void JX10AudioProcessor::noteOn(int note, int velocity)
+void JX10AudioProcessor::renderVoices(float **out, int numOutputs, int numFrames)
 {
+    if (_oversampling == 1) {
+        renderSamples(out, numOutputs, numFrames);
+        return;
+    }
+
+    // When oversampling, render `_oversampling` samples for every output
+    // sample, then filter and decimate them. This is done in chunks so that
+    // the buffer for the oversampled signal can be allocated ahead of time.
+    const int chunkSize = OVERSAMPLE_CHUNK * _oversampling;
+    float *oversampled[NUM_PARTS];
+    for (int n = 0; n < numOutputs; ++n) {
+        oversampled[n] = _oversampled.data() + n * chunkSize;
+    }
+
+    int pos = 0;
+    while (pos < numFrames) {
+        const int chunk = std::min(numFrames - pos, OVERSAMPLE_CHUNK);
+        renderSamples(oversampled, numOutputs, chunk * _oversampling);
+        for (int n = 0; n < numOutputs; ++n) {
+            _decimators[n].process(oversampled[n], out[n] + pos, chunk);
+        }
+        pos += chunk;
+    }
+}
+
+void JX10AudioProcessor::renderSamples(float **out, int numOutputs, int numSamples)
+{
+    for (int i = 0; i < numSamples; ++i) {
+        // This adds up the output values of all the active voices, one sum
+        // for every output. JX10 is a mono synth, so there is only one
+        // channel per output.
+        float mix[NUM_PARTS];
+        for (int n = 0; n < numOutputs; ++n) {
+            mix[n] = 0.0f;
+        }
+
+        // Generate the next integer pseudorandom number.
+        _noiseSeed = _noiseSeed * 196314165 + 907633515;
+
+        // Convert the integer to a float, to get a number between 2 and 4.
+        // That's because 32-bit floating point numbers from 2.0 to 4.0 have
+        // the hexadecimal values 0x40000000 - 0x407fffff.
+        unsigned int r = (_noiseSeed & 0x7FFFFF) + 0x40000000;
+        float noise = *(float *)&r;
+
+        // Subtract 3 to get the float into the range [-1, 1]. Each voice
+        // multiplies this by the noise level setting of its part.
+        noise -= 3.0f;
+
+        // The LFOs and any things they modulate are updated every 32 samples.
+        if (--_lfoStep < 0) {
+            for (int part = 0; part < _numParts; ++part) {
+                JX10Part &P = _parts[part];
+                P.lfo += P.lfoInc;
+                if (P.lfo > PI) { P.lfo -= TWOPI; }
+                updateModulation(P);
+            }
+            _lfoStep = LFO_MAX;  // reset the counter
+        }
+
+        // Render all the voices, one group of lanes at a time.
+        const bool lfoTick = (_lfoStep == LFO_MAX);
+        for (int g = 0; g < _numLaneGroups; ++g) {
+            renderLanes(_lanes[g], mix, noise, lfoTick);
+        }
+
+        // Write the results into the output buffers.
+        for (int n = 0; n < numOutputs; ++n) {
+            out[n][i] = mix[n];
+        }
+    }
+}
+
+void JX10AudioProcessor::updateModulation(JX10Part &P)
+{
+    // The LFO is a basic sine wave.
+    const float sine = std::sin(P.lfo);
+
+    // The low-pass filter cutoff is modulated by the combination of the VCF Freq
+    // parameter set by the user, the MIDI CC, aftertouch, and the LFO intensity.
+    // This value swings between approx -7.97 and 11.7. In renderLanes(), we will
+    // also add the filter envelope to this. (The reason we don't add the envelope
+    // here is that we'll be smoothing `fmod`.)
+    P.fmod = P.filterMultiplier + P.filterCtl + (P.filterLFODepth + P.pressure) * sine;
+
+    // The modulation intensity for vibrato / PWM is set by the parameter and by
+    // the modulation wheel. The `pwm` and `vib` values are used to directly
+    // modulate the oscillator period. They are multipliers that range between
+    // 0.869 and 1.131, so that's a bit more than two semitones up and down. For
+    // some reason, the modulation wheel has a slightly larger range than the
+    // vibrato / PWM intensity parameter.
+    P.pwm = 1.0f + sine * (P.modWheel + P.pwmDepth);
+    P.vib = 1.0f + sine * (P.modWheel + P.vibrato);
+}
+
+void JX10AudioProcessor::gatherVoices()
+{
+    // Put the voices that are in use next to each other in the lanes. If one
+    // note is playing, only one group needs to be rendered, no matter which
+    // voice it is using.
+    _numLaneGroups = (_numActiveVoices + LANES - 1) / LANES;
+
+    for (int g = 0; g < _numLaneGroups; ++g) {
+        JX10VoiceLanes &L = _lanes[g];
+        for (int i = 0; i < LANES; ++i) {
+            const int n = g * LANES + i;
+            if (n >= _numActiveVoices) {
+                // Unused lane. With env = 0, it's always inactive. The other
+                // values only need to be something harmless.
+                L.voice[i] = -1;
+                L.output[i] = 0;
+                L.env[i] = 0.0f;
+                L.fq[i] = 1.0f;
+                L.fx[i] = 1.0f;
+                L.noiseMix[i] = 0.0f;
+                continue;
+            }
+
+            const int v = _activeVoices[n];
+            const JX10Voice &V = _voices[v];
+            const JX10Part &P = _parts[V.part];
+            L.voice[i] = v;
+            L.output[i] = P.output;
+
+            // Q value for the filter. This ranges from 1.0 (no Q) down to 0.0 (full
+            // Q). It's calculated here because the resonance CC may have changed.
+            L.fq[i] = P.filterQ * P.resonanceCtl;
+
+            // The SVF filter this synth uses may have stability issues when the cutoff
+            // frequency is too high, so we set an upper limit on the cutoff frequency.
+            // This also depends on the amount of Q. where more Q means the upper limit
+            // is raised, not lowered, as `fq` becomes smaller then.
+            L.fx[i] = 1.97f - 0.85f * L.fq[i];
+
+            L.noiseMix[i] = P.noiseMix;
+            L.p1[i] = V.p1;
+            L.pmax1[i] = V.pmax1;
+            L.dp1[i] = V.dp1;
+            L.sin01[i] = V.sin01;
+            L.sin11[i] = V.sin11;
+            L.sinx1[i] = V.sinx1;
+            L.dc1[i] = V.dc1;
+            L.p2[i] = V.p2;
+            L.pmax2[i] = V.pmax2;
+            L.dp2[i] = V.dp2;
+            L.sin02[i] = V.sin02;
+            L.sin12[i] = V.sin12;
+            L.sinx2[i] = V.sinx2;
+            L.dc2[i] = V.dc2;
+            L.saw[i] = V.saw;
+            L.ff[i] = V.ff;
+            L.f0[i] = V.f0;
+            L.f1[i] = V.f1;
+            L.f2[i] = V.f2;
+            L.env[i] = V.env;
+            L.envd[i] = V.envd;
+            L.envl[i] = V.envl;
+        }
+    }
+}
+
+void JX10AudioProcessor::scatterVoices()
+{
+    for (int g = 0; g < _numLaneGroups; ++g) {
+        const JX10VoiceLanes &L = _lanes[g];
+        for (int i = 0; i < LANES; ++i) {
+            if (L.voice[i] < 0) { continue; }
+
+            JX10Voice &V = _voices[L.voice[i]];
+            V.p1 = L.p1[i];
+            V.pmax1 = L.pmax1[i];
+            V.dp1 = L.dp1[i];
+            V.sin01 = L.sin01[i];
+            V.sin11 = L.sin11[i];
+            V.sinx1 = L.sinx1[i];
+            V.dc1 = L.dc1[i];
+            V.p2 = L.p2[i];
+            V.pmax2 = L.pmax2[i];
+            V.dp2 = L.dp2[i];
+            V.sin02 = L.sin02[i];
+            V.sin12 = L.sin12[i];
+            V.sinx2 = L.sinx2[i];
+            V.dc2 = L.dc2[i];
+            V.saw = L.saw[i];
+            V.ff = L.ff[i];
+            V.f0 = L.f0[i];
+            V.f1 = L.f1[i];
+            V.f2 = L.f2[i];
+            V.env = L.env[i];
+            V.envd = L.envd[i];
+            V.envl = L.envl[i];
+        }
+    }
+}
+
+// Returns `a` where the bits in `mask` are 1 and `b` where they are 0. With the
+// mask either all ones or all zeros, this picks one of the two values. Writing
+// it with bitwise operations rather than `mask ? a : b` is what allows GCC and
+// Clang to vectorize the loops in renderLanes() on SSE, which doesn't have
+// masked stores.
+static inline float select(int mask, float a, float b)
+{
+    int ia, ib;
+    std::memcpy(&ia, &a, sizeof(float));
+    std::memcpy(&ib, &b, sizeof(float));
+    const int ir = (ia & mask) | (ib & ~mask);
+    float r;
+    std::memcpy(&r, &ir, sizeof(float));
+    return r;
+}
+
+void JX10AudioProcessor::renderLanes(JX10VoiceLanes &L, float *mix, float noise, bool lfoTick)
+{
+    /*
+      Renders one sample for a group of LANES voices.
+
+      Each of the `for` loops below does the same thing to every lane. They are
+      written without `if` statements so that the compiler can vectorize them:
+      instead of skipping an inactive voice, it is computed anyway and then the
+      old state is kept using select(active, newValue, oldValue), which becomes
+      a blend instruction. The few things that cannot be vectorized easily (the
+      oscillator reset and the LFO-rate updates) are done one lane at a time.
+
+      The lanes are in the same order as the voices, and the voices are mixed
+      in that order too, so the output is exactly the same as when rendering
+      the voices one at a time.
+     */
+
+    // Used by the oscillators.
+    const float hpf = _sawLeak;
+    const float min = 1.0f;
+
+    // Only render the voices that have an active envelope. The mask is all
+    // one bits for an active lane and all zero bits for an inactive lane.
+    alignas(32) int active[LANES];
+    for (int i = 0; i < LANES; ++i) {
+        active[i] = -int(L.env[i] > SILENCE);
+    }
+
+    // Oscillator 1. This creates a sinc pulse every `period*2` samples.
+    // This is why in noteOn() we calculate the half period rather than
+    // the full period corresponding to the note's pitch.
+    alignas(32) int reset1[LANES];
+    alignas(32) float x1[LANES];
+    for (int i = 0; i < LANES; ++i) {
+        float x = L.p1[i] + L.dp1[i];
+        const int running = active[i] & -int(x > min);
+        reset1[i] = active[i] & ~running;
+
+        // Reached the end of the loop? Then go back the other way.
+        const int reflect = -int(x > L.pmax1[i]);
+        x = select(reflect, L.pmax1[i] + L.pmax1[i] - x, x);
+        const float dp = select(reflect, -L.dp1[i], L.dp1[i]);
+
+        // Sine wave approximation.
+        const float s = L.sin01[i] * L.sinx1[i] - L.sin11[i];
+
+        // Sinc function: y = sin(x) / x.
+        x1[i] = s / x;
+
+        L.p1[i] = select(running, x, L.p1[i]);
+        L.dp1[i] = select(running, dp, L.dp1[i]);
+        L.sin11[i] = select(running, L.sin01[i], L.sin11[i]);
+        L.sin01[i] = select(running, s, L.sin01[i]);
+    }
+
+    for (int i = 0; i < LANES; ++i) {
+        if (reset1[i]) {
+            const JX10Voice &V = _voices[L.voice[i]];
+            const JX10Part &P = _parts[V.part];
+            float x = L.p1[i] + L.dp1[i];
+
+            // This is executed the very first time and after every cycle.
+            // Set the period for the next cycle. Even though the period can
+            // be modulated (vibrato, pitch bend, glide), it's only changed
+            // for the next cycle, never in the middle of an ongoing cycle.
+            L.dp1[i] = V.period * P.vib * P.pitchBend;
+            L.p1[i] = x = -x;
+            L.pmax1[i] = std::floor(0.5f + L.dp1[i]) - 0.5f;
+            L.dc1[i] = -0.5f * V.lev1 / L.pmax1[i];
+            L.pmax1[i] *= PI;
+            L.dp1[i] = L.pmax1[i] / L.dp1[i];
+            L.sin01[i] = V.lev1 * std::sin(x);
+            L.sin11[i] = V.lev1 * std::sin(x - L.dp1[i]);
+            L.sinx1[i] = 2.0f * std::cos(L.dp1[i]);
+
+            // Output the peak of the sinc pulse.
+            if (x*x > 0.1f) {
+                x1[i] = L.sin01[i] / x;
+            } else {
+                x1[i] = V.lev1;
+            }
+        }
+    }
+
+    // Oscillator 2. This is the same algorithm as for osc 1, except
+    // this uses PWM instead of vibrato, and can be slightly detuned.
+    alignas(32) int reset2[LANES];
+    alignas(32) float x2[LANES];
+    for (int i = 0; i < LANES; ++i) {
+        float x = L.p2[i] + L.dp2[i];
+        const int running = active[i] & -int(x > min);
+        reset2[i] = active[i] & ~running;
+
+        const int reflect = -int(x > L.pmax2[i]);
+        x = select(reflect, L.pmax2[i] + L.pmax2[i] - x, x);
+        const float dp = select(reflect, -L.dp2[i], L.dp2[i]);
+
+        const float s = L.sin02[i] * L.sinx2[i] - L.sin12[i];
+        x2[i] = s / x;
+
+        L.p2[i] = select(running, x, L.p2[i]);
+        L.dp2[i] = select(running, dp, L.dp2[i]);
+        L.sin12[i] = select(running, L.sin02[i], L.sin12[i]);
+        L.sin02[i] = select(running, s, L.sin02[i]);
+    }
+
+    for (int i = 0; i < LANES; ++i) {
+        if (reset2[i]) {
+            const JX10Voice &V = _voices[L.voice[i]];
+            const JX10Part &P = _parts[V.part];
+            float x = L.p2[i] + L.dp2[i];
+
+            L.dp2[i] = V.period * V.detune * P.pwm * P.pitchBend;
+            L.p2[i] = x = -x;
+            L.pmax2[i] = std::floor(0.5f + L.dp2[i]) - 0.5f;
+            L.dc2[i] = -0.5f * V.lev2 / L.pmax2[i];
+            L.pmax2[i] *= PI;
+            L.dp2[i] = L.pmax2[i] / L.dp2[i];
+            L.sin02[i] = V.lev2 * std::sin(x);
+            L.sin12[i] = V.lev2 * std::sin(x - L.dp2[i]);
+            L.sinx2[i] = 2.0f * std::cos(L.dp2[i]);
+            if (x*x > 0.1f) {
+                x2[i] = L.sin02[i] / x;
+            } else {
+                x2[i] = V.lev2;
+            }
+        }
+    }
+
+    alignas(32) float input[LANES];
+    for (int i = 0; i < LANES; ++i) {
+        /*
+          By adding up the sinc pulses over time, i.e. by integrating them,
+          we create a bandlimited saw wave without much aliasing.
+
+          Oscillator 2 is subtracted. In PWM mode, osc 2 is also flipped
+          (and phase-locked with osc 1) to get a pulse wave.
+
+          Note: It can be a little unpredictable how these two oscillators
+          interact. The oscillator state is not reset when an old voice is
+          reused for a new note, and so the phase difference between osc 1
+          and 2 is never the same (I guess that's part of the fun).
+
+          Also, if you don't detune osc 2, it eventually will completely
+          cancel out with osc 1 and you end up with silence.
+         */
+        const float saw = L.saw[i] * hpf + L.dc1[i] + x1[i] - L.dc2[i] - x2[i];
+        L.saw[i] = select(active[i], saw, L.saw[i]);
+
+        // Combine the output from the oscillators with the noise.
+        input[i] = saw + L.noiseMix[i] * noise;
+
+        // Update the amplitude envelope. This is basically a one-pole
+        // filter creating an analog-style exponential envelope curve.
+        // It does the same as: `env = (1 - envd)*env + envd*envl`.
+        const float env = L.env[i] + L.envd[i] * (L.envl[i] - L.env[i]);
+        L.env[i] = select(active[i], env, L.env[i]);
+    }
+
+    // Do the following updates at the LFO update rate. These must be done in
+    // voice order, because every voice nudges its part's `filterZip` along.
+    if (lfoTick) {
+        for (int i = 0; i < LANES; ++i) {
+            if (!active[i]) { continue; }
+
+            JX10Voice &V = _voices[L.voice[i]];
+            JX10Part &P = _parts[V.part];
+
+            // Done with the attack portion? Then go into decay. Notice that
+            // envl is 2.0 when the envelope is in the attack stage; that is
+            // how we tell apart the different stages.
+            if (L.env[i] + L.envl[i] > 3.0f) {
+                L.envd[i] = P.envDecay;
+                L.envl[i] = P.envSustain;
+            }
+
+            // Update the filter envelope. This is the same equation as for
+            // the amplitude envelope, but only performed every LFO_MAX steps.
+            V.fenv += V.fenvd * (V.fenvl - V.fenv);
+
+            // Done with the filter attack portion? Then go into decay.
+            if (V.fenv + V.fenvl > 3.0f) {
+                V.fenvd = P.filterDecay;
+                V.fenvl = P.filterSustain;
+            }
+
+            // Use a basic one-pole smoothing filter to de-zipper changes to
+            // the amount of filter modulation.
+            P.filterZip += _filterZipRate * (P.fmod - P.filterZip);
+
+            /*
+              Calculate the filter cutoff. We multiply the base coefficient,
+              `fc`, by the total amount of modulation. This also includes the
+              filter envelope and any pitch bending.
+
+              We use an exponent because frequencies are logarithmic, and so
+              modulating them works best exponentially. Note that the exp()
+              gives a multiplier with a possible range from 1e-6 to 1e+7,
+              which seems excessive! The pitch bend adds another 2 semitones
+              up or down.
+
+              The final filter coefficient should be a value between 0.0 and
+              2.0 (= Nyquist), but the filter is only stable up to 1.0 or so
+              (depending on Q). The value of `y` may be larger than 2.0 but
+              we'll limit this before actually applying the filter.
+
+              This is done for every voice, so the exp() uses the fast
+              approximation from MDAFastMath.h rather than std::exp().
+             */
+            float y = V.fc * mda::fastExp(P.filterZip + P.filterEnvDepth * V.fenv) * P.inversePitchBend;
+
+            // Don't set the cutoff too low either.
+            if (y < 0.005f) { y = 0.005f; }
+
+            // For debugging: print out the actual cutoff frequency.
+            //if (y < 2.0f) { printf("cutoff = %f\n", std::asin(y / 2) * getSampleRate() / PI); }
+
+            L.ff[i] = y;
+
+            /*
+              Like so many things in this synth, glide between pitches is
+              implemented as an exponential curve using a simple one-pole
+              smoothing filter. If the voice's current period is not yet
+              equal to the target value, this equation brings it a little
+              closer with every update step.
+
+              We always perform this calculation, even if glide is disabled.
+              In that case, the `glideRate` is 1, and so the voice's period
+              is immediately set to the target value. (Note that this logic
+              is only performed once every 32 samples, so there could be one
+              or more cycles that get rendered using the old period length).
+             */
+            V.period += P.glideRate * (V.target - V.period);
+        }
+    }
+
+    alignas(32) float output[LANES];
+    for (int i = 0; i < LANES; ++i) {
+        const float ff = L.ff[i] > L.fx[i] ? L.fx[i] : L.ff[i];  // stability limit
+
+        // State variable filter for low-pass filtering the sound.
+        // This appears to be a modification of a Chamberlin SVF. I'm not
+        // quite sure where this variation comes from but no doubt it's
+        // done to make the filter behave better at higher frequencies.
+        const float f0 = L.f0[i] + ff * L.f1[i];
+        float f1 = L.f1[i] - ff * (f0 + L.fq[i] * L.f1[i] - input[i] - L.f2[i]);
+        f1 -= 0.2f * f1 * f1 * f1;  // soft limit
+
+        L.ff[i] = select(active[i], ff, L.ff[i]);
+        L.f0[i] = select(active[i], f0, L.f0[i]);
+        L.f1[i] = select(active[i], f1, L.f1[i]);
+        L.f2[i] = select(active[i], input[i], L.f2[i]);
+
+        // The output for this voice is the amplitude envelope times the
+        // output from the filter.
+        output[i] = L.env[i] * f0;
+    }
+
+    // Mix the voices into their outputs. This is done in voice order so that
+    // the floating-point additions happen in the same order as in the original
+    // code.
+    for (int i = 0; i < LANES; ++i) {
+        if (active[i]) { mix[L.output[i]] += output[i]; }
+    }
+}
+
+void JX10AudioProcessor::noteOn(int part, int note, int velocity)
+{
+    JX10Part &P = _parts[part];
+
     if (velocity > 0) {  // note on
-        if (_ignoreVelocity) { velocity = 80; }
+        if (P.ignoreVelocity) { velocity = 80; }
 
         int held = 0;  // how many notes playing that are not released yet
         int v = 0;     // index of the voice to use
 
-        if (_mode & 4) {  // monophonic
+        if (P.mode & 4) {  // monophonic
+            // In the MONO modes, the part always plays the same voice. This is
+            // voice 0 in the normal mode. In multi-timbral mode, the voice may
+            // have been taken by another part in the mean time; if so, a new
+            // voice is chosen below.
+            v = P.monoVoice;
 
             // We get here when in MONO, M-LEGATO, or M-GLIDE mode and the user is
             // playing legato-style, i.e. they pressed a new key before releasing
             // the previous key or keys.
-            if (_voices[0].note > 0) {
-
-                // Queue any held notes. This puts the previous note values into the
-                // other voices, but it won't actually play these voices. This is used
-                // during the next note-off event to determine which note to restore.
-                // For example, if you press and hold E, the synth will play the E.
-                // Then also press F, now the synth will play an F. When you release
-                // the F, the synth sees that E is still held down and it will change
-                // the mono voice to play E again, until that is released too.
-                for (int tmp = NVOICES - 1; tmp > 0; tmp--) {
-                    _voices[tmp].note = _voices[tmp - 1].note;
+            if (_voices[v].part == part && _voices[v].note > 0) {
+
+                // Queue any held notes. The voice won't play these notes, but this
+                // is used during the next note-off event to determine which note to
+                // restore. For example, if you press and hold E, the synth will play
+                // the E. Then also press F, now the synth will play an F. When you
+                // release the F, the synth sees that E is still held down and it will
+                // change the mono voice to play E again, until that is released too.
+                for (int i = MONO_QUEUE - 2; i > 0; i--) {
+                    P.monoQueue[i] = P.monoQueue[i - 1];
                 }
+                P.monoQueue[0] = _voices[v].note;
 
                 // Calculate the oscillator period. These formulas are explained below.
-                float p = _tune * std::exp(-0.05776226505f * (float(note) + ANALOG * float(v)));
-                while (p < 3.0f || (p * _detune) < 3.0f) { p += p; }
+                float p = P.tune * std::exp(-0.05776226505f * (float(note) + ANALOG * float(v)));
+                while (p < 3.0f || (p * P.detune) < 3.0f) { p += p; }
                 _voices[v].target = p;
 
                 // Not in M-LEGATO or M-GLIDE? Then no portamento. Otherwise, glide
                 // from whatever was the previous period for this voice. Note that this
                 // does not use the additional glide bend parameter.
-                if ((_mode & 2) == 0) { _voices[v].period = p; }
+                if ((P.mode & 2) == 0) { _voices[v].period = p; }
 
                 // See below for explanations of these.
-                _voices[v].fc = std::exp(_velocitySensitivity * float(velocity - 64)) / p;
+                _voices[v].fc = std::exp(P.velocitySensitivity * float(velocity - 64)) / p;
                 _voices[v].env += SILENCE + SILENCE;
-                _voices[v].note = note;
+                activateVoice(v);
+                setVoiceNote(v, note);
+                updateVoiceTree(v);
                 return;
             }
 
-        } else {  // polyphonic
-            float l = 100.0f;  // louder than any envelope!
-
-            // Find a voice to use.
-            for (int tmp = 0; tmp < NVOICES; tmp++) {
-                // Count how many playing voices are for keys that are still held down,
-                // i.e. that did not get a note-off event yet. If note is 0, this voice
-                // is not playing; if it's -1, the note is sustained by the pedal.
-                if (_voices[tmp].note > 0) { held++; }
-
-                // Replace quietest voice not in attack. Recall that envl is set to 2.0
-                // for the attack portion of the envelope, but for decay and sustain it
-                // is set to the sustain level and for release it is 0; both are < 2.0.
-                // This will first use any voices that are not playing (with env = 0.0).
-                // If all are in use, steal the voice with the lowest envelope value.
-                if (_voices[tmp].env < l && _voices[tmp].envl < 2.0f) {
-                    l = _voices[tmp].env;
-                    v = tmp;
-                }
+            if (_voices[v].part != part) {
+                v = P.monoVoice = findVoice();
             }
+
+        } else {  // polyphonic
+            // How many playing voices are for keys that are still held down, i.e.
+            // that did not get a note-off event yet.
+            held = P.numHeldNotes;
+
+            v = findVoice();
+        }
+
+        // The voice may have been playing for a different part. Take it over.
+        // This is done before setVoiceNote() so that the other part's count of
+        // held notes stays correct.
+        if (_voices[v].part != part) {
+            setVoiceNote(v, 0);
+            _voices[v].part = part;
         }
 
         /*
@@ -1010,8 +1520,8 @@ void JX10AudioProcessor::noteOn(int note, int velocity)
           We can rewrite this as:
                 half period = (sampleRate / 16.3516) * 2^(-note/12)
 
-          Earlier when we calculated `_tune`, we did:
-                _tune = sampleRate * 1.0594^(semitones)
+          Earlier when we calculated `tune`, we did:
+                tune = sampleRate * 1.0594^(semitones)
 
           We can fold that 1/16.3516 factor into the number of semitones like so:
 
@@ -1020,17 +1530,17 @@ void JX10AudioProcessor::noteOn(int note, int velocity)
 
           So that's where that factor -48.376 comes from. If no additional tuning
           is applied, then:
-                _tune = sampleRate * 1.0594^(-48.376)
+                tune = sampleRate * 1.0594^(-48.376)
 
-          When tuning is used, the value of _tune simply becomes smaller or larger
+          When tuning is used, the value of tune simply becomes smaller or larger
           depending on the number of semitones we need to shift up or down. Tuning
           higher means pitches become higher and so the period becomes smaller.
 
             The formula for the half period can now be written as:
-                half period = _tune * 2^(-note / 12)
+                half period = tune * 2^(-note / 12)
 
           which is the same as:
-                half period = _tune * exp(-0.05776 * note)
+                half period = tune * exp(-0.05776 * note)
 
           It appears kind of complicated but that's because all the math has been
           combined into just a couple of formulas.
@@ -1038,44 +1548,45 @@ void JX10AudioProcessor::noteOn(int note, int velocity)
           The ANALOG term adds a small amount of detuning based on the current
           voice number. For moar analog!
          */
-        float p = _tune * std::exp(-0.05776226505f * (float(note) + ANALOG * float(v)));
+        float p = P.tune * std::exp(-0.05776226505f * (float(note) + ANALOG * float(v)));
 
         // Make sure the period does not become too small. This lowers the pitch an
         // octave at a time until `p` is at least 3 samples long. It seems likely
         // that this is a requirement of the oscillator algorithm. You can experience
         // this pitch drop for yourself by playing notes in the highest octave.
-        while (p < 3.0f || (p * _detune) < 3.0f) { p += p; }
+        while (p < 3.0f || (p * P.detune) < 3.0f) { p += p; }
 
         // Set the period as the target that we'll glide to (if glide enabled).
         _voices[v].target = p;
-        _voices[v].detune = _detune;
+        _voices[v].detune = P.detune;
 
         // In LEGATO or GLIDE mode, perform a portamento from the previous note's
         // pitch to the new one. The difference between LEGATO and GLIDE is that
         // GLIDE will always perform the portamento, while LEGATO only does it when
         // playing legato-style (at least one previous key is still held down).
-        // Note that `_mode & 2` means the mode is 2 or 3 (poly), or 6 or 7 (mono),
-        // which are the LEGATO and GLIDE modes. If `_mode & 1`, then the mode is
+        // Note that `mode & 2` means the mode is 2 or 3 (poly), or 6 or 7 (mono),
+        // which are the LEGATO and GLIDE modes. If `mode & 1`, then the mode is
         // 3 or 7, which is only GLIDE. Note that legato-style playing in MONO mode
         // is handled separately above (regardless of GLIDE or LEGATO modes).
         int noteDistance = 0;
-        if ((_mode & 2) && ((_mode & 1) || (held > 0))) {
-            noteDistance = note - _lastNote;
+        if ((P.mode & 2) && ((P.mode & 1) || (held > 0))) {
+            noteDistance = note - P.lastNote;
         }
 
         // Make the starting period equal to the period of the previous note (only
         // in LEGATO or GLIDE modes), but also offset it by an additional amount of
-        // glide bending (± semitones). Note that `_glideBend` is always used, even
+        // glide bending (± semitones). Note that `glideBend` is always used, even
         // if you're not in a LEGATO or GLIDE mode.
         // This again is the familiar formula 1.0594^semitones or 2^(semitones/12).
-        _voices[v].period = p * std::pow(1.059463094359f, float(noteDistance) - _glideBend);
+        _voices[v].period = p * std::pow(1.059463094359f, float(noteDistance) - P.glideBend);
 
         // Make sure the starting period does not become too small. Unlike the
         // target period, this doesn't need to be exact, so we can simply limit
         // it to the minimum of 3 samples.
         if (_voices[v].period < 3.0f) { _voices[v].period = 3.0f; }
 
-        _voices[v].note = _lastNote = note;
+        setVoiceNote(v, note);
+        P.lastNote = note;
 
         /*
           Set the base cutoff frequency for the low-pass filter, based on the pitch
@@ -1099,7 +1610,7 @@ void JX10AudioProcessor::noteOn(int note, int velocity)
           To see this for yourself: Choose a patch with a full sound (has lots of
           harmonics), put VCF Freq at 18%, disable all other filter modulations,
           and set VCF Reso to full resonance. At this setting, VCF Freq does not
-          affect the cutoff frequency (i.e. exp(_filterMultiplier) = 1.0).
+          affect the cutoff frequency (i.e. exp(filterMultiplier) = 1.0).
 
           Now you can see in a spectrum analyzer that there is a peak at 1/3rd the
           expected pitch (if it's not clear, twiddle VCF Reso to see the peak come
@@ -1117,7 +1628,7 @@ void JX10AudioProcessor::noteOn(int note, int velocity)
           1/24 up to 24. This suspiciously looks like two octaves up or down -- but
           these are not semitones, and it's more like ±55 semitones.
          */
-        _voices[v].fc = std::exp(_velocitySensitivity * float(velocity - 64)) / p;
+        _voices[v].fc = std::exp(P.velocitySensitivity * float(velocity - 64)) / p;
 
         // The loudness of the tone uses the MIDI velocity but you cannot set the
         // sensitivity other than on/off. We convert the linear velocity curve into
@@ -1126,14 +1637,13 @@ void JX10AudioProcessor::noteOn(int note, int velocity)
 
         // Use the different volume controls to set the output level for both
         // oscillators. This is a value between 0 and 1 -- because even though
-        // `vel` is large-ish, `_volume` is quite small (0.0005 by default).
-        _voices[v].lev1 = _volumeTrim * _volume * vel;
-        _voices[v].lev2 = _voices[v].lev1 * _oscMix;
+        // `vel` is large-ish, `volume` is quite small (0.0005 by default).
+        _voices[v].lev1 = P.volumeTrim * P.volume * vel;
+        _voices[v].lev2 = _voices[v].lev1 * P.oscMix;
 
         // In PWM mode, the second oscillator should be flipped around in order to
         // make a square wave from two saw waves.
-        float param20 = apvts.getRawParameterValue("Vibrato")->load();
-        if (param20 < 0.5f) {
+        if (P.pwmMode) {
             float p = 0.0f;
             if (_voices[v].dp1 > 0.0f) {
                 p = _voices[v].pmax1 + _voices[v].pmax1 - _voices[v].p1;
@@ -1155,56 +1665,55 @@ void JX10AudioProcessor::noteOn(int note, int velocity)
         // the filter state and the filter envelope, but I removed that as it was
         // not used for anything.
         _voices[v].env += SILENCE + SILENCE;
+        activateVoice(v);
 
         // Start the attack portion of the envelope. The target level is not 1.0
         // but 2.0 in order to make the attack steeper than a regular exponential
         // curve. The attack ends when the envelope level exceeds 1.0.
         _voices[v].envl  = 2.0f;
-        _voices[v].envd  = _envAttack;
+        _voices[v].envd  = P.envAttack;
         _voices[v].fenvl = 2.0f;
-        _voices[v].fenvd = _filterAttack;
+        _voices[v].fenvd = P.filterAttack;
+        updateVoiceTree(v);
     }
 
     // Note off
     else {
+        const int v = P.monoVoice;
+
         // In one of the MONO modes and the currently playing note is released?
-        if ((_mode & 4) && (_voices[0].note == note)) {
+        if ((P.mode & 4) && _voices[v].part == part && _voices[v].note == note) {
 
             // Are there any older notes queued? Note that some of these may have
-            // been released in the mean time, in which case `voice.note` was set
-            // to 0 or SUSTAIN (in the loop from the else clause below). This means
-            // notes kept alive only by the sustain pedal are not restored.
-            int held = 0;
-            int v;
-            for (v = NVOICES - 1; v > 0; v--) {
-                if (_voices[v].note > 0) { held = v; }
+            // been released in the mean time, in which case they were set to 0 or
+            // SUSTAIN (in the else clause below). This means notes kept alive only
+            // by the sustain pedal are not restored.
+            int held = -1;
+            for (int i = MONO_QUEUE - 2; i >= 0; i--) {
+                if (P.monoQueue[i] > 0) { held = i; }
             }
 
             // Did we find an older note whose key is still held down?
-            if (held > 0) {
-                // Put this note into voice 0 (note: v is always 0 here).
-                _voices[v].note = _voices[held].note;
-                _voices[held].note = 0;
+            if (held >= 0) {
+                // Put this note into the mono voice.
+                setVoiceNote(v, P.monoQueue[held]);
+                P.monoQueue[held] = 0;
 
                 // Calculate the new period based on this note number. These are the
                 // same formulas as above.
-                float p = _tune * std::exp(-0.05776226505f * (float(_voices[v].note) + ANALOG * float(v)));
-                while (p < 3.0f || (p * _detune) < 3.0f) { p += p; }
+                float p = P.tune * std::exp(-0.05776226505f * (float(_voices[v].note) + ANALOG * float(v)));
+                while (p < 3.0f || (p * P.detune) < 3.0f) { p += p; }
                 _voices[v].target = p;
 
                 // Don't glide unless in M-LEGATO or M-GLIDE modes.
-                if ((_mode & 2) == 0) { _voices[v].period = p; }
+                if ((P.mode & 2) == 0) { _voices[v].period = p; }
 
                 // Set the low-pass filter cutoff. This is simpler than before because
                 // we do not have the velocity anymore, so we just ignore that part.
                 _voices[v].fc = 1.0f / p;
             } else {
                 // The last note was released, so turn off the mono voice completely.
-                _voices[v].envl  = 0.0f;
-                _voices[v].envd  = _envRelease;
-                _voices[v].fenvl = 0.0f;
-                _voices[v].fenvd = _filterRelease;
-                _voices[v].note  = 0;
+                releaseVoice(v);
             }
         } else {
             // We get here in polyphonic mode, or when a key was released that is
@@ -1214,26 +1723,160 @@ void JX10AudioProcessor::noteOn(int note, int velocity)
             // the note number is -1 (SUSTAIN). The sustain pedal does not work in
             // any of the MONO modes, by the way.
 
-            for (int v = 0; v < NVOICES; v++) {
-                // Any voices playing this note?
-                if (_voices[v].note == note) {
+            for (int v = 0; v < MAX_VOICES; v++) {
+                // Any voices of this part playing this note?
+                if (_voices[v].note == note && _voices[v].part == part) {
                     // If the sustain pedal is not pressed, then start envelope release.
-                    if (_sustain == 0) {
-                        _voices[v].envl  = 0.0f;
-                        _voices[v].envd  = _envRelease;
-                        _voices[v].fenvl = 0.0f;
-                        _voices[v].fenvd = _filterRelease;
-                        _voices[v].note  = 0;
+                    if (P.sustain == 0) {
+                        releaseVoice(v);
                     } else {
                         // Sustain pedal is pressed, so put the note in sustain mode.
-                        _voices[v].note = SUSTAIN;
+                        setVoiceNote(v, SUSTAIN);
                     }
                 }
             }
+
+            // The key may also be one of the older notes in the mono queue.
+            for (int i = 0; i < MONO_QUEUE - 1; i++) {
+                if (P.monoQueue[i] == note) {
+                    P.monoQueue[i] = (P.sustain == 0) ? 0 : SUSTAIN;
+                }
+            }
         }
     }
 }
 
+int JX10AudioProcessor::findVoice()
+{
+    // If there is a free voice, take the one with the lowest index. The original
+    // plug-in did this by looking for the voice with the lowest envelope level,
+    // which is 0.0 for a free voice; this gives the same result without having
+    // to look at all the voices.
+    juce::uint64 free = _freeVoices & _polyphonyMask;
+    if (free != 0) {
+        return lowestSetBit(free);
+    }
+
+    // All voices are in use. Replace the quietest voice not in attack. The
+    // stolen voice stays where it is in the list of active voices. In multi-
+    // timbral mode, the voice may be taken from any part.
+    //
+    // The envelope levels were changed by rendering, so the first voice that
+    // is stolen after that rebuilds the tree. This is O(polyphony), but only
+    // once per render segment. Stealing more voices for the notes of a chord
+    // is O(log polyphony) each, since noteOn() updates the tree.
+    if (!_voiceTreeValid) {
+        for (int v = 0; v < _polyphony; ++v) {
+            _voiceTree.setLevel(v, stealLevel(v));
+        }
+        _voiceTree.rebuild(_polyphony);
+        _voiceTreeValid = true;
+    }
+
+    // If all voices are in their attack, voice 0 is used. If several voices
+    // are equally quiet, the one with the lowest index is used.
+    if (_voiceTree.quietestLevel() < mda::QuietestVoiceTree::unavailable()) {
+        return _voiceTree.quietest();
+    }
+    return 0;
+}
+
+float JX10AudioProcessor::stealLevel(int v) const
+{
+    // Recall that envl is set to 2.0 for the attack portion of the envelope,
+    // but for decay and sustain it is set to the sustain level and for release
+    // it is 0; both are < 2.0. Voices in their attack are not stolen.
+    if (_voices[v].envl < 2.0f) {
+        return _voices[v].env;
+    }
+    return mda::QuietestVoiceTree::unavailable();
+}
+
+void JX10AudioProcessor::updateVoiceTree(int v)
+{
+    // When the tree is not valid, the next rebuild picks up the new level.
+    if (_voiceTreeValid && v < _polyphony) {
+        _voiceTree.update(v, stealLevel(v));
+    }
+}
+
+void JX10AudioProcessor::releaseVoice(int v)
+{
+    // Start the release portion of the envelopes, using the release times of
+    // the part the voice belongs to.
+    const JX10Part &P = _parts[_voices[v].part];
+    _voices[v].envl  = 0.0f;
+    _voices[v].envd  = P.envRelease;
+    _voices[v].fenvl = 0.0f;
+    _voices[v].fenvd = P.filterRelease;
+    setVoiceNote(v, 0);
+    updateVoiceTree(v);
+}
+
+void JX10AudioProcessor::allNotesOff(int part)
+{
+    for (int v = 0; v < MAX_VOICES; ++v) {
+        if (_voices[v].part != part) { continue; }
+
+        // Setting the envelope to 0 immediately turns off the voice.
+        _voices[v].env  = 0.0f;
+        _voices[v].envd = 0.0f;
+        _voices[v].envl = 0.0f;
+        setVoiceNote(v, 0);
+        updateVoiceTree(v);
+
+        // Since the voices go straight back into the pool, also clear the
+        // filter, which is what would happen when the voice is choked.
+        _voices[v].f0 = 0.0f;
+        _voices[v].f1 = 0.0f;
+        _voices[v].f2 = 0.0f;
+        _voices[v].ff = 0.0f;
+        _freeVoices |= juce::uint64(1) << v;
+    }
+
+    // Remove the voices from the list of active voices.
+    int numActive = 0;
+    for (int i = 0; i < _numActiveVoices; ++i) {
+        const int v = _activeVoices[i];
+        if (_voices[v].part != part) {
+            _activeVoices[numActive++] = v;
+        }
+    }
+    _numActiveVoices = numActive;
+
+    for (int i = 0; i < MONO_QUEUE - 1; ++i) {
+        _parts[part].monoQueue[i] = 0;
+    }
+    _parts[part].sustain = 0;
+}
+
+void JX10AudioProcessor::activateVoice(int v)
+{
+    // Already playing? Then it's in the list already (voice stealing).
+    const juce::uint64 bit = juce::uint64(1) << v;
+    if ((_freeVoices & bit) == 0) { return; }
+    _freeVoices &= ~bit;
+
+    // Insert the voice into the list of active voices, keeping it sorted.
+    int i = _numActiveVoices++;
+    while (i > 0 && _activeVoices[i - 1] > v) {
+        _activeVoices[i] = _activeVoices[i - 1];
+        i--;
+    }
+    _activeVoices[i] = v;
+}
+
+void JX10AudioProcessor::setVoiceNote(int v, int note)
+{
+    // Keep count of the voices whose key is held down, so that noteOn() does
+    // not need to look at every voice to find out whether we're playing legato.
+    // This count is kept per part.
+    int &numHeldNotes = _parts[_voices[v].part].numHeldNotes;
+    if (_voices[v].note > 0) { numHeldNotes--; }
+    if (note > 0) { numHeldNotes++; }
+    _voices[v].note = note;
+}
+
 juce::AudioProcessorEditor *JX10AudioProcessor::createEditor()
 {
     auto editor = new juce::GenericAudioProcessorEditor(*this);
@@ -1243,14 +1886,39 @@ juce::AudioProcessorEditor *JX10AudioProcessor::createEditor()
 
 void JX10AudioProcessor::getStateInformation(juce::MemoryBlock &destData)
 {
-    copyXmlToBinary(*apvts.copyState().createXml(), destData);
+    // Part 1 uses the parameters, but the programs chosen for the other parts
+    // in multi-timbral mode are not parameters, so store them separately.
+    juce::StringArray partPrograms;
+    for (int part = 1; part < NUM_PARTS; ++part) {
+        partPrograms.add(juce::String(_parts[part].program.load()));
+    }
+
+    auto state = apvts.copyState();
+    state.setProperty("partPrograms", partPrograms.joinIntoString(","), nullptr);
+    copyXmlToBinary(*state.createXml(), destData);
 }
 
 void JX10AudioProcessor::setStateInformation(const void *data, int sizeInBytes)
 {
     std::unique_ptr<juce::XmlElement> xml(getXmlFromBinary(data, sizeInBytes));
     if (xml.get() != nullptr && xml->hasTagName(apvts.state.getType())) {
-        apvts.replaceState(juce::ValueTree::fromXml(*xml));
+        auto state = juce::ValueTree::fromXml(*xml);
+
+        auto partPrograms = juce::StringArray::fromTokens(
+            state.getProperty("partPrograms").toString(), ",", "");
+        for (int i = 0; i < partPrograms.size() && i < NUM_PARTS - 1; ++i) {
+            int program = partPrograms[i].getIntValue();
+            if (program >= 0 && program < int(_programs.size())) {
+                _parts[i + 1].program = program;
+            }
+        }
+
+        apvts.replaceState(state);
+
+        // The part programs are not parameters, so the watcher can't see them.
+        // Invalidating it makes the audio thread call update(), which loads
+        // the new programs into the parts.
+        _parameters.invalidate();
     }
 }
 
@@ -1601,6 +2269,28 @@ juce::AudioProcessorValueTreeState::ParameterLayout JX10AudioProcessor::createPa
                 }
             )));
 
+    // Not part of the original plug-in and not stored in the factory presets.
+    layout.add(std::make_unique<juce::AudioParameterInt>(
+        juce::ParameterID("Polyphony", 1),
+        "Polyphony",
+        1, MAX_VOICES, DEFAULT_VOICES,
+        juce::AudioParameterIntAttributes().withLabel("voices")));
+
+    // Not part of the original plug-in. In Omni mode, the synth responds to all
+    // MIDI channels. In Multi mode, each MIDI channel plays its own part.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("MIDI Mode", 1),
+        "MIDI Mode",
+        juce::StringArray { "Omni", "Multi" },
+        0));
+
+    // Not part of the original plug-in and not stored in the factory presets.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("Oversampling", 1),
+        "Oversampling",
+        juce::StringArray { "Off", "2x", "4x" },
+        0));
+
     return layout;
 }
 
@@ -1,13 +1,28 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAEventQueue.h"
+#include "MDAFastMath.h"
+#include "MDAOversampling.h"
+#include "MDAParameters.h"
+#include "MDAVoiceTree.h"
 
 const int NPARAMS = 24;       // number of parameters
-const int NVOICES = 8;        // max polyphony
+const int MAX_VOICES = 64;    // max polyphony
+const int DEFAULT_VOICES = 8; // polyphony of the original plug-in
+const int NUM_PARTS = 16;     // one part per MIDI channel in multi-timbral mode
+
+// In the MONO modes, a part only plays one voice. It remembers up to
+// MONO_QUEUE - 1 older keys that are still held down.
+const int MONO_QUEUE = 8;
 
 const float SILENCE = 0.0001f;  // voice choking
 const float ANALOG = 0.002f;    // oscillator drift
 
+// When oversampling, the voices are rendered in chunks of this many samples
+// (at the normal sample rate) before they are downsampled.
+const int OVERSAMPLE_CHUNK = 128;
+
 const float PI = 3.1415926535897932f;
 const float TWOPI = 6.2831853071795864f;
 
@@ -27,12 +42,16 @@ struct JX10Program
 };
 
 // State for an active voice.
-struct Voice
+struct JX10Voice
 {
     // What note triggered this voice, or SUSTAIN when the key is released
     // but the sustain pedal is held down. 0 if the voice is inactive.
     int note;
 
+    // Index of the part that is playing this voice. This is always 0 unless
+    // the synth is in multi-timbral mode.
+    int part;
+
     // The "period" of the waveform in samples. This is actually only half the
     // period due to the way the oscillators are implemented: they count up for
     // `period` samples and then down for `period` samples.
@@ -85,94 +104,88 @@ struct Voice
     float fenvl;   // target level
 };
 
-class JX10AudioProcessor : public juce::AudioProcessor
+// The voices are rendered in groups of this many SIMD lanes. Eight floats fill
+// one AVX register, or two SSE or NEON registers.
+const int LANES = 8;
+
+// Structure-of-arrays copy of the voice state that changes on every sample.
+//
+// The render loop works on this copy rather than on JX10Voice directly. With
+// the data laid out like this, the same operation can be done on all lanes at
+// once, and the compiler turns the loops in renderLanes() into SSE, AVX or NEON
+// instructions. Everything that only changes in noteOn() or at the LFO rate is
+// read from the JX10Voice objects instead.
+//
+// Inactive lanes are not skipped: they are computed like any other lane but
+// the results are thrown away, so that there are no branches in the loop.
+struct JX10VoiceLanes
 {
-public:
-    JX10AudioProcessor();
-    ~JX10AudioProcessor() override;
-
-    void prepareToPlay(double sampleRate, int samplesPerBlock) override;
-    void releaseResources() override;
-    void reset() override;
-
-    bool isBusesLayoutSupported(const BusesLayout &layouts) const override;
-
-    void processBlock(juce::AudioBuffer<float> &, juce::MidiBuffer &) override;
-
-    juce::AudioProcessorEditor *createEditor() override;
-    bool hasEditor() const override { return true; }
-
-    const juce::String getName() const override;
-
-    bool acceptsMidi() const override { return true; }
-    bool producesMidi() const override { return false; }
-    bool isMidiEffect() const override { return false; }
-    double getTailLengthSeconds() const override { return 0.0; }
+    // Index into _voices of the voice that each lane belongs to.
+    int voice[LANES];
 
-    int getNumPrograms() override;
-    int getCurrentProgram() override;
-    void setCurrentProgram(int index) override;
-    const juce::String getProgramName(int index) override;
-    void changeProgramName(int index, const juce::String &newName) override;
-
-    void getStateInformation(juce::MemoryBlock &destData) override;
-    void setStateInformation(const void *data, int sizeInBytes) override;
+    // Which output the voice is mixed into. See JX10Part::output.
+    int output[LANES];
 
-    juce::AudioProcessorValueTreeState apvts { *this, nullptr, "Parameters", createParameterLayout() };
-
-private:
-    juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
-
-    void update();
-    void resetState();
-
-    void createPrograms();
-    void processEvents(juce::MidiBuffer &midiMessages);
-    void noteOn(int note, int velocity);
+    // Settings from the voice's part. These are the same for every lane in
+    // the normal mode, but in multi-timbral mode each lane can belong to a
+    // different part.
+    alignas(32) float fq[LANES];        // filter Q
+    alignas(32) float fx[LANES];        // filter cutoff limit
+    alignas(32) float noiseMix[LANES];  // noise level
 
-    // The factory presets.
-    std::vector<JX10Program> _programs;
-
-    // Index of the active preset.
-    int _currentProgram;
-
-    // The current sample rate and 1 / sample rate.
-    float _sampleRate, _inverseSampleRate;
-
-    // MIDI note on / note off events for the current block. Each event is
-    // described by 3 values: delta time, note number, velocity.
-    static const int EVENTBUFFER = 120;
-    int _notes[EVENTBUFFER + 8];
-
-    // Special event code that marks the end of the MIDI events list.
-    const int EVENTS_DONE = 99999999;
-
-    // Special "note number" that says this voice is now kept alive by the
-    // sustain pedal being pressed down. As soon as the pedal is released,
-    // this voice will fade out.
-    const int SUSTAIN = -1;
-
-    // List of the active voices.
-    Voice _voices[NVOICES] = { 0 };
-
-    // How many voices are currently in use.
-    int _numActiveVoices;
-
-    // Used to smoothen changes in the amount of low-pass filter modulation.
-    float _filterZip;
+    // Oscillator 1
+    alignas(32) float p1[LANES];
+    alignas(32) float pmax1[LANES];
+    alignas(32) float dp1[LANES];
+    alignas(32) float sin01[LANES];
+    alignas(32) float sin11[LANES];
+    alignas(32) float sinx1[LANES];
+    alignas(32) float dc1[LANES];
 
-    // How often we update the LFO, in samples.
-    const int LFO_MAX = 32;
+    // Oscillator 2
+    alignas(32) float p2[LANES];
+    alignas(32) float pmax2[LANES];
+    alignas(32) float dp2[LANES];
+    alignas(32) float sin02[LANES];
+    alignas(32) float sin12[LANES];
+    alignas(32) float sinx2[LANES];
+    alignas(32) float dc2[LANES];
+
+    // Saw integrator, filter and amplitude envelope
+    alignas(32) float saw[LANES];
+    alignas(32) float ff[LANES];
+    alignas(32) float f0[LANES];
+    alignas(32) float f1[LANES];
+    alignas(32) float f2[LANES];
+    alignas(32) float env[LANES];
+    alignas(32) float envd[LANES];
+    alignas(32) float envl[LANES];
+};
 
-    // The LFO only updates every 32 samples. This counter keeps track of when
-    // the next update is.
-    int _lfoStep;
+// The settings and MIDI controller state for one part.
+//
+// In the normal mode there is only one part. It uses the plug-in's parameters
+// and listens to all MIDI channels, just like the original plug-in. In multi-
+// timbral mode there are NUM_PARTS parts, one for each MIDI channel. Part 1
+// still uses the plug-in's parameters, while the other parts each play one of
+// the factory presets, which is chosen with a program change on that channel.
+// All parts share the same pool of voices.
+struct JX10Part
+{
+    // Index of the factory preset that this part plays. Not used by part 1,
+    // which gets its settings from the plug-in's parameters. Program changes
+    // set this on the audio thread, but the plug-in state is saved and loaded
+    // on the message thread, hence the atomic.
+    std::atomic<int> program;
 
-    // Most recent note that was played. Used for gliding.
-    int _lastNote;
+    // The preset that the values below were calculated from, or -1 if they
+    // must be recalculated, for example because the sample rate changed.
+    // Only used on the audio thread.
+    int activeProgram;
 
-    // Pseudo random number generator.
-    unsigned int _noiseSeed;
+    // Which output this part is mixed into: 0 is the main output bus, 1 is
+    // the first of the part buses that is enabled, and so on.
+    int output;
 
     // === Parameter values ===
 
@@ -183,92 +196,306 @@ private:
     // 4, 5: MONO
     //    6: M-LEGATO
     //    7: M-GLIDE
-    int _mode;
+    int mode;
 
     // How much oscillator 2 is mixed into the sound; 0.0 = osc 2 is silent,
     // 1.0 = osc2 has same level as osc 1. Note that osc 2 is subtracted, so
     // if it's not detuned from osc 1, they cancel each other out into silence.
-    float _oscMix;
+    float oscMix;
 
     // Amount of detuning for oscillator 2. This is a multiplier for the period
     // of the oscillator.
-    float _detune;
+    float detune;
 
     // Master tuning.
-    float _tune;
+    float tune;
 
     // Coefficient for the speed of the glide. 1.0 is instantaneous (no glide).
-    float _glideRate;
+    float glideRate;
 
     // Number of semitones to glide up or down into any new note. This is used
     // even if not in a LEGATO or GLIDE mode.
-    float _glideBend;
+    float glideBend;
 
     // Resonance setting for the low-pass filter.
-    float _filterQ;
+    float filterQ;
 
     // The "VCF Freq" parameter is used to modulate the low-pass filter's cutoff.
     // The user does not manually set the cutoff frequency; this is determined by
     // the note's pitch and velocity. It can be modulated by an envelope and LFO,
     // and also by "VCF Freq". Lower percentages will reduce the cutoff frequency,
     // higher precentages will raise it.
-    float _filterMultiplier;
+    float filterMultiplier;
 
     // LFO intensity for the filter cutoff.
-    float _filterLFODepth;
+    float filterLFODepth;
 
     // Envelope intensity for the filter cutoff.
-    float _filterEnvDepth;
+    float filterEnvDepth;
 
     // Used to set the low-pass filter's cutoff frequency based on the note's
     // velocity. There is no velocity sensitivity for the amplitude envelope,
     // only for the filter cutoff. 0 when velocity is disabled.
-    float _velocitySensitivity;
+    float velocitySensitivity;
 
     // If this is set, velocity sensitivity is completely off and all notes
     // will be played with the same velocity.
-    bool _ignoreVelocity;
+    bool ignoreVelocity;
 
     // Filter ADSR settings.
-    float _filterAttack, _filterDecay, _filterSustain, _filterRelease;
+    float filterAttack, filterDecay, filterSustain, filterRelease;
 
     // Amplitude ADSR settings.
-    float _envAttack, _envDecay, _envSustain, _envRelease;
+    float envAttack, envDecay, envSustain, envRelease;
 
-    // Current LFO value and phase increment.
-    float _lfo, _lfoInc;
+    // Phase increment for the LFO.
+    float lfoInc;
 
     // Gain for mixing the noise into the output.
-    float _noiseMix;
+    float noiseMix;
 
     // Used to keep the output gain constant after changing parameters.
-    float _volumeTrim;
+    float volumeTrim;
 
     // LFO intensity for vibrato and PWM.
-    float _vibrato, _pwmDepth;
+    float vibrato, pwmDepth;
+
+    // In PWM mode, the second oscillator is flipped around. This is set when
+    // the Vibrato parameter is turned to the left.
+    bool pwmMode;
 
     // === MIDI CC values ===
 
     // Status of the damper pedal: 64 = pressed, 0 = released.
-    int _sustain;
+    int sustain;
 
     // Output gain in linear units. Can be changed by MIDI CC 7.
-    float _volume;
+    float volume;
 
     // Modulation wheel value. Sets the modulation depth for vibrato / PWM.
-    float _modWheel;
+    float modWheel;
 
     // MIDI CC amount used to modulate the cutoff frequency.
-    float _filterCtl;
+    float filterCtl;
 
     // MIDI CC amount used to modulate the filter Q.
-    float _resonanceCtl;
+    float resonanceCtl;
 
     // Amount of channel aftertouch. Used to modulate the filter cutoff.
-    float _pressure;
+    float pressure;
 
     // Pitch bend value, and its inverse. Also used to modulate the filter.
-    float _pitchBend, _inversePitchBend;
+    float pitchBend, inversePitchBend;
+
+    // === Modulation ===
+
+    // Current LFO phase.
+    float lfo;
+
+    // The LFO-modulated filter cutoff, PWM and vibrato amounts. These are
+    // updated every LFO_MAX samples.
+    float fmod, pwm, vib;
+
+    // Used to smoothen changes in the amount of low-pass filter modulation.
+    float filterZip;
+
+    // Most recent note that was played. Used for gliding.
+    int lastNote;
+
+    // === Note bookkeeping ===
+
+    // The voice used in the MONO modes. In the normal mode this is always
+    // voice 0, like in the original plug-in.
+    int monoVoice;
+
+    // In the MONO modes, the older keys that are still held down, newest
+    // first. When the playing key is released, the mono voice goes back to
+    // the newest of these. A note of 0 means the slot is empty.
+    int monoQueue[MONO_QUEUE - 1];
+
+    // How many voices of this part have a note whose key is still held down,
+    // i.e. how many have `note > 0`. Kept up-to-date by setVoiceNote().
+    int numHeldNotes;
+};
+
+class JX10AudioProcessor : public juce::AudioProcessor,
+                           private juce::AudioProcessorValueTreeState::Listener,
+                           private juce::AsyncUpdater
+{
+public:
+    JX10AudioProcessor();
+    ~JX10AudioProcessor() override;
+
+    void prepareToPlay(double sampleRate, int samplesPerBlock) override;
+    void releaseResources() override;
+    void reset() override;
+
+    bool isBusesLayoutSupported(const BusesLayout &layouts) const override;
+
+    void processBlock(juce::AudioBuffer<float> &, juce::MidiBuffer &) override;
+
+    juce::AudioProcessorEditor *createEditor() override;
+    bool hasEditor() const override { return true; }
+
+    const juce::String getName() const override;
+
+    bool acceptsMidi() const override { return true; }
+    bool producesMidi() const override { return false; }
+    bool isMidiEffect() const override { return false; }
+    double getTailLengthSeconds() const override { return 0.0; }
+
+    int getNumPrograms() override;
+    int getCurrentProgram() override;
+    void setCurrentProgram(int index) override;
+    const juce::String getProgramName(int index) override;
+    void changeProgramName(int index, const juce::String &newName) override;
+
+    void getStateInformation(juce::MemoryBlock &destData) override;
+    void setStateInformation(const void *data, int sizeInBytes) override;
+
+    juce::AudioProcessorValueTreeState apvts { *this, nullptr, "Parameters", createParameterLayout() };
+
+private:
+    juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+
+    void update();
+    void updatePart(JX10Part &P, const float *param);
+    void updateModulation(JX10Part &P);
+    void resetState();
+
+    void createPrograms();
+    void processEvents(juce::MidiBuffer &midiMessages);
+    void fillEvents();
+    void handleEvent(const mda::MidiEvent &event);
+    void noteOn(int part, int note, int velocity);
+    int findVoice();
+    float stealLevel(int v) const;
+    void updateVoiceTree(int v);
+    void releaseVoice(int v);
+    void allNotesOff(int part);
+    void setVoiceNote(int v, int note);
+    void activateVoice(int v);
+
+    void gatherVoices();
+    void scatterVoices();
+    void renderLanes(JX10VoiceLanes &L, float *mix, float noise, bool lfoTick);
+    void renderVoices(float **out, int numOutputs, int numFrames);
+    void renderSamples(float **out, int numOutputs, int numSamples);
+    void setOversampling(int factor);
+    void reportLatency();
+
+    // The host must only be told about a new latency from the message thread,
+    // but it's the audio thread that switches the oversampling factor. This
+    // defers the call to setLatencySamples() to the message thread.
+    void parameterChanged(const juce::String &, float) override
+    {
+        triggerAsyncUpdate();
+    }
+
+    void handleAsyncUpdate() override
+    {
+        reportLatency();
+    }
+
+    // The factory presets.
+    std::vector<JX10Program> _programs;
+
+    // Index of the active preset.
+    int _currentProgram;
+
+    // The sample rate that the voices are rendered at, and 1 / sample rate.
+    // This is higher than the host's sample rate when oversampling.
+    float _sampleRate, _inverseSampleRate;
+
+    // The host's sample rate.
+    double _hostSampleRate;
+
+    // Oversampling factor: 1, 2 or 4.
+    int _oversampling;
+
+    // Coefficients that the original code applies once per sample, or once
+    // per LFO update. When oversampling, these happen more often, so they are
+    // adjusted to keep the same time constants. See setOversampling().
+    float _sawLeak, _filterZipRate;
+
+    // Filters the oversampled signal and brings it back to the host's rate.
+    // Every output has its own filter.
+    mda::Decimator _decimators[NUM_PARTS];
+
+    // The oversampled signal for one chunk, for every output, before it is
+    // decimated.
+    std::vector<float> _oversampled;
+
+    // The MIDI events for the current block, in timestamp order.
+    mda::EventQueue _events;
+
+    // The host's MIDI events that haven't been copied into the queue yet.
+    juce::MidiBufferIterator _midiIterator, _midiEnd;
+
+    // Special "note number" that says this voice is now kept alive by the
+    // sustain pedal being pressed down. As soon as the pedal is released,
+    // this voice will fade out.
+    const int SUSTAIN = -1;
+
+    // The pool of voices. This always has room for MAX_VOICES voices, so that
+    // changing the polyphony does not need to allocate memory. The pool is
+    // allocated in prepareToPlay().
+    std::vector<JX10Voice> _voices;
+
+    // Bitmask of the voices that are not in use. A voice becomes free when its
+    // envelope has dropped below SILENCE. Finding a free voice is O(1): it's
+    // the lowest bit that is set.
+    juce::uint64 _freeVoices;
+
+    // Bitmask of the voices that may be used for new notes, based on the
+    // Polyphony parameter. Voices above this limit are released.
+    juce::uint64 _polyphonyMask;
+
+    // Finds the quietest voice when all voices are in use. The envelope levels
+    // change while rendering, so the tree is only valid until the next render
+    // segment. It's rebuilt the first time a voice is stolen after that.
+    mda::QuietestVoiceTree _voiceTree { MAX_VOICES };
+    bool _voiceTreeValid = false;
+
+    // Maximum number of voices that can play at once. The voices are shared
+    // by all the parts.
+    int _polyphony;
+
+    // Indices of the voices that are in use, sorted from low to high. Only the
+    // first _numActiveVoices entries are valid. Rendering works from this list
+    // rather than from the entire pool, so that the cost of rendering depends
+    // on how many notes are actually playing. The list is kept in voice order
+    // because the order in which the voices are rendered affects the output.
+    int _activeVoices[MAX_VOICES];
+    int _numActiveVoices;
+
+    // The voice state in SIMD-friendly form, used while rendering. The lanes
+    // are filled from _activeVoices, so only the first _numLaneGroups groups
+    // are used.
+    std::vector<JX10VoiceLanes> _lanes;
+    int _numLaneGroups;
+
+    // The parts. Only the first _numParts are in use: one in the normal mode,
+    // NUM_PARTS in multi-timbral mode.
+    JX10Part _parts[NUM_PARTS];
+    int _numParts;
+
+    // Whether the synth is in multi-timbral mode, where each MIDI channel plays
+    // its own part.
+    bool _multiTimbral;
+
+    // How often we update the LFO, in samples.
+    const int LFO_MAX = 32;
+
+    // The LFO only updates every 32 samples. This counter keeps track of when
+    // the next update is.
+    int _lfoStep;
+
+    // Pseudo random number generator.
+    unsigned int _noiseSeed;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(JX10AudioProcessor)
 };
@@ -1,14 +1,31 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDALimiterAudioProcessor::MDALimiterAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    _sampleRate = 44100.0f;
+    _maxLookahead = 0;
+    _detection = mda::DETECTION_LINKED;
+    _lookahead = 0;
+    _truePeak = true;
+    _delay = 0;
+    _delayMask = 0;
+    _delayPos = 0;
+
+    mda::watchAllParameters(_parameters, apvts);
+
+    apvts.addParameterListener("Lookahead", this);
+    apvts.addParameterListener("True Peak", this);
 }
 
 MDALimiterAudioProcessor::~MDALimiterAudioProcessor()
 {
+    apvts.removeParameterListener("Lookahead", this);
+    apvts.removeParameterListener("True Peak", this);
+    cancelPendingUpdate();
 }
 
 const juce::String MDALimiterAudioProcessor::getName() const
@@ -41,7 +58,42 @@ void MDALimiterAudioProcessor::changeProgramName(int index, const juce::String &
 
 void MDALimiterAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    _sampleRate = float(sampleRate);
+    _trim.prepare(sampleRate);
+
+    // Allocate everything for the longest lookahead time, so that changing
+    // the Lookahead setting doesn't need to allocate memory.
+    _maxLookahead = int(std::ceil(MAX_LOOKAHEAD_MS * 0.001f * _sampleRate));
+    const int numChannels = std::max(getTotalNumInputChannels(), 1);
+
+    // Every channel gets its own detector, in case Detection is not Linked.
+    _sidechains.resize(size_t(numChannels));
+    for (auto &sidechain : _sidechains) {
+        // The window is two samples longer than the lookahead, see
+        // computeLookaheadGains().
+        sidechain.peakWindow.setMaxLength(_maxLookahead + 2);
+        sidechain.smoothBuffer.resize(size_t(_maxLookahead));
+    }
+    _levels.resize(size_t(numChannels * CHUNK_SIZE));
+    _gains.resize(size_t(numChannels * CHUNK_SIZE));
+    _detectors.resize(size_t(numChannels));
+
+    int delayLength = 1;
+    while (delayLength < _maxLookahead + mda::TruePeakDetector::getLatency() + 1) {
+        delayLength *= 2;
+    }
+    _delayLines.resize(size_t(numChannels));
+    for (auto &delayLine : _delayLines) {
+        delayLine.resize(size_t(delayLength));
+    }
+    _delayMask = delayLength - 1;
+
+    // Make update() set up the detectors again for the new sample rate.
+    _lookahead = -1;
+    _detection = -1;
+
     resetState();
+    reportLatency();
 }
 
 void MDALimiterAudioProcessor::releaseResources()
@@ -55,13 +107,43 @@ void MDALimiterAudioProcessor::reset()
 
 bool MDALimiterAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDALimiterAudioProcessor::resetState()
 {
+    _trim.reset();
+
+    resetDetectors();
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
+}
+
+void MDALimiterAudioProcessor::resetDetectors()
+{
+    const int lookahead = std::max(_lookahead, 0);
+
+    for (auto &detector : _detectors) {
+        detector.reset();
+    }
+    for (auto &delayLine : _delayLines) {
+        std::fill(delayLine.begin(), delayLine.end(), 0.0f);
+    }
+    _delayPos = 0;
+
     // Always start at maximum volume.
-    _gain = 1.0f;
+    for (auto &sidechain : _sidechains) {
+        sidechain.gain = 1.0f;
+        sidechain.peakWindow.setLength(lookahead + 2);
+        sidechain.env = 1.0f;
+        std::fill(sidechain.smoothBuffer.begin(), sidechain.smoothBuffer.end(), 1.0f);
+        sidechain.smoothSum = double(lookahead);
+        sidechain.smoothPos = 0;
+    }
 }
 
 void MDALimiterAudioProcessor::update()
@@ -99,7 +181,7 @@ void MDALimiterAudioProcessor::update()
 
     // The output level is in decibels; convert to a linear gain.
     float fParam2 = apvts.getRawParameterValue("Output")->load();
-    _trim = juce::Decibels::decibelsToGain(fParam2);
+    _trim.setTarget(juce::Decibels::decibelsToGain(fParam2));
 
     // The attack parameter goes between 0 and 1. Convert it into a value from
     // 1 to 0.01, where 1 means the attack is fast and 0.01 means it's slow.
@@ -110,6 +192,45 @@ void MDALimiterAudioProcessor::update()
     // 0.01 to 0.00001. Like with the attack, a smaller number means slower.
     float fParam4 = apvts.getRawParameterValue("Release")->load();
     _release = std::pow(10.0f, -2.0f - (3.0f * fParam4));
+
+    // Lookahead: convert milliseconds to samples. The delay of the audio is
+    // the lookahead plus the delay of the true peak detector, if used. When
+    // this or the detection mode changes, the detectors and the delay lines
+    // start over, which is a short dropout in lookahead mode.
+    // The new latency is reported to the host by reportLatency(), which runs
+    // on the message thread.
+    float lookaheadMs = apvts.getRawParameterValue("Lookahead")->load();
+    int lookahead = lookaheadSamples(lookaheadMs);
+    bool truePeak = apvts.getRawParameterValue("True Peak")->load() > 0.5f;
+    int detection = int(apvts.getRawParameterValue("Detection")->load());
+    if (lookahead != _lookahead || truePeak != _truePeak || detection != _detection) {
+        _lookahead = lookahead;
+        _truePeak = truePeak;
+        _detection = detection;
+        _delay = delaySamples(lookahead, truePeak);
+        resetDetectors();
+    }
+}
+
+int MDALimiterAudioProcessor::lookaheadSamples(float lookaheadMs) const
+{
+    int lookahead = int(std::round(lookaheadMs * 0.001f * _sampleRate));
+    return std::min(lookahead, _maxLookahead);
+}
+
+int MDALimiterAudioProcessor::delaySamples(int lookahead, bool truePeak)
+{
+    if (lookahead == 0) {
+        return 0;
+    }
+    return lookahead + (truePeak ? mda::TruePeakDetector::getLatency() : 0);
+}
+
+void MDALimiterAudioProcessor::reportLatency()
+{
+    float lookaheadMs = apvts.getRawParameterValue("Lookahead")->load();
+    bool truePeak = apvts.getRawParameterValue("True Peak")->load() > 0.5f;
+    setLatencySamples(delaySamples(lookaheadSamples(lookaheadMs), truePeak));
 }
 
 void MDALimiterAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
@@ -123,19 +244,64 @@ void MDALimiterAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (_parameters.changed()) {
+        update();
+    }
+
+    const int numChannels = std::min(buffer.getNumChannels(), int(_sidechains.size()));
+    const int numSamples = buffer.getNumSamples();
+    const bool linked = (_detection == mda::DETECTION_LINKED);
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    // In Mid/Side mode, the detectors and the gains work on mid and side
+    // instead of on left and right.
+    const bool midSide = (_detection == mda::DETECTION_MID_SIDE && numChannels >= 2);
+    if (midSide) {
+        mda::encodeMidSide(buffer.getWritePointer(0), buffer.getWritePointer(1), numSamples);
+    }
+
+    /*
+      The original plug-in did everything for one sample at a time: read the
+      left and right input, update the gain, and write the output. Here, this
+      is split up into steps that each do a chunk of samples: first compute the
+      gain signal for every detector, then multiply each channel by its gain.
+      Updating the gain depends on the gain from the previous sample, so that
+      has to be done one sample at a time, but the other loops don't have such
+      dependencies and become SIMD code. That's also what makes it easy to
+      handle any number of channels.
+     */
+    for (int start = 0; start < numSamples; start += CHUNK_SIZE) {
+        const int n = std::min(CHUNK_SIZE, numSamples - start);
+
+        for (int i = 0; i < n; ++i) {
+            _trims[i] = _trim.next();
+        }
+
+        if (_lookahead > 0) {
+            computeLookaheadGains(buffer, numChannels, start, n);
+            delayAudio(buffer, numChannels, start, n);
+        } else {
+            computeGains(buffer, numChannels, start, n);
+        }
+
+        for (int c = 0; c < numChannels; ++c) {
+            const float *gains = &_gains[size_t((linked ? 0 : c) * CHUNK_SIZE)];
+            mda::applyGain(buffer.getWritePointer(c, start), _trims, gains, n);
+        }
+    }
+
+    if (midSide) {
+        mda::decodeMidSide(buffer.getWritePointer(0), buffer.getWritePointer(1), numSamples);
+    }
+}
+
+void MDALimiterAudioProcessor::computeGains(const juce::AudioBuffer<float> &buffer, int numChannels, int start, int numSamples)
+{
+    const bool linked = (_detection == mda::DETECTION_LINKED);
+    const int numSidechains = mda::numSidechains(_detection, numChannels);
 
     const float threshold = _threshold;
     const float attack = _attack;
     const float release = _release;
-    const float trim = _trim;
-
-    float g = _gain;
 
     /*
       How this works:
@@ -173,79 +339,222 @@ void MDALimiterAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
       soft knee gives a more gentle effect, while hard knee tends to be harsher.
      */
 
-    if (_softKnee) {
-        for (int i = 0; i < buffer.getNumSamples(); ++i) {
-            float inL = in1[i];
-            float inR = in2[i];
-
-            // In soft knee mode we don't wait until the audio exceeds the threshold.
-            // Instead, calculate what the current audio amplitude should be to stay
-            // below the threshold. If the audio is silent, the level variable is 1.
-            // The louder the audio becomes, the smaller level will be and the more
-            // the gain will be reduced. Also, the larger the threshold, the quicker
-            // this variable will drop towards 0 (although it will never reach 0).
-            float level = 1.0f / (1.0f + threshold * std::abs(inL + inR));
-
-            // If we wanted to immediately squash the audio signal to fit within the
-            // desired levels, we could use the value of the level variable as the
-            // gain for the current sample. In fact, that is what happens when attack
-            // and release are both 1.0. However, this also distorts the signal.
-            // By using smaller attack and release values, the gain signal becomes a
-            // smoothed version of the instantaneous audio level.
-            if (g > level) {
-                g = g - attack * (g - level);
-            } else {
-                g = g + release * (level - g);
+    // === Measure the level ===
+
+    // Like the original plug-in, the detector looks at |inL + inR|. In Linked
+    // mode with a different number of channels, the sum is scaled so that the
+    // same sound on every channel gives the same level as in stereo (for
+    // stereo the scale is 1). An unlinked detector sees its own channel as if
+    // it were on both sides of a stereo signal.
+    if (linked) {
+        float *levels = _levels.data();
+        const float *in = buffer.getReadPointer(0, start);
+        for (int i = 0; i < numSamples; ++i) {
+            levels[i] = in[i];
+        }
+        for (int c = 1; c < numChannels; ++c) {
+            in = buffer.getReadPointer(c, start);
+            for (int i = 0; i < numSamples; ++i) {
+                levels[i] += in[i];
+            }
+        }
+        const float scale = 2.0f / float(numChannels);
+        for (int i = 0; i < numSamples; ++i) {
+            levels[i] = scale * std::abs(levels[i]);
+        }
+    } else {
+        for (int c = 0; c < numChannels; ++c) {
+            float *levels = &_levels[size_t(c * CHUNK_SIZE)];
+            const float *in = buffer.getReadPointer(c, start);
+            for (int i = 0; i < numSamples; ++i) {
+                levels[i] = 2.0f * std::abs(in[i]);
             }
+        }
+    }
 
-            out1[i] = inL * trim * g;
-            out2[i] = inR * trim * g;
+    // === Compute the gain ===
+
+    for (int k = 0; k < numSidechains; ++k) {
+        const float *levels = &_levels[size_t(k * CHUNK_SIZE)];
+        float *gains = &_gains[size_t(k * CHUNK_SIZE)];
+        float g = _sidechains[size_t(k)].gain;
+
+        if (_softKnee) {
+            for (int i = 0; i < numSamples; ++i) {
+                // In soft knee mode we don't wait until the audio exceeds the threshold.
+                // Instead, calculate what the current audio amplitude should be to stay
+                // below the threshold. If the audio is silent, the level variable is 1.
+                // The louder the audio becomes, the smaller level will be and the more
+                // the gain will be reduced. Also, the larger the threshold, the quicker
+                // this variable will drop towards 0 (although it will never reach 0).
+                float level = 1.0f / (1.0f + threshold * levels[i]);
+
+                // If we wanted to immediately squash the audio signal to fit within the
+                // desired levels, we could use the value of the level variable as the
+                // gain for the current sample. In fact, that is what happens when attack
+                // and release are both 1.0. However, this also distorts the signal.
+                // By using smaller attack and release values, the gain signal becomes a
+                // smoothed version of the instantaneous audio level.
+                if (g > level) {
+                    g = g - attack * (g - level);
+                } else {
+                    g = g + release * (level - g);
+                }
+
+                gains[i] = g;
+            }
+
+        // Hard knee mode
+        } else {
+            for (int i = 0; i < numSamples; ++i) {
+                // To find out whether the sound exceeds the threshold, we need to find
+                // out how loud it is. First, convert the signal from stereo to mono by
+                // adding up the two channels. To compensate for the increased amplitude
+                // from this, multiply by 0.5 (i.e. we average the two channels).
+                // Then take the absolute value so that negative sample values don't
+                // cancel out positive sample values. Also multiply by the current gain
+                // level, because we'll be using this variable to determine if that gain
+                // is still appropriate.
+                // This is a very simple level detector: it only looks at the current
+                // sample. If this sample is way below the threshold but the overall
+                // sound is still too loud, we'll actually start incrementing the gain
+                // again. One way to improve that is to use an envelope detector, which
+                // looks at the general trend of the signal instead of single samples.
+                float level = 0.5f * g * levels[i];
+
+                if (level > threshold) {
+                    // If the signal level goes over the threshold, the current gain
+                    // value is too high and we must reduce it. The attack determines
+                    // how quickly the gain responds -- we don't immediately drop the
+                    // gain all the way but only reduce it a little bit. We keep doing
+                    // this for the next samples too, until the sound level no longer
+                    // exceeds the threshold.
+                    g = g - (attack * (level - threshold));
+                } else {
+                    // If the signal is below the threshold, the gain setting might
+                    // now be too low. Slowly bring the gain level back to 1.0.
+                    // This follows a logarithmic curve. The smaller the release,
+                    // the longer this takes. This continues until the gain is 1 or
+                    // until the sound level crosses the threshold again.
+                    g = g + (release * (1.0f - g));
+                }
+
+                gains[i] = g;
+            }
         }
 
-    // Hard knee mode
-    } else {
-        for (int i = 0; i < buffer.getNumSamples(); ++i) {
-            float inL = in1[i];
-            float inR = in2[i];
-
-            // To find out whether the sound exceeds the threshold, we need to find
-            // out how loud it is. First, convert the signal from stereo to mono by
-            // adding up the two channels. To compensate for the increased amplitude
-            // from this, multiply by 0.5 (i.e. we average the two channels).
-            // Then take the absolute value so that negative sample values don't
-            // cancel out positive sample values. Also multiply by the current gain
-            // level, because we'll be using this variable to determine if that gain
-            // is still appropriate.
-            // This is a very simple level detector: it only looks at the current
-            // sample. If this sample is way below the threshold but the overall
-            // sound is still too loud, we'll actually start incrementing the gain
-            // again. One way to improve that is to use an envelope detector, which
-            // looks at the general trend of the signal instead of single samples.
-            float level = 0.5f * g * std::abs(inL + inR);
-
-            if (level > threshold) {
-                // If the signal level goes over the threshold, the current gain
-                // value is too high and we must reduce it. The attack determines
-                // how quickly the gain responds -- we don't immediately drop the
-                // gain all the way but only reduce it a little bit. We keep doing
-                // this for the next samples too, until the sound level no longer
-                // exceeds the threshold.
-                g = g - (attack * (level - threshold));
+        _sidechains[size_t(k)].gain = g;
+    }
+}
+
+void MDALimiterAudioProcessor::computeLookaheadGains(const juce::AudioBuffer<float> &buffer, int numChannels, int start, int numSamples)
+{
+    /*
+      Lookahead mode. This is not part of the original plug-in.
+
+      The original limiter only looks at the current sample, so it always
+      reacts too late: the start of a loud transient gets through before the
+      gain comes down. Here, the audio is delayed by the lookahead time, so
+      the gain can already be turned down when a peak arrives at the output.
+
+      For every sample, the peak level (over all channels, when they are
+      linked) goes into a sliding window that is as long as the lookahead,
+      which gives the loudest peak that is coming up. From this we compute
+      the gain that keeps that peak at the threshold. Dropping the gain to
+      that level instantly would distort the sound, so a moving average over
+      the lookahead time turns every drop into a ramp that starts before the
+      peak and just reaches the right gain when the peak comes out of the
+      delay line. In hard knee mode,
+      the peaks therefore never go over the threshold (times the Output gain).
+
+      The Attack setting is not used here: the attack is always as long as
+      the lookahead. The release works as before.
+
+      With True Peak on, the peaks are measured in between the samples too,
+      which is what counts after the D/A converter or a lossy codec.
+     */
+    const bool linked = (_detection == mda::DETECTION_LINKED);
+    const int numSidechains = mda::numSidechains(_detection, numChannels);
+
+    const float threshold = _threshold;
+    const float release = _release;
+    const int lookahead = _lookahead;
+    const double scale = 1.0 / double(lookahead);
+
+    // === Find the peak levels ===
+
+    // In Linked mode this is the loudest peak over all channels.
+    std::fill(_levels.begin(), _levels.begin() + numSidechains * CHUNK_SIZE, 0.0f);
+    for (int c = 0; c < numChannels; ++c) {
+        float *peaks = &_levels[size_t((linked ? 0 : c) * CHUNK_SIZE)];
+        const float *in = buffer.getReadPointer(c, start);
+        if (_truePeak) {
+            auto &detector = _detectors[size_t(c)];
+            for (int i = 0; i < numSamples; ++i) {
+                peaks[i] = std::max(peaks[i], detector.process(in[i]));
+            }
+        } else {
+            for (int i = 0; i < numSamples; ++i) {
+                peaks[i] = std::max(peaks[i], std::abs(in[i]));
+            }
+        }
+    }
+
+    // === Compute the gain ===
+
+    for (int k = 0; k < numSidechains; ++k) {
+        auto &sidechain = _sidechains[size_t(k)];
+        const float *peaks = &_levels[size_t(k * CHUNK_SIZE)];
+        float *gains = &_gains[size_t(k * CHUNK_SIZE)];
+
+        for (int i = 0; i < numSamples; ++i) {
+            // The loudest peak from now until the end of the lookahead time.
+            // The window is two samples longer than the lookahead: one so that
+            // the last value of the moving average below includes the gain
+            // for this peak, and one because a peak in between two samples
+            // needs the gain to be low enough on both sides of it.
+            const float peak = sidechain.peakWindow.process(peaks[i]);
+
+            // In soft knee mode, this is the same formula as without lookahead,
+            // where |inL + inR| is about twice the peak level. In hard knee
+            // mode, this is the gain that brings the peak down to the threshold.
+            float target;
+            if (_softKnee) {
+                target = 1.0f / (1.0f + threshold * 2.0f * peak);
             } else {
-                // If the signal is below the threshold, the gain setting might
-                // now be too low. Slowly bring the gain level back to 1.0.
-                // This follows a logarithmic curve. The smaller the release,
-                // the longer this takes. This continues until the gain is 1 or
-                // until the sound level crosses the threshold again.
-                g = g + (release * (1.0f - g));
+                target = (peak > threshold) ? threshold / peak : 1.0f;
             }
 
-            out1[i] = inL * trim * g;
-            out2[i] = inR * trim * g;
+            // Go down right away, come back up slowly.
+            sidechain.env = std::min(target, sidechain.env + release * (1.0f - sidechain.env));
+
+            // The moving average.
+            float &oldest = sidechain.smoothBuffer[size_t(sidechain.smoothPos)];
+            sidechain.smoothSum += double(sidechain.env) - double(oldest);
+            oldest = sidechain.env;
+            if (++sidechain.smoothPos == lookahead) { sidechain.smoothPos = 0; }
+
+            gains[i] = float(sidechain.smoothSum * scale);
         }
     }
+}
 
-    _gain = g;
+void MDALimiterAudioProcessor::delayAudio(juce::AudioBuffer<float> &buffer, int numChannels, int start, int numSamples)
+{
+    const int delay = _delay;
+    const int mask = _delayMask;
+
+    for (int c = 0; c < numChannels; ++c) {
+        float *data = buffer.getWritePointer(c, start);
+        float *delayLine = _delayLines[size_t(c)].data();
+        int pos = _delayPos;
+        for (int i = 0; i < numSamples; ++i) {
+            delayLine[pos & mask] = data[i];
+            data[i] = delayLine[(pos - delay) & mask];
+            pos++;
+        }
+    }
+    _delayPos = (_delayPos + numSamples) & mask;
 }
 
 juce::AudioProcessorEditor *MDALimiterAudioProcessor::createEditor()
@@ -311,6 +620,34 @@ juce::AudioProcessorValueTreeState::ParameterLayout MDALimiterAudioProcessor::cr
         juce::StringArray({ "Hard", "Soft" }),
         0));
 
+    // Not part of the original plug-in.
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        juce::ParameterID("Lookahead", 1),
+        "Lookahead",
+        juce::NormalisableRange<float>(0.0f, MAX_LOOKAHEAD_MS, 0.1f),
+        0.0f,
+        juce::AudioParameterFloatAttributes()
+            .withLabel("ms")
+            .withStringFromValueFunction(
+                [](float value, int) {
+                    return (value <= 0.0f) ? juce::String("Off") : juce::String(value, 1);
+                }
+            )));
+
+    // Not part of the original plug-in. Only used in lookahead mode.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("True Peak", 1),
+        "True Peak",
+        juce::StringArray({ "Off", "On" }),
+        1));
+
+    // Not part of the original plug-in.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("Detection", 1),
+        "Detection",
+        juce::StringArray({ "Linked", "Unlinked", "Mid/Side" }),
+        mda::DETECTION_LINKED));
+
     return layout;
 }
 
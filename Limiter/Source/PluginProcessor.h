@@ -1,8 +1,46 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAParameters.h"
+#include "MDAPeakDetection.h"
+#include "MDASidechain.h"
 
-class MDALimiterAudioProcessor : public juce::AudioProcessor
+// Longest possible lookahead time in milliseconds.
+const float MAX_LOOKAHEAD_MS = 10.0f;
+
+// The limiter works on chunks of at most this many samples.
+const int CHUNK_SIZE = 64;
+
+// The state of one detector. In Linked mode there is one detector for all
+// channels, otherwise there is one per channel.
+struct MDALimiterSidechain
+{
+    // The current gain level. When the audio signal exceeds or approaches the
+    // threshold, the gain level is lowered to reduce the amplitude. The limiter
+    // essentially calculates a gain signal over time that is used to prevent
+    // the audio from becoming too loud. This is the gain signal's most recent
+    // value.
+    float gain;
+
+    // The loudest peak in the lookahead window.
+    mda::SlidingMaximum peakWindow;
+
+    // The gain before smoothing, in lookahead mode. This drops immediately
+    // when a peak comes into the lookahead window and recovers at the release
+    // speed.
+    float env;
+
+    // Moving average over the lookahead window that turns the drops in env
+    // into smooth ramps. This uses a ring buffer of the last `lookahead`
+    // values of env and their sum.
+    std::vector<float> smoothBuffer;
+    int smoothPos;
+    double smoothSum;
+};
+
+class MDALimiterAudioProcessor : public juce::AudioProcessor,
+                                 private juce::AudioProcessorValueTreeState::Listener,
+                                 private juce::AsyncUpdater
 {
 public:
     MDALimiterAudioProcessor();
@@ -41,7 +79,27 @@ private:
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
     void update();
+    int lookaheadSamples(float lookaheadMs) const;
+    static int delaySamples(int lookahead, bool truePeak);
+    void reportLatency();
     void resetState();
+    void resetDetectors();
+    void computeGains(const juce::AudioBuffer<float> &buffer, int numChannels, int start, int numSamples);
+    void computeLookaheadGains(const juce::AudioBuffer<float> &buffer, int numChannels, int start, int numSamples);
+    void delayAudio(juce::AudioBuffer<float> &buffer, int numChannels, int start, int numSamples);
+
+    // The host must only be told about a new latency from the message thread,
+    // but the audio thread may be the one that changes Lookahead or True Peak.
+    // This defers the call to setLatencySamples() to the message thread.
+    void parameterChanged(const juce::String &, float) override
+    {
+        triggerAsyncUpdate();
+    }
+
+    void handleAsyncUpdate() override
+    {
+        reportLatency();
+    }
 
     // The maximum amplitude you want the sound to have. Louder sounds will be
     // reduced to approximately this level. With a very slow attack it may take
@@ -59,16 +117,54 @@ private:
     float _release;
 
     // Use this for boosting the output level when setting a low threshold.
-    float _trim;
+    // This is smoothed to avoid zipper noise when the Output knob is moved.
+    mda::SmoothedValue _trim;
 
     // Choose between hard knee and soft knee modes.
     bool _softKnee;
 
-    // The current gain level. When the audio signal exceeds or approaches the
-    // threshold, the gain level is lowered to reduce the amplitude. The limiter
-    // essentially calculates a gain signal over time that is used to prevent the
-    // audio from becoming too loud. This is the gain signal's most recent value.
-    float _gain;
+    // Linked, unlinked, or mid/side detection. See MDASidechain.h.
+    int _detection;
+
+    // The detectors, one for each channel. Linked mode only uses the first.
+    std::vector<MDALimiterSidechain> _sidechains;
+
+    float _sampleRate;
+
+    // Longest possible lookahead in samples at the current sample rate.
+    int _maxLookahead;
+
+    // Lookahead mode. The audio is delayed by a few milliseconds, so that the
+    // limiter can see peaks coming and turn the gain down before they arrive.
+    // This is the lookahead time in samples; 0 means lookahead is off and the
+    // plug-in works like the original.
+    int _lookahead;
+
+    // Whether the lookahead mode detects the peaks in between samples.
+    bool _truePeak;
+
+    // Total delay of the audio in lookahead mode. This is the latency that is
+    // reported to the host.
+    int _delay;
+
+    // One true peak detector for each channel.
+    std::vector<mda::TruePeakDetector> _detectors;
+
+    // The delay lines for the audio, one per channel. The length is a power of
+    // two, so the read and write positions can wrap around using a mask.
+    std::vector<std::vector<float>> _delayLines;
+    int _delayMask;
+    int _delayPos;
+
+    // Scratch buffers for one chunk. There are CHUNK_SIZE levels and gains
+    // for every detector, one after the other, and one smoothed value of the
+    // Output level per sample.
+    std::vector<float> _levels;
+    std::vector<float> _gains;
+    float _trims[CHUNK_SIZE];
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDALimiterAudioProcessor)
 };
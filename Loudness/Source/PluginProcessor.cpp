@@ -1,4 +1,5 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 // Lookup table of filter coefficients.
 static float loudness[14][3] =
@@ -24,6 +25,7 @@ MDALoudnessAudioProcessor::MDALoudnessAudioProcessor()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(parameters, apvts);
 }
 
 MDALoudnessAudioProcessor::~MDALoudnessAudioProcessor()
@@ -60,6 +62,14 @@ void MDALoudnessAudioProcessor::changeProgramName(int index, const juce::String
 
 void MDALoudnessAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+    pairs.resize(channelPairs.size());
+
     resetState();
 }
 
@@ -74,12 +84,20 @@ void MDALoudnessAudioProcessor::reset()
 
 bool MDALoudnessAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDALoudnessAudioProcessor::resetState()
 {
-    z0 = z1 = z2 = z3 = 0.0f;
+    for (auto &state : pairs) {
+        state.z0 = state.z1 = state.z2 = state.z3 = 0.0f;
+    }
+
+    // Recalculate the parameters at the start of the next block.
+    parameters.invalidate();
 }
 
 void MDALoudnessAudioProcessor::update()
@@ -126,15 +144,27 @@ void MDALoudnessAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (parameters.changed()) {
+        update();
+    }
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    mda::processChannelPairs(channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this](int pair, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            processPair(pairs[size_t(pair)], in1, in2, out1, out2, numSamples);
+        });
+}
+
+void MDALoudnessAudioProcessor::processPair(MDALoudnessState &state, const float *in1, const float *in2,
+                                            float *out1, float *out2, int numSamples)
+{
+    float &z0 = state.z0;
+    float &z1 = state.z1;
+    float &z2 = state.z2;
+    float &z3 = state.z3;
 
     if (mode == 0) {  // cut
-        for (int i = 0; i < buffer.getNumSamples(); ++i) {
+        for (int i = 0; i < numSamples; ++i) {
             float a = in1[i];
             float b = in2[i];
 
@@ -156,7 +186,7 @@ void MDALoudnessAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
             out2[i] = b * gain;
         }
     } else {  // boost
-        for (int i = 0; i < buffer.getNumSamples(); ++i) {
+        for (int i = 0; i < numSamples; ++i) {
             float a = in1[i];
             float b = in2[i];
 
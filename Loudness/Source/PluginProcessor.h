@@ -1,6 +1,14 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAParameters.h"
+
+// The state of the effect for one pair of channels.
+struct MDALoudnessState
+{
+    float z0, z1, z2, z3;  // filter delays (0+1 = left channel, 2+3 = right)
+};
 
 class MDALoudnessAudioProcessor : public juce::AudioProcessor
 {
@@ -42,11 +50,20 @@ private:
 
     void update();
     void resetState();
+    void processPair(MDALoudnessState &state, const float *in1, const float *in2,
+                     float *out1, float *out2, int numSamples);
 
-    float z0, z1, z2, z3;  // filter delays (0+1 = left channel, 2+3 = right)
     float a0, a1, a2;      // filter coefficients
     float gain;            // output gain
     int mode;              // 0 = cut, 1 = boost
 
+    // How the channels are split into stereo pairs, and the state of the
+    // effect for each pair.
+    std::vector<mda::ChannelPair> channelPairs;
+    std::vector<MDALoudnessState> pairs;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher parameters;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDALoudnessAudioProcessor)
 };
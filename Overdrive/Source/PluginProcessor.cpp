@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDAOverdriveAudioProcessor::MDAOverdriveAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(_parameters, apvts);
 }
 
 MDAOverdriveAudioProcessor::~MDAOverdriveAudioProcessor()
@@ -41,6 +43,18 @@ void MDAOverdriveAudioProcessor::changeProgramName(int index, const juce::String
 
 void MDAOverdriveAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    _gain.prepare(sampleRate);
+    _drive.prepare(sampleRate);
+    _filt.prepare(sampleRate);
+
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    _channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+    _pairs.resize(_channelPairs.size());
+
     resetState();
 }
 
@@ -55,19 +69,30 @@ void MDAOverdriveAudioProcessor::reset()
 
 bool MDAOverdriveAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDAOverdriveAudioProcessor::resetState()
 {
     // Set the filter delay units back to zero.
-    _filtL = _filtR = 0.0f;
+    for (auto &state : _pairs) {
+        state.filtL = state.filtR = 0.0f;
+    }
+    _gain.reset();
+    _drive.reset();
+    _filt.reset();
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
 }
 
 void MDAOverdriveAudioProcessor::update()
 {
     // The amount of drive is a percentage; divide by 100 to make it 0 - 1.
-    _drive = apvts.getRawParameterValue("Drive")->load() / 100.0f;
+    _drive.setTarget(apvts.getRawParameterValue("Drive")->load() / 100.0f);
 
     // The muffle parameter controls a low-pass filter. Muffle is a percentage;
     // convert it to a value between 1.0 and 0.025 that drops off exponentially.
@@ -75,11 +100,11 @@ void MDAOverdriveAudioProcessor::update()
     // cutoff frequency will be. At 100%, the cutoff is around 200 Hz somewhere.
     // Since it's a first-order filter, it has a gentle roll-off of 6 dB/octave.
     float muffle = apvts.getRawParameterValue("Muffle")->load();
-    _filt = std::pow(10.0f, -1.6f * muffle / 100.0f);
+    _filt.setTarget(std::pow(10.0f, -1.6f * muffle / 100.0f));
 
     // The output level is between -20 dB and +20 dB. Convert to linear gain.
     float output = apvts.getRawParameterValue("Output")->load();
-    _gain = juce::Decibels::decibelsToGain(output);
+    _gain.setTarget(juce::Decibels::decibelsToGain(output));
 }
 
 void MDAOverdriveAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
@@ -93,20 +118,36 @@ void MDAOverdriveAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (_parameters.changed()) {
+        update();
+    }
+
+    // All pairs start from the same settings and ramp them the same way.
+    for (auto &state : _pairs) {
+        state.gain = _gain;
+        state.drive = _drive;
+        state.filt = _filt;
+    }
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    mda::processChannelPairs(_channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this](int pair, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            processPair(_pairs[size_t(pair)], in1, in2, out1, out2, numSamples);
+        });
 
-    const float drive = _drive;
-    const float gain = _gain;
-    const float f = _filt;
+    if (!_pairs.empty()) {
+        _gain = _pairs[0].gain;
+        _drive = _pairs[0].drive;
+        _filt = _pairs[0].filt;
+    }
+}
 
-    float fa = _filtL, fb = _filtR;
+void MDAOverdriveAudioProcessor::processPair(MDAOverdriveState &state, const float *in1, const float *in2,
+                                             float *out1, float *out2, int numSamples)
+{
+    float fa = state.filtL, fb = state.filtR;
 
-    for (int i = 0; i < buffer.getNumSamples(); ++i) {
+    for (int i = 0; i < numSamples; ++i) {
         float a = in1[i];
         float b = in2[i];
 
@@ -128,17 +169,20 @@ void MDAOverdriveAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
         // is, the more we add the overdriven signal into the mix.
         //
         // fa is y(n - 1) for the left channel and fb is for the right channel.
+        const float drive = state.drive.next();
+        const float f = state.filt.next();
         fa = fa + f * (drive * (aa - a) + a - fa);
         fb = fb + f * (drive * (bb - b) + b - fb);
 
         // Apply output gain and write to output buffer.
+        const float gain = state.gain.next();
         out1[i] = fa * gain;
         out2[i] = fb * gain;
     }
 
     // Catch denormals
-    if (std::abs(fa) > 1.0e-10f) _filtL = fa; else _filtL = 0.0f;
-    if (std::abs(fb) > 1.0e-10f) _filtR = fb; else _filtR = 0.0f;
+    if (std::abs(fa) > 1.0e-10f) state.filtL = fa; else state.filtL = 0.0f;
+    if (std::abs(fb) > 1.0e-10f) state.filtR = fb; else state.filtR = 0.0f;
 }
 
 juce::AudioProcessorEditor *MDAOverdriveAudioProcessor::createEditor()
@@ -1,6 +1,18 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAParameters.h"
+
+// The state of the effect for one pair of channels.
+struct MDAOverdriveState
+{
+    // Delay units for the left and right channel filters.
+    float filtL, filtR;
+
+    // This pair's copies of the smoothed output gain, drive and filter.
+    mda::SmoothedValue gain, drive, filt;
+};
 
 class MDAOverdriveAudioProcessor : public juce::AudioProcessor
 {
@@ -42,19 +54,28 @@ private:
 
     void update();
     void resetState();
+    void processPair(MDAOverdriveState &state, const float *in1, const float *in2,
+                     float *out1, float *out2, int numSamples);
 
     // Amount of overdrive, a value between 0 and 1. This controls the mix
     // between the original signal and the overdriven one.
-    float _drive;
+    mda::SmoothedValue _drive;
 
-    // Filter coefficient, a value between 1 and 0.025.
-    float _filt;
+    // Filter coefficient, a value between 1 and 0.025. Like the drive, this is
+    // smoothed so that moving the knob doesn't click.
+    mda::SmoothedValue _filt;
 
     // Output gain, a value between 0.1 (for -20 dB) and 10 (for +20 dB).
-    float _gain;
+    // This is smoothed to avoid zipper noise when the Output knob is moved.
+    mda::SmoothedValue _gain;
 
-    // Delay units for the left and right channel filters.
-    float _filtL, _filtR;
+    // How the channels are split into stereo pairs, and the state of the
+    // effect for each pair.
+    std::vector<mda::ChannelPair> _channelPairs;
+    std::vector<MDAOverdriveState> _pairs;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDAOverdriveAudioProcessor)
 };
@@ -1,5 +1,9 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
+
+#if !MDA_EXTERNAL_SAMPLES
 #include "mdaPianoData.h"
+#endif
 
 MDAPianoProgram::MDAPianoProgram()
 {
@@ -44,24 +48,37 @@ MDAPianoAudioProcessor::MDAPianoAudioProcessor()
     createPrograms();
     setCurrentProgram(0);
 
-    _waves = pianoData;
-
-    // Waveform data and keymapping is hard-wired in *this* version.
-    _keygroups[ 0].root = 36; _keygroups[ 0].high = 37;  _keygroups[ 0].pos = 0;      _keygroups[ 0].end = 36275;  _keygroups[ 0].loop = 14774;
-    _keygroups[ 1].root = 40; _keygroups[ 1].high = 41;  _keygroups[ 1].pos = 36278;  _keygroups[ 1].end = 83135;  _keygroups[ 1].loop = 16268;
-    _keygroups[ 2].root = 43; _keygroups[ 2].high = 45;  _keygroups[ 2].pos = 83137;  _keygroups[ 2].end = 146756; _keygroups[ 2].loop = 33541;
-    _keygroups[ 3].root = 48; _keygroups[ 3].high = 49;  _keygroups[ 3].pos = 146758; _keygroups[ 3].end = 204997; _keygroups[ 3].loop = 21156;
-    _keygroups[ 4].root = 52; _keygroups[ 4].high = 53;  _keygroups[ 4].pos = 204999; _keygroups[ 4].end = 244908; _keygroups[ 4].loop = 17191;
-    _keygroups[ 5].root = 55; _keygroups[ 5].high = 57;  _keygroups[ 5].pos = 244910; _keygroups[ 5].end = 290978; _keygroups[ 5].loop = 23286;
-    _keygroups[ 6].root = 60; _keygroups[ 6].high = 61;  _keygroups[ 6].pos = 290980; _keygroups[ 6].end = 342948; _keygroups[ 6].loop = 18002;
-    _keygroups[ 7].root = 64; _keygroups[ 7].high = 65;  _keygroups[ 7].pos = 342950; _keygroups[ 7].end = 391750; _keygroups[ 7].loop = 19746;
-    _keygroups[ 8].root = 67; _keygroups[ 8].high = 69;  _keygroups[ 8].pos = 391752; _keygroups[ 8].end = 436915; _keygroups[ 8].loop = 22253;
-    _keygroups[ 9].root = 72; _keygroups[ 9].high = 73;  _keygroups[ 9].pos = 436917; _keygroups[ 9].end = 468807; _keygroups[ 9].loop = 8852;
-    _keygroups[10].root = 76; _keygroups[10].high = 77;  _keygroups[10].pos = 468809; _keygroups[10].end = 492772; _keygroups[10].loop = 9693;
-    _keygroups[11].root = 79; _keygroups[11].high = 81;  _keygroups[11].pos = 492774; _keygroups[11].end = 532293; _keygroups[11].loop = 10596;
-    _keygroups[12].root = 84; _keygroups[12].high = 85;  _keygroups[12].pos = 532295; _keygroups[12].end = 560192; _keygroups[12].loop = 6011;
-    _keygroups[13].root = 88; _keygroups[13].high = 89;  _keygroups[13].pos = 560194; _keygroups[13].end = 574121; _keygroups[13].loop = 3414;
-    _keygroups[14].root = 93; _keygroups[14].high = 999; _keygroups[14].pos = 574123; _keygroups[14].end = 586343; _keygroups[14].loop = 2399;
+#if MDA_EXTERNAL_SAMPLES
+    // Load the waveforms from a sample file. This looks next to the plug-in's
+    // binary. The file is memory-mapped, so all instances of the plug-in share
+    // the same copy of the data.
+    auto folder = juce::File::getSpecialLocation(juce::File::currentExecutableFile).getParentDirectory();
+    _sampleStore = mda::SampleStore::find("mdaPiano.samples", folder.getFullPathName().toStdString());
+#else
+    _sampleStore = mda::SampleStore::fromMemory(pianoData, int(std::size(pianoData)), pianoKeygroups, 15);
+#endif
+
+    // Copy the keygroups, so that noteOn() does not need to go through the
+    // sample store to find them.
+    _waves = nullptr;
+    if (_sampleStore != nullptr && _sampleStore->numKeygroups() == 15) {
+        _waves = _sampleStore->samples();
+        std::memcpy(_keygroups, _sampleStore->keygroups(), sizeof(_keygroups));
+    } else {
+        DBG("Could not load mdaPiano.samples");
+        std::memset(_keygroups, 0, sizeof(_keygroups));
+    }
+
+    // Start out with the original waveforms.
+    _upsampledFactor = 1;
+    _waveFactor = 1;
+    _waveRate = RECORDED_RATE;
+
+    // Make the table for the sinc interpolation now, rather than on the audio
+    // thread when it is first used.
+    mda::SincTable::instance();
+
+    mda::watchAllParameters(_parameters, apvts);
 }
 
 MDAPianoAudioProcessor::~MDAPianoAudioProcessor()
@@ -103,7 +120,16 @@ void MDAPianoAudioProcessor::setCurrentProgram(int index)
     };
 
     for (int i = 0; i < NPARAMS; ++i) {
-        apvts.getParameter(paramNames[i])->setValueNotifyingHost(_programs[index].param[i]);
+        auto *param = apvts.getParameter(paramNames[i]);
+        float value = _programs[index].param[i];
+
+        // The presets were made when Polyphony went from 8 to 32 voices, but
+        // now it goes up to NVOICES. Convert the preset's value to the new range
+        // so that it still gives the same number of voices.
+        if (i == 8) {
+            value = param->convertTo0to1(8.0f + 24.0f * value);
+        }
+        param->setValueNotifyingHost(value);
     }
 }
 
@@ -129,6 +155,29 @@ void MDAPianoAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBloc
     // it's probably good enough... (about 3 ms at 44100 Hz).
     if (_sampleRate > 64000.0f) _delayMax = 0xFF; else _delayMax = 0x7F;
 
+    // Waveform Rate: if this option is on, get the waveforms upsampled for
+    // this sample rate. Making them takes a moment, so this is done here and
+    // not on the audio thread. Instances that run at the same sample rate
+    // share the upsampled waveforms.
+    _upsampledFactor = mda::SampleStore::upsamplingFactor(RECORDED_RATE, sampleRate);
+    if (apvts.getRawParameterValue("Waveform Rate")->load() > 0.5f && _upsampledFactor > 1) {
+        _upsampledStore = mda::SampleStore::upsampled(_sampleStore, _upsampledFactor);
+    } else {
+        _upsampledStore = nullptr;
+    }
+
+    // The previous upsampled waveforms may be gone now, so always select the
+    // waveforms again.
+    _waves = nullptr;
+    selectWaveforms();
+
+    // Stolen voices fade out by 60 dB in 5 ms. That is quick enough to not
+    // get in the way of the new note, and slow enough to not click.
+    _ghostDecay = std::exp(-6.9f / (0.005f * _sampleRate));
+
+    // Preallocate room for the MIDI events.
+    _events.reserve(mda::EventQueue::DEFAULT_CAPACITY);
+
     resetState();
 }
 
@@ -173,9 +222,14 @@ void MDAPianoAudioProcessor::resetState()
         _voices[v].decay = 0.99f;   // very quick fade out
     }
     _numActiveVoices = 0;
+    _numGhosts = 0;
 
     // Clear out any pending MIDI events.
-    _notes[0] = EVENTS_DONE;
+    _events.clear();
+
+    // Also clear the scratch buffers. Unused slots in the last group of voices
+    // still get processed, and this makes sure they never contain garbage.
+    std::memset(_voiceBuffers, 0, sizeof(_voiceBuffers));
 
     // These variables are changed by MIDI CC, reset to defaults.
     _volume = 0.2f;
@@ -185,6 +239,9 @@ void MDAPianoAudioProcessor::resetState()
     // Empty the delay for the comb filter.
     _delayPos = 0;
     memset(_combDelay, 0, sizeof(float) * 256);
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
 }
 
 void MDAPianoAudioProcessor::update()
@@ -244,9 +301,15 @@ void MDAPianoAudioProcessor::update()
     _width = 0.04f * param7;
     if (_width > 0.03f) _width = 0.03f;
 
-    // Polyphony is an integer number between 8 and 32.
+    // Polyphony is an integer number between 8 and NVOICES (128).
     _polyphony = int(apvts.getRawParameterValue("Polyphony")->load());
 
+    // CPU Budget: The UI shows -90 dB (off) to -30 dB. Convert to a linear
+    // envelope level. At the lowest setting this is 0, so no voice is quiet
+    // enough and the plug-in behaves like the original.
+    float budget = apvts.getRawParameterValue("CPU Budget")->load();
+    _stealThreshold = (budget <= -90.0f) ? 0.0f : std::pow(10.0f, budget / 20.0f);
+
     // Fine Tuning: The UI shows -50 to +50 cents. Convert this into -0.5 to
     // +0.5, which turns it from cents into semitones.
     _fine = apvts.getRawParameterValue("Fine Tuning")->load() / 100.0f;
@@ -261,97 +324,139 @@ void MDAPianoAudioProcessor::update()
     float param11 = apvts.getRawParameterValue("Stretch Tuning")->load();
     param11 = (param11 + 50.0f) / 100.0f;  // first to 0 - 1
     _stretch = 0.000434f * (param11 - 0.5f);
+
+    _interpolation = int(apvts.getRawParameterValue("Interpolation")->load());
+
+    // Waveform Rate: switch between the original and the upsampled waveforms.
+    selectWaveforms();
+}
+
+void MDAPianoAudioProcessor::selectWaveforms()
+{
+    // If the samples could not be loaded, there is nothing to choose from.
+    if (_sampleStore == nullptr || _sampleStore->numKeygroups() != 15) { return; }
+
+    // The upsampled waveforms are only available if the option was already on
+    // in prepareToPlay(). Turning it on while playing keeps the original
+    // waveforms until the host prepares the plug-in again.
+    bool upsampled = apvts.getRawParameterValue("Waveform Rate")->load() > 0.5f && _upsampledStore != nullptr;
+    const auto &store = upsampled ? _upsampledStore : _sampleStore;
+    if (store->samples() == _waves) { return; }
+
+    // The voices that are playing have read positions into the other table,
+    // so they are stopped.
+    for (int v = 0; v < NVOICES; ++v) {
+        _voices[v].env = 0.0f;
+    }
+    _numActiveVoices = 0;
+    _numGhosts = 0;
+
+    _waves = store->samples();
+    std::memcpy(_keygroups, store->keygroups(), sizeof(_keygroups));
+    _waveFactor = upsampled ? _upsampledFactor : 1;
+    _waveRate = RECORDED_RATE * float(_waveFactor);
 }
 
 void MDAPianoAudioProcessor::processEvents(juce::MidiBuffer &midiMessages)
 {
     // There are different ways a synth can handle MIDI events. This plug-in does
-    // it by copying the events it cares about -- note on and note off -- into an
-    // array. In the render loop, we step through this array to process the events
-    // one-by-one. Controllers such as the sustain pedal are processed right away,
-    // at the start of the block, so these are not sample accurate.
-
-    int npos = 0;
-    for (const auto metadata : midiMessages) {
-        if (metadata.numBytes != 3) continue;
-
-        const auto data0 = metadata.data[0];
-        const auto data1 = metadata.data[1];
-        const auto data2 = metadata.data[2];
-        const int deltaFrames = metadata.samplePosition;
-
-        switch (data0 & 0xf0) {  // status byte (all channels)
-            // Note off
-            case 0x80:
-                _notes[npos++] = deltaFrames;   // time offset
-                _notes[npos++] = data1 & 0x7F;  // note
-                _notes[npos++] = 0;             // vel
-                break;
-
-            // Note on
-            case 0x90:
-                _notes[npos++] = deltaFrames;   // time offset
-                _notes[npos++] = data1 & 0x7F;  // note
-                _notes[npos++] = data2 & 0x7F;  // vel
-                break;
-
-            // Controller
-            case 0xB0:
-                switch (data1) {
-                    case 0x01:  // mod wheel
-                    case 0x43:  // soft pedal
-                        // This maps the position of the mod wheel to a
-                        // parabolic curve starting at 161.29 (position 0)
-                        // down to 0.0 (position 127).
-                        _muff = 0.01f * float((127 - data2) * (127 - data2));
-                        break;
-
-                    case 0x07:  // volume
-                        // Map the position of the volume control to a
-                        // parabolic curve starting at 0.0 (position 0)
-                        // up to 0.323 (position 127).
-                        _volume = 0.00002f * float(data2 * data2);
-                        break;
-
-                    case 0x40:  // sustain pedal
-                    case 0x42:  // sustenuto pedal
-                        // Make the variable 64 when the pedal is pressed
-                        // and 0 when released.
-                        _sustain = data2 & 0x40;
-
-                        // Pedal released? Then end all sustained notes.
-                        if (_sustain == 0) {
-                            _notes[npos++] = deltaFrames;
-                            _notes[npos++] = SUSTAIN;
-                            _notes[npos++] = 0;
-                        }
-                        break;
-
-                    default:  // all notes off
-                        if (data1 > 0x7A) {
-                            // Setting the decay to 0.99 will fade out the
-                            // voice very quickly.
-                            for (int v = 0; v < NVOICES; ++v) _voices[v].decay = 0.99f;
-                            _sustain = 0;
-                            _muff = 160.0f;
-                        }
-                        break;
-                }
-                break;
+    // it by copying the events into a queue. In the render loop, we step through
+    // this queue and handle each event at the exact sample it belongs to. That
+    // includes controllers such as the sustain pedal and the volume.
+    //
+    // The queue has a fixed size, so that it never allocates on the audio
+    // thread. If the host sends more events than fit, the render loop calls
+    // fillEvents() again once the queue is empty, to get the next batch.
+    _midiIterator = midiMessages.cbegin();
+    _midiEnd = midiMessages.cend();
+    fillEvents();
+}
+
+void MDAPianoAudioProcessor::fillEvents()
+{
+    _events.clear();
 
-            // Program change
-            case 0xC0:
-                if (data1 < NPROGS) setCurrentProgram(data1);
-                break;
+    while (_midiIterator != _midiEnd) {
+        const auto metadata = *_midiIterator;
 
-            default: break;
+        // Program change and channel aftertouch have only one data byte.
+        // Anything longer than three bytes is SysEx, which is ignored.
+        if (metadata.numBytes >= 2 && metadata.numBytes <= 3) {
+            const auto data2 = metadata.numBytes == 3 ? metadata.data[2] : juce::uint8(0);
+            if (!_events.add(metadata.samplePosition, metadata.data[0], metadata.data[1], data2)) {
+                break;  // the queue is full, continue from this event later
+            }
         }
+        ++_midiIterator;
+    }
+}
+
+void MDAPianoAudioProcessor::handleEvent(const mda::MidiEvent &event)
+{
+    const auto data0 = event.status;
+    const auto data1 = event.data1;
+    const auto data2 = event.data2;
+
+    switch (data0 & 0xf0) {  // status byte (all channels)
+        // Note off
+        case 0x80:
+            noteOn(data1 & 0x7F, 0);
+            break;
+
+        // Note on
+        case 0x90:
+            noteOn(data1 & 0x7F, data2 & 0x7F);
+            break;
+
+        // Controller
+        case 0xB0:
+            switch (data1) {
+                case 0x01:  // mod wheel
+                case 0x43:  // soft pedal
+                    // This maps the position of the mod wheel to a
+                    // parabolic curve starting at 161.29 (position 0)
+                    // down to 0.0 (position 127).
+                    _muff = 0.01f * float((127 - data2) * (127 - data2));
+                    break;
+
+                case 0x07:  // volume
+                    // Map the position of the volume control to a
+                    // parabolic curve starting at 0.0 (position 0)
+                    // up to 0.323 (position 127).
+                    _volume = 0.00002f * float(data2 * data2);
+                    break;
+
+                case 0x40:  // sustain pedal
+                case 0x42:  // sustenuto pedal
+                    // Make the variable 64 when the pedal is pressed
+                    // and 0 when released.
+                    _sustain = data2 & 0x40;
+
+                    // Pedal released? Then end all sustained notes.
+                    if (_sustain == 0) {
+                        noteOn(SUSTAIN, 0);
+                    }
+                    break;
+
+                default:  // all notes off
+                    if (data1 > 0x7A) {
+                        // Setting the decay to 0.99 will fade out the
+                        // voice very quickly.
+                        for (int v = 0; v < NVOICES; ++v) _voices[v].decay = 0.99f;
+                        _sustain = 0;
+                        _muff = 160.0f;
+                    }
+                    break;
+            }
+            break;
 
-        // Discard events if buffer full!
-        if (npos > EVENTBUFFER) npos -= 3;
+        // Program change
+        case 0xC0:
+            if (data1 < NPROGS) setCurrentProgram(data1);
+            break;
+
+        default: break;
     }
-    _notes[npos] = EVENTS_DONE;
-    midiMessages.clear();
 }
 
 void MDAPianoAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
@@ -365,25 +470,29 @@ void MDAPianoAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (_parameters.changed()) {
+        update();
+    }
 
     processEvents(midiMessages);
 
+    // The voices may have changed since the last chunk was rendered: silent
+    // voices were removed at the end of the previous block, or the polyphony
+    // may have changed.
+    rebuildVoiceTree();
+
     const int sampleFrames = buffer.getNumSamples();
 
     float *out0 = buffer.getWritePointer(0);
     float *out1 = buffer.getWritePointer(1);
 
-    int event = 0;
     int frame = 0;  // how many samples are already rendered
 
     while (frame < sampleFrames) {
-        // Get the timestamp of the next note on/off event. This is usually in
-        // the future, i.e. a number of samples after the current sample.
-        int frames = _notes[event++];
-
-        // This catches the EVENTS_DONE special event. There are no events left.
-        if (frames > sampleFrames) frames = sampleFrames;
+        // Get the timestamp of the next MIDI event. This is usually in the
+        // future, i.e. a number of samples after the current sample. If there
+        // are no more events, render until the end of the block.
+        int frames = _events.nextEventTime(sampleFrames);
 
         // The timestamp for the event is relative to the start of the block.
         // Make it relative to the previous event; this tells us how many samples
@@ -395,51 +504,156 @@ void MDAPianoAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce
         frame += frames;
 
         // Until it's time to process the upcoming event, render the active voices.
-        while (--frames >= 0) {
-            Voice *V = _voices;
-
-            // Accumulators for the left and right channel. We will add the outputs
-            // of all the active voices to these.
-            float l = 0.0f, r = 0.0f;
-
-            for (int v = 0; v < _numActiveVoices; ++v) {
-                // Increment the read position in the waveform. The read position is
-                // split into `pos`, which is the integer part, and `frac`, which is
-                // the fractional part. To read the next sample value, we move the read
-                // position ahead by the step size `delta`, a fixed-point number, where
-                // the lowest 16 bits are the fractional part.
-                V->frac += V->delta;
-
-                // If the fractional part of the read position is now more than 1.0,
-                // or more than 65535, increment the integer part of the read position.
-                V->pos += V->frac >> 16;
-
-                // Remove the integer amount from `frac` (if any), since that just got
-                // added to `pos`. This is the same as doing `frac modulo 65536`.
-                V->frac &= 0xFFFF;
-
-                // If the read position has reached the end of the sample, wrap it
-                // around to where the loop begins. The attack portion of the sample is
-                // played just once, and from then on we just keep looping this region.
-                if (V->pos > V->end) V->pos -= V->loop;
+        while (frames > 0) {
+            const int chunk = std::min(frames, RENDER_CHUNK);
+            renderVoices(chunk);
+
+            for (int i = 0; i < chunk; ++i) {
+                const float l = _mixL[i];
+                const float r = _mixR[i];
+
+                // When you sum a signal with a delayed version, you get a comb filter.
+                // This filter boosts frequencies that are a multiple of the delay length
+                // and suppresses other frequencies. To get a wider stereo field, we can
+                // add this filtered signal to one channel and subtract it from the other.
+                // The length of the delay is fixed (127 or 255 samples).
+                _combDelay[_delayPos] = l + r;            // add to delay line, as mono
+                ++_delayPos &= _delayMax;                 // increment position & wrap around
+                float x = _comb * _combDelay[_delayPos];  // read from delay line
+
+                // Write the result into the output buffer.
+                *out0++ = l + x;
+                *out1++ = r - x;
+            }
+            frames -= chunk;
+        }
 
-                // Integer-based linear interpolation. Together, `pos` and `frac` will
-                // point to a value in between two samples (unless frac is 0).
-                // Suppose pos = 3 and frac = 0.6 (or really 65536 * 0.6 = 39321). Then
-                // the interpolated sample should be 40% of the sample at index 3 and
-                // 60% of the sample at index 4. That's exactly what the formula below
-                // calculates: it takes the sample value at index 3, plus 0.6 times the
-                // sample at index 4, minus 0.6 times the sample at index 3. The >> 16
-                // is used to divide the result by 65536 because of how frac is stored.
-                int i = _waves[V->pos] + ((V->frac * (_waves[V->pos + 1] - _waves[V->pos])) >> 16);
+        // It's time to handle the event, or events if there are several with
+        // the same timestamp. This starts or stops notes, but also handles the
+        // controllers, such as the sustain pedal and the volume.
+        while (_events.hasEventAt(frame)) {
+            handleEvent(_events.next());
+            if (_events.empty()) {
+                fillEvents();
+            }
+        }
+    }
+
+    // Remove the ghost voices that have faded out.
+    int g = 0;
+    while (g < _numGhosts) {
+        if (_ghosts[g].env < SILENCE) {
+            _ghosts[g] = _ghosts[--_numGhosts];
+        } else {
+            ++g;
+        }
+    }
+
+    // Turn off voices whose envelope has dropped below the minimum level. In
+    // CPU budget mode, that level can be higher, and those voices can still
+    // be heard, so they fade out as ghosts.
+    const float silence = std::max(SILENCE, _stealThreshold);
+    for (int v = 0; v < _numActiveVoices; ++v) {
+        if (_voices[v].env < silence) {
+            fadeOutVoice(v);
+            _voices[v] = _voices[--_numActiveVoices];
+        }
+    }
+
+    // All the events have been handled, so they're not passed on to the host.
+    midiMessages.clear();
+}
+
+void MDAPianoAudioProcessor::renderVoices(int numFrames)
+{
+    /*
+      The original plug-in renders one sample at a time: for every sample, it
+      loops through all the active voices, and for every voice it reads the
+      waveform, applies the envelope and the muffling filter, and adds the
+      result to the mix. Here, the voices render a whole chunk of samples in
+      three steps, each of which is a simple loop that the compiler can turn
+      into SIMD instructions:
+
+      1. Every voice reads its waveform for the whole chunk into its own buffer.
+
+      2. One sample at a time, the envelope and the muffling filter are applied
+         to all voices. These have feedback from one sample to the next, so they
+         can't be vectorized across samples. But the voices are independent, so
+         they can be vectorized across voices, and that also keeps the CPU busy
+         with one voice while the previous one's result is not ready yet.
+
+      3. Every voice is added into the mix for the whole chunk.
+
+      The voices are still added into the mix in the same order as before, and
+      all the math is the same, so the output is exactly the same as rendering
+      sample-by-sample.
+     */
+    // The voices to render: the active voices, followed by the ghosts of the
+    // voices that were stolen and are fading out.
+    const int numVoices = _numActiveVoices + _numGhosts;
+    MDAPianoVoice *voices[NVOICES + NGHOSTS];
+    for (int v = 0; v < _numActiveVoices; ++v) {
+        voices[v] = &_voices[v];
+    }
+    for (int g = 0; g < _numGhosts; ++g) {
+        voices[_numActiveVoices + g] = &_ghosts[g];
+    }
+
+    // === Step 1: Read the waveforms ===
+
+    for (int v = 0; v < numVoices; ++v) {
+        MDAPianoVoice &V = *voices[v];
+
+        // Step through the waveform. The read position is split into `pos`,
+        // which is the integer part, and `frac`, which is the fractional part.
+        // For every sample, the read position moves ahead by the step size
+        // `delta`, a fixed-point number where the lowest 16 bits are the
+        // fractional part. If the read position reaches the end of the sample,
+        // it wraps around to where the loop begins. The attack portion of the
+        // sample is played just once, and from then on we keep looping this
+        // region. This gives the read positions for every sample in the chunk.
+        mda::advanceReadPosition(V.pos, V.frac, V.delta, V.end, V.loop, _readPos, _readFrac, numFrames);
+
+        readVoice(V, _voiceBuffers[v], numFrames);
+    }
+
+    // === Step 2: Envelope and muffling filter ===
+
+    // Copy the state of the voices into arrays, one for each variable, so the
+    // loop over the voices can load them straight into SIMD registers.
+    float env[NVOICES + NGHOSTS], decay[NVOICES + NGHOSTS];
+    float f0[NVOICES + NGHOSTS], f1[NVOICES + NGHOSTS], ff[NVOICES + NGHOSTS];
+    for (int v = 0; v < numVoices; ++v) {
+        env[v] = voices[v]->env;
+        decay[v] = voices[v]->decay;
+        f0[v] = voices[v]->f0;
+        f1[v] = voices[v]->f1;
+        ff[v] = voices[v]->ff;
+    }
+
+    // The voices go in groups of VOICE_GROUP. Because that number is fixed,
+    // the compiler turns the loop over the voices into a handful of SIMD
+    // instructions. The group at the end may be partly empty; those slots get
+    // an envelope of zero and their results are never used.
+    const int numSlots = (numVoices + VOICE_GROUP - 1) / VOICE_GROUP * VOICE_GROUP;
+    for (int v = numVoices; v < numSlots; ++v) {
+        env[v] = 0.0f;
+        decay[v] = 0.0f;
+        f0[v] = 0.0f;
+        f1[v] = 0.0f;
+        ff[v] = 0.0f;
+    }
 
+    for (int g = 0; g < numSlots; g += VOICE_GROUP) {
+        for (int i = 0; i < numFrames; ++i) {
+            for (int v = g; v < g + VOICE_GROUP; ++v) {
                 // Apply the envelope and scale. The original sample data is 16-bit but
                 // we're working with floats here so divide by 32768 as well.
-                float x = V->env * float(i) / 32768.0f;
+                const float x = env[v] * _voiceBuffers[v][i] / 32768.0f;
 
                 // Update the envelope. Multiplying by a decay value that is less than
                 // 1.0 gives this an exponentially decaying curve.
-                V->env = V->env * V->decay;
+                env[v] *= decay[v];
 
                 // Apply the muffle filter. This is a gentle first-order low-pass
                 // filter with the difference equation:
@@ -458,80 +672,150 @@ void MDAPianoAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce
                 // Note: because x(n) and x(n-1) are both multiplied by f, this filter
                 // has a 6 dB overall gain. You can remove this by multiplying them by
                 // f / 2 instead.
-                V->f0 += V->ff * (x + V->f1 - V->f0);
-                V->f1 = x;
-
-                // Apply panning. The amount of panning was computed in noteOn().
-                l += V->outl * V->f0;
-                r += V->outr * V->f0;
-
-                // Ear protection: just in case the sound explodes, turn it off.
-                // Silly bugs (such as filter cutoff > Nyquist) can blow out your
-                // eardrums...
-                if ((l < -2.0f) || (l > 2.0f)) {
-                    l = 0.0f;
-                }
-                if ((r < -2.0f) || (r > 2.0f)) {
-                    r = 0.0f;
-                }
+                f0[v] += ff[v] * (x + f1[v] - f0[v]);
+                f1[v] = x;
 
-                // Go to the next active voice.
-                V++;
+                _voiceBuffers[v][i] = f0[v];
             }
-
-            // When you sum a signal with a delayed version, you get a comb filter.
-            // This filter boosts frequencies that are a multiple of the delay length
-            // and suppresses other frequencies. To get a wider stereo field, we can
-            // add this filtered signal to one channel and subtract it from the other.
-            // The length of the delay is fixed (127 or 255 samples).
-            _combDelay[_delayPos] = l + r;            // add to delay line, as mono
-            ++_delayPos &= _delayMax;                 // increment position & wrap around
-            float x = _comb * _combDelay[_delayPos];  // read from delay line
-
-            // Write the result into the output buffer.
-            *out0++ = l + x;
-            *out1++ = r - x;
         }
+    }
+
+    for (int v = 0; v < numVoices; ++v) {
+        voices[v]->env = env[v];
+        voices[v]->f0 = f0[v];
+        voices[v]->f1 = f1[v];
+    }
+
+    // The levels of all the voices have changed.
+    rebuildVoiceTree();
+
+    // === Step 3: Mix ===
 
-        // It's time to handle the event. This starts the new note, or stops the
-        // note if velocity is 0.
-        if (frame < sampleFrames) {
-            int note = _notes[event++];
-            int vel  = _notes[event++];
-            noteOn(note, vel);
+    for (int i = 0; i < numFrames; ++i) {
+        _mixL[i] = 0.0f;
+        _mixR[i] = 0.0f;
+    }
+
+    for (int v = 0; v < numVoices; ++v) {
+        const float *y = _voiceBuffers[v];
+        const float outl = voices[v]->outl;
+        const float outr = voices[v]->outr;
+
+        for (int i = 0; i < numFrames; ++i) {
+            // Apply panning. The amount of panning was computed in noteOn().
+            const float l = _mixL[i] + outl * y[i];
+            const float r = _mixR[i] + outr * y[i];
+
+            // Ear protection: just in case the sound explodes, turn it off.
+            // Silly bugs (such as filter cutoff > Nyquist) can blow out your
+            // eardrums...
+            _mixL[i] = ((l < -2.0f) || (l > 2.0f)) ? 0.0f : l;
+            _mixR[i] = ((r < -2.0f) || (r > 2.0f)) ? 0.0f : r;
         }
     }
+}
 
-    // Turn off voices whose envelope has dropped below the minimum level.
-    for (int v = 0; v < _numActiveVoices; ++v) {
-        if (_voices[v].env < SILENCE) {
-            _voices[v] = _voices[--_numActiveVoices];
+void MDAPianoAudioProcessor::rebuildVoiceTree()
+{
+    // Only the first _polyphony voices can be stolen. There can be more voices
+    // playing than that if the Polyphony setting was just lowered.
+    const int numVoices = std::min(_numActiveVoices, _polyphony);
+    for (int v = 0; v < numVoices; ++v) {
+        _voiceTree.setLevel(v, _voices[v].env);
+    }
+    _voiceTree.rebuild(numVoices);
+}
+
+void MDAPianoAudioProcessor::fadeOutVoice(int v)
+{
+    // The original plug-in simply overwrites a stolen voice, so its sound stops
+    // in the middle of a waveform, which clicks. Instead, move the voice into
+    // the pool of ghost voices. There it carries on where it was, but with an
+    // envelope that fades out in a few milliseconds.
+    const float env = _voices[v].env;
+    if (env < SILENCE) { return; }
+
+    // If all ghosts are busy, replace the quietest one. But if the voice that
+    // is being stolen is quieter still, cutting that one off is the lesser
+    // click.
+    int g = _numGhosts;
+    if (g == NGHOSTS) {
+        g = 0;
+        for (int i = 1; i < NGHOSTS; ++i) {
+            if (_ghosts[i].env < _ghosts[g].env) { g = i; }
         }
+        if (env < _ghosts[g].env) { return; }
+    } else {
+        _numGhosts++;
     }
 
-    // Mark the events buffer as done.
-    _notes[0] = EVENTS_DONE;
+    _ghosts[g] = _voices[v];
+    _ghosts[g].decay = std::min(_voices[v].decay, _ghostDecay);
+}
+
+void MDAPianoAudioProcessor::readVoice(const MDAPianoVoice &V, float *wave, int numFrames)
+{
+    // Reads the waveform at the positions from _readPos and _readFrac. Each
+    // interpolation method has its own loop, so that the choice is made once
+    // per chunk instead of once per sample.
+    switch (_interpolation) {
+        case 0:
+            for (int i = 0; i < numFrames; ++i) {
+                const int pos = _readPos[i];
+                const int frac = _readFrac[i];
+
+                // Integer-based linear interpolation. Together, `pos` and `frac` will
+                // point to a value in between two samples (unless frac is 0).
+                // Suppose pos = 3 and frac = 0.6 (or really 65536 * 0.6 = 39321). Then
+                // the interpolated sample should be 40% of the sample at index 3 and
+                // 60% of the sample at index 4. That's exactly what the formula below
+                // calculates: it takes the sample value at index 3, plus 0.6 times the
+                // sample at index 4, minus 0.6 times the sample at index 3. The >> 16
+                // is used to divide the result by 65536 because of how frac is stored.
+                int s = _waves[pos] + ((frac * (_waves[pos + 1] - _waves[pos])) >> 16);
+                wave[i] = float(s);
+            }
+            break;
+
+        case 1:
+            for (int i = 0; i < numFrames; ++i) {
+                wave[i] = mda::interpolateCubic(_waves, _readPos[i], _readFrac[i], V.start, V.end, V.loop);
+            }
+            break;
+
+        default: {
+            const mda::SincTable &table = mda::SincTable::instance();
+            for (int i = 0; i < numFrames; ++i) {
+                wave[i] = mda::interpolateSinc(table, _waves, _readPos[i], _readFrac[i], V.start, V.end, V.loop);
+            }
+            break;
+        }
+    }
 }
 
 void MDAPianoAudioProcessor::noteOn(int note, int velocity)
 {
+    // Without waveforms there is nothing to play.
+    if (_waves == nullptr) { return; }
+
     if (velocity > 0) {
         // === Find voice ===
 
-        // If max polyphony is not reached yet, use a free voice.
+        // In CPU budget mode, a voice that has become too quiet to matter is
+        // reused first, so that fewer voices are playing at any time.
         int vl = 0;
-        if (_numActiveVoices < _polyphony) {
+        if (_voiceTree.quietestLevel() < _stealThreshold) {
+            vl = _voiceTree.quietest();
+            fadeOutVoice(vl);
+        } else if (_numActiveVoices < _polyphony) {
+            // If max polyphony is not reached yet, use a free voice.
             vl = _numActiveVoices;
             _numActiveVoices++;
         } else {
-            // Otherwise, find the quietest voice to steal.
-            float l = 99.0f;
-            for (int v = 0; v < _polyphony; ++v) {
-                if (_voices[v].env < l) {
-                    l = _voices[v].env;
-                    vl = v;
-                }
-            }
+            // Otherwise, steal the quietest voice. The original plug-in looked
+            // at every voice to find it; the voice tree already knows.
+            vl = _voiceTree.quietest();
+            fadeOutVoice(vl);
         }
 
         // === Calculate pitch ===
@@ -594,7 +878,9 @@ void MDAPianoAudioProcessor::noteOn(int note, int velocity)
         // "frequency" is 22050 / sampleRate for the root note, i.e. 0.5 at 44100
         // Hz. To get the step size, multiply by exp(0.05776226 * semitones) which
         // is the same as 2^(semitones/12).
-        l = 22050.0f * _inverseSampleRate * std::exp(0.05776226505f * l);
+        // With the Waveform Rate option, the waveforms have been upsampled and
+        // _waveRate is a multiple of 22050 Hz.
+        l = _waveRate * _inverseSampleRate * std::exp(0.05776226505f * l);
 
         // Instead of storing the step size as a float, this plug-in stores it as a
         // fixed point number, so it's multiplied by 65536 (shifted by 16 bits).
@@ -605,6 +891,7 @@ void MDAPianoAudioProcessor::noteOn(int note, int velocity)
         _voices[vl].pos = _keygroups[kg].pos;
         _voices[vl].end = _keygroups[kg].end;
         _voices[vl].loop = _keygroups[kg].loop;
+        _voices[vl].start = _keygroups[kg].pos;
         _voices[vl].note = note;
 
         // === Muffle filter ===
@@ -684,11 +971,15 @@ void MDAPianoAudioProcessor::noteOn(int note, int velocity)
         // change, to say 0.999929, makes a big difference in the decay time!
         if (note < 44) note = 44;  // limit max decay length
         _voices[vl].decay = std::exp(-_inverseSampleRate * std::exp(-0.6f + 0.033f*float(note) - _envDecay));
+
+        // Let the voice tree know about the new voice's level, in case another
+        // note at the same time needs to steal a voice.
+        _voiceTree.update(vl, _voices[vl].env);
     }
 
     // Note off
     else {
-        for (int v = 0; v < NVOICES; ++v) {
+        for (int v = 0; v < _numActiveVoices; ++v) {
             // Any voices playing this note?
             if (_voices[v].note == note) {
                 // If the sustain pedal is not pressed...
@@ -798,7 +1089,7 @@ juce::AudioProcessorValueTreeState::ParameterLayout MDAPianoAudioProcessor::crea
     layout.add(std::make_unique<juce::AudioParameterFloat>(
         juce::ParameterID("Polyphony", 1),
         "Polyphony",
-        juce::NormalisableRange<float>(8.0f, 32.0f, 1.0f),
+        juce::NormalisableRange<float>(8.0f, float(NVOICES), 1.0f),
         16.0f,
         juce::AudioParameterFloatAttributes().withLabel("voices")));
 
@@ -833,6 +1124,34 @@ juce::AudioProcessorValueTreeState::ParameterLayout MDAPianoAudioProcessor::crea
         0.0f,
         juce::AudioParameterFloatAttributes().withLabel("cents")));
 
+    // Not part of the original plug-in and not stored in the factory presets.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("Interpolation", 1),
+        "Interpolation",
+        juce::StringArray { "Linear", "Cubic", "Sinc" },
+        0));
+
+    // Not part of the original plug-in and not stored in the factory presets.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID("Waveform Rate", 1),
+        "Waveform Rate",
+        juce::StringArray { "Original", "Upsampled" },
+        0));
+
+    // Not part of the original plug-in and not stored in the factory presets.
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        juce::ParameterID("CPU Budget", 1),
+        "CPU Budget",
+        juce::NormalisableRange<float>(-90.0f, -30.0f, 1.0f),
+        -90.0f,
+        juce::AudioParameterFloatAttributes()
+            .withLabel("dB")
+            .withStringFromValueFunction(
+                [](float value, int) {
+                    return (value <= -90.0f) ? juce::String("Off") : juce::String(int(value));
+                }
+            )));
+
     return layout;
 }
 
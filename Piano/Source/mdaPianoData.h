@@ -1,3 +1,25 @@
+#include "MDASampleStore.h"
+
+// Maps the waveforms in pianoData to ranges of notes.
+const mda::Keygroup pianoKeygroups[15] = {
+//    root high  pos     end     loop
+    { 36,  37,      0,  36275, 14774 },
+    { 40,  41,  36278,  83135, 16268 },
+    { 43,  45,  83137, 146756, 33541 },
+    { 48,  49, 146758, 204997, 21156 },
+    { 52,  53, 204999, 244908, 17191 },
+    { 55,  57, 244910, 290978, 23286 },
+    { 60,  61, 290980, 342948, 18002 },
+    { 64,  65, 342950, 391750, 19746 },
+    { 67,  69, 391752, 436915, 22253 },
+    { 72,  73, 436917, 468807,  8852 },
+    { 76,  77, 468809, 492772,  9693 },
+    { 79,  81, 492774, 532293, 10596 },
+    { 84,  85, 532295, 560192,  6011 },
+    { 88,  89, 560194, 574121,  3414 },
+    { 93, 999, 574123, 586343,  2399 },
+};
+
 short pianoData[] = {
 5,-7,5,-6,159,163,146,133,130,152,
 220,299,641,1124,1413,673,-1277,-3818,-4550,-3574,
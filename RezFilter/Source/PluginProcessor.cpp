@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDARezFilterAudioProcessor::MDARezFilterAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(parameters, apvts);
 }
 
 MDARezFilterAudioProcessor::~MDARezFilterAudioProcessor()
@@ -41,6 +43,14 @@ void MDARezFilterAudioProcessor::changeProgramName(int index, const juce::String
 
 void MDARezFilterAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+    pairs.resize(channelPairs.size());
+
     resetState();
 }
 
@@ -55,19 +65,27 @@ void MDARezFilterAudioProcessor::reset()
 
 bool MDARezFilterAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDARezFilterAudioProcessor::resetState()
 {
-    env = 0.0f;
-    lfo = 0.0f;
-    lfoPhase = 0.0f;
-    buf0 = 0.0f;
-    buf1 = 0.0f;
-    triggerEnv = 0.0f;
-    triggered = false;
-    triggerAttack = false;
+    for (auto &state : pairs) {
+        state.env = 0.0f;
+        state.lfo = 0.0f;
+        state.lfoPhase = 0.0f;
+        state.buf0 = 0.0f;
+        state.buf1 = 0.0f;
+        state.triggerEnv = 0.0f;
+        state.triggered = false;
+        state.triggerAttack = false;
+    }
+
+    // Recalculate the parameters at the start of the next block.
+    parameters.invalidate();
 }
 
 void MDARezFilterAudioProcessor::update()
@@ -141,17 +159,31 @@ void MDARezFilterAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (parameters.changed()) {
+        update();
+    }
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    mda::processChannelPairs(channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this](int pair, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            processPair(pairs[size_t(pair)], in1, in2, out1, out2, numSamples);
+        });
+}
+
+void MDARezFilterAudioProcessor::processPair(MDARezFilterState &state, const float *in1, const float *in2,
+                                             float *out1, float *out2, int numSamples)
+{
+    float &env = state.env;
+    float &lfo = state.lfo;
+    float &lfoPhase = state.lfoPhase;
+    float &triggerEnv = state.triggerEnv;
+    bool &triggered = state.triggered;
+    bool &triggerAttack = state.triggerAttack;
 
-    float b0 = buf0, b1 = buf1;
+    float b0 = state.buf0, b1 = state.buf1;
 
     if (threshold == 0.0f) {
-        for (int i = 0; i < buffer.getNumSamples(); ++i) {
+        for (int i = 0; i < numSamples; ++i) {
             // Process as mono
             float a = in1[i] + in2[i];
 
@@ -197,7 +229,7 @@ void MDARezFilterAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
             out2[i] = b1;
         }
     } else {
-        for (int i = 0; i < buffer.getNumSamples(); ++i) {
+        for (int i = 0; i < numSamples; ++i) {
             // Process as mono.
             float a = in1[i] + in2[i];
 
@@ -260,11 +292,11 @@ void MDARezFilterAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
     }
 
     if (std::abs(b0) < 1.0e-10f) {
-        buf0 = 0.0f;
-        buf1 = 0.0f;
+        state.buf0 = 0.0f;
+        state.buf1 = 0.0f;
     } else {
-        buf0 = b0;
-        buf1 = b1;
+        state.buf0 = b0;
+        state.buf1 = b1;
     }
 
     lfoPhase = std::fmod(lfoPhase, 6.2831853f);
@@ -1,6 +1,20 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAParameters.h"
+
+// The state of the effect for one pair of channels.
+struct MDARezFilterState
+{
+    float env;           // current envelope level
+    float lfo;           // most recent LFO value
+    float lfoPhase;      // current LFO phase
+    float buf0, buf1;    // filter delay units
+    float triggerEnv;    // secondary envelope used when triggered
+    bool triggered;      // whether envelope exceeded threshold
+    bool triggerAttack;  // triggerEnv currently in attack mode
+};
 
 class MDARezFilterAudioProcessor : public juce::AudioProcessor
 {
@@ -42,6 +56,8 @@ private:
 
     void update();
     void resetState();
+    void processPair(MDARezFilterState &state, const float *in1, const float *in2,
+                     float *out1, float *out2, int numSamples);
 
     float cutoff;      // filter cutoff
     float q;           // filter Q
@@ -51,20 +67,20 @@ private:
     float envDepth;    // envelope modulation amount
     float attack;      // envelope attack coefficient
     float release;     // envelope release coefficient
-    float env;         // current envelope level
 
-    float lfo;         // most recent LFO value
-    float lfoPhase;    // current LFO phase
     float lfoInc;      // LFO rate
     float lfoDepth;    // LFO modulation amount
     bool sampleHold;   // 0 = sine, 1 = sample & hold
 
-    float buf0, buf1;  // filter delay units
+    float threshold;   // envelope trigger threshold
 
-    float threshold;     // envelope trigger threshold
-    float triggerEnv;    // secondary envelope used when triggered
-    bool triggered;      // whether envelope exceeded threshold
-    bool triggerAttack;  // triggerEnv currently in attack mode
+    // How the channels are split into stereo pairs, and the state of the
+    // effect for each pair.
+    std::vector<mda::ChannelPair> channelPairs;
+    std::vector<MDARezFilterState> pairs;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher parameters;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDARezFilterAudioProcessor)
 };
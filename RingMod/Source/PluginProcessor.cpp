@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDARingModAudioProcessor::MDARingModAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(_parameters, apvts);
 }
 
 MDARingModAudioProcessor::~MDARingModAudioProcessor()
@@ -41,6 +43,17 @@ void MDARingModAudioProcessor::changeProgramName(int index, const juce::String &
 
 void MDARingModAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    _level.prepare(sampleRate);
+    _feedbackAmount.prepare(sampleRate);
+
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    _channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+    _pairs.resize(_channelPairs.size());
+
     resetState();
 }
 
@@ -55,14 +68,25 @@ void MDARingModAudioProcessor::reset()
 
 bool MDARingModAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDARingModAudioProcessor::resetState()
 {
     _phase = 0.0f;
-    _prevL = 0.0f;
-    _prevR = 0.0f;
+    for (auto &state : _pairs) {
+        state.prevL = 0.0f;
+        state.prevR = 0.0f;
+    }
+
+    _level.reset();
+    _feedbackAmount.reset();
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
 }
 
 void MDARingModAudioProcessor::update()
@@ -77,11 +101,11 @@ void MDARingModAudioProcessor::update()
     _phaseInc = twoPi * (fine + freq) / float(getSampleRate());
 
     // Feedback is a percentage from 0 to 95%.
-    _feedbackAmount = apvts.getRawParameterValue("Feedback")->load() / 100.0f;
+    _feedbackAmount.setTarget(apvts.getRawParameterValue("Feedback")->load() / 100.0f);
 
     // Convert from decibels to a linear gain value.
     float level = apvts.getRawParameterValue("Level")->load();
-    _level = juce::Decibels::decibelsToGain(level);
+    _level.setTarget(juce::Decibels::decibelsToGain(level));
 }
 
 void MDARingModAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
@@ -95,24 +119,43 @@ void MDARingModAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (_parameters.changed()) {
+        update();
+    }
+
+    // All pairs start from the same phase, output level and feedback, so they
+    // all get the same sine wave and ramps.
+    for (auto &state : _pairs) {
+        state.phase = _phase;
+        state.level = _level;
+        state.feedback = _feedbackAmount;
+    }
+
+    mda::processChannelPairs(_channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this](int pair, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            processPair(_pairs[size_t(pair)], in1, in2, out1, out2, numSamples);
+        });
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    if (!_pairs.empty()) {
+        _phase = _pairs[0].phase;
+        _level = _pairs[0].level;
+        _feedbackAmount = _pairs[0].feedback;
+    }
+}
 
-    const float level = _level;
+void MDARingModAudioProcessor::processPair(MDARingModState &state, const float *in1, const float *in2,
+                                           float *out1, float *out2, int numSamples)
+{
     const float phaseInc = _phaseInc;
-    const float feedback = _feedbackAmount;
 
-    float phase = _phase;
-    float prevL = _prevL;
-    float prevR = _prevR;
+    float phase = state.phase;
+    float prevL = state.prevL;
+    float prevR = state.prevR;
 
     const auto twoPi = juce::MathConstants<float>::twoPi;
 
-    for (int i = 0; i < buffer.getNumSamples(); ++i) {
+    for (int i = 0; i < numSamples; ++i) {
         // The value of the sine is the instantaneous gain.
         const float g = std::sin(phase);
 
@@ -121,18 +164,20 @@ void MDARingModAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
 
         // Add the previous output value to the new input sample, multiplied by
         // the feedback factor. Then multiply by sine wave for ring modulation.
+        const float feedback = state.feedback.next();
         prevL = (feedback * prevL + in1[i]) * g;
         prevR = (feedback * prevR + in2[i]) * g;
 
         // Before putting the value into the output buffer, multiply it by the
         // output level in order to attenuate it, if necessary.
+        const float level = state.level.next();
         out1[i] = prevL * level;
         out2[i] = prevR * level;
     }
 
-    _phase = phase;
-    _prevL = prevL;
-    _prevR = prevR;
+    state.phase = phase;
+    state.prevL = prevL;
+    state.prevR = prevR;
 }
 
 juce::AudioProcessorEditor *MDARingModAudioProcessor::createEditor()
@@ -1,6 +1,20 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAParameters.h"
+
+// The state of the effect for one pair of channels.
+struct MDARingModState
+{
+    // Previous output values for the left and right channels; used for feedback.
+    float prevL, prevR;
+
+    // This pair's copies of the sine wave phase and the smoothed output level
+    // and feedback. All pairs use the same sine wave.
+    float phase;
+    mda::SmoothedValue level, feedback;
+};
 
 class MDARingModAudioProcessor : public juce::AudioProcessor
 {
@@ -42,22 +56,30 @@ private:
 
     void update();
     void resetState();
+    void processPair(MDARingModState &state, const float *in1, const float *in2,
+                     float *out1, float *out2, int numSamples);
 
     // Output level. This was not in the original plug-in, but with a lot of
     // feedback it's useful to dial back the total volume to prevent clipping.
-    float _level;
+    // This is smoothed to avoid zipper noise when the Level knob is moved.
+    mda::SmoothedValue _level;
 
     // Phase increment for the sine wave.
     float _phaseInc;
 
-    // Amount of feedback to add (value between 0 and 1).
-    float _feedbackAmount;
+    // Amount of feedback to add (value between 0 and 1). Also smoothed.
+    mda::SmoothedValue _feedbackAmount;
 
     // Current phase for the sine wave.
     float _phase;
 
-    // Previous output values for the left and right channels; used for feedback.
-    float _prevL, _prevR;
+    // How the channels are split into stereo pairs, and the state of the
+    // effect for each pair.
+    std::vector<mda::ChannelPair> _channelPairs;
+    std::vector<MDARingModState> _pairs;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDARingModAudioProcessor)
 };
@@ -0,0 +1,54 @@
+/*
+  Writes the Piano and EPiano waveforms to sample files.
+
+  The waveforms of mdaPiano and mdaEPiano are compiled into the plug-ins from
+  mdaPianoData.h and mdaEPianoData.h. When the plug-ins are built with
+  MDA_EXTERNAL_SAMPLES, they leave those tables out and load the same data
+  from sample files instead. This tool is the only thing that still compiles
+  the tables; it writes them out in the format of mda::SampleStore.
+
+  Usage: mda-samplepack <output folder>
+
+  This does not depend on JUCE.
+*/
+
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include "MDASampleStore.h"
+#include "mdaPianoData.h"
+#include "mdaEPianoData.h"
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        std::fprintf(stderr, "usage: mda-samplepack <output folder>\n");
+        return 1;
+    }
+
+    std::string folder = argv[1];
+    if (!folder.empty() && folder.back() != '/' && folder.back() != '\\') {
+        folder += '/';
+    }
+
+    bool ok = mda::SampleStore::write(folder + "mdaPiano.samples",
+                                      pianoData, int(std::size(pianoData)),
+                                      pianoKeygroups, int(std::size(pianoKeygroups)));
+
+    // EPiano cross-fades the end of each loop into the start of the loop. The
+    // plug-in can't change the data once it's in a read-only sample file, so
+    // do it here. This is the same as crossfadedSamples() in EPiano.
+    for (int k = 0; k < 28; ++k) {
+        mda::crossfadeLoop(epianoData, epianoKeygroups[k]);
+    }
+
+    ok = ok && mda::SampleStore::write(folder + "mdaEPiano.samples",
+                                       epianoData, int(std::size(epianoData)),
+                                       epianoKeygroups, int(std::size(epianoKeygroups)));
+
+    if (!ok) {
+        std::fprintf(stderr, "mda-samplepack: could not write the sample files to %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
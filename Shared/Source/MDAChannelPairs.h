@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+
+namespace mda
+{
+
+/*
+  Running a stereo effect on a surround bus.
+
+  Most of the MDA effects are written for stereo: they mix the left and right
+  channels into mono, or filter one channel based on the other, and so on.
+  There isn't one right way to turn such an algorithm into a 5.1 or 7.1.4
+  version. What people did instead was to put one instance of the plug-in on
+  every stereo pair of the surround mix.
+
+  This does the same thing inside a single plug-in. The channels are split
+  into stereo pairs, in order: front left and right, the surrounds, the rear
+  surrounds, the height channels, and so on. Every pair has its own copy of
+  the plug-in's state (filters, delay lines, envelopes), so it behaves just
+  like a separate instance with the same settings. The parameters only need
+  to be converted once, in update(), for all of them.
+
+  Some channels don't have a partner. The centre and LFE channels are always
+  processed on their own, and so is the last channel of a layout with an odd
+  number of channels, such as mono. A channel on its own is sent to both
+  inputs of the effect, like a mono track in a DAW feeding a stereo plug-in,
+  and receives the left output.
+ */
+struct ChannelPair
+{
+    int left;   // index of the left channel
+    int right;  // index of the right channel, or -1 for a channel on its own
+};
+
+/*
+  Splits `numChannels` channels into pairs. The channels listed in `singles`
+  are not paired with any other channel; indices of -1 are ignored, so you can
+  pass what juce::AudioChannelSet::getChannelIndexForType() returns, e.g. for
+  the centre and LFE channels. Allocates memory, so call from prepareToPlay().
+ */
+inline std::vector<ChannelPair> makeChannelPairs(int numChannels, std::initializer_list<int> singles)
+{
+    std::vector<ChannelPair> pairs;
+    int waiting = -1;
+    for (int c = 0; c < numChannels; ++c) {
+        bool single = false;
+        for (int s : singles) {
+            if (s == c) { single = true; }
+        }
+        if (single) {
+            pairs.push_back({ c, -1 });
+        } else if (waiting < 0) {
+            waiting = c;
+        } else {
+            pairs.push_back({ waiting, c });
+            waiting = -1;
+        }
+    }
+    if (waiting >= 0) {
+        pairs.push_back({ waiting, -1 });
+    }
+    return pairs;
+}
+
+// Size of the stack buffer that receives the right output of a single channel.
+const int PAIR_SCRATCH_SIZE = 256;
+
+/*
+  Calls `process(index, in1, in2, out1, out2, numSamples)` for every channel
+  pair, where `index` is the position of the pair in `pairs`. The processing
+  is done in place: the outputs are the same arrays as the inputs.
+
+  For a channel on its own, the right output is written into a small buffer
+  that is thrown away. If the block is longer than that buffer, the channel is
+  processed in several pieces, which is why all the state of the effect must
+  be kept per pair.
+ */
+template<typename Process>
+void processChannelPairs(const std::vector<ChannelPair> &pairs, float *const *channels,
+                         int numChannels, int numSamples, Process &&process)
+{
+    for (std::size_t p = 0; p < pairs.size(); ++p) {
+        const ChannelPair &pair = pairs[p];
+        if (pair.left >= numChannels) { continue; }
+
+        float *left = channels[pair.left];
+        if (pair.right >= 0 && pair.right < numChannels) {
+            float *right = channels[pair.right];
+            process(int(p), left, right, left, right, numSamples);
+        } else {
+            float scratch[PAIR_SCRATCH_SIZE];
+            for (int start = 0; start < numSamples; start += PAIR_SCRATCH_SIZE) {
+                const int n = (numSamples - start < PAIR_SCRATCH_SIZE) ? numSamples - start : PAIR_SCRATCH_SIZE;
+                process(int(p), left + start, left + start, left + start, scratch, n);
+            }
+        }
+    }
+}
+
+}  // namespace mda
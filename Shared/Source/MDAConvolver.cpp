@@ -0,0 +1,718 @@
+#include "MDAConvolver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace mda
+{
+
+// ------------------------------------------------------------------------------
+// Impulse responses
+
+static std::uint32_t readU16(const unsigned char *p) noexcept
+{
+    return std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8);
+}
+
+static std::uint32_t readU32(const unsigned char *p) noexcept
+{
+    return readU16(p) | (readU16(p + 2) << 16);
+}
+
+bool ImpulseResponse::readWavFile(const std::string &path, ImpulseResponse &ir)
+{
+    // Impulse responses are small enough to read the whole file into memory.
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    std::vector<unsigned char> data;
+    if (std::fseek(file, 0, SEEK_END) == 0) {
+        const long size = std::ftell(file);
+        if (size > 0 && std::fseek(file, 0, SEEK_SET) == 0) {
+            data.resize(size_t(size));
+            data.resize(std::fread(data.data(), 1, data.size(), file));
+        }
+    }
+    std::fclose(file);
+
+    const size_t size = data.size();
+    const unsigned char *bytes = data.data();
+    if (size < 12 || std::memcmp(bytes, "RIFF", 4) != 0 || std::memcmp(bytes + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    // A .wav file is a list of chunks. We need the "fmt " chunk, which says
+    // how the samples are stored, and the "data" chunk with the samples.
+    std::uint32_t format = 0, numChannels = 0, sampleRate = 0, bits = 0;
+    const unsigned char *samples = nullptr;
+    size_t sampleBytes = 0;
+
+    size_t pos = 12;
+    while (pos + 8 <= size) {
+        const unsigned char *id = bytes + pos;
+        const size_t body = pos + 8;
+        size_t chunkSize = readU32(bytes + pos + 4);
+        if (chunkSize > size - body) {
+            chunkSize = size - body;  // the file was cut off, use what's there
+        }
+
+        if (std::memcmp(id, "fmt ", 4) == 0 && chunkSize >= 16) {
+            format = readU16(bytes + body);
+            numChannels = readU16(bytes + body + 2);
+            sampleRate = readU32(bytes + body + 4);
+            bits = readU16(bytes + body + 14);
+
+            // WAVE_FORMAT_EXTENSIBLE has the actual format in the sub-format.
+            if (format == 0xFFFE && chunkSize >= 26) {
+                format = readU16(bytes + body + 24);
+            }
+        } else if (std::memcmp(id, "data", 4) == 0) {
+            samples = bytes + body;
+            sampleBytes = chunkSize;
+        }
+
+        // Chunks are padded to an even number of bytes.
+        pos = body + chunkSize + (chunkSize & 1);
+    }
+
+    const bool isInteger = (format == 1) && (bits == 16 || bits == 24 || bits == 32);
+    const bool isFloat = (format == 3) && (bits == 32);
+    if (samples == nullptr || numChannels == 0 || sampleRate == 0 || !(isInteger || isFloat)) {
+        return false;
+    }
+
+    const size_t bytesPerSample = bits / 8;
+    const size_t frameBytes = bytesPerSample * numChannels;
+    const size_t numFrames = sampleBytes / frameBytes;
+    if (numFrames == 0) {
+        return false;
+    }
+
+    const int keep = std::min(int(numChannels), 2);
+    ir.channels.assign(size_t(keep), std::vector<float>(numFrames));
+    ir.sampleRate = double(sampleRate);
+
+    for (int c = 0; c < keep; ++c) {
+        float *channel = ir.channels[size_t(c)].data();
+        for (size_t i = 0; i < numFrames; ++i) {
+            const unsigned char *p = samples + i * frameBytes + size_t(c) * bytesPerSample;
+            if (isFloat) {
+                const std::uint32_t u = readU32(p);
+                std::memcpy(&channel[i], &u, sizeof(float));
+            } else if (bits == 16) {
+                channel[i] = float(std::int16_t(readU16(p))) / 32768.0f;
+            } else if (bits == 24) {
+                const std::uint32_t u = readU16(p) | (std::uint32_t(p[2]) << 16);
+                channel[i] = float(std::int32_t(u << 8) >> 8) / 8388608.0f;
+            } else {
+                channel[i] = float(double(std::int32_t(readU32(p))) / 2147483648.0);
+            }
+        }
+    }
+    return true;
+}
+
+ImpulseResponse ImpulseResponse::resampled(double newSampleRate) const
+{
+    if (sampleRate <= 0.0 || newSampleRate <= 0.0 || sampleRate == newSampleRate || length() == 0) {
+        return *this;
+    }
+
+    // Cubic interpolation is not band-limited, so going down in sample rate
+    // can fold some of the highest frequencies back into the audible range.
+    // Reverbs have very little energy up there, so this is good enough.
+    const double step = sampleRate / newSampleRate;
+    const int oldLength = length();
+    const int newLength = int(double(oldLength - 1) / step) + 1;
+
+    ImpulseResponse result;
+    result.sampleRate = newSampleRate;
+    result.channels.resize(channels.size());
+    for (size_t c = 0; c < channels.size(); ++c) {
+        const std::vector<float> &in = channels[c];
+        std::vector<float> &out = result.channels[c];
+        out.resize(size_t(newLength));
+
+        auto sample = [&](int i) { return (i >= 0 && i < oldLength) ? in[size_t(i)] : 0.0f; };
+
+        for (int i = 0; i < newLength; ++i) {
+            const double position = double(i) * step;
+            const int pos = int(position);
+            const float t = float(position - double(pos));
+
+            // Same weights as in MDAInterpolation.h.
+            const float w0 = t * (-0.5f + t * (1.0f - 0.5f * t));
+            const float w1 = 1.0f + t * t * (-2.5f + 1.5f * t);
+            const float w2 = t * (0.5f + t * (2.0f - 1.5f * t));
+            const float w3 = t * t * (-0.5f + 0.5f * t);
+            out[size_t(i)] = (w0 * sample(pos - 1) + w1 * sample(pos))
+                           + (w2 * sample(pos + 1) + w3 * sample(pos + 2));
+        }
+    }
+    return result;
+}
+
+void ImpulseResponse::normalize() noexcept
+{
+    // White noise has the same energy at every frequency, so it comes out of
+    // the convolution with the energy of the impulse response times the
+    // energy of the input. Make the loudest channel have an energy of 1.
+    double maxEnergy = 0.0;
+    for (const auto &channel : channels) {
+        double energy = 0.0;
+        for (float x : channel) {
+            energy += double(x) * double(x);
+        }
+        maxEnergy = std::max(maxEnergy, energy);
+    }
+    if (maxEnergy > 0.0) {
+        const float gain = float(1.0 / std::sqrt(maxEnergy));
+        for (auto &channel : channels) {
+            for (float &x : channel) {
+                x *= gain;
+            }
+        }
+    }
+}
+
+// ------------------------------------------------------------------------------
+// Convolver
+
+/*
+  One uniformly partitioned convolution. The FFT size is twice the block size.
+  Every block, the previous and the current block of input are transformed
+  together. After multiplying with the spectrum of a partition, which is one
+  block of impulse response padded with zeros, the second half of the inverse
+  FFT is the correct output (overlap-save).
+ */
+struct Convolver::Stage
+{
+    int blockSize = 0;
+    int numPartitions = 0;
+
+    // Whether this stage runs on the background thread.
+    bool background = false;
+
+    FFT fft;
+
+    // Spectra of the partitions, as [partition][channel][bin].
+    std::vector<float> irReal, irImag;
+
+    // The frequency-domain delay line: spectra of the last numPartitions
+    // blocks of input, as [partition][bin]. `newest` is the latest one.
+    std::vector<float> inputReal, inputImag;
+    int newest = 0;
+
+    // The previous and the current block of input.
+    std::vector<float> frame;
+
+    // Where the audio thread collects the next block of input.
+    std::vector<float> collected;
+
+    // Two sets of output blocks, as [set][channel][sample]. The audio thread
+    // plays one set while the background thread computes the other. When the
+    // output wasn't ready in time, `playing` is -1 and the stage is silent.
+    std::vector<float> output;
+    int playing = 0;
+
+    // Number of blocks of input that were left out because the background
+    // thread was too slow. The audio thread counts them in `missed`, and
+    // hands the count over in `skipped` together with the next block, so
+    // that compute() can put silence in their place.
+    int missed = 0;
+    int skipped = 0;
+
+    // Scratch space for compute().
+    std::vector<float> sumReal, sumImag, scratch;
+
+    // Number of blocks handed to the background thread and the number it has
+    // finished. These only ever differ by one.
+    std::atomic<unsigned> submitted { 0 };
+    std::atomic<unsigned> completed { 0 };
+
+    // Set by reset() for a background stage. The next time the audio thread
+    // hands over a block, it throws away what was computed from the old input
+    // and tells compute() to forget the old input too.
+    bool discard = false;
+    bool clearHistory = false;
+
+    void compute(int numChannels, int set) noexcept;
+    void clear() noexcept;
+};
+
+void Convolver::Stage::compute(int numChannels, int set) noexcept
+{
+    const int bins = fft.numBins();
+    const int L = blockSize;
+
+    if (clearHistory) {
+        std::fill(inputReal.begin(), inputReal.end(), 0.0f);
+        std::fill(inputImag.begin(), inputImag.end(), 0.0f);
+        newest = 0;
+        clearHistory = false;
+    }
+
+    // The blocks that were left out count as silence, so that the later
+    // blocks still line up with the right partitions.
+    for (int i = 0; i < std::min(skipped, numPartitions); ++i) {
+        newest = (newest + 1 == numPartitions) ? 0 : newest + 1;
+        std::fill(inputReal.begin() + newest * bins, inputReal.begin() + (newest + 1) * bins, 0.0f);
+        std::fill(inputImag.begin() + newest * bins, inputImag.begin() + (newest + 1) * bins, 0.0f);
+    }
+    skipped = 0;
+
+    // Add the spectrum of the newest input to the delay line. It replaces
+    // the oldest one, which isn't needed anymore.
+    newest = (newest + 1 == numPartitions) ? 0 : newest + 1;
+    float *xr = inputReal.data() + newest * bins;
+    float *xi = inputImag.data() + newest * bins;
+    fft.forward(frame.data(), xr, xi);
+
+    std::fill(sumReal.begin(), sumReal.end(), 0.0f);
+    std::fill(sumImag.begin(), sumImag.end(), 0.0f);
+
+    // The newest input goes with the first partition, the input from one
+    // block ago with the second partition, and so on.
+    int slot = newest;
+    for (int p = 0; p < numPartitions; ++p) {
+        const float *ar = inputReal.data() + slot * bins;
+        const float *ai = inputImag.data() + slot * bins;
+        for (int c = 0; c < numChannels; ++c) {
+            const float *hr = irReal.data() + (p * numChannels + c) * bins;
+            const float *hi = irImag.data() + (p * numChannels + c) * bins;
+            float *sr = sumReal.data() + c * bins;
+            float *si = sumImag.data() + c * bins;
+            for (int k = 0; k < bins; ++k) {
+                sr[k] += ar[k] * hr[k] - ai[k] * hi[k];
+                si[k] += ar[k] * hi[k] + ai[k] * hr[k];
+            }
+        }
+        slot = (slot == 0) ? numPartitions - 1 : slot - 1;
+    }
+
+    for (int c = 0; c < numChannels; ++c) {
+        fft.inverse(sumReal.data() + c * bins, sumImag.data() + c * bins, scratch.data());
+        std::memcpy(output.data() + (set * numChannels + c) * L, scratch.data() + L, size_t(L) * sizeof(float));
+    }
+}
+
+void Convolver::Stage::clear() noexcept
+{
+    std::fill(inputReal.begin(), inputReal.end(), 0.0f);
+    std::fill(inputImag.begin(), inputImag.end(), 0.0f);
+    std::fill(frame.begin(), frame.end(), 0.0f);
+    std::fill(collected.begin(), collected.end(), 0.0f);
+    std::fill(output.begin(), output.end(), 0.0f);
+    newest = 0;
+    missed = 0;
+    skipped = 0;
+    discard = false;
+    clearHistory = false;
+
+    // The block counters keep going. They're only compared with each other
+    // and used to pick the output set, which works from any starting point.
+}
+
+const int Convolver::HEAD_SIZE;
+
+Convolver::Convolver(ConvolverThread &thread) : _thread(thread)
+{
+}
+
+Convolver::~Convolver()
+{
+    if (_usesThread) {
+        _thread.remove(this);
+    }
+}
+
+void Convolver::prepare(const ImpulseResponse &ir)
+{
+    if (_usesThread) {
+        _thread.remove(this);
+        _usesThread = false;
+    }
+    _stages.clear();
+
+    _numChannels = std::min(ir.numChannels(), 2);
+    const int length = ir.length();
+
+    _head.assign(size_t(_numChannels * HEAD_SIZE), 0.0f);
+    for (int c = 0; c < _numChannels; ++c) {
+        for (int i = 0; i < std::min(length, HEAD_SIZE); ++i) {
+            _head[size_t(c * HEAD_SIZE + i)] = ir.channels[size_t(c)][size_t(i)];
+        }
+    }
+    _headInput.assign(2 * HEAD_SIZE, 0.0f);
+
+    // Block size, and where the stage starts and ends in the impulse response.
+    // The last stage goes on until the end.
+    struct Layout { int blockSize, start, end; };
+    const Layout layouts[] = {
+        {   64,   64,    1024 },
+        {  512, 1024,    8192 },
+        { 4096, 8192, INT_MAX },
+    };
+
+    _period = HEAD_SIZE;
+    bool needsThread = false;
+
+    for (const Layout &layout : layouts) {
+        const int L = layout.blockSize;
+        const int end = std::min(layout.end, length);
+        if (end <= layout.start) {
+            break;
+        }
+
+        auto stage = std::make_unique<Stage>();
+        stage->blockSize = L;
+        stage->numPartitions = (end - layout.start + L - 1) / L;
+        stage->background = (layout.start >= 2 * L);
+        stage->fft.prepare(2 * L);
+
+        const int bins = stage->fft.numBins();
+        const int P = stage->numPartitions;
+        stage->irReal.resize(size_t(P * _numChannels * bins));
+        stage->irImag.resize(size_t(P * _numChannels * bins));
+
+        // Transform the partitions. The inverse FFT makes everything 2L times
+        // larger, so scale the impulse response down by the same amount.
+        const float scale = 1.0f / float(2 * L);
+        std::vector<float> padded(size_t(2 * L));
+        for (int p = 0; p < P; ++p) {
+            for (int c = 0; c < _numChannels; ++c) {
+                const float *source = ir.channels[size_t(c)].data();
+                std::fill(padded.begin(), padded.end(), 0.0f);
+                for (int i = 0; i < L; ++i) {
+                    const int index = layout.start + p * L + i;
+                    if (index < end) {
+                        padded[size_t(i)] = source[index] * scale;
+                    }
+                }
+                const int offset = (p * _numChannels + c) * bins;
+                stage->fft.forward(padded.data(), stage->irReal.data() + offset, stage->irImag.data() + offset);
+            }
+        }
+
+        stage->inputReal.resize(size_t(P * bins));
+        stage->inputImag.resize(size_t(P * bins));
+        stage->frame.resize(size_t(2 * L));
+        stage->collected.resize(size_t(L));
+        stage->output.resize(size_t(2 * _numChannels * L));
+        stage->sumReal.resize(size_t(_numChannels * bins));
+        stage->sumImag.resize(size_t(_numChannels * bins));
+        stage->scratch.resize(size_t(2 * L));
+        stage->clear();
+
+        _period = L;
+        needsThread = needsThread || stage->background;
+        _stages.push_back(std::move(stage));
+    }
+
+    _time = 0;
+
+    if (needsThread) {
+        _thread.add(this);
+        _usesThread = true;
+    }
+}
+
+void Convolver::reset() noexcept
+{
+    for (auto &stage : _stages) {
+        if (!stage->background) {
+            stage->clear();
+            continue;
+        }
+
+        // The background thread may be busy with this stage, so only clear
+        // what it doesn't touch: the output set that is playing now, and the
+        // input being collected. The rest is done in finishBlock().
+        const int L = stage->blockSize;
+        if (stage->playing >= 0) {
+            float *playing = stage->output.data() + stage->playing * _numChannels * L;
+            std::fill(playing, playing + _numChannels * L, 0.0f);
+        }
+        std::fill(stage->collected.begin(), stage->collected.end(), 0.0f);
+        stage->discard = true;
+    }
+    std::fill(_headInput.begin(), _headInput.end(), 0.0f);
+    _time = 0;
+}
+
+void Convolver::process(const float *input, float *out1, float *out2, int numSamples) noexcept
+{
+    if (_numChannels == 0) {
+        std::fill(out1, out1 + numSamples, 0.0f);
+        std::fill(out2, out2 + numSamples, 0.0f);
+        return;
+    }
+
+    float *outputs[2] = { out1, out2 };
+    float *current = _headInput.data() + HEAD_SIZE;
+
+    // Work in chunks that end where a block of HEAD_SIZE samples ends. All
+    // block sizes are multiples of HEAD_SIZE, so a chunk never straddles the
+    // blocks of any stage.
+    int done = 0;
+    while (done < numSamples) {
+        const int offset = _time % HEAD_SIZE;
+        const int n = std::min(numSamples - done, HEAD_SIZE - offset);
+
+        // Store the input first, because the outputs may be the same arrays.
+        std::memcpy(current + offset, input + done, size_t(n) * sizeof(float));
+        for (auto &stage : _stages) {
+            const int position = _time % stage->blockSize;
+            std::memcpy(stage->collected.data() + position, input + done, size_t(n) * sizeof(float));
+        }
+
+        for (int c = 0; c < _numChannels; ++c) {
+            float *out = outputs[c] + done;
+
+            // The head is a plain FIR filter. Going through the impulse
+            // response in the outer loop, rather than through the samples,
+            // lets the compiler vectorize the inner loop.
+            const float *h = _head.data() + c * HEAD_SIZE;
+            const float *x = current + offset;
+            for (int i = 0; i < n; ++i) {
+                out[i] = h[0] * x[i];
+            }
+            for (int j = 1; j < HEAD_SIZE; ++j) {
+                const float hj = h[j];
+                const float *xj = x - j;
+                for (int i = 0; i < n; ++i) {
+                    out[i] += hj * xj[i];
+                }
+            }
+
+            // The stages already computed this part of their output.
+            for (auto &stage : _stages) {
+                if (stage->playing < 0) {
+                    continue;
+                }
+                const int L = stage->blockSize;
+                const float *y = stage->output.data() + (stage->playing * _numChannels + c) * L + _time % L;
+                for (int i = 0; i < n; ++i) {
+                    out[i] += y[i];
+                }
+            }
+        }
+
+        _time += n;
+        done += n;
+
+        if (_time % HEAD_SIZE == 0) {
+            std::memcpy(_headInput.data(), current, HEAD_SIZE * sizeof(float));
+            for (auto &stage : _stages) {
+                if (_time % stage->blockSize == 0) {
+                    finishBlock(*stage);
+                }
+            }
+            if (_time == _period) {
+                _time = 0;
+            }
+        }
+    }
+
+    if (_numChannels == 1 && out2 != out1) {
+        std::memcpy(out2, out1, size_t(numSamples) * sizeof(float));
+    }
+}
+
+void Convolver::finishBlock(Stage &stage) noexcept
+{
+    const int L = stage.blockSize;
+
+    if (!stage.background) {
+        // Small blocks are done right away. The output plays during the next
+        // block, which is exactly where this stage starts in the impulse response.
+        std::memcpy(stage.frame.data(), stage.frame.data() + L, size_t(L) * sizeof(float));
+        std::memcpy(stage.frame.data() + L, stage.collected.data(), size_t(L) * sizeof(float));
+        stage.compute(_numChannels, 0);
+        stage.playing = 0;
+        return;
+    }
+
+    // The background thread should have finished the previous block by now,
+    // since it had a whole block of time to do so. If not, wait for it when
+    // rendering offline. In real time, skip this block instead: the stage is
+    // silent for the next block, and this block's input is left out.
+    const unsigned block = stage.submitted.load(std::memory_order_relaxed);
+    if (stage.completed.load(std::memory_order_acquire) != block) {
+        if (!_nonRealtime) {
+            stage.playing = -1;
+            stage.missed++;
+            _missedBlocks.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        while (stage.completed.load(std::memory_order_acquire) != block) {
+            std::this_thread::yield();
+        }
+    }
+
+    // That block's output plays next. This stage starts two blocks into the
+    // impulse response: one for collecting the input and one for computing.
+    // (Before the first block, this picks the other set, which is silent.)
+    // If blocks were skipped, that output is too late, so stay silent for
+    // one more block. The input of the skipped block is silence for compute(),
+    // so it must not be the previous half of the frame either.
+    if (stage.missed > 0) {
+        stage.playing = -1;
+        std::fill(stage.frame.begin() + L, stage.frame.end(), 0.0f);
+        stage.skipped = stage.missed;
+        stage.missed = 0;
+    } else {
+        stage.playing = int((block - 1) & 1);
+    }
+
+    // After a reset, that block was made from the old input, so silence it.
+    // The old input must not go into the next block either, neither as the
+    // previous half of the frame nor in the frequency-domain delay line.
+    if (stage.discard) {
+        if (stage.playing >= 0) {
+            float *playing = stage.output.data() + stage.playing * _numChannels * L;
+            std::fill(playing, playing + _numChannels * L, 0.0f);
+        }
+        std::fill(stage.frame.begin() + L, stage.frame.end(), 0.0f);
+        stage.clearHistory = true;
+        stage.discard = false;
+    }
+
+    std::memcpy(stage.frame.data(), stage.frame.data() + L, size_t(L) * sizeof(float));
+    std::memcpy(stage.frame.data() + L, stage.collected.data(), size_t(L) * sizeof(float));
+    stage.submitted.store(block + 1, std::memory_order_release);
+    _thread.notify();
+}
+
+Convolver::Stage *Convolver::nextBlock() const noexcept
+{
+    // The stages are sorted by block size, so this finds the one with the
+    // nearest deadline.
+    for (auto &stage : _stages) {
+        if (stage->background && stage->submitted.load(std::memory_order_acquire)
+                                 != stage->completed.load(std::memory_order_relaxed)) {
+            return stage.get();
+        }
+    }
+    return nullptr;
+}
+
+void Convolver::computeBlock(Stage &stage) noexcept
+{
+    const unsigned block = stage.completed.load(std::memory_order_relaxed);
+    stage.compute(_numChannels, int(block & 1));
+    stage.completed.store(block + 1, std::memory_order_release);
+}
+
+// ------------------------------------------------------------------------------
+// ConvolverThread
+
+ConvolverThread::ConvolverThread()
+{
+}
+
+ConvolverThread::~ConvolverThread()
+{
+    if (_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _quit = true;
+        }
+        _wakeUp.notify_one();
+        _thread.join();
+    }
+}
+
+void ConvolverThread::add(Convolver *convolver)
+{
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        waitUntilIdle(lock);
+        _convolvers.push_back(convolver);
+    }
+    _wakeUp.notify_one();
+
+    if (!_thread.joinable()) {
+        _thread = std::thread([this] { run(); });
+    }
+}
+
+void ConvolverThread::remove(Convolver *convolver)
+{
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        waitUntilIdle(lock);
+        _convolvers.erase(std::remove(_convolvers.begin(), _convolvers.end(), convolver), _convolvers.end());
+    }
+    _wakeUp.notify_one();
+}
+
+void ConvolverThread::waitUntilIdle(std::unique_lock<std::mutex> &lock)
+{
+    // The thread doesn't start on a new block while someone is waiting here,
+    // so this takes at most the time of one block.
+    _waiting++;
+    _idle.wait(lock, [this] { return !_working; });
+    _waiting--;
+}
+
+void ConvolverThread::notify() noexcept
+{
+    // This doesn't take the lock, so if the thread is just about to go to
+    // sleep, it may miss the notification. That's why it also wakes up by
+    // itself every millisecond.
+    _pending.store(true, std::memory_order_release);
+    _wakeUp.notify_one();
+}
+
+void ConvolverThread::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_quit) {
+        if (_waiting > 0) {
+            _wakeUp.wait(lock, [this] { return _quit || _waiting == 0; });
+            continue;
+        }
+
+        // Look for work without holding the lock. add() and remove() wait
+        // until this is done, so the list can't change in the meantime.
+        _working = true;
+        lock.unlock();
+
+        // A block handed over after this point is found on the next pass.
+        _pending.store(false, std::memory_order_relaxed);
+
+        // Of all the convolvers, the block with the smallest size has the
+        // nearest deadline, so it goes first.
+        Convolver *owner = nullptr;
+        Convolver::Stage *next = nullptr;
+        for (Convolver *convolver : _convolvers) {
+            Convolver::Stage *stage = convolver->nextBlock();
+            if (stage != nullptr && (next == nullptr || stage->blockSize < next->blockSize)) {
+                owner = convolver;
+                next = stage;
+            }
+        }
+        if (next != nullptr) {
+            owner->computeBlock(*next);
+        }
+
+        lock.lock();
+        _working = false;
+        _idle.notify_all();
+
+        if (next == nullptr) {
+            _wakeUp.wait_for(lock, std::chrono::milliseconds(1), [this] {
+                return _quit || _waiting > 0 || _pending.load(std::memory_order_acquire);
+            });
+        }
+    }
+}
+
+}  // namespace mda
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "MDAFFT.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mda
+{
+
+/*
+  A recorded impulse response, for example of a room or a hall.
+ */
+struct ImpulseResponse
+{
+    // One vector per channel, all the same length. Only the first two channels
+    // of a file are kept.
+    std::vector<std::vector<float>> channels;
+
+    // The sample rate the impulse response was recorded at.
+    double sampleRate = 0.0;
+
+    int numChannels() const noexcept { return int(channels.size()); }
+    int length() const noexcept { return channels.empty() ? 0 : int(channels[0].size()); }
+
+    // Reads a .wav file with 16, 24 or 32-bit integer or 32-bit float samples.
+    // Returns false if the file can't be read or isn't in one of these formats.
+    static bool readWavFile(const std::string &path, ImpulseResponse &ir);
+
+    // Returns a copy at a different sample rate, using cubic interpolation.
+    ImpulseResponse resampled(double newSampleRate) const;
+
+    // Scales the samples so that white noise comes out of the convolution at
+    // the same level as it went in. Impulse responses are recorded at all kinds
+    // of levels, so without this, some would be much too loud and others too
+    // soft. The same gain is used for all channels, to keep their balance.
+    void normalize() noexcept;
+};
+
+/*
+  Convolution with a long impulse response, such as a reverb of a few seconds.
+
+  Convolution in the time domain means that every output sample is the sum of
+  the last N input samples, each multiplied by a sample of the impulse
+  response. For a 3-second reverb at 48 kHz that is 144000 multiplications for
+  every sample, which is way too slow. In the frequency domain, convolution is
+  a multiplication of two spectra, which is much cheaper, but the FFT works on
+  blocks, and filling up a block introduces latency.
+
+  The usual solution is to chop the impulse response into partitions:
+
+  - The first HEAD_SIZE samples are done in the time domain, sample by sample.
+    This part has no latency, so the reverb starts right away.
+
+  - The rest of the impulse response is divided into stages. Every stage
+    cuts its piece of the impulse response into partitions of equal length, its
+    block size, and does a uniformly partitioned convolution: the spectra of the
+    last few blocks of input are kept in a frequency-domain delay line, and
+    each block of output is the sum of those spectra times the spectra of the
+    partitions. So every block costs one forward FFT, one multiply-add of two
+    spectra per partition, and one inverse FFT.
+
+  - Short blocks have little latency but there are lots of them. Long blocks
+    are much more efficient, but they take longer to fill up. Therefore, the
+    block size goes up further along the impulse response (non-uniform
+    partitioning): 64 samples for the first 1024 samples, 512 samples up to
+    8192, and 4096 samples after that.
+
+  The first stage, with the small blocks, runs on the audio thread. Its output
+  is ready as soon as a block of input is complete, which is why it can start
+  right after the head. The stages with the long blocks run on a background
+  thread: the audio thread hands over a block of input, and picks up the
+  output one block later. So a stage with block size B starts 2B samples into
+  the impulse response: one block for collecting the input and one block for
+  the background thread to do the work. Without this, the
+  audio thread would have to do all the work of a long block in one go, which
+  makes for very uneven CPU use. The background thread is a ConvolverThread,
+  which can be shared by several convolvers.
+
+  If the background thread is too slow, what happens depends on the mode:
+
+  - When rendering offline (setNonRealtime(true)), the audio thread waits
+    for it, so the output is always the same.
+
+  - In real time, the audio thread never waits. The stage plays silence for
+    the block whose output isn't ready, and that block's input is left out
+    of the stage. Once the background thread catches up, the output computed
+    too late is thrown away as well, so everything stays in the right place
+    and the stage only drops out for a short while. These misses are counted
+    by getNumMissedBlocks(). This was chosen over giving the background
+    thread more time by starting the stages later in the impulse response,
+    because that would need more FFT blocks on the audio thread and still
+    doesn't help when the thread doesn't get to run at all.
+
+  The input is mono and there can be one or two outputs, one for each channel
+  of the impulse response.
+ */
+class ConvolverThread;
+
+class Convolver
+{
+public:
+    // The long blocks are done by `thread`, which must outlive the convolver.
+    explicit Convolver(ConvolverThread &thread);
+    ~Convolver();
+
+    Convolver(const Convolver &) = delete;
+    Convolver &operator=(const Convolver &) = delete;
+
+    // Makes the partitions from an impulse response with one or two channels.
+    // Allocates memory and may start the background thread, so don't call
+    // this from the audio thread.
+    void prepare(const ImpulseResponse &ir);
+
+    // Clears the reverb tail. This doesn't wait for the background thread,
+    // so it's safe to call from the audio thread.
+    void reset() noexcept;
+
+    // Whether to wait for the background thread when it's too slow, rather
+    // than dropping its blocks. Call this when the host switches between
+    // offline and real-time rendering. The default is real-time.
+    void setNonRealtime(bool nonRealtime) noexcept { _nonRealtime = nonRealtime; }
+
+    // How many blocks were dropped in real-time mode because the background
+    // thread didn't finish them in time.
+    int getNumMissedBlocks() const noexcept { return _missedBlocks.load(std::memory_order_relaxed); }
+
+    // Convolves `numSamples` samples of `input`. When the impulse response is
+    // mono, `out1` and `out2` get the same output.
+    void process(const float *input, float *out1, float *out2, int numSamples) noexcept;
+
+    // Length of the direct time-domain part and of the smallest FFT block.
+    static const int HEAD_SIZE = 64;
+
+private:
+    friend class ConvolverThread;
+    struct Stage;
+
+    void finishBlock(Stage &stage) noexcept;
+
+    // For the background thread: the stage that has a block waiting to be
+    // done, if any, and doing that block.
+    Stage *nextBlock() const noexcept;
+    void computeBlock(Stage &stage) noexcept;
+
+    ConvolverThread &_thread;
+
+    // Whether this convolver has stages that need the background thread.
+    bool _usesThread = false;
+
+    bool _nonRealtime = false;
+    std::atomic<int> _missedBlocks { 0 };
+
+    int _numChannels = 0;
+
+    // The first HEAD_SIZE samples of the impulse response, for every channel.
+    std::vector<float> _head;
+
+    // The previous and the current block of HEAD_SIZE input samples.
+    std::vector<float> _headInput;
+
+    // Number of samples processed since the last reset, modulo the largest
+    // block size. All stages start a new block at the same time.
+    int _time = 0;
+    int _period = HEAD_SIZE;
+
+    std::vector<std::unique_ptr<Stage>> _stages;
+};
+
+/*
+  The background thread for the long blocks of any number of convolvers, so
+  that an effect with several channel pairs, each with its own convolver,
+  doesn't start a thread for every pair. The thread starts when the first
+  convolver that needs it is prepared. Destroy the convolvers before this.
+ */
+class ConvolverThread
+{
+public:
+    ConvolverThread();
+    ~ConvolverThread();
+
+    ConvolverThread(const ConvolverThread &) = delete;
+    ConvolverThread &operator=(const ConvolverThread &) = delete;
+
+private:
+    friend class Convolver;
+
+    // Called by the convolvers from the message thread.
+    void add(Convolver *convolver);
+    void remove(Convolver *convolver);
+
+    // Called by the audio thread after handing over a block. This doesn't
+    // take the lock, so the audio thread never has to wait for it.
+    void notify() noexcept;
+
+    // Waits until the thread isn't looking at the convolvers.
+    void waitUntilIdle(std::unique_lock<std::mutex> &lock);
+
+    void run();
+
+    std::vector<Convolver *> _convolvers;
+
+    // Whether the thread is looking at the convolvers outside the lock, and
+    // how many calls to add() or remove() are waiting for it to finish.
+    bool _working = false;
+    int _waiting = 0;
+
+    // Set by notify(). The thread checks this before going to sleep, and also
+    // wakes up now and then by itself, in case it missed a notification.
+    std::atomic<bool> _pending { false };
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _wakeUp;
+    std::condition_variable _idle;
+    bool _quit = false;
+};
+
+}  // namespace mda
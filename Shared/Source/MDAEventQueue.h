@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace mda
+{
+
+// A MIDI message plus the sample position inside the current block where it
+// should take effect.
+struct MidiEvent
+{
+    int time;
+    unsigned char status;
+    unsigned char data1;
+    unsigned char data2;
+};
+
+/*
+  The MIDI events for one block, sorted by timestamp.
+
+  The synths originally copied their note events into a fixed array of 120
+  ints, three per event, and handled controllers such as the mod wheel or
+  pitch bend immediately at the start of the block. Anything past the 40th
+  note event was dropped, and controller changes were not sample accurate.
+
+  This queue keeps every event, including the controllers, so that the render
+  loop can stop at each event's timestamp, handle it, and then continue:
+
+      int frame = 0;
+      while (frame < sampleFrames) {
+          int frames = _events.nextEventTime(sampleFrames) - frame;
+          frame += frames;
+          ...render `frames` samples...
+          while (_events.hasEventAt(frame)) {
+              handleEvent(_events.next());
+          }
+      }
+
+  Storage is allocated by reserve(), which should be called from
+  prepareToPlay(). The queue never grows after that, so it doesn't allocate
+  on the audio thread. If the host sends more events than there is room for,
+  add() returns false for the first event that doesn't fit. The plug-in then
+  renders up to the last event that did fit, and once the queue is empty,
+  clears it and adds the remaining events from where it left off:
+
+      while (_events.hasEventAt(frame)) {
+          handleEvent(_events.next());
+          if (_events.empty()) {
+              fillEvents();  // clear() and add() the next batch
+          }
+      }
+
+  Because the host's events are sorted, the events that didn't fit always
+  come after the ones in the queue, so no events are lost or reordered.
+ */
+class EventQueue
+{
+public:
+    static const int DEFAULT_CAPACITY = 2048;
+
+    // Makes room for `capacity` events. This allocates, so don't call it from
+    // the audio thread.
+    void reserve(int capacity)
+    {
+        if (capacity > int(_events.capacity())) {
+            _events.reserve(std::size_t(capacity));
+        }
+    }
+
+    // Removes all events. Call this before adding the events for a new block.
+    void clear()
+    {
+        _events.clear();
+        _readPos = 0;
+    }
+
+    // Adds an event. The events from juce::MidiBuffer are already in order,
+    // so this normally just appends. An event with an earlier timestamp is
+    // moved into place, after any other events with the same timestamp.
+    // Returns false, without adding the event, if the queue is full.
+    bool add(int time, unsigned char status, unsigned char data1, unsigned char data2)
+    {
+        if (_events.size() == _events.capacity()) { return false; }
+
+        const MidiEvent event = { time < 0 ? 0 : time, status, data1, data2 };
+        _events.push_back(event);
+
+        std::size_t i = _events.size() - 1;
+        while (i > _readPos && _events[i - 1].time > event.time) {
+            _events[i] = _events[i - 1];
+            i--;
+        }
+        _events[i] = event;
+        return true;
+    }
+
+    // Are there any events left that haven't been handled yet?
+    bool empty() const
+    {
+        return _readPos >= _events.size();
+    }
+
+    // Returns the timestamp of the next event, but no later than `end`.
+    int nextEventTime(int end) const
+    {
+        if (empty() || _events[_readPos].time > end) { return end; }
+        return _events[_readPos].time;
+    }
+
+    // Is the next event due at (or before) sample position `time`?
+    bool hasEventAt(int time) const
+    {
+        return !empty() && _events[_readPos].time <= time;
+    }
+
+    // Returns the next event and moves on to the one after it.
+    const MidiEvent &next()
+    {
+        return _events[_readPos++];
+    }
+
+private:
+    std::vector<MidiEvent> _events;
+    std::size_t _readPos = 0;
+};
+
+}  // namespace mda
@@ -0,0 +1,152 @@
+#include "MDAFFT.h"
+
+#include <cmath>
+#include <utility>
+
+namespace mda
+{
+
+void FFT::prepare(int size)
+{
+    _size = size;
+    const int half = size / 2;
+
+    int bits = 0;
+    while ((1 << bits) < half) {
+        ++bits;
+    }
+    _bitReverse.resize(size_t(half));
+    for (int i = 0; i < half; ++i) {
+        int r = 0;
+        for (int b = 0; b < bits; ++b) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        _bitReverse[size_t(i)] = r;
+    }
+
+    // Calculate the tables in double precision, so that the rounding errors
+    // don't add up for the larger sizes.
+    const double twoPi = 6.283185307179586476925;
+    _cos.resize(size_t(half / 2));
+    _sin.resize(size_t(half / 2));
+    for (int k = 0; k < half / 2; ++k) {
+        _cos[size_t(k)] = float(std::cos(twoPi * k / half));
+        _sin[size_t(k)] = float(std::sin(twoPi * k / half));
+    }
+
+    _realCos.resize(size_t(half + 1));
+    _realSin.resize(size_t(half + 1));
+    for (int k = 0; k <= half; ++k) {
+        _realCos[size_t(k)] = float(std::cos(twoPi * k / size));
+        _realSin[size_t(k)] = float(std::sin(twoPi * k / size));
+    }
+
+    _work.resize(size_t(size));
+}
+
+void FFT::transform(bool inverse) noexcept
+{
+    const int n = _size / 2;
+    float *w = _work.data();
+
+    for (int i = 0; i < n; ++i) {
+        const int j = _bitReverse[size_t(i)];
+        if (j > i) {
+            std::swap(w[2*i], w[2*j]);
+            std::swap(w[2*i + 1], w[2*j + 1]);
+        }
+    }
+
+    // Combine pairs of transforms of length `half` into transforms of length
+    // `len`. The forward transform uses e^(-i...) and the inverse e^(+i...),
+    // so only the sign of the sine changes.
+    const float sign = inverse ? 1.0f : -1.0f;
+    for (int len = 2; len <= n; len *= 2) {
+        const int half = len / 2;
+        const int step = n / len;
+        for (int start = 0; start < n; start += len) {
+            for (int k = 0; k < half; ++k) {
+                const float wr = _cos[size_t(k * step)];
+                const float wi = sign * _sin[size_t(k * step)];
+                float *a = w + 2*(start + k);
+                float *b = w + 2*(start + k + half);
+                const float br = b[0] * wr - b[1] * wi;
+                const float bi = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - br;
+                b[1] = a[1] - bi;
+                a[0] += br;
+                a[1] += bi;
+            }
+        }
+    }
+}
+
+void FFT::forward(const float *input, float *real, float *imag) noexcept
+{
+    const int half = _size / 2;
+
+    // The even samples become the real parts, the odd samples the imaginary
+    // parts, which is exactly how the input is laid out already.
+    for (int i = 0; i < _size; ++i) {
+        _work[size_t(i)] = input[i];
+    }
+    transform(false);
+
+    /*
+      Untangle the spectrum. If Z is the transform of the complex numbers, then
+      the transform of the even samples is E[k] = (Z[k] + conj(Z[N/2 - k])) / 2
+      and that of the odd samples is O[k] = (Z[k] - conj(Z[N/2 - k])) / 2i. The
+      spectrum of the whole signal is X[k] = E[k] + e^(-2pi i k/N) * O[k].
+     */
+    const float *w = _work.data();
+    for (int k = 0; k <= half; ++k) {
+        const int k1 = (k == half) ? 0 : k;
+        const int k2 = (k == 0) ? 0 : half - k;
+        const float ar = w[2*k1], ai = w[2*k1 + 1];
+        const float br = w[2*k2], bi = w[2*k2 + 1];
+
+        const float evenR = 0.5f * (ar + br);
+        const float evenI = 0.5f * (ai - bi);
+        const float oddR = 0.5f * (ai + bi);
+        const float oddI = -0.5f * (ar - br);
+
+        const float c = _realCos[size_t(k)];
+        const float s = _realSin[size_t(k)];
+        real[k] = evenR + c * oddR + s * oddI;
+        imag[k] = evenI + c * oddI - s * oddR;
+    }
+}
+
+void FFT::inverse(const float *real, const float *imag, float *output) noexcept
+{
+    const int half = _size / 2;
+
+    // Do the untangling in reverse to find the spectrum of the N/2 complex
+    // numbers. The factors 1/2 are left out, which makes the output N times
+    // larger instead of N/2 times.
+    float *w = _work.data();
+    for (int k = 0; k < half; ++k) {
+        const float ar = real[k], ai = imag[k];
+        const float br = real[half - k], bi = imag[half - k];
+
+        const float evenR = ar + br;
+        const float evenI = ai - bi;
+        const float dr = ar - br;
+        const float di = ai + bi;
+
+        const float c = _realCos[size_t(k)];
+        const float s = _realSin[size_t(k)];
+        const float oddR = dr * c - di * s;
+        const float oddI = dr * s + di * c;
+
+        w[2*k] = evenR - oddI;
+        w[2*k + 1] = evenI + oddR;
+    }
+    transform(true);
+
+    for (int i = 0; i < _size; ++i) {
+        output[i] = w[i];
+    }
+}
+
+}  // namespace mda
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+namespace mda
+{
+
+/*
+  Fast Fourier transform of real-valued signals.
+
+  A signal of N real samples has a spectrum of N/2 + 1 frequency bins, from DC
+  up to and including Nyquist. (The other half of the spectrum is a mirror
+  image of the first half, so there's no point in computing it.) The spectrum
+  is stored with the real and imaginary parts in separate arrays. That makes
+  the loops that multiply two spectra simple enough for the compiler to turn
+  into SIMD instructions.
+
+  The trick for real signals is to pretend the N real samples are N/2 complex
+  numbers, with the even samples as the real parts and the odd samples as the
+  imaginary parts, do a complex FFT of half the size, and then untangle the
+  result. That's about twice as fast as a complex FFT of the full size.
+
+  The complex FFT is the textbook iterative radix-2 algorithm. It's not as
+  fast as FFTW or the vendor libraries, but it has no dependencies, and it's
+  good enough for a convolution reverb where most of the time goes into the
+  multiplications of the spectra anyway.
+
+  The inverse transform is not normalized: doing forward() followed by
+  inverse() gives back the original signal times N. The convolution folds the
+  1/N into the impulse response, so it doesn't cost anything.
+ */
+class FFT
+{
+public:
+    // Makes the lookup tables for `size` samples, which must be a power of
+    // two and at least 4. Allocates memory, so don't call from the audio thread.
+    void prepare(int size);
+
+    int size() const noexcept { return _size; }
+    int numBins() const noexcept { return _size / 2 + 1; }
+
+    // Reads size() samples from `input` and writes numBins() values into
+    // `real` and `imag`.
+    void forward(const float *input, float *real, float *imag) noexcept;
+
+    // Reads numBins() values from `real` and `imag` and writes size() samples
+    // into `output`. The imaginary parts of DC and Nyquist are ignored.
+    void inverse(const float *real, const float *imag, float *output) noexcept;
+
+private:
+    // In-place complex FFT of size / 2 interleaved values in _work.
+    void transform(bool inverse) noexcept;
+
+    int _size = 0;
+
+    // Where each value goes when sorting the input in bit-reversed order.
+    std::vector<int> _bitReverse;
+
+    // cos and sin of 2pi * k / (size / 2), for the complex FFT.
+    std::vector<float> _cos, _sin;
+
+    // cos and sin of 2pi * k / size, for untangling the real spectrum.
+    std::vector<float> _realCos, _realSin;
+
+    // Interleaved complex values the complex FFT works on.
+    std::vector<float> _work;
+};
+
+}  // namespace mda
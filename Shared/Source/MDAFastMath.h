@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Fast approximations of math functions from <cmath>, for use in render loops.
+//
+// These do not give the same results as the libm versions, so anything that
+// uses them is no longer bit-exact with the original plug-ins. For A/B tests,
+// build with MDA_FAST_EXP=0 (the CMake option of the same name) and the
+// functions simply call into <cmath> again. See Tests/README.markdown for how
+// to compare the two builds.
+
+#ifndef MDA_FAST_EXP
+#define MDA_FAST_EXP 1
+#endif
+
+#if !MDA_FAST_EXP
+#include <cmath>
+#endif
+
+namespace mda
+{
+
+/*
+  Computes 2^x.
+
+  The input is split into an integer part n and a fraction f in [-0.5, 0.5].
+  2^n is exact: it's simply the float exponent field. 2^f is approximated by
+  a degree-5 polynomial whose coefficients minimize the maximum relative
+  error on [-0.5, 0.5] (found with the Remez algorithm). The polynomial alone
+  has a relative error of 7.5e-8; with float rounding in the evaluation, the
+  measured maximum relative error is 2.4e-7, or a few units in the last
+  place. That is far below anything you can hear in a cutoff frequency or a
+  pitch: 2.4e-7 is 0.0004 cents.
+
+  There are no branches and no table lookups, so the compiler can vectorize
+  loops that call this function.
+
+  The input is clamped to [-126, 127], which keeps the result a normal float:
+  inputs below -126 return 2^-126 instead of a denormal or zero, and inputs
+  above 127 return 2^127 instead of infinity. NaN is not handled.
+ */
+inline float fastExp2(float x) noexcept
+{
+#if MDA_FAST_EXP
+    x = x < -126.0f ? -126.0f : x;
+    x = x > 127.0f ? 127.0f : x;
+
+    // Round to the nearest integer. Adding and subtracting 1.5 * 2^23 pushes
+    // the fraction bits out of the mantissa. This is valid for |x| < 2^22.
+    const float n = (x + 12582912.0f) - 12582912.0f;
+    const float f = x - n;
+
+    float p = 0.0013276471979286704f;
+    p = p * f + 0.009675541334209831f;
+    p = p * f + 0.05550713273543075f;
+    p = p * f + 0.2402211972384865f;
+    p = p * f + 0.693146967064733f;
+    p = p * f + 1.0000000716546822f;
+
+    // Build the float 2^n by putting n + 127 into the exponent bits.
+    const std::int32_t bits = (std::int32_t(n) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+#else
+    return std::exp2(x);
+#endif
+}
+
+/*
+  Computes e^x.
+
+  This works the same way as fastExp2(), but splits the input into n * ln(2)
+  plus a remainder r in [-ln(2)/2, ln(2)/2], and approximates e^r with its
+  own minimax polynomial. ln(2) is split into two constants (Cody-Waite) so
+  that r is computed without losing precision. Simply doing fastExp2(x *
+  log2(e)) would be up to 5x less accurate for larger inputs, because of the
+  rounding in the multiplication.
+
+  The measured maximum relative error is 2.4e-7. The input is clamped to
+  [-87.3, 88.0], the range where e^x is a normal float.
+ */
+inline float fastExp(float x) noexcept
+{
+#if MDA_FAST_EXP
+    x = x < -87.3f ? -87.3f : x;
+    x = x > 88.0f ? 88.0f : x;
+
+    const float n = (x * 1.44269504088896341f + 12582912.0f) - 12582912.0f;
+    const float r = (x - n * 0.693359375f) + n * 2.12194440e-4f;
+
+    float p = 0.008297655080363472f;
+    p = p * r + 0.04191538199169587f;
+    p = p * r + 0.16667574728755044f;
+    p = p * r + 0.49998894851221964f;
+    p = p * r + 0.9999996919915167f;
+    p = p * r + 1.0000000716546822f;
+
+    const std::int32_t bits = (std::int32_t(n) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+#else
+    return std::exp(x);
+#endif
+}
+
+}  // namespace mda
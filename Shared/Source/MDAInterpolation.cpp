@@ -0,0 +1,69 @@
+#include "MDAInterpolation.h"
+
+#include <cmath>
+
+namespace mda
+{
+
+// The power series converges quickly for the values of x we need.
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    const double y = x * x / 4.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= y / double(k * k);
+        sum += term;
+        if (term < sum * 1e-12) { break; }
+    }
+    return sum;
+}
+
+const SincTable &SincTable::instance()
+{
+    // Thread-safe: C++11 guarantees that this is only constructed once.
+    static const SincTable table;
+    return table;
+}
+
+SincTable::SincTable()
+{
+    const double pi = 3.14159265358979323846;
+
+    // The cutoff frequency, relative to the waveform's Nyquist frequency, and
+    // the shape of the Kaiser window. With only 8 taps, the filter can't be
+    // very steep. These settings keep the response within 0.5 dB up to 0.6
+    // times the Nyquist frequency (-3 dB at 0.8), and attenuate the mirror
+    // images above 1.4 times the Nyquist frequency by more than 60 dB. Linear
+    // interpolation only attenuates those by 17 dB or so.
+    const double cutoff = 0.9;
+    const double beta = 6.0;
+    const double i0Beta = besselI0(beta);
+    const double halfWidth = double(SINC_TAPS / 2);
+
+    for (int phase = 0; phase <= SINC_PHASES; ++phase) {
+        const double t = double(phase) / double(SINC_PHASES);
+        float *row = _coeffs + phase * SINC_TAPS;
+
+        // Tap k is for the sample at pos + k - (SINC_TAPS/2 - 1). The distance
+        // from the read position at pos + t is x.
+        double sum = 0.0;
+        double weights[SINC_TAPS];
+        for (int k = 0; k < SINC_TAPS; ++k) {
+            const double x = double(k - (SINC_TAPS / 2 - 1)) - t;
+            const double sinc = (x == 0.0) ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+            const double r = x / halfWidth;
+            const double window = (r * r < 1.0) ? besselI0(beta * std::sqrt(1.0 - r * r)) / i0Beta : 0.0;
+            weights[k] = sinc * window;
+            sum += weights[k];
+        }
+
+        // Normalize so that the gain at DC is exactly 1 for every phase.
+        // Otherwise, the level would wobble slightly with the read position.
+        for (int k = 0; k < SINC_TAPS; ++k) {
+            row[k] = float(weights[k] / sum);
+        }
+    }
+}
+
+}  // namespace mda
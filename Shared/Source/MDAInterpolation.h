@@ -0,0 +1,187 @@
+#pragma once
+
+namespace mda
+{
+
+/*
+  Reading a sampled waveform at a fractional position.
+
+  Piano and EPiano play their waveforms at a different speed for every note.
+  The read position moves ahead by a fixed-point step size on every sample, so
+  it usually lands in between two samples of the waveform. The original code
+  draws a straight line between those two samples (linear interpolation). That
+  is cheap, but it softens the highs, and the corners where the line segments
+  meet produce mirror images of the sound above the waveform's Nyquist
+  frequency, which you can hear as a metallic haze on high notes.
+
+  The functions below look at more neighboring samples. `pos` is the index of
+  the sample just before the read position and `frac` is the fraction of the
+  way to the next sample, from 0 to 65535 (16-bit fixed point).
+
+  The neighbors can be outside of the part of the waveform that is playing. A
+  neighbor past `end` is wrapped around to the start of the loop, just like the
+  read position itself, so that the loop point stays seamless. A neighbor from
+  before `start`, the first sample of the waveform, uses the first sample.
+ */
+
+// Index of a neighboring sample, wrapped around as described above. There are
+// no branches, so loops that call this can be vectorized.
+inline int neighborIndex(int index, int start, int end, int loop) noexcept
+{
+    index -= loop & -int(index > end);
+    return index < start ? start : index;
+}
+
+/*
+  Cubic Hermite interpolation (also known as Catmull-Rom), which uses two
+  samples on either side of the read position. The curve passes through the
+  samples and the slope at every sample is the average of the slopes on either
+  side of it, so there are no corners. This is roughly twice the work of linear
+  interpolation.
+ */
+inline float interpolateCubic(const short *samples, int pos, int frac, int start, int end, int loop) noexcept
+{
+    const float t = float(frac) * (1.0f / 65536.0f);
+
+    // The weights for the four samples, from the polynomial's coefficients.
+    const float w0 = t * (-0.5f + t * (1.0f - 0.5f * t));
+    const float w1 = 1.0f + t * t * (-2.5f + 1.5f * t);
+    const float w2 = t * (0.5f + t * (2.0f - 1.5f * t));
+    const float w3 = t * t * (-0.5f + 0.5f * t);
+
+    const float y0 = float(samples[neighborIndex(pos - 1, start, end, loop)]);
+    const float y1 = float(samples[pos]);
+    const float y2 = float(samples[neighborIndex(pos + 1, start, end, loop)]);
+    const float y3 = float(samples[neighborIndex(pos + 2, start, end, loop)]);
+
+    return (w0 * y0 + w1 * y1) + (w2 * y2 + w3 * y3);
+}
+
+/*
+  Table of windowed-sinc filter kernels for band-limited interpolation.
+
+  The ideal way to read a waveform in between its samples is to add up all the
+  samples, each weighted by a sinc function centered on the read position. The
+  table stores a short version of that: SINC_TAPS weights, shaped by a Kaiser
+  window, for SINC_PHASES evenly spaced read positions between two samples.
+  Positions in between those are found by blending two neighboring rows.
+
+  The kernel's cutoff is a little below the waveform's Nyquist frequency, so
+  that the mirror images are suppressed. This assumes that the waveform is
+  played back at about the same speed or slower, i.e. the step size is at most
+  1.0, which is true for Piano and EPiano at 44.1 kHz and higher sample rates.
+
+  There is only one table, shared by everything in the process. It is made the
+  first time instance() is called.
+ */
+const int SINC_TAPS = 8;
+const int SINC_PHASES = 256;
+
+class SincTable
+{
+public:
+    static const SincTable &instance();
+
+    // The SINC_TAPS weights for the read position `phase / SINC_PHASES`. The
+    // rows go up to and including SINC_PHASES, so that row + 1 always exists.
+    const float *row(int phase) const noexcept { return _coeffs + phase * SINC_TAPS; }
+
+private:
+    SincTable();
+    float _coeffs[(SINC_PHASES + 1) * SINC_TAPS];
+};
+
+/*
+  Windowed-sinc interpolation. This uses SINC_TAPS samples, half of them on
+  either side of the read position. This is roughly four times the work of
+  linear interpolation.
+ */
+inline float interpolateSinc(const SincTable &table, const short *samples,
+                             int pos, int frac, int start, int end, int loop) noexcept
+{
+    // The top 8 bits of the fraction choose the row, the lower 8 bits blend
+    // between that row and the next one.
+    const int phase = frac >> 8;
+    const float blend = float(frac & 0xFF) * (1.0f / 256.0f);
+    const float *row0 = table.row(phase);
+    const float *row1 = table.row(phase + 1);
+
+    // These loops have no dependencies between iterations, so they become
+    // SIMD instructions.
+    float products[SINC_TAPS];
+    for (int k = 0; k < SINC_TAPS; ++k) {
+        const int index = neighborIndex(pos + k - (SINC_TAPS / 2 - 1), start, end, loop);
+        const float weight = row0[k] + blend * (row1[k] - row0[k]);
+        products[k] = weight * float(samples[index]);
+    }
+
+    // Add them up pairwise, which is also how SIMD code would do it.
+    for (int n = SINC_TAPS / 2; n > 0; n /= 2) {
+        for (int k = 0; k < n; ++k) {
+            products[k] += products[k + n];
+        }
+    }
+    return products[0];
+}
+
+/*
+  Moves a read position ahead by `numFrames` steps and writes the position
+  after every step into `positions` and `fracs`. This gives exactly the same
+  results as doing the following `numFrames` times:
+
+      frac += delta;
+      pos += frac >> 16;
+      frac &= 0xFFFF;
+      if (pos > end) pos -= loop;
+
+  Written like that, every step depends on the one before it. But as long as
+  the read position doesn't wrap around, the position after k steps is simply
+  `pos + ((frac + k*delta) >> 16)`. So first we work out how many steps fit
+  before the position goes past `end`, fill those in with a loop that can be
+  vectorized, and then do the wrap-around by hand.
+
+  `numFrames * delta` must fit in an int, so keep numFrames small.
+ */
+inline void advanceReadPosition(int &pos, int &frac, int delta, int end, int loop,
+                                int *positions, int *fracs, int numFrames) noexcept
+{
+    int i = 0;
+    while (i < numFrames) {
+        const int remaining = numFrames - i;
+
+        // The distance to the end of the waveform in 16-bit fixed point. This
+        // can be more than 32 bits.
+        const long long room = (long long)(end - pos + 1) * 65536 - frac;
+        long long steps = (delta > 0) ? (room - 1) / delta : (room > 0 ? remaining : 0);
+        if (steps > remaining) steps = remaining;
+        if (steps < 0) steps = 0;
+
+        const int count = int(steps);
+        for (int k = 0; k < count; ++k) {
+            const int acc = frac + (k + 1) * delta;
+            positions[i + k] = pos + (acc >> 16);
+            fracs[i + k] = acc & 0xFFFF;
+        }
+        i += count;
+
+        if (i == numFrames) {
+            // All done, remember where we ended up.
+            const int acc = frac + count * delta;
+            pos += acc >> 16;
+            frac = acc & 0xFFFF;
+        } else {
+            // The next step goes past the end, so wrap around to the loop.
+            const int acc = frac + (count + 1) * delta;
+            pos += (acc >> 16) - loop;
+            frac = acc & 0xFFFF;
+            positions[i] = pos;
+            fracs[i] = frac;
+            i += 1;
+        }
+    }
+}
+
+// Modified Bessel function of the first kind, order 0. Used for Kaiser windows.
+double besselI0(double x);
+
+}  // namespace mda
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "MDAParameters.h"
+
+namespace mda
+{
+
+/*
+  The JUCE side of MDAParameters.h. Unlike the rest of this folder, this
+  header needs JUCE, so it's only included by the plug-ins themselves.
+ */
+
+// Makes `watcher` watch every parameter of the plug-in that `apvts` belongs
+// to, so that update() only needs to be called when one of them changes.
+// Parameters that aren't managed by `apvts` have no raw value to watch and
+// are skipped. Call this from the constructor, since it allocates.
+inline void watchAllParameters(ParameterWatcher &watcher, juce::AudioProcessorValueTreeState &apvts)
+{
+    for (auto *param : apvts.processor.getParameters()) {
+        if (auto *ranged = dynamic_cast<juce::RangedAudioParameter *>(param)) {
+            if (auto *value = apvts.getRawParameterValue(ranged->paramID)) {
+                watcher.add(value);
+            }
+        }
+    }
+}
+
+}  // namespace mda
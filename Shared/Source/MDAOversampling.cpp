@@ -0,0 +1,126 @@
+#include "MDAOversampling.h"
+#include "MDAInterpolation.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace mda
+{
+
+HalfbandDecimator::HalfbandDecimator(int halfLength, float beta) : _halfLength(halfLength)
+{
+    /*
+      The full filter has 4 * halfLength - 1 taps, with the middle tap at
+      index `center`. The ideal halfband filter is 0.5 * sinc(n / 2), where n
+      is the distance from the middle. For even n (other than 0) this is zero,
+      so we only compute the odd distances n = 1, 3, 5, ...
+     */
+    const int center = 2 * halfLength - 1;
+    const double pi = 3.14159265358979323846;
+    const double i0Beta = besselI0(double(beta));
+
+    _coeffs.resize(halfLength);
+    double sum = 0.0;
+    for (int k = 0; k < halfLength; ++k) {
+        const double n = double(2 * k + 1);
+        const double sinc = std::sin(pi * n / 2.0) / (pi * n);
+        const double r = n / double(center);
+        const double window = besselI0(double(beta) * std::sqrt(1.0 - r * r)) / i0Beta;
+        _coeffs[k] = float(sinc * window);
+        sum += 2.0 * sinc * window;
+    }
+
+    // Normalize so that the gain at DC is exactly 1. The middle coefficient
+    // is 0.5, so the other coefficients must add up to 0.5 too.
+    for (int k = 0; k < halfLength; ++k) {
+        _coeffs[k] = float(double(_coeffs[k]) * 0.5 / sum);
+    }
+
+    _even.resize(2 * halfLength);
+    _odd.resize(4 * halfLength);
+    reset();
+}
+
+void HalfbandDecimator::reset()
+{
+    std::memset(_even.data(), 0, _even.size() * sizeof(float));
+    std::memset(_odd.data(), 0, _odd.size() * sizeof(float));
+    _evenPos = 0;
+    _oddPos = 0;
+}
+
+void HalfbandDecimator::process(const float *input, float *output, int numFrames)
+{
+    const int M = _halfLength;
+    const int evenLength = M;
+    const int oddLength = 2 * M;
+    const float *coeffs = _coeffs.data();
+
+    for (int n = 0; n < numFrames; ++n) {
+        const float even = input[2 * n];
+        const float odd = input[2 * n + 1];
+
+        // Put the new samples into the delay lines. After this, e[0] is the
+        // even sample from M - 1 steps ago, and o[0] ... o[2M - 1] are the
+        // last 2M odd samples, from oldest to newest.
+        _even[_evenPos] = _even[_evenPos + evenLength] = even;
+        _odd[_oddPos] = _odd[_oddPos + oddLength] = odd;
+        if (++_evenPos == evenLength) { _evenPos = 0; }
+        if (++_oddPos == oddLength) { _oddPos = 0; }
+        const float *e = &_even[_evenPos];
+        const float *o = &_odd[_oddPos];
+
+        // The middle coefficient, and the odd samples in symmetric pairs,
+        // working outward from the middle.
+        float y = 0.5f * e[0];
+        for (int k = 0; k < M; ++k) {
+            y += coeffs[k] * (o[M + k] + o[M - 1 - k]);
+        }
+        output[n] = y;
+    }
+}
+
+// Kaiser beta and length for each stage. The beta of 10 gives a stopband
+// attenuation of about 100 dB. The lengths are the shortest that reach it,
+// given the transition band each stage needs. These were found by measuring
+// the response to sine waves over the whole frequency range.
+Decimator::Decimator() : _stage1(7, 10.0f), _stage2(17, 10.0f), _factor(1)
+{
+}
+
+void Decimator::setFactor(int factor)
+{
+    _factor = factor;
+    reset();
+}
+
+void Decimator::reset()
+{
+    _stage1.reset();
+    _stage2.reset();
+}
+
+void Decimator::process(float *input, float *output, int numFrames)
+{
+    if (_factor == 4) {
+        _stage1.process(input, input, numFrames * 2);
+        _stage2.process(input, output, numFrames);
+    } else if (_factor == 2) {
+        _stage2.process(input, output, numFrames);
+    } else {
+        std::memmove(output, input, numFrames * sizeof(float));
+    }
+}
+
+float Decimator::getLatency(int factor) const
+{
+    if (factor == 4) {
+        return _stage1.getLatency() / 2.0f + _stage2.getLatency();
+    } else if (factor == 2) {
+        return _stage2.getLatency();
+    } else {
+        return 0.0f;
+    }
+}
+
+}  // namespace mda
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+
+namespace mda
+{
+
+/*
+  Halfband lowpass filter combined with 2:1 decimation.
+
+  To go from 2x the sample rate back down to 1x, everything above the new
+  Nyquist frequency must be filtered out first, otherwise it aliases. A
+  halfband filter is an FIR lowpass filter whose cutoff is exactly halfway to
+  Nyquist. It has the nice property that every other coefficient is zero,
+  except for the one in the middle, which is 0.5.
+
+  Because we only keep every other output sample, we don't need to compute the
+  samples that get thrown away. This is the polyphase form of the filter: the
+  input is split into the even and the odd samples. The even samples only meet
+  the middle coefficient, so they are simply delayed and scaled by 0.5. The
+  odd samples go through the nonzero coefficients, which are symmetric, so the
+  samples are added in pairs before multiplying. With `halfLength` nonzero
+  coefficients on each side, one output sample costs `halfLength` multiplies.
+
+  The coefficients are a windowed sinc with a Kaiser window. The filter is
+  linear phase, with a delay of `halfLength - 0.5` output samples.
+ */
+class HalfbandDecimator
+{
+public:
+    // Creates a filter with 4 * halfLength - 1 taps, of which halfLength + 1
+    // are unique and nonzero. Beta is the Kaiser window shape: a larger beta
+    // gives more stopband attenuation but a wider transition band.
+    HalfbandDecimator(int halfLength, float beta);
+
+    // Clears the filter's memory.
+    void reset();
+
+    // Reads 2 * numFrames samples from `input` and writes numFrames samples to
+    // `output`. The output may be the same buffer as the input.
+    void process(const float *input, float *output, int numFrames);
+
+    // The delay of the filter, in output samples.
+    float getLatency() const { return float(_halfLength) - 0.5f; }
+
+private:
+    int _halfLength;
+
+    // The nonzero coefficients on one side of the middle, starting with the
+    // one closest to the middle.
+    std::vector<float> _coeffs;
+
+    // Delay lines for the even and odd input samples. Every sample is written
+    // twice, `length` positions apart, so that the most recent `length`
+    // samples can always be read as one contiguous block.
+    std::vector<float> _even, _odd;
+    int _evenPos, _oddPos;
+};
+
+/*
+  Brings an oversampled signal back down to the normal sample rate.
+
+  For 2x, this is a single halfband filter with a narrow transition band. For
+  4x, another halfband filter goes first to go from 4x to 2x. That first stage
+  can be much shorter, because the frequencies it needs to keep only go up to
+  a fifth of its Nyquist frequency, so it has a wide transition band.
+
+  Everything below 0.4 times the output sample rate (17.6 kHz at 44.1 kHz) is
+  kept, with less than 0.07 dB of droop at the top. Anything that would alias
+  into that range is attenuated by about 100 dB. Between 0.4 times the sample
+  rate and Nyquist there may be some aliasing, which is mostly inaudible.
+ */
+class Decimator
+{
+public:
+    Decimator();
+
+    // Sets the oversampling factor: 1, 2 or 4. This also resets the filters.
+    void setFactor(int factor);
+    int getFactor() const { return _factor; }
+
+    // Clears the filters' memory.
+    void reset();
+
+    // Reads numFrames * factor samples from `input` and writes numFrames
+    // samples to `output`. The input buffer is used as scratch space, so its
+    // contents are lost. With a factor of 1, this simply copies.
+    void process(float *input, float *output, int numFrames);
+
+    // The delay of the filters, in output samples.
+    float getLatency() const { return getLatency(_factor); }
+
+    // The delay the filters would have with the given factor. This doesn't
+    // touch the filter state, so it's safe to call from another thread.
+    float getLatency(int factor) const;
+
+private:
+    HalfbandDecimator _stage1;  // 4x -> 2x
+    HalfbandDecimator _stage2;  // 2x -> 1x
+    int _factor;
+};
+
+}  // namespace mda
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace mda
+{
+
+/*
+  Tells the plug-in when any of its parameters has changed.
+
+  The plug-ins convert their parameters into the coefficients that are used by
+  the audio code in update(). The original plug-ins only did this when a
+  parameter actually changed. The JUCE versions called update() at the start
+  of every block, which means looking up every parameter by name and redoing
+  all the std::exp() and std::pow() math, even if nothing changed.
+
+  The watcher keeps a pointer to each parameter's atomic value, as returned by
+  AudioProcessorValueTreeState::getRawParameterValue(), and a copy of the value
+  it saw last. Checking for changes is only a load and a compare per parameter:
+
+      // in the constructor, see MDAJuceParameters.h
+      mda::watchAllParameters(_parameters, apvts);
+
+      // in processBlock()
+      if (_parameters.changed()) {
+          update();
+      }
+
+  Things other than the parameters that update() depends on, such as the
+  sample rate, are handled by calling invalidate(). This forces the next call
+  to changed() to return true. A new watcher starts out invalidated.
+
+  This is TestTone's `_parametersChanged` flag, except that it does not need a
+  listener on the ValueTree, so it also sees changes that were made from the
+  audio thread, and it doesn't wait for the message thread to sync the tree.
+ */
+class ParameterWatcher
+{
+public:
+    // Adds a parameter to watch. This allocates memory, so do it in the
+    // constructor and not on the audio thread.
+    void add(const std::atomic<float> *value)
+    {
+        _values.push_back(value);
+        _last.push_back(value->load());
+    }
+
+    // Makes the next call to changed() return true. Safe to call from any
+    // thread, for example from setStateInformation().
+    void invalidate() noexcept
+    {
+        _invalid.store(true);
+    }
+
+    // Returns true if any of the parameters has a different value than the
+    // last time this was called. Only call this from the audio thread.
+    bool changed() noexcept
+    {
+        bool changed = _invalid.exchange(false);
+        for (std::size_t i = 0; i < _values.size(); ++i) {
+            const float value = _values[i]->load(std::memory_order_relaxed);
+            if (value != _last[i]) {
+                _last[i] = value;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+private:
+    std::vector<const std::atomic<float> *> _values;
+    std::vector<float> _last;
+    std::atomic<bool> _invalid { true };
+};
+
+/*
+  A coefficient that ramps linearly to a new value, for dezippering.
+
+  When the user moves a gain knob, update() computes the new gain once, and
+  then this object moves from the old gain to the new one over a short time,
+  one step per sample. Without the ramp, the gain jumps at the start of the
+  block, which you can hear as clicks or "zipper noise" during automation.
+
+  After reset(), the next setTarget() jumps straight to the new value. That
+  way, the first update() after prepareToPlay() does not fade in from zero,
+  and the output is exactly the same as without the ramp until a parameter
+  changes.
+
+  When there is no ramp in progress, next() returns exactly the target value.
+ */
+class SmoothedValue
+{
+public:
+    // Sets the length of the ramp. Call this from prepareToPlay().
+    void prepare(double sampleRate, double rampSeconds = 0.02)
+    {
+        _rampLength = int(sampleRate * rampSeconds);
+        reset();
+    }
+
+    // Stops any ramp; the next call to setTarget() takes effect immediately.
+    void reset() noexcept
+    {
+        _steps = 0;
+        _jump = true;
+    }
+
+    // Starts ramping from the current value to the new one.
+    void setTarget(float value) noexcept
+    {
+        if (_jump || _rampLength <= 0) {
+            _current = _target = value;
+            _steps = 0;
+            _jump = false;
+        } else if (value != _target) {
+            _target = value;
+            _steps = _rampLength;
+            _increment = (_target - _current) / float(_steps);
+        }
+    }
+
+    // Returns the value for the next sample.
+    float next() noexcept
+    {
+        if (_steps > 0) {
+            // On the last step, use the target value itself so that the
+            // rounding errors of the increments don't add up.
+            _current = (--_steps == 0) ? _target : _current + _increment;
+        }
+        return _current;
+    }
+
+    bool isSmoothing() const noexcept { return _steps > 0; }
+    float getTarget() const noexcept { return _target; }
+
+private:
+    float _current = 0.0f;
+    float _target = 0.0f;
+    float _increment = 0.0f;
+    int _steps = 0;
+    int _rampLength = 0;
+    bool _jump = true;
+};
+
+}  // namespace mda
@@ -0,0 +1,81 @@
+#include "MDAPeakDetection.h"
+#include "MDAInterpolation.h"
+
+#include <cstring>
+
+namespace mda
+{
+
+void SlidingMaximum::setMaxLength(int maxLength)
+{
+    // The queue never holds more than one window's worth of samples, plus
+    // the new one before the oldest is removed.
+    _capacity = maxLength + 1;
+    _values.assign(size_t(_capacity), 0.0f);
+    _times.assign(size_t(_capacity), 0);
+    if (_length > maxLength) { _length = maxLength; }
+    reset();
+}
+
+void SlidingMaximum::setLength(int length)
+{
+    _length = std::max(1, std::min(length, _capacity - 1));
+    reset();
+}
+
+void SlidingMaximum::reset()
+{
+    // Start with a single zero, as if the window was filled with zeros.
+    _front = 0;
+    _count = 0;
+    _time = 0;
+    if (_capacity > 0) {
+        _values[0] = 0.0f;
+        _times[0] = 0;
+        _count = 1;
+        _time = 1;
+    }
+}
+
+TruePeakDetector::TruePeakDetector()
+{
+    /*
+      Windowed sinc, like SincTable. The cutoff is right at the Nyquist
+      frequency, so that the highest frequencies are not underestimated. The
+      Kaiser window with beta 6 is the one that keeps the filters from
+      overshooting, which would make the detector see peaks that aren't there.
+     */
+    const double pi = 3.14159265358979323846;
+    const double beta = 6.0;
+    const double i0Beta = besselI0(beta);
+    const double halfWidth = double(TAPS / 2);
+
+    for (int phase = 0; phase < 3; ++phase) {
+        const double t = double(phase + 1) / 4.0;
+        double sum = 0.0;
+        double weights[TAPS];
+        for (int k = 0; k < TAPS; ++k) {
+            const double x = double(k - (TAPS / 2 - 1)) - t;
+            const double sinc = std::sin(pi * x) / (pi * x);
+            const double r = x / halfWidth;
+            const double window = (r * r < 1.0) ? besselI0(beta * std::sqrt(1.0 - r * r)) / i0Beta : 0.0;
+            weights[k] = sinc * window;
+            sum += weights[k];
+        }
+
+        // Normalize so that the gain at DC is exactly 1.
+        for (int k = 0; k < TAPS; ++k) {
+            _coeffs[phase][k] = float(weights[k] / sum);
+        }
+    }
+
+    reset();
+}
+
+void TruePeakDetector::reset()
+{
+    std::memset(_history, 0, sizeof(_history));
+    _pos = 0;
+}
+
+}  // namespace mda
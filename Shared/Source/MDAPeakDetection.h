@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace mda
+{
+
+/*
+  The largest value in a sliding window over a signal.
+
+  A lookahead limiter needs to know the loudest sample in the next N samples,
+  for every sample. Looking at all N of them every time is O(N) per sample.
+  This uses a monotonic queue instead: it keeps only the samples that can
+  still become the maximum, from largest to smallest. A new sample removes all
+  the smaller ones from the back of the queue, because they are older and
+  smaller, so they can never be the maximum again. The oldest sample falls off
+  the front when it leaves the window. The front of the queue is always the
+  maximum. Every sample is added and removed once, so this is O(1) per sample
+  on average.
+ */
+class SlidingMaximum
+{
+public:
+    // Allocates room for windows of up to `maxLength` samples. Don't call
+    // this from the audio thread.
+    void setMaxLength(int maxLength);
+
+    // Sets the window length, from 1 up to the maximum length. This also
+    // empties the window.
+    void setLength(int length);
+    int getLength() const { return _length; }
+
+    // Empties the window. Until it has seen `length` samples, the window acts
+    // as if it was filled with zeros.
+    void reset();
+
+    // Adds a sample and returns the largest of the last `length` samples.
+    float process(float x) noexcept
+    {
+        // Remove the samples that are not larger than the new one. There is
+        // always at least one sample in the queue after this, the new one.
+        while (_count > 0 && _values[back()] <= x) {
+            _count--;
+        }
+
+        const int i = back() + 1 == _capacity ? 0 : back() + 1;
+        _values[i] = x;
+        _times[i] = _time;
+        _count++;
+
+        // Remove the oldest sample if it has left the window.
+        if (_time - _times[_front] >= unsigned(_length)) {
+            _front = (_front + 1 == _capacity) ? 0 : _front + 1;
+            _count--;
+        }
+
+        _time++;
+        return _values[_front];
+    }
+
+private:
+    int back() const noexcept
+    {
+        const int i = _front + _count - 1;
+        return (i >= _capacity) ? i - _capacity : (i < 0 ? i + _capacity : i);
+    }
+
+    // The queue is a ring buffer of `_capacity` entries, starting at _front.
+    std::vector<float> _values;
+    std::vector<unsigned> _times;
+    int _capacity = 0;
+    int _front = 0;
+    int _count = 0;
+
+    int _length = 1;
+
+    // Counts the samples. This may wrap around, which is fine because only
+    // differences between two times are used.
+    unsigned _time = 0;
+};
+
+/*
+  Measures the true peak level of a signal.
+
+  The samples of a digital signal are not the whole story: when the signal is
+  turned back into a continuous waveform, it can peak in between two samples,
+  higher than either of them. A limiter that only looks at the samples lets
+  those peaks through, and they clip in the D/A converter or when the audio is
+  encoded for streaming.
+
+  This upsamples the signal 4x with a windowed-sinc interpolator, the same
+  method as the ITU-R BS.1770 loudness standard, and returns the largest
+  absolute value out of every sample and the three points in between it and
+  the next sample. That finds the peaks in between samples to within about
+  0.5 dB up to 0.9 times the Nyquist frequency, and never overestimates them.
+  The remaining error is because it only looks at four points per sample.
+
+  To compute the points after a sample, the interpolator needs to see some
+  samples that come after it, so the result is for the sample from
+  getLatency() samples ago.
+ */
+class TruePeakDetector
+{
+public:
+    TruePeakDetector();
+
+    // Clears the detector's memory.
+    void reset();
+
+    // Adds a sample and returns the peak level around the sample from
+    // getLatency() samples ago.
+    float process(float x) noexcept
+    {
+        _history[_pos] = _history[_pos + TAPS] = x;
+        if (++_pos == TAPS) { _pos = 0; }
+        const float *h = &_history[_pos];
+
+        // The oldest sample is h[0], the newest h[TAPS - 1]. The points in
+        // between are for the read position h[TAPS/2 - 1] + phase/4.
+        float peak = std::abs(h[TAPS / 2 - 1]);
+        for (int phase = 0; phase < 3; ++phase) {
+            float y = 0.0f;
+            for (int k = 0; k < TAPS; ++k) {
+                y += _coeffs[phase][k] * h[k];
+            }
+            peak = std::max(peak, std::abs(y));
+        }
+        return peak;
+    }
+
+    static int getLatency() { return TAPS / 2; }
+
+private:
+    // Length of the interpolation filter for one phase. The full 4x filter
+    // has 48 taps, as in BS.1770.
+    static const int TAPS = 12;
+
+    // The filters for the read positions 1/4, 2/4 and 3/4.
+    float _coeffs[3][TAPS];
+
+    // The last TAPS samples. Every sample is written twice, TAPS positions
+    // apart, so that they can always be read as one contiguous block.
+    float _history[2 * TAPS];
+    int _pos;
+};
+
+}  // namespace mda
@@ -0,0 +1,391 @@
+#include "MDASampleStore.h"
+#include "MDAInterpolation.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mda
+{
+
+static const char sampleMagic[8] = { 'M', 'D', 'A', 'S', 'M', 'P', 'L', '1' };
+
+// The fixed-size part at the start of a sample file. The keygroups follow
+// directly after it.
+struct SampleFileHeader
+{
+    char magic[8];
+    std::uint32_t numKeygroups;
+    std::uint32_t numSamples;
+    std::uint32_t dataOffset;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(SampleFileHeader) == 24, "unexpected padding");
+static_assert(sizeof(Keygroup) == 5 * sizeof(std::int32_t), "unexpected padding");
+
+// Start the samples on a 64-byte boundary, so that the first one is at the
+// start of a cache line.
+static std::uint32_t dataOffsetFor(int numKeygroups)
+{
+    const std::uint32_t size = std::uint32_t(sizeof(SampleFileHeader) + sizeof(Keygroup) * size_t(numKeygroups));
+    return (size + 63) & ~std::uint32_t(63);
+}
+
+// Checks that the keygroups don't point outside the sample data, so that a
+// damaged file can't make the plug-in read random memory.
+static bool keygroupsAreValid(const Keygroup *keygroups, int numKeygroups, int numSamples)
+{
+    for (int i = 0; i < numKeygroups; ++i) {
+        const Keygroup &kg = keygroups[i];
+        if (kg.pos < 0 || kg.end < kg.pos || kg.end + 1 >= numSamples || kg.loop < 0 || kg.loop > kg.end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+  The stores that were opened from files, by path. These are weak pointers, so
+  the cache does not keep a store alive by itself: when the last plug-in that
+  uses it goes away, the file is unmapped. The next open() maps it again.
+ */
+static std::mutex cacheMutex;
+static std::map<std::string, std::weak_ptr<const SampleStore>> cache;
+
+/*
+  The upsampled stores, by the address of the original samples and the factor.
+  The address is enough to recognize the waveforms: an upsampled store holds
+  on to its original, so those samples can't go away and be replaced by other
+  data at the same address while the cache entry is still alive. A separate
+  mutex, since making an upsampled store takes a while.
+ */
+static std::mutex upsampledMutex;
+static std::map<std::pair<const short *, int>, std::weak_ptr<const SampleStore>> upsampledCache;
+
+// Length of the upsampling filter, in samples of the original waveform.
+static const int upsampleTaps = 32;
+
+SampleStore::~SampleStore()
+{
+#ifdef _WIN32
+    if (_mapping != nullptr) { UnmapViewOfFile(_mapping); }
+    if (_mappingHandle != nullptr) { CloseHandle(_mappingHandle); }
+    if (_fileHandle != nullptr) { CloseHandle(_fileHandle); }
+#else
+    if (_mapping != nullptr) { munmap(const_cast<void *>(_mapping), _mappingSize); }
+#endif
+}
+
+std::shared_ptr<const SampleStore> SampleStore::open(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    auto it = cache.find(path);
+    if (it != cache.end()) {
+        if (auto existing = it->second.lock()) {
+            return existing;
+        }
+    }
+
+    // Not using make_shared because the constructor is private.
+    std::shared_ptr<SampleStore> store(new SampleStore());
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) { return nullptr; }
+    store->_fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < LONGLONG(sizeof(SampleFileHeader))) {
+        return nullptr;
+    }
+    store->_mappingSize = size_t(fileSize.QuadPart);
+
+    store->_mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (store->_mappingHandle == nullptr) { return nullptr; }
+
+    store->_mapping = MapViewOfFile(store->_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (store->_mapping == nullptr) { return nullptr; }
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { return nullptr; }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < off_t(sizeof(SampleFileHeader))) {
+        ::close(fd);
+        return nullptr;
+    }
+    store->_mappingSize = size_t(info.st_size);
+
+    // The mapping stays valid after the file is closed.
+    void *mapping = mmap(nullptr, store->_mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) { return nullptr; }
+    store->_mapping = mapping;
+#endif
+
+    const auto *bytes = static_cast<const unsigned char *>(store->_mapping);
+
+    SampleFileHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, sampleMagic, sizeof(sampleMagic)) != 0) {
+        return nullptr;
+    }
+
+    // Be careful not to overflow when checking the sizes.
+    const std::uint64_t keygroupsEnd = sizeof(SampleFileHeader) + std::uint64_t(header.numKeygroups) * sizeof(Keygroup);
+    const std::uint64_t samplesEnd = std::uint64_t(header.dataOffset) + std::uint64_t(header.numSamples) * sizeof(short);
+    if (header.numKeygroups > 1024 || header.numSamples > 0x7FFFFFFF ||
+        header.dataOffset < keygroupsEnd || (header.dataOffset & 1) != 0 ||
+        samplesEnd > store->_mappingSize) {
+        return nullptr;
+    }
+
+    store->_keygroups = reinterpret_cast<const Keygroup *>(bytes + sizeof(SampleFileHeader));
+    store->_numKeygroups = int(header.numKeygroups);
+    store->_samples = reinterpret_cast<const short *>(bytes + header.dataOffset);
+    store->_numSamples = int(header.numSamples);
+
+    if (!keygroupsAreValid(store->_keygroups, store->_numKeygroups, store->_numSamples)) {
+        return nullptr;
+    }
+
+    cache[path] = store;
+    return store;
+}
+
+std::shared_ptr<const SampleStore> SampleStore::find(const std::string &fileName, const std::string &folder)
+{
+#ifdef _WIN32
+    const char separator = '\\';
+#else
+    const char separator = '/';
+#endif
+
+    std::vector<std::string> folders;
+    if (const char *env = std::getenv("MDA_SAMPLE_DIR")) {
+        folders.push_back(env);
+    }
+    folders.push_back(folder);
+#ifdef MDA_DEFAULT_SAMPLE_DIR
+    folders.push_back(MDA_DEFAULT_SAMPLE_DIR);
+#endif
+
+    for (const auto &dir : folders) {
+        if (dir.empty()) { continue; }
+        std::string path = dir;
+        if (path.back() != '/' && path.back() != separator) { path += separator; }
+        if (auto store = open(path + fileName)) {
+            return store;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const SampleStore> SampleStore::fromMemory(const short *samples, int numSamples,
+                                                           const Keygroup *keygroups, int numKeygroups)
+{
+    std::shared_ptr<SampleStore> store(new SampleStore());
+    store->_samples = samples;
+    store->_numSamples = numSamples;
+    store->_keygroups = keygroups;
+    store->_numKeygroups = numKeygroups;
+    return store;
+}
+
+bool SampleStore::write(const std::string &path,
+                        const short *samples, int numSamples,
+                        const Keygroup *keygroups, int numKeygroups)
+{
+    if (!keygroupsAreValid(keygroups, numKeygroups, numSamples)) {
+        return false;
+    }
+
+    SampleFileHeader header;
+    std::memcpy(header.magic, sampleMagic, sizeof(sampleMagic));
+    header.numKeygroups = std::uint32_t(numKeygroups);
+    header.numSamples = std::uint32_t(numSamples);
+    header.dataOffset = dataOffsetFor(numKeygroups);
+    header.reserved = 0;
+
+    // The header, the keygroups and the padding up to the sample data.
+    std::vector<unsigned char> head(header.dataOffset, 0);
+    std::memcpy(head.data(), &header, sizeof(header));
+    std::memcpy(head.data() + sizeof(header), keygroups, sizeof(Keygroup) * size_t(numKeygroups));
+
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) { return false; }
+
+    bool ok = std::fwrite(head.data(), 1, head.size(), file) == head.size();
+    ok = ok && std::fwrite(samples, sizeof(short), size_t(numSamples), file) == size_t(numSamples);
+    ok = (std::fclose(file) == 0) && ok;
+    return ok;
+}
+
+int SampleStore::upsamplingFactor(double recordedRate, double sampleRate)
+{
+    int factor = 1;
+    while (factor < 8 && recordedRate * double(factor * 2) <= sampleRate) {
+        factor *= 2;
+    }
+    return factor;
+}
+
+// Index of a sample in the original waveform, for the upsampling filter. Like
+// the read position of a voice, anything past the end continues in the loop.
+static int loopedIndex(int index, const Keygroup &kg)
+{
+    while (index > kg.end && kg.loop > 0) { index -= kg.loop; }
+    if (index > kg.end) { index = kg.end; }
+    return index < kg.pos ? kg.pos : index;
+}
+
+std::shared_ptr<const SampleStore> SampleStore::upsampled(const std::shared_ptr<const SampleStore> &source,
+                                                          int factor)
+{
+    if (source == nullptr || factor <= 1) {
+        return source;
+    }
+
+    std::lock_guard<std::mutex> lock(upsampledMutex);
+
+    const auto key = std::make_pair(source->samples(), factor);
+    auto it = upsampledCache.find(key);
+    if (it != upsampledCache.end()) {
+        if (auto existing = it->second.lock()) {
+            return existing;
+        }
+    }
+
+    /*
+      The new samples are made with a windowed-sinc filter, the same idea as
+      SincTable but much longer, since this only happens once. There are
+      `factor` new samples for every original sample, each at a different
+      phase in between two original samples, so there are `factor` sets of
+      weights. Phase 0 lands on an original sample.
+
+      The cutoff is slightly below the Nyquist frequency of the original
+      waveform. With 32 taps and this Kaiser window, everything up to 0.8 times
+      that Nyquist frequency is kept within 0.01 dB (-3 dB at about 0.92), and
+      the mirror images are at least 60 dB down above 1.1 times the Nyquist
+      frequency and 80 dB above 1.2 times.
+     */
+    const double pi = 3.14159265358979323846;
+    const double cutoff = 0.95;
+    const double beta = 8.0;
+    const double i0Beta = besselI0(beta);
+    const double halfWidth = double(upsampleTaps / 2);
+
+    std::vector<float> weights(size_t(factor * upsampleTaps));
+    for (int phase = 0; phase < factor; ++phase) {
+        const double t = double(phase) / double(factor);
+        float *row = weights.data() + phase * upsampleTaps;
+
+        double sum = 0.0;
+        double w[upsampleTaps];
+        for (int k = 0; k < upsampleTaps; ++k) {
+            const double x = double(k - (upsampleTaps / 2 - 1)) - t;
+            const double sinc = (x == 0.0) ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+            const double r = x / halfWidth;
+            const double window = (r * r < 1.0) ? besselI0(beta * std::sqrt(1.0 - r * r)) / i0Beta : 0.0;
+            w[k] = sinc * window;
+            sum += w[k];
+        }
+        for (int k = 0; k < upsampleTaps; ++k) {
+            row[k] = float(w[k] / sum);
+        }
+    }
+
+    // Not using make_shared because the constructor is private.
+    std::shared_ptr<SampleStore> store(new SampleStore());
+    store->_source = source;
+
+    const int numKeygroups = source->numKeygroups();
+    size_t numSamples = 0;
+    for (int g = 0; g < numKeygroups; ++g) {
+        const Keygroup &kg = source->keygroups()[g];
+        numSamples += size_t(kg.end - kg.pos + 1) * size_t(factor) + 1;
+    }
+    if (numSamples > 0x7FFFFFFF) {
+        return nullptr;
+    }
+    store->_ownedSamples.resize(numSamples);
+    store->_ownedKeygroups.resize(size_t(numKeygroups));
+
+    const short *in = source->samples();
+    short *out = store->_ownedSamples.data();
+    int count = 0;
+
+    for (int g = 0; g < numKeygroups; ++g) {
+        const Keygroup &kg = source->keygroups()[g];
+        Keygroup &newKg = store->_ownedKeygroups[size_t(g)];
+
+        // Original sample i becomes new sample pos + (i - kg.pos)*factor. The
+        // loop wraps around after the last of the new samples that come from
+        // kg.end, so that is the new end.
+        newKg.root = kg.root;
+        newKg.high = kg.high;
+        newKg.pos = count;
+        newKg.end = count + (kg.end - kg.pos + 1) * factor - 1;
+        newKg.loop = kg.loop * factor;
+
+        for (int i = kg.pos; i <= kg.end; ++i) {
+            for (int phase = 0; phase < factor; ++phase) {
+                const float *row = weights.data() + phase * upsampleTaps;
+                float sum = 0.0f;
+                for (int k = 0; k < upsampleTaps; ++k) {
+                    sum += row[k] * float(in[loopedIndex(i + k - (upsampleTaps / 2 - 1), kg)]);
+                }
+                sum = std::round(sum);
+                out[count++] = short(sum > 32767.0f ? 32767.0f : (sum < -32768.0f ? -32768.0f : sum));
+            }
+        }
+
+        // The extra sample after the end is the first sample of the loop.
+        out[count] = out[newKg.loop > 0 ? newKg.end + 1 - newKg.loop : newKg.end];
+        count++;
+    }
+
+    store->_samples = out;
+    store->_numSamples = count;
+    store->_keygroups = store->_ownedKeygroups.data();
+    store->_numKeygroups = numKeygroups;
+
+    upsampledCache[key] = store;
+    return store;
+}
+
+void crossfadeLoop(short *samples, const Keygroup &keygroup)
+{
+    int p0 = keygroup.end;
+    int p1 = keygroup.end - keygroup.loop;
+
+    float xf = 1.0f;
+    float dxf = -0.02f;
+    while (xf > 0.0f) {
+        samples[p0] = short((1.0f - xf) * float(samples[p0]) + xf * float(samples[p1]));
+        p0--;
+        p1--;
+        xf += dxf;
+    }
+}
+
+}  // namespace mda
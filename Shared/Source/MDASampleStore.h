@@ -0,0 +1,151 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Set MDA_EXTERNAL_SAMPLES to 1 (the CMake option of the same name) to load
+// the Piano and EPiano waveforms from sample files at runtime, instead of
+// compiling the big mdaPianoData.h and mdaEPianoData.h tables into the
+// plug-ins. See SamplePack/README.markdown.
+#ifndef MDA_EXTERNAL_SAMPLES
+#define MDA_EXTERNAL_SAMPLES 0
+#endif
+
+namespace mda
+{
+
+/*
+  A keygroup maps a range of notes to a waveform. All the waveforms of an
+  instrument are stored one after the other in one big table of 16-bit
+  samples. Each waveform consists of an attack portion and a loop portion.
+ */
+struct Keygroup
+{
+    int root;  // MIDI root note (usually the note in the middle of the keygroup)
+    int high;  // highest note this waveform should be used for
+    int pos;   // index of the first sample in the lookup table
+    int end;   // index of the last sample in the lookup table
+    int loop;  // how far from end the first sample of the loop is
+};
+
+/*
+  Read-only waveform data and keygroups for a sample-based instrument.
+
+  The original plug-ins compile their waveforms into the binary as a giant
+  array of shorts. That makes every plug-in binary several megabytes larger
+  and the data headers are slow to compile. This class can instead load the
+  same data from a sample file, which has this layout (all little-endian):
+
+      char     magic[8]        "MDASMPL1"
+      uint32   numKeygroups
+      uint32   numSamples
+      uint32   dataOffset      where the samples start, from start of file
+      uint32   reserved        0
+      int32    keygroups[numKeygroups][5]   root, high, pos, end, loop
+      ...      padding
+      int16    samples[numSamples]          at dataOffset
+
+  The file is memory-mapped rather than read into memory. The pages are only
+  loaded when a note actually plays them, and because the mapping is read-only,
+  the operating system keeps a single copy of them in its file cache that is
+  shared by every process that maps the file.
+
+  Within a process, open() returns the same object for the same file for as
+  long as anyone is still using it, so 30 instances of the piano share a
+  single mapping. The object stays alive as long as there is a shared_ptr to
+  it, so a plug-in should hold on to the pointer until it is destroyed.
+
+  The sample data must not be modified. Anything that needs to be done to the
+  waveforms, such as the loop cross-fade of EPiano, is done when the sample
+  file is created.
+
+  The one exception is upsampled(), which makes a new store with the same
+  waveforms at a higher sample rate. That store owns its data in memory.
+ */
+class SampleStore
+{
+public:
+    ~SampleStore();
+
+    // Memory-maps a sample file. Returns nullptr if the file doesn't exist or
+    // is not a valid sample file. This may block on file I/O, so don't call it
+    // from the audio thread.
+    static std::shared_ptr<const SampleStore> open(const std::string &path);
+
+    // Looks for a sample file named `fileName` and opens it. The folder from
+    // the MDA_SAMPLE_DIR environment variable is tried first, then `folder`,
+    // then the folder where the build put the sample files, if any.
+    static std::shared_ptr<const SampleStore> find(const std::string &fileName,
+                                                   const std::string &folder);
+
+    // Wraps waveform data that is already in memory, such as the tables from
+    // mdaPianoData.h. The data is not copied, so it must stay alive.
+    static std::shared_ptr<const SampleStore> fromMemory(const short *samples, int numSamples,
+                                                         const Keygroup *keygroups, int numKeygroups);
+
+    // Writes a sample file. Returns false if the file could not be written.
+    static bool write(const std::string &path,
+                      const short *samples, int numSamples,
+                      const Keygroup *keygroups, int numKeygroups);
+
+    // The largest upsampling factor (1, 2, 4 or 8) that doesn't take waveforms
+    // recorded at `recordedRate` above `sampleRate`.
+    static int upsamplingFactor(double recordedRate, double sampleRate);
+
+    /*
+      Returns a store with the same waveforms as `source`, but with `factor`
+      times as many samples per second. The keygroups are adjusted to match:
+      pos and end point into the new table and loop is `factor` times longer.
+      The waveform for every keygroup is followed by one extra sample that
+      continues the loop, for the linear interpolation, which reads one sample
+      past the read position.
+
+      Upsampling takes a while, so don't call this from the audio thread. The
+      result is cached in the same way as open(): instances of the plug-in
+      that ask for the same waveforms at the same factor share one copy.
+      With a factor of 1, this returns `source` itself.
+     */
+    static std::shared_ptr<const SampleStore> upsampled(const std::shared_ptr<const SampleStore> &source,
+                                                        int factor);
+
+    const short *samples() const noexcept { return _samples; }
+    int numSamples() const noexcept { return _numSamples; }
+
+    const Keygroup *keygroups() const noexcept { return _keygroups; }
+    int numKeygroups() const noexcept { return _numKeygroups; }
+
+private:
+    SampleStore() = default;
+    SampleStore(const SampleStore &) = delete;
+    SampleStore &operator=(const SampleStore &) = delete;
+
+    const short *_samples = nullptr;
+    int _numSamples = 0;
+    const Keygroup *_keygroups = nullptr;
+    int _numKeygroups = 0;
+
+    // For upsampled stores: the data, and the original store. Holding on to
+    // the original keeps its samples at the same address, which is what the
+    // cache of upsampled stores uses to recognize them.
+    std::vector<short> _ownedSamples;
+    std::vector<Keygroup> _ownedKeygroups;
+    std::shared_ptr<const SampleStore> _source;
+
+    // The memory mapping, if this store was opened from a file.
+    const void *_mapping = nullptr;
+    size_t _mappingSize = 0;
+#ifdef _WIN32
+    void *_fileHandle = nullptr;
+    void *_mappingHandle = nullptr;
+#endif
+};
+
+/*
+  Makes a waveform loop more seamlessly by cross-fading the last 50 samples
+  before the end of the loop with the samples before the start of the loop.
+  This is what EPiano does to its waveforms.
+ */
+void crossfadeLoop(short *samples, const Keygroup &keygroup);
+
+}  // namespace mda
@@ -0,0 +1,11 @@
+// Most of the shared DSP code lives in headers so that it can be inlined into
+// the plug-ins' render loops. Lookup tables and other things that should only
+// exist once go into .cpp files in this folder.
+//
+// This file makes sure mda_dsp is always a valid static library, even when all
+// the shared code happens to be header-only.
+
+namespace mda
+{
+    int sharedLibraryVersion() { return 1; }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+namespace mda
+{
+
+/*
+  Detection modes for the dynamics plug-ins, Limiter and Dynamics.
+
+  A compressor or limiter has two parts: the detector (or sidechain) that
+  measures how loud the audio is and turns that into a gain signal, and the
+  part that multiplies the audio by that gain. With more than one channel,
+  there is a choice to make about what the detector looks at:
+
+  - Linked: one detector looks at all channels together and the same gain is
+    applied to every channel. This is what the original plug-ins do. It keeps
+    the stereo image steady: a loud sound on the left also turns down the
+    right channel, so the sound doesn't shift towards the right.
+
+  - Unlinked: every channel has its own detector and its own gain. A loud
+    sound on one channel doesn't affect the others, but the balance between
+    the channels moves around.
+
+  - Mid/Side: the first two channels (left and right) are converted into mid
+    (L + R) and side (L - R), these get their own detector and gain, and are
+    then converted back. This can squash the center of the mix without
+    touching the stereo width, or the other way around. Any other channels,
+    such as center and surrounds, are unlinked.
+
+  The numbers are the same as the choices of the Detection parameter.
+ */
+const int DETECTION_LINKED = 0;
+const int DETECTION_UNLINKED = 1;
+const int DETECTION_MID_SIDE = 2;
+
+// Number of separate gain signals the plug-in needs to compute.
+inline int numSidechains(int detection, int numChannels) noexcept
+{
+    return (detection == DETECTION_LINKED) ? 1 : numChannels;
+}
+
+/*
+  Mid/side conversion, in place. Mid is the average of left and right, side is
+  half their difference. The decoder turns them back into left and right.
+ */
+inline void encodeMidSide(float *left, float *right, int numSamples) noexcept
+{
+    for (int i = 0; i < numSamples; ++i) {
+        const float l = left[i];
+        const float r = right[i];
+        left[i] = 0.5f * (l + r);
+        right[i] = 0.5f * (l - r);
+    }
+}
+
+inline void decodeMidSide(float *mid, float *side, int numSamples) noexcept
+{
+    for (int i = 0; i < numSamples; ++i) {
+        const float m = mid[i];
+        const float s = side[i];
+        mid[i] = m + s;
+        side[i] = m - s;
+    }
+}
+
+/*
+  Multiplies a channel by a gain signal. The detectors compute the gains for a
+  chunk of samples first, so this loop has no dependencies between samples and
+  the compiler turns it into SIMD instructions.
+ */
+inline void applyGain(float *data, const float *gains, int numSamples) noexcept
+{
+    for (int i = 0; i < numSamples; ++i) {
+        data[i] *= gains[i];
+    }
+}
+
+// Same, but with a separate (smoothed) output level. The multiplications are
+// done in the same order as in the original plug-ins: input * trim * gain.
+inline void applyGain(float *data, const float *trims, const float *gains, int numSamples) noexcept
+{
+    for (int i = 0; i < numSamples; ++i) {
+        data[i] = data[i] * trims[i] * gains[i];
+    }
+}
+
+}  // namespace mda
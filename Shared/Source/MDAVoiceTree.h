@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace mda
+{
+
+/*
+  Finds the quietest voice, for voice stealing.
+
+  When all voices are in use and a new note comes in, the synth takes over the
+  voice that is the quietest. The simple way to find that voice is to look at
+  all of them, which is fine for 16 voices but adds up with 128 voices and a
+  big chord, where every note of the chord needs to steal a voice.
+
+  This is a tournament tree. The voices are the leaves. Every node above them
+  holds the quieter of its two children, so the root is the quietest voice of
+  all. Asking for the quietest voice is O(1). When a voice's level changes,
+  only the nodes on the path from that leaf to the root need to be redone,
+  which is O(log n).
+
+  The levels of all playing voices change on every sample, of course. The
+  synth sets all the levels and calls rebuild() once per rendered chunk, which
+  is O(n) but that's a lot less often than once per note. In between, every
+  note that steals or starts a voice calls update() for that voice.
+
+  If two voices are equally quiet, the one with the lowest index wins, just
+  like the linear search it replaces.
+ */
+class QuietestVoiceTree
+{
+public:
+    explicit QuietestVoiceTree(int capacity)
+    {
+        _size = 1;
+        while (_size < capacity) { _size *= 2; }
+        _levels.assign(std::size_t(_size), unavailable());
+        _nodes.assign(std::size_t(2 * _size), 0);
+        rebuild(0);
+    }
+
+    // Sets the level of a voice. Call rebuild() when done setting levels.
+    void setLevel(int voice, float level) noexcept
+    {
+        _levels[std::size_t(voice)] = level;
+    }
+
+    // Recalculates the whole tree. Only voices 0 to numVoices - 1 can be
+    // stolen; the rest are marked as unavailable.
+    void rebuild(int numVoices) noexcept
+    {
+        for (int v = numVoices; v < _size; ++v) {
+            _levels[std::size_t(v)] = unavailable();
+        }
+        for (int v = 0; v < _size; ++v) {
+            _nodes[std::size_t(_size + v)] = v;
+        }
+        for (int n = _size - 1; n > 0; --n) {
+            _nodes[std::size_t(n)] = quieter(_nodes[std::size_t(2 * n)], _nodes[std::size_t(2 * n + 1)]);
+        }
+    }
+
+    // Changes the level of a single voice and fixes up the tree.
+    void update(int voice, float level) noexcept
+    {
+        _levels[std::size_t(voice)] = level;
+        for (int n = (_size + voice) / 2; n > 0; n /= 2) {
+            _nodes[std::size_t(n)] = quieter(_nodes[std::size_t(2 * n)], _nodes[std::size_t(2 * n + 1)]);
+        }
+    }
+
+    // Index of the quietest voice. Only meaningful if there is at least one
+    // available voice.
+    int quietest() const noexcept { return _nodes[1]; }
+
+    // Level of the quietest voice, or unavailable() if there is none.
+    float quietestLevel() const noexcept { return _levels[std::size_t(_nodes[1])]; }
+
+    // The level for a voice that must not be stolen.
+    static float unavailable() noexcept { return std::numeric_limits<float>::max(); }
+
+private:
+    int quieter(int a, int b) const noexcept
+    {
+        return (_levels[std::size_t(b)] < _levels[std::size_t(a)]) ? b : a;
+    }
+
+    int _size;                  // number of leaves, a power of two
+    std::vector<float> _levels; // level of every voice
+    std::vector<int> _nodes;    // index of the quietest voice below each node
+};
+
+}  // namespace mda
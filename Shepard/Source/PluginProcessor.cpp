@@ -1,4 +1,5 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDAShepardAudioProcessor::MDAShepardAudioProcessor()
 : AudioProcessor(BusesProperties()
@@ -29,6 +30,8 @@ MDAShepardAudioProcessor::MDAShepardAudioProcessor()
     // Make last value the same as the first, for easier interpolation.
     _buf1[max] = 0.0f;
     _buf2[max] = 0.0f;
+
+    mda::watchAllParameters(_parameters, apvts);
 }
 
 MDAShepardAudioProcessor::~MDAShepardAudioProcessor()
@@ -65,6 +68,7 @@ void MDAShepardAudioProcessor::changeProgramName(int index, const juce::String &
 
 void MDAShepardAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    _level.prepare(sampleRate);
     resetState();
 }
 
@@ -86,6 +90,11 @@ void MDAShepardAudioProcessor::resetState()
 {
     _pos = 0.0f;
     _rate = 1.0f;
+
+    _level.reset();
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
 }
 
 void MDAShepardAudioProcessor::update()
@@ -101,7 +110,7 @@ void MDAShepardAudioProcessor::update()
 
     // Convert the output level from decibels to a linear gain.
     float fParam2 = int(apvts.getRawParameterValue("Output")->load());
-    _level = 0.4842f * juce::Decibels::decibelsToGain(fParam2);
+    _level.setTarget(0.4842f * juce::Decibels::decibelsToGain(fParam2));
 }
 
 void MDAShepardAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
@@ -115,7 +124,9 @@ void MDAShepardAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (_parameters.changed()) {
+        update();
+    }
 
     const float *in1 = buffer.getReadPointer(0);
     const float *in2 = buffer.getReadPointer(1);
@@ -127,7 +138,6 @@ void MDAShepardAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
     const float max = float(bufferSize - 1);
     const int mode = _mode;
     const float delta = _delta;
-    const float level = _level;
 
     float rate = _rate;
     float pos = _pos;
@@ -174,7 +184,7 @@ void MDAShepardAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, ju
 
         // Dividing by the rate means we fade out the sound as the pitch goes
         // up, or fade it in when the pitch goes down.
-        b *= level / rate;
+        b *= _level.next() / rate;
 
         // Do we need to combine the tone with incoming audio?
         if (mode > 0) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAParameters.h"
 
 class MDAShepardAudioProcessor : public juce::AudioProcessor
 {
@@ -46,8 +47,8 @@ private:
     // The currently selected mode.
     int _mode;
 
-    // Output gain level.
-    float _level;
+    // Output gain level. This is smoothed to avoid zipper noise.
+    mda::SmoothedValue _level;
 
     // The speed of rising or falling.
     float _delta;
@@ -63,5 +64,8 @@ private:
     // Increment of read position. This is what determines the current pitch.
     float _rate;
 
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDAShepardAudioProcessor)
 };
@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDASplitterAudioProcessor::MDASplitterAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(parameters, apvts);
 }
 
 MDASplitterAudioProcessor::~MDASplitterAudioProcessor()
@@ -41,6 +43,14 @@ void MDASplitterAudioProcessor::changeProgramName(int index, const juce::String
 
 void MDASplitterAudioProcessor::prepareToPlay(double newSampleRate, int samplesPerBlock)
 {
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+    pairs.resize(channelPairs.size());
+
     resetState();
 }
 
@@ -55,12 +65,20 @@ void MDASplitterAudioProcessor::reset()
 
 bool MDASplitterAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDASplitterAudioProcessor::resetState()
 {
-    env = a0 = a1 = b0 = b1 = 0.0f;
+    for (auto &state : pairs) {
+        state.env = state.a0 = state.a1 = state.b0 = state.b1 = 0.0f;
+    }
+
+    // Recalculate the parameters at the start of the next block.
+    parameters.invalidate();
 }
 
 void MDASplitterAudioProcessor::update()
@@ -136,14 +154,27 @@ void MDASplitterAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (parameters.changed()) {
+        update();
+    }
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    mda::processChannelPairs(channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this](int pair, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            processPair(pairs[size_t(pair)], in1, in2, out1, out2, numSamples);
+        });
+}
+
+void MDASplitterAudioProcessor::processPair(MDASplitterState &state, const float *in1, const float *in2,
+                                            float *out1, float *out2, int numSamples)
+{
+    float &a0 = state.a0;
+    float &a1 = state.a1;
+    float &b0 = state.b0;
+    float &b1 = state.b1;
+    float &env = state.env;
 
-    for (int i = 0; i < buffer.getNumSamples(); ++i) {
+    for (int i = 0; i < numSamples; ++i) {
         float a = in1[i];
         float b = in2[i];
 
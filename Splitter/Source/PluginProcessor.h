@@ -1,6 +1,15 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAParameters.h"
+
+// The state of the effect for one pair of channels.
+struct MDASplitterState
+{
+    float a0, a1, b0, b1;  // filter states (a = left, b = right channel)
+    float env;             // current envelope level
+};
 
 class MDASplitterAudioProcessor : public juce::AudioProcessor
 {
@@ -42,16 +51,24 @@ private:
 
     void update();
     void resetState();
+    void processPair(MDASplitterState &state, const float *in1, const float *in2,
+                     float *out1, float *out2, int numSamples);
 
     float freq;                // filter coefficient
-    float a0, a1, b0, b1;      // filter states (a = left, b = right channel)
 
     float level;               // gate threshold
-    float env;                 // current envelope level
     float att, rel;            // attack and release constants
 
     float ff, ll, pp;          // routing: freq, level, polarity
     float i2l, i2r, o2l, o2r;  // routing: gain for left/right dry&wet
 
+    // How the channels are split into stereo pairs, and the state of the
+    // effect for each pair.
+    std::vector<mda::ChannelPair> channelPairs;
+    std::vector<MDASplitterState> pairs;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher parameters;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDASplitterAudioProcessor)
 };
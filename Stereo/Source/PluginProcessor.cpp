@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDAStereoAudioProcessor::MDAStereoAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(_parameters, apvts);
 }
 
 MDAStereoAudioProcessor::~MDAStereoAudioProcessor()
@@ -77,6 +79,9 @@ void MDAStereoAudioProcessor::resetState()
 
     // Clear out the delay buffer.
     memset(_delayBuffer.data(), 0, _delayMax * sizeof(float));
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
 }
 
 void MDAStereoAudioProcessor::update()
@@ -204,7 +209,9 @@ void MDAStereoAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juc
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (_parameters.changed()) {
+        update();
+    }
 
     const float *in1 = buffer.getReadPointer(0);
     const float *in2 = buffer.getReadPointer(1);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAParameters.h"
 
 class MDAStereoAudioProcessor : public juce::AudioProcessor
 {
@@ -71,5 +72,8 @@ private:
     // Output level.
     float _gain;
 
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDAStereoAudioProcessor)
 };
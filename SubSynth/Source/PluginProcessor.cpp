@@ -1,10 +1,12 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 MDASubSynthAudioProcessor::MDASubSynthAudioProcessor()
 : AudioProcessor(BusesProperties()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
+    mda::watchAllParameters(_parameters, apvts);
 }
 
 MDASubSynthAudioProcessor::~MDASubSynthAudioProcessor()
@@ -41,9 +43,21 @@ void MDASubSynthAudioProcessor::changeProgramName(int index, const juce::String
 
 void MDASubSynthAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    _wet.prepare(sampleRate);
+    _dry.prepare(sampleRate);
+    _filti.prepare(sampleRate);
+
     // Store this in a variable so we can use it to format the parameters.
     _sampleRate = sampleRate;
 
+    // Process the channels in stereo pairs, see MDAChannelPairs.h.
+    const auto channelSet = getChannelLayoutOfBus(true, 0);
+    _channelPairs = mda::makeChannelPairs(channelSet.size(), {
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::centre),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE),
+        channelSet.getChannelIndexForType(juce::AudioChannelSet::LFE2) });
+    _pairs.resize(_channelPairs.size());
+
     resetState();
 }
 
@@ -58,21 +72,35 @@ void MDASubSynthAudioProcessor::reset()
 
 bool MDASubSynthAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
-    return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+    // Any number of channels works, from mono to surround, as long as the
+    // input and output are the same.
+    const auto &channelSet = layouts.getMainOutputChannelSet();
+    return !channelSet.isDisabled() && layouts.getMainInputChannelSet() == channelSet;
 }
 
 void MDASubSynthAudioProcessor::resetState()
 {
-    _oscPhase = 0.0f;
-    _env = 0.0f;
-    _filt1 = _filt2 = _filt3 = _filt4 = 0.0f;
+    for (auto &state : _pairs) {
+        state.oscPhase = 0.0f;
+        state.env = 0.0f;
+        state.filt1 = state.filt2 = state.filt3 = state.filt4 = 0.0f;
+    }
+
+    _wet.reset();
+    _dry.reset();
+    _filti.reset();
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
 }
 
 void MDASubSynthAudioProcessor::update()
 {
     // Reset these to their starting values.
-    _sign = 1.0f;
-    _phase = 1.0f;
+    for (auto &state : _pairs) {
+        state.sign = 1.0f;
+        state.phase = 1.0f;
+    }
 
     // What is the current mode? The first three modes -- Distort, Divide, and
     // Invert -- manipulate the input signal to enhance the bass frequencies.
@@ -86,15 +114,14 @@ void MDASubSynthAudioProcessor::update()
     // these are correct numbers.
     // In "Key Osc" mode, the cut-off is set to a fixed frequency.
     float fParam3 = apvts.getRawParameterValue("Tune")->load();
-    _filti = (_type == 3) ? 0.018f : std::pow(10.0f, -3.0f + (2.0f * fParam3));
-    _filto = 1.0f - _filti;
+    _filti.setTarget((_type == 3) ? 0.018f : std::pow(10.0f, -3.0f + (2.0f * fParam3)));
 
     // In "Key Osc" mode, the Tune parameter sets the oscillator frequency.
     _phaseInc = 0.456159f * std::pow(10.0f, -2.5f + (1.5f * fParam3));
 
     // The wet/dry levels are percentages (not decibel levels).
-    _wet = apvts.getRawParameterValue("Level")->load() * 0.01f;
-    _dry = apvts.getRawParameterValue("Dry Mix")->load() * 0.01f;
+    _wet.setTarget(apvts.getRawParameterValue("Level")->load() * 0.01f);
+    _dry.setTarget(apvts.getRawParameterValue("Dry Mix")->load() * 0.01f);
 
     // The threshold parameter is in decibels, so convert this to linear gain.
     float fParam5 = apvts.getRawParameterValue("Thresh")->load();
@@ -120,37 +147,56 @@ void MDASubSynthAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    update();
+    if (_parameters.changed()) {
+        update();
+    }
 
-    const float *in1 = buffer.getReadPointer(0);
-    const float *in2 = buffer.getReadPointer(1);
-    float *out1 = buffer.getWritePointer(0);
-    float *out2 = buffer.getWritePointer(1);
+    // All pairs start from the same wet & dry levels and filter, and ramp them
+    // the same way.
+    for (auto &state : _pairs) {
+        state.wet = _wet;
+        state.dry = _dry;
+        state.filti = _filti;
+    }
 
+    mda::processChannelPairs(_channelPairs, buffer.getArrayOfWritePointers(),
+                             buffer.getNumChannels(), buffer.getNumSamples(),
+        [this](int pair, const float *in1, const float *in2, float *out1, float *out2, int numSamples) {
+            processPair(_pairs[size_t(pair)], in1, in2, out1, out2, numSamples);
+        });
+
+    if (!_pairs.empty()) {
+        _wet = _pairs[0].wet;
+        _dry = _pairs[0].dry;
+        _filti = _pairs[0].filti;
+    }
+}
+
+void MDASubSynthAudioProcessor::processPair(MDASubSynthState &state, const float *in1, const float *in2,
+                                            float *out1, float *out2, int numSamples)
+{
     const int type = _type;
     const float phaseInc = _phaseInc;
     const float decay = _decay;
     const float threshold = _threshold;
-    const float wet = _wet;
-    const float dry = _dry;
-    const float fi = _filti;
-    const float fo = _filto;
-
-    float sign = _sign;
-    float phase = _phase;
-    float osc = _oscPhase;
-    float env = _env;
-    float f1 = _filt1;
-    float f2 = _filt2;
-    float f3 = _filt3;
-    float f4 = _filt4;
-
-    for (int i = 0; i < buffer.getNumSamples(); ++i) {
+
+    float sign = state.sign;
+    float phase = state.phase;
+    float osc = state.oscPhase;
+    float env = state.env;
+    float f1 = state.filt1;
+    float f2 = state.filt2;
+    float f3 = state.filt3;
+    float f4 = state.filt4;
+
+    for (int i = 0; i < numSamples; ++i) {
         float a = in1[i];
         float b = in2[i];
 
         // Combine the two channels into one (stereo to mono) and low-pass filter
         // it twice. Filtering twice gives us a roll-off of 12 dB/octave.
+        const float fi = state.filti.next();
+        const float fo = 1.0f - fi;
         f1 = (fo * f1) + (fi * (a + b));
         f2 = (fo * f2) + (fi * f1);
 
@@ -272,20 +318,22 @@ void MDASubSynthAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
         f4 = (fo * f4) + (fi * f3);
 
         // Mix the sub-bass signal with the original into the buffer.
+        const float wet = state.wet.next();
+        const float dry = state.dry.next();
         out1[i] = (a * dry) + (f4 * wet);
         out2[i] = (b * dry) + (f4 * wet);
     }
 
     // Fix numerical underflow.
-    if (std::abs(f1) < 1.0e-10f) _filt1 = 0.0f; else _filt1 = f1;
-    if (std::abs(f2) < 1.0e-10f) _filt2 = 0.0f; else _filt2 = f2;
-    if (std::abs(f3) < 1.0e-10f) _filt3 = 0.0f; else _filt3 = f3;
-    if (std::abs(f4) < 1.0e-10f) _filt4 = 0.0f; else _filt4 = f4;
-
-    _sign = sign;
-    _phase = phase;
-    _oscPhase = osc;
-    _env = env;
+    if (std::abs(f1) < 1.0e-10f) state.filt1 = 0.0f; else state.filt1 = f1;
+    if (std::abs(f2) < 1.0e-10f) state.filt2 = 0.0f; else state.filt2 = f2;
+    if (std::abs(f3) < 1.0e-10f) state.filt3 = 0.0f; else state.filt3 = f3;
+    if (std::abs(f4) < 1.0e-10f) state.filt4 = 0.0f; else state.filt4 = f4;
+
+    state.sign = sign;
+    state.phase = phase;
+    state.oscPhase = osc;
+    state.env = env;
 }
 
 juce::AudioProcessorEditor *MDASubSynthAudioProcessor::createEditor()
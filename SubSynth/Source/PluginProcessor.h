@@ -1,6 +1,27 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAChannelPairs.h"
+#include "MDAParameters.h"
+
+// The state of the effect for one pair of channels.
+struct MDASubSynthState
+{
+    // Used to find the octave below the input frequency.
+    float sign, phase;
+
+    // Oscillator phase, for "Key Osc" mode.
+    float oscPhase;
+
+    // Current envelope level for the oscillator.
+    float env;
+
+    // Filter delays. We use the same filter four times.
+    float filt1, filt2, filt3, filt4;
+
+    // This pair's copies of the smoothed wet & dry levels and filter.
+    mda::SmoothedValue wet, dry, filti;
+};
 
 class MDASubSynthAudioProcessor : public juce::AudioProcessor
 {
@@ -42,6 +63,8 @@ private:
 
     void update();
     void resetState();
+    void processPair(MDASubSynthState &state, const float *in1, const float *in2,
+                     float *out1, float *out2, int numSamples);
 
     // Used to calculate the release time in milliseconds in the UI.
     float _sampleRate;
@@ -49,32 +72,33 @@ private:
     // The kind of sub-bass sound to add.
     int _type;
 
-    // Amount of synthesized low-frequency signal to be added.
-    float _wet;
+    // Amount of synthesized low-frequency signal to be added. This and _dry
+    // are smoothed to avoid zipper noise.
+    mda::SmoothedValue _wet;
 
     // Reduces the level of the original signal.
-    float _dry;
+    mda::SmoothedValue _dry;
 
     // Threshold level. The lower this is, the more intense the effect.
     float _threshold;
 
-    // Used to find the octave below the input frequency.
-    float _sign, _phase;
-
-    // Oscillator phase and phase increment, for "Key Osc" mode.
-    float _oscPhase, _phaseInc;
-
-    // Current envelope level for the oscillator.
-    float _env;
+    // Oscillator phase increment, for "Key Osc" mode.
+    float _phaseInc;
 
     // Decay amount for "Key Osc" mode.
     float _decay;
 
-    // Low-pass filter coefficients.
-    float _filti, _filto;
+    // Low-pass filter coefficient. The other coefficient is 1 - _filti.
+    // This is smoothed so that turning the Tune knob doesn't click.
+    mda::SmoothedValue _filti;
 
-    // Filter delays. We use the same filter four times.
-    float _filt1, _filt2, _filt3, _filt4;
+    // How the channels are split into stereo pairs, and the state of the
+    // effect for each pair.
+    std::vector<mda::ChannelPair> _channelPairs;
+    std::vector<MDASubSynthState> _pairs;
+
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDASubSynthAudioProcessor)
 };
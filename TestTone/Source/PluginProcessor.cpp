@@ -1,4 +1,5 @@
 #include "PluginProcessor.h"
+#include "MDAJuceParameters.h"
 
 static constexpr float twopi = 6.2831853f;
 
@@ -7,16 +8,16 @@ MDATestToneAudioProcessor::MDATestToneAudioProcessor()
                  .withInput ("Input",  juce::AudioChannelSet::stereo(), true)
                  .withOutput("Output", juce::AudioChannelSet::stereo(), true))
 {
-    apvts.state.addListener(this);
     apvts.addParameterListener("Mode", this);
     apvts.addParameterListener("0dB =", this);
+
+    mda::watchAllParameters(_parameters, apvts);
 }
 
 MDATestToneAudioProcessor::~MDATestToneAudioProcessor()
 {
     apvts.removeParameterListener("Mode", this);
     apvts.removeParameterListener("0dB =", this);
-    apvts.state.removeListener(this);
 }
 
 const juce::String MDATestToneAudioProcessor::getName() const
@@ -50,7 +51,6 @@ void MDATestToneAudioProcessor::changeProgramName(int index, const juce::String
 void MDATestToneAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
     resetState();
-    _parametersChanged.store(true);
 }
 
 void MDATestToneAudioProcessor::releaseResources()
@@ -71,6 +71,9 @@ void MDATestToneAudioProcessor::resetState()
 {
     // Reset the filter delays and the oscillator phase.
     _z0 = _z1 = _z2 = _z3 = _z4 = _z5 = _phase = 0.0f;
+
+    // Recalculate the parameters at the start of the next block.
+    _parameters.invalidate();
 }
 
 void MDATestToneAudioProcessor::update()
@@ -258,9 +261,8 @@ void MDATestToneAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, j
     // Whenever a parameter changed, updateTx was incremented. At the start of
     // the audio processing code, it would call update() if updateRx != updateTx.
     // Inside update(), updateRx would be set equal to updateTx again. (The way
-    // we do it is a bit more thread-safe.)
-    bool expected = true;
-    if (_parametersChanged.compare_exchange_strong(expected, false)) {
+    // we do it is a bit more thread-safe, see mda::ParameterWatcher.)
+    if (_parameters.changed()) {
         update();
     }
 
@@ -425,7 +427,6 @@ void MDATestToneAudioProcessor::setStateInformation(const void *data, int sizeIn
     std::unique_ptr<juce::XmlElement> xml(getXmlFromBinary(data, sizeInBytes));
     if (xml.get() != nullptr && xml->hasTagName(apvts.state.getType())) {
         apvts.replaceState(juce::ValueTree::fromXml(*xml));
-        _parametersChanged.store(true);
     }
 }
 
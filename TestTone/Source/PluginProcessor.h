@@ -1,9 +1,9 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "MDAParameters.h"
 
 class MDATestToneAudioProcessor : public juce::AudioProcessor,
-                                  private juce::ValueTree::Listener,
                                   private juce::AudioProcessorValueTreeState::Listener
 {
 public:
@@ -42,13 +42,6 @@ public:
 private:
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
-    void valueTreePropertyChanged(juce::ValueTree &, const juce::Identifier &) override
-    {
-        _parametersChanged.store(true);
-    }
-
-    std::atomic<bool> _parametersChanged { false };
-
     void parameterChanged(const juce::String &identifier, float value) override
     {
         // The following code triggers the UI to redraw F1 and F2 when the mode
@@ -126,5 +119,8 @@ private:
     // Filter delay units for the pink noise filter.
     float _z0, _z1, _z2, _z3, _z4, _z5;
 
+    // Used to call update() only when a parameter has changed.
+    mda::ParameterWatcher _parameters;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MDATestToneAudioProcessor)
 };
@@ -0,0 +1,474 @@
+/*
+  Golden-output regression tests for the MDA plug-ins.
+
+  Renders every factory program of every plug-in against the fixtures from
+  Benchmark/Source/Fixtures.h, and either records the output as golden files
+  or compares the output against previously recorded golden files.
+
+  Usage: mda-golden record|check [options]
+
+    --plugins A,B,...     only these plug-ins (default: all)
+    --golden-dir DIR      where the golden files live (default: Golden)
+    --mode MODE           "exact" (default) or "tolerance"
+    --max-ulp N           tolerance mode: max distance in units in the last place
+    --max-error-db DB     tolerance mode: max absolute error in dBFS
+    --sample-rate R       record only (default: 44100)
+    --block-size N        record only (default: 256)
+    --seconds S           record only (default: 4, one loop of the MIDI fixture)
+    --variations N        record only: extra random parameter sets for plug-ins
+                          that have only one program (default: 4)
+
+  The render settings are stored in each golden file, so `check` always uses
+  the same sample rate, block size and duration as `record` did.
+
+  Exit code 0 means everything matched, 1 means there were differences, and 77
+  means that no golden files were found (CTest reports this as skipped).
+*/
+
+#include <JuceHeader.h>
+#include "Fixtures.h"
+#include "PluginRegistry.h"
+
+namespace
+{
+
+const int exitPassed = 0;
+const int exitFailed = 1;
+const int exitUsage = 2;
+const int exitSkipped = 77;
+
+struct Options
+{
+    juce::String command;
+    juce::StringArray plugins;
+    juce::File goldenDir;
+    bool exact = true;
+    juce::int64 maxUlp = 16;
+    double maxErrorDb = -120.0;
+    double sampleRate = 44100.0;
+    int blockSize = 256;
+    double seconds = 4.0;
+    int variations = 4;
+};
+
+// Describes one render: either a factory program or a random set of parameter
+// values. Random parameters are used for the effects, since most of them have
+// only a single program and would otherwise only be tested with the defaults.
+struct RenderSpec
+{
+    int program;      // index of the factory program
+    int variation;    // 0 = the program as-is, otherwise the random seed
+
+    juce::String fileName() const
+    {
+        if (variation == 0) {
+            return "program-" + juce::String(program).paddedLeft('0', 3) + ".golden";
+        } else {
+            return "variation-" + juce::String(variation).paddedLeft('0', 3) + ".golden";
+        }
+    }
+};
+
+// The golden files have a small header followed by the output of each channel
+// as 32-bit floats. The files are not portable between machines with different
+// endianness, but neither is bit-exact float output.
+struct GoldenHeader
+{
+    char magic[4];
+    juce::uint32 version;
+    juce::uint32 sampleRate;
+    juce::uint32 blockSize;
+    juce::uint32 numChannels;
+    juce::uint32 numFrames;
+};
+
+const char goldenMagic[4] = { 'M', 'D', 'A', 'G' };
+const juce::uint32 goldenVersion = 1;
+
+void printUsage()
+{
+    std::fprintf(stderr,
+        "usage: mda-golden record|check [--plugins A,B] [--golden-dir DIR]\n"
+        "                  [--mode exact|tolerance] [--max-ulp N] [--max-error-db DB]\n"
+        "                  [--sample-rate 44100] [--block-size 256] [--seconds 4]\n"
+        "                  [--variations 4]\n");
+}
+
+bool parseOptions(int argc, char *argv[], Options &options)
+{
+    if (argc < 2) {
+        return false;
+    }
+
+    options.command = argv[1];
+    if (options.command != "record" && options.command != "check") {
+        return false;
+    }
+
+    options.goldenDir = juce::File::getCurrentWorkingDirectory().getChildFile("Golden");
+
+    for (int i = 2; i < argc; ++i) {
+        juce::String arg(argv[i]);
+        if (i + 1 >= argc) {
+            return false;
+        }
+        juce::String value(argv[++i]);
+
+        if (arg == "--plugins") {
+            options.plugins.addTokens(value, ",", "");
+            options.plugins.trim();
+            options.plugins.removeEmptyStrings();
+        } else if (arg == "--golden-dir") {
+            options.goldenDir = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+        } else if (arg == "--mode") {
+            if (value == "exact") {
+                options.exact = true;
+            } else if (value == "tolerance") {
+                options.exact = false;
+            } else {
+                return false;
+            }
+        } else if (arg == "--max-ulp") {
+            options.maxUlp = value.getLargeIntValue();
+        } else if (arg == "--max-error-db") {
+            options.maxErrorDb = value.getDoubleValue();
+        } else if (arg == "--sample-rate") {
+            options.sampleRate = value.getDoubleValue();
+        } else if (arg == "--block-size") {
+            options.blockSize = value.getIntValue();
+        } else if (arg == "--seconds") {
+            options.seconds = value.getDoubleValue();
+        } else if (arg == "--variations") {
+            options.variations = value.getIntValue();
+        } else {
+            return false;
+        }
+    }
+
+    return options.sampleRate > 0.0 && options.blockSize > 0
+        && options.seconds > 0.0 && options.variations >= 0 && options.maxUlp >= 0;
+}
+
+// Gives every parameter a pseudo-random value. This uses its own generator
+// (rather than juce::Random) so the values can never change between versions.
+void randomizeParameters(juce::AudioProcessor &processor, int seed)
+{
+    juce::uint32 state = juce::uint32(seed) * 2654435761u + 1u;
+    for (auto *parameter : processor.getParameters()) {
+        state = state * 1664525u + 1013904223u;
+        parameter->setValueNotifyingHost(float(state >> 8) / float(1 << 24));
+    }
+}
+
+// Renders the plug-in with the given settings. The output buffer has one
+// channel for every output channel of the plug-in.
+juce::AudioBuffer<float> render(const PluginInfo &info,
+                                const RenderSpec &spec,
+                                double sampleRate,
+                                int blockSize,
+                                int numFrames)
+{
+    // Several of the plug-ins use std::rand() for noise. Reseed it so that the
+    // output doesn't depend on what was rendered before.
+    std::srand(1);
+
+    std::unique_ptr<juce::AudioProcessor> processor(info.create());
+
+    if (spec.variation == 0) {
+        processor->setCurrentProgram(spec.program);
+    } else {
+        randomizeParameters(*processor, spec.variation);
+    }
+
+    const int numInputs = processor->getTotalNumInputChannels();
+    const int numOutputs = processor->getTotalNumOutputChannels();
+    const int numChannels = std::max(numInputs, numOutputs);
+    const bool wantsMidi = processor->acceptsMidi();
+
+    // This renders offline, much faster than real time.
+    processor->setNonRealtime(true);
+    processor->setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processor->prepareToPlay(sampleRate, blockSize);
+
+    juce::AudioBuffer<float> buffer(numChannels, blockSize);
+    juce::AudioBuffer<float> output(numOutputs, numFrames);
+    juce::MidiBuffer midi;
+
+    for (int position = 0; position < numFrames; position += blockSize) {
+        const int numSamples = std::min(blockSize, numFrames - position);
+
+        Fixtures::renderAudio(buffer, numInputs, numSamples, position, sampleRate);
+        if (wantsMidi) {
+            Fixtures::renderMidi(midi, numSamples, position, sampleRate);
+        } else {
+            midi.clear();
+        }
+
+        juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), numChannels, numSamples);
+        processor->processBlock(block, midi);
+
+        for (int channel = 0; channel < numOutputs; ++channel) {
+            output.copyFrom(channel, position, block, channel, 0, numSamples);
+        }
+    }
+
+    processor->releaseResources();
+    return output;
+}
+
+std::vector<RenderSpec> makeRenderSpecs(const PluginInfo &info, int variations)
+{
+    std::unique_ptr<juce::AudioProcessor> processor(info.create());
+
+    std::vector<RenderSpec> specs;
+    for (int program = 0; program < processor->getNumPrograms(); ++program) {
+        specs.push_back({ program, 0 });
+    }
+    if (processor->getNumPrograms() <= 1) {
+        for (int variation = 1; variation <= variations; ++variation) {
+            specs.push_back({ 0, variation });
+        }
+    }
+    return specs;
+}
+
+bool writeGolden(const juce::File &file, const juce::AudioBuffer<float> &output,
+                 double sampleRate, int blockSize)
+{
+    GoldenHeader header;
+    std::memcpy(header.magic, goldenMagic, 4);
+    header.version = goldenVersion;
+    header.sampleRate = juce::uint32(sampleRate);
+    header.blockSize = juce::uint32(blockSize);
+    header.numChannels = juce::uint32(output.getNumChannels());
+    header.numFrames = juce::uint32(output.getNumSamples());
+
+    juce::MemoryBlock data;
+    data.append(&header, sizeof(header));
+    for (int channel = 0; channel < output.getNumChannels(); ++channel) {
+        data.append(output.getReadPointer(channel), sizeof(float) * size_t(output.getNumSamples()));
+    }
+
+    file.getParentDirectory().createDirectory();
+    return file.replaceWithData(data.getData(), data.getSize());
+}
+
+bool readGolden(const juce::File &file, GoldenHeader &header, juce::AudioBuffer<float> &output)
+{
+    juce::MemoryBlock data;
+    if (!file.loadFileAsData(data) || data.getSize() < sizeof(header)) {
+        return false;
+    }
+
+    std::memcpy(&header, data.getData(), sizeof(header));
+    if (std::memcmp(header.magic, goldenMagic, 4) != 0 || header.version != goldenVersion) {
+        return false;
+    }
+
+    const size_t channelBytes = sizeof(float) * size_t(header.numFrames);
+    if (data.getSize() != sizeof(header) + channelBytes * header.numChannels) {
+        return false;
+    }
+
+    output.setSize(int(header.numChannels), int(header.numFrames));
+    auto bytes = static_cast<const char *>(data.getData()) + sizeof(header);
+    for (int channel = 0; channel < int(header.numChannels); ++channel) {
+        std::memcpy(output.getWritePointer(channel), bytes + channelBytes * size_t(channel), channelBytes);
+    }
+    return true;
+}
+
+// Distance between two floats in units in the last place. Maps the float bit
+// patterns onto a line of integers so that neighbouring floats are 1 apart,
+// including across zero.
+juce::int64 ulpDistance(float a, float b)
+{
+    auto toOrdered = [](float x) {
+        juce::int32 bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        return bits < 0 ? juce::int64(std::numeric_limits<juce::int32>::min()) - bits : juce::int64(bits);
+    };
+    return std::abs(toOrdered(a) - toOrdered(b));
+}
+
+struct Comparison
+{
+    bool passed = true;
+    juce::int64 mismatches = 0;
+    juce::int64 maxUlp = 0;
+    double maxError = 0.0;
+    int firstChannel = -1;
+    int firstFrame = -1;
+};
+
+Comparison compare(const juce::AudioBuffer<float> &expected,
+                   const juce::AudioBuffer<float> &actual,
+                   const Options &options)
+{
+    Comparison result;
+    const double maxError = std::pow(10.0, options.maxErrorDb / 20.0);
+
+    if (expected.getNumChannels() != actual.getNumChannels()
+            || expected.getNumSamples() != actual.getNumSamples()) {
+        result.passed = false;
+        return result;
+    }
+
+    for (int channel = 0; channel < expected.getNumChannels(); ++channel) {
+        const float *e = expected.getReadPointer(channel);
+        const float *a = actual.getReadPointer(channel);
+
+        for (int i = 0; i < expected.getNumSamples(); ++i) {
+            // Compare the bit patterns, so that NaNs compare equal to the
+            // same NaN, and -0 is not the same as +0.
+            if (std::memcmp(&e[i], &a[i], sizeof(float)) == 0) {
+                continue;
+            }
+
+            juce::int64 ulp = ulpDistance(e[i], a[i]);
+            double error = std::abs(double(e[i]) - double(a[i]));
+            result.maxUlp = std::max(result.maxUlp, ulp);
+            if (!std::isnan(error)) {
+                result.maxError = std::max(result.maxError, error);
+            }
+
+            bool ok = !options.exact
+                   && !std::isnan(e[i]) && !std::isnan(a[i])
+                   && (ulp <= options.maxUlp || error <= maxError);
+
+            if (!ok) {
+                if (result.passed) {
+                    result.firstChannel = channel;
+                    result.firstFrame = i;
+                }
+                result.passed = false;
+                result.mismatches += 1;
+            }
+        }
+    }
+    return result;
+}
+
+juce::String toDecibels(double gain)
+{
+    return gain > 0.0 ? juce::String(20.0 * std::log10(gain), 1) + " dB" : juce::String("-inf dB");
+}
+
+int record(const PluginInfo &info, const Options &options)
+{
+    const int numFrames = int(options.seconds * options.sampleRate);
+    const auto dir = options.goldenDir.getChildFile(info.name);
+
+    for (auto &spec : makeRenderSpecs(info, options.variations)) {
+        auto output = render(info, spec, options.sampleRate, options.blockSize, numFrames);
+        auto file = dir.getChildFile(spec.fileName());
+        if (!writeGolden(file, output, options.sampleRate, options.blockSize)) {
+            std::fprintf(stderr, "could not write %s\n", file.getFullPathName().toRawUTF8());
+            return exitFailed;
+        }
+        std::printf("recorded %s/%s\n", info.name, spec.fileName().toRawUTF8());
+    }
+    return exitPassed;
+}
+
+int check(const PluginInfo &info, const Options &options)
+{
+    const auto dir = options.goldenDir.getChildFile(info.name);
+    if (!dir.isDirectory()) {
+        std::printf("SKIP %s: no golden files in %s\n", info.name, dir.getFullPathName().toRawUTF8());
+        return exitSkipped;
+    }
+
+    int result = exitPassed;
+
+    // The number of variations is taken from whatever was recorded.
+    for (auto &spec : makeRenderSpecs(info, 1000)) {
+        auto file = dir.getChildFile(spec.fileName());
+        if (!file.existsAsFile()) {
+            if (spec.variation == 0) {
+                std::printf("FAIL %s/%s: golden file is missing\n", info.name, spec.fileName().toRawUTF8());
+                result = exitFailed;
+            }
+            continue;
+        }
+
+        GoldenHeader header;
+        juce::AudioBuffer<float> expected;
+        if (!readGolden(file, header, expected)) {
+            std::printf("FAIL %s/%s: cannot read golden file\n", info.name, spec.fileName().toRawUTF8());
+            result = exitFailed;
+            continue;
+        }
+
+        auto actual = render(info, spec, double(header.sampleRate), int(header.blockSize), int(header.numFrames));
+        auto comparison = compare(expected, actual, options);
+
+        if (comparison.passed) {
+            std::printf("ok   %s/%s", info.name, spec.fileName().toRawUTF8());
+            if (comparison.maxUlp > 0) {
+                std::printf(" (max %lld ulp, max error %s)",
+                            (long long)comparison.maxUlp, toDecibels(comparison.maxError).toRawUTF8());
+            }
+            std::printf("\n");
+        } else if (comparison.firstFrame < 0) {
+            std::printf("FAIL %s/%s: output has %d channels x %d frames, expected %d x %d\n",
+                        info.name, spec.fileName().toRawUTF8(),
+                        actual.getNumChannels(), actual.getNumSamples(),
+                        expected.getNumChannels(), expected.getNumSamples());
+            result = exitFailed;
+        } else {
+            std::printf("FAIL %s/%s: %lld samples differ, first at channel %d frame %d "
+                        "(expected %.9g, got %.9g), max %lld ulp, max error %s\n",
+                        info.name, spec.fileName().toRawUTF8(),
+                        (long long)comparison.mismatches, comparison.firstChannel, comparison.firstFrame,
+                        double(expected.getSample(comparison.firstChannel, comparison.firstFrame)),
+                        double(actual.getSample(comparison.firstChannel, comparison.firstFrame)),
+                        (long long)comparison.maxUlp, toDecibels(comparison.maxError).toRawUTF8());
+            result = exitFailed;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return exitUsage;
+    }
+
+    std::vector<const PluginInfo *> selected;
+    if (options.plugins.isEmpty()) {
+        for (auto &info : getAllPlugins()) {
+            selected.push_back(&info);
+        }
+    } else {
+        for (auto &name : options.plugins) {
+            auto info = findPlugin(name);
+            if (info == nullptr) {
+                std::fprintf(stderr, "unknown plug-in: %s\n", name.toRawUTF8());
+                return exitUsage;
+            }
+            selected.push_back(info);
+        }
+    }
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    bool anyFailed = false;
+    bool anyChecked = false;
+
+    for (auto info : selected) {
+        int result = options.command == "record" ? record(*info, options) : check(*info, options);
+        anyFailed |= (result == exitFailed);
+        anyChecked |= (result != exitSkipped);
+    }
+
+    if (anyFailed) {
+        return exitFailed;
+    }
+    return anyChecked ? exitPassed : exitSkipped;
+}
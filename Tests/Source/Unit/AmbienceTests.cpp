@@ -0,0 +1,121 @@
+#include <JuceHeader.h>
+#include "TestUtilities.h"
+
+using namespace TestUtilities;
+
+class AmbienceTests : public juce::UnitTest
+{
+public:
+    AmbienceTests() : juce::UnitTest("Ambience") { }
+
+    // Writes a mono 32-bit float .wav file.
+    static bool writeWavFile(const juce::File &file, const std::vector<float> &samples, int sampleRate)
+    {
+        std::vector<unsigned char> data;
+        auto add16 = [&](unsigned x) { data.push_back((unsigned char)(x)); data.push_back((unsigned char)(x >> 8)); };
+        auto add32 = [&](unsigned x) { add16(x & 0xFFFF); add16(x >> 16); };
+        auto addTag = [&](const char *tag) { data.insert(data.end(), tag, tag + 4); };
+
+        const unsigned dataBytes = unsigned(samples.size() * sizeof(float));
+        addTag("RIFF"); add32(36 + dataBytes); addTag("WAVE");
+        addTag("fmt "); add32(16); add16(3); add16(1); add32(unsigned(sampleRate));
+        add32(unsigned(sampleRate) * 4); add16(4); add16(32);
+        addTag("data"); add32(dataBytes);
+        for (float x : samples) {
+            std::uint32_t u;
+            std::memcpy(&u, &x, sizeof(u));
+            add32(u);
+        }
+        return file.replaceWithData(data.data(), data.size());
+    }
+
+    // Points the plug-in at an impulse response file through its state, like
+    // a host that restores a session.
+    static void loadImpulseResponse(juce::AudioProcessor &processor, const juce::File &file)
+    {
+        juce::MemoryBlock state;
+        processor.getStateInformation(state);
+        auto xml = juce::AudioProcessor::getXmlFromBinary(state.getData(), int(state.getSize()));
+        xml->setAttribute("ImpulseResponse", file.getFullPathName());
+        juce::AudioProcessor::copyXmlToBinary(*xml, state);
+        processor.setStateInformation(state.getData(), int(state.getSize()));
+    }
+
+    static std::unique_ptr<juce::AudioProcessor> createWet(int mode)
+    {
+        auto processor = createPlugin("Ambience");
+        setParameter(*processor, "Mode", float(mode));
+        setParameter(*processor, "Mix", 100.0f);
+        setParameter(*processor, "HF Damp", 100.0f);
+        return processor;
+    }
+
+    void runTest() override
+    {
+        const int numFrames = 44100;
+        juce::AudioBuffer<float> impulse(2, numFrames);
+        impulse.clear();
+        impulse.setSample(0, 0, 1.0f);
+
+        // An impulse response that is a single echo after half a second. It
+        // is normalized to an energy of 1, which this already is.
+        const int delay = 22050;
+        std::vector<float> echo(size_t(delay + 1), 0.0f);
+        echo[size_t(delay)] = 1.0f;
+        const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                              .getChildFile("mda-ambience-test.wav");
+        expect(writeWavFile(file, echo, 44100));
+
+        beginTest("Convolution mode plays the impulse response");
+        {
+            auto processor = createWet(1);
+            loadImpulseResponse(*processor, file);
+            const auto output = render(*processor, impulse, juce::MidiBuffer(), numFrames);
+
+            // With Mix at 100% there is no dry signal. The input is the left
+            // channel times the wet level of 0.8, and one step of the HF
+            // damping filter with a coefficient of 0.95 makes that 0.76.
+            float before = 0.0f;
+            for (int i = 0; i < delay; ++i) {
+                before = std::max(before, std::abs(output.getSample(0, i)));
+            }
+            expectLessThan(before, 1e-6f);
+            expectWithinAbsoluteError(output.getSample(0, delay), 0.76f, 1e-5f);
+            expectWithinAbsoluteError(output.getSample(1, delay), 0.76f, 1e-5f);
+            expectEquals(peak(output), std::abs(output.getSample(0, delay)));
+
+            expectWithinAbsoluteError(processor->getTailLengthSeconds(), double(delay + 1) / 44100.0, 1e-9);
+        }
+
+        beginTest("Convolution mode without an impulse response uses the allpass filters");
+        {
+            auto allpass = createWet(0);
+            auto convolution = createWet(1);
+            expect(isIdentical(render(*allpass, impulse, juce::MidiBuffer(), numFrames),
+                               render(*convolution, impulse, juce::MidiBuffer(), numFrames)));
+        }
+
+        beginTest("Allpass mode reports the tail of the allpass filters");
+        {
+            auto processor = createWet(0);
+            loadImpulseResponse(*processor, file);
+            const auto output = render(*processor, impulse, juce::MidiBuffer(), 2 * numFrames);
+
+            // By the end of the reported tail, the reverb has died down by at
+            // least 60 dB.
+            const double tail = processor->getTailLengthSeconds();
+            expectGreaterThan(tail, 0.5);
+            expectLessThan(tail, 2.0);
+            const int end = int(tail * 44100.0);
+            float after = 0.0f;
+            for (int i = end; i < output.getNumSamples(); ++i) {
+                after = std::max({ after, std::abs(output.getSample(0, i)), std::abs(output.getSample(1, i)) });
+            }
+            expectLessThan(after, 0.001f * peak(output));
+        }
+
+        file.deleteFile();
+    }
+};
+
+static AmbienceTests ambienceTests;
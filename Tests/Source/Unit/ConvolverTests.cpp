@@ -0,0 +1,213 @@
+#include <JuceHeader.h>
+#include "MDAConvolver.h"
+
+class ConvolverTests : public juce::UnitTest
+{
+public:
+    ConvolverTests() : juce::UnitTest("Convolver") { }
+
+    // Decaying noise, like a reverb. 10000 samples is long enough to use the
+    // head and all three stages, two of which run on the background thread.
+    static mda::ImpulseResponse makeImpulseResponse(int numChannels, int length, juce::Random &random)
+    {
+        mda::ImpulseResponse ir;
+        ir.sampleRate = 44100.0;
+        ir.channels.resize(size_t(numChannels));
+        for (auto &channel : ir.channels) {
+            channel.resize(size_t(length));
+            for (int i = 0; i < length; ++i) {
+                const float decay = std::exp(-4.0f * float(i) / float(length));
+                channel[size_t(i)] = (2.0f * random.nextFloat() - 1.0f) * decay;
+            }
+        }
+        ir.normalize();
+        return ir;
+    }
+
+    static std::vector<float> makeNoise(int numSamples, juce::Random &random)
+    {
+        std::vector<float> noise(static_cast<size_t>(numSamples));
+        for (float &x : noise) {
+            x = 2.0f * random.nextFloat() - 1.0f;
+        }
+        return noise;
+    }
+
+    // The slow way, in the time domain.
+    static std::vector<float> directConvolution(const std::vector<float> &input, const std::vector<float> &ir)
+    {
+        std::vector<float> output(input.size());
+        for (size_t i = 0; i < input.size(); ++i) {
+            double sum = 0.0;
+            for (size_t j = 0; j < ir.size() && j <= i; ++j) {
+                sum += double(ir[j]) * double(input[i - j]);
+            }
+            output[i] = float(sum);
+        }
+        return output;
+    }
+
+    // Runs the input through the convolver in uneven chunks, so that the
+    // chunks don't line up with the blocks of any stage. This is done in
+    // offline mode, so the background thread can't miss any blocks.
+    static void process(mda::Convolver &convolver, const std::vector<float> &input,
+                        std::vector<float> &out1, std::vector<float> &out2)
+    {
+        convolver.setNonRealtime(true);
+        out1.resize(input.size());
+        out2.resize(input.size());
+        const int numSamples = int(input.size());
+        int done = 0;
+        int chunk = 1;
+        while (done < numSamples) {
+            const int n = std::min(chunk, numSamples - done);
+            convolver.process(input.data() + done, out1.data() + done, out2.data() + done, n);
+            done += n;
+            chunk = (chunk * 13) % 509 + 1;
+        }
+    }
+
+    static float maxError(const std::vector<float> &a, const std::vector<float> &b)
+    {
+        float error = 0.0f;
+        for (size_t i = 0; i < a.size(); ++i) {
+            error = std::max(error, std::abs(a[i] - b[i]));
+        }
+        return error;
+    }
+
+    void runTest() override
+    {
+        juce::Random random(1234);
+        const int length = 10000;
+        const int numSamples = 16384;
+
+        const auto stereo = makeImpulseResponse(2, length, random);
+        const auto input = makeNoise(numSamples, random);
+        const auto expected1 = directConvolution(input, stereo.channels[0]);
+        const auto expected2 = directConvolution(input, stereo.channels[1]);
+
+        // The output is around 0.6 RMS. The FFTs are done with floats, which
+        // are not as precise as the direct convolution with doubles.
+        const float tolerance = 1e-4f;
+
+        mda::ConvolverThread thread;
+
+        beginTest("Mono impulse response matches direct convolution");
+        {
+            mda::ImpulseResponse mono = stereo;
+            mono.channels.resize(1);
+            mda::Convolver convolver(thread);
+            convolver.prepare(mono);
+
+            std::vector<float> out1, out2;
+            process(convolver, input, out1, out2);
+            expectLessThan(maxError(out1, expected1), tolerance);
+            expect(out1 == out2, "both outputs should be the same");
+        }
+
+        beginTest("Stereo impulse response matches direct convolution");
+        {
+            mda::Convolver convolver(thread);
+            convolver.prepare(stereo);
+
+            std::vector<float> out1, out2;
+            process(convolver, input, out1, out2);
+            expectLessThan(maxError(out1, expected1), tolerance);
+            expectLessThan(maxError(out2, expected2), tolerance);
+        }
+
+        beginTest("Short impulse response, only the head");
+        {
+            mda::ImpulseResponse ir = makeImpulseResponse(1, 50, random);
+            mda::Convolver convolver(thread);
+            convolver.prepare(ir);
+
+            std::vector<float> out1, out2;
+            process(convolver, input, out1, out2);
+            expectLessThan(maxError(out1, directConvolution(input, ir.channels[0])), tolerance);
+        }
+
+        beginTest("Reset gives the same output as a new convolver");
+        {
+            // Reset in the middle of a block of every stage, while the
+            // background thread may still be busy with the old input.
+            mda::Convolver convolver(thread);
+            convolver.prepare(stereo);
+            std::vector<float> out1, out2;
+            process(convolver, makeNoise(9000 + 37, random), out1, out2);
+            convolver.reset();
+            process(convolver, input, out1, out2);
+
+            mda::Convolver fresh(thread);
+            fresh.prepare(stereo);
+            std::vector<float> expectedOut1, expectedOut2;
+            process(fresh, input, expectedOut1, expectedOut2);
+
+            expect(out1 == expectedOut1 && out2 == expectedOut2, "the old input is still audible");
+        }
+
+        beginTest("Convolvers can share a thread");
+        {
+            mda::Convolver first(thread), second(thread), third(thread);
+            mda::Convolver *convolvers[3] = { &first, &second, &third };
+            for (auto *convolver : convolvers) {
+                convolver->prepare(stereo);
+                convolver->setNonRealtime(true);
+            }
+
+            // Interleave the convolvers like the channel pairs of a plug-in.
+            std::vector<float> outputs[3][2];
+            for (auto &output : outputs) {
+                output[0].resize(size_t(numSamples));
+                output[1].resize(size_t(numSamples));
+            }
+            for (int start = 0; start < numSamples; start += 256) {
+                for (int c = 0; c < 3; ++c) {
+                    convolvers[c]->process(input.data() + start, outputs[c][0].data() + start,
+                                           outputs[c][1].data() + start, 256);
+                }
+            }
+            for (auto &output : outputs) {
+                expectLessThan(maxError(output[0], expected1), tolerance);
+                expectLessThan(maxError(output[1], expected2), tolerance);
+            }
+        }
+
+        beginTest("Real-time mode doesn't wait for the background thread");
+        {
+            // Handing the convolver all the input at once doesn't give the
+            // background thread any time, so it may miss blocks. The first
+            // 1024 samples come from the audio thread and are always right.
+            mda::Convolver convolver(thread);
+            convolver.prepare(stereo);
+            std::vector<float> out1(size_t(numSamples)), out2(size_t(numSamples));
+            convolver.process(input.data(), out1.data(), out2.data(), numSamples);
+
+            float headError = 0.0f;
+            for (size_t i = 0; i < 1024; ++i) {
+                headError = std::max(headError, std::abs(out1[i] - expected1[i]));
+            }
+            expectLessThan(headError, tolerance);
+
+            // Blocks that were missed are silent, the rest is correct, so
+            // nothing can be much louder than the expected output.
+            bool finite = true;
+            float outputPeak = 0.0f, expectedPeak = 0.0f;
+            for (size_t i = 0; i < out1.size(); ++i) {
+                finite = finite && std::isfinite(out1[i]) && std::isfinite(out2[i]);
+                outputPeak = std::max(outputPeak, std::abs(out1[i]));
+                expectedPeak = std::max(expectedPeak, std::abs(expected1[i]));
+            }
+            expect(finite);
+            expectLessThan(outputPeak, 2.0f * expectedPeak);
+
+            if (convolver.getNumMissedBlocks() == 0) {
+                expectLessThan(maxError(out1, expected1), tolerance);
+                expectLessThan(maxError(out2, expected2), tolerance);
+            }
+        }
+    }
+};
+
+static ConvolverTests convolverTests;
@@ -0,0 +1,85 @@
+#include <JuceHeader.h>
+#include "TestUtilities.h"
+
+using namespace TestUtilities;
+
+class DX10Tests : public juce::UnitTest
+{
+public:
+    DX10Tests() : juce::UnitTest("DX10") { }
+
+    // Plays a short phrase with the given algorithm. The extra operators are
+    // turned up, since they're silent by default.
+    static juce::AudioBuffer<float> renderAlgorithm(int algorithm, float extraLevel)
+    {
+        auto processor = createPlugin("DX10");
+        setParameter(*processor, "Algorithm", float(algorithm));
+        for (int op = 3; op <= 6; ++op) {
+            setParameter(*processor, "Op" + juce::String(op) + " Ratio", 0.1f * float(op));
+            setParameter(*processor, "Op" + juce::String(op) + " Level", extraLevel);
+            setParameter(*processor, "Op" + juce::String(op) + " Decay", 0.5f);
+        }
+
+        juce::MidiBuffer midi;
+        midi.addEvent(juce::MidiMessage::noteOn(1, 48, juce::uint8(100)), 0);
+        midi.addEvent(juce::MidiMessage::noteOn(1, 67, juce::uint8(80)), 5000);
+        midi.addEvent(juce::MidiMessage::noteOff(1, 48), 20000);
+        midi.addEvent(juce::MidiMessage::noteOff(1, 67), 20000);
+        return render(*processor, midi, 30000);
+    }
+
+    void runTest() override
+    {
+        const int numAlgorithms = 8;
+
+        beginTest("Every algorithm makes a different, well-behaved sound");
+        {
+            std::vector<juce::AudioBuffer<float>> outputs;
+            for (int algorithm = 0; algorithm < numAlgorithms; ++algorithm) {
+                outputs.push_back(renderAlgorithm(algorithm, 0.5f));
+                const auto &output = outputs.back();
+                const juce::String name = "algorithm " + juce::String(algorithm + 1);
+
+                expect(isFinite(output), name + " is not finite");
+                expectGreaterThan(rms(output), 0.01, name + " is too soft");
+                expectLessThan(peak(output), 4.0f, name + " is too loud");
+            }
+
+            for (int a = 0; a < numAlgorithms; ++a) {
+                for (int b = a + 1; b < numAlgorithms; ++b) {
+                    expect(!isIdentical(outputs[size_t(a)], outputs[size_t(b)]),
+                           "algorithms " + juce::String(a + 1) + " and " + juce::String(b + 1) + " are the same");
+                }
+            }
+        }
+
+        beginTest("Silent extra operators in parallel with operator 2 change nothing");
+        {
+            // In algorithms 2 and 6, operator 2 still modulates the carrier
+            // directly, and the others only add to that. With their levels at
+            // zero, these must sound exactly like the original algorithm.
+            const auto original = renderAlgorithm(0, 0.0f);
+            expect(isIdentical(renderAlgorithm(1, 0.0f), original), "algorithm 2");
+            expect(isIdentical(renderAlgorithm(5, 0.0f), original), "algorithm 6");
+        }
+
+        beginTest("A block with more events than the queue holds loses none");
+        {
+            // Fill most of one big block with controller messages, so that
+            // the note-on at the end only fits in the second batch of events.
+            auto processor = createPlugin("DX10");
+            const int numControllers = 3000;
+            juce::MidiBuffer midi;
+            for (int i = 0; i < numControllers; ++i) {
+                midi.addEvent(juce::MidiMessage::controllerEvent(1, 1, i & 0x7F), i);
+            }
+            midi.addEvent(juce::MidiMessage::noteOn(1, 60, juce::uint8(100)), numControllers);
+
+            const auto output = render(*processor, midi, 8192, 8192);
+            expectEquals(output.getMagnitude(0, numControllers), 0.0f);
+            expectGreaterThan(rms(output, numControllers), 0.01);
+        }
+    }
+};
+
+static DX10Tests dx10Tests;
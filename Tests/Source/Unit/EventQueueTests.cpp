@@ -0,0 +1,157 @@
+#include <JuceHeader.h>
+#include "MDAEventQueue.h"
+
+class EventQueueTests : public juce::UnitTest
+{
+public:
+    EventQueueTests() : juce::UnitTest("EventQueue") { }
+
+    void runTest() override
+    {
+        beginTest("Events come out sorted by time");
+        {
+            mda::EventQueue queue;
+            queue.reserve(16);
+            queue.add(10, 0x90, 60, 100);
+            queue.add(5, 0x90, 62, 100);
+            queue.add(20, 0x80, 60, 0);
+            queue.add(0, 0xB0, 1, 64);
+
+            const int expected[] = { 0, 5, 10, 20 };
+            for (int time : expected) {
+                expect(!queue.empty());
+                expectEquals(queue.next().time, time);
+            }
+            expect(queue.empty());
+        }
+
+        beginTest("Events with the same time keep their order");
+        {
+            // A note-off followed by a note-on for the same key must not be
+            // swapped, or the note would be cut off instead of restarted.
+            mda::EventQueue queue;
+            queue.reserve(16);
+            queue.add(8, 0x80, 60, 0);
+            queue.add(8, 0x90, 60, 100);
+            queue.add(3, 0xC0, 4, 0);
+            queue.add(8, 0xB0, 64, 127);
+
+            expectEquals(int(queue.next().status), 0xC0);
+            expectEquals(int(queue.next().status), 0x80);
+            expectEquals(int(queue.next().status), 0x90);
+            expectEquals(int(queue.next().status), 0xB0);
+        }
+
+        beginTest("Late events are not moved before events already handled");
+        {
+            mda::EventQueue queue;
+            queue.reserve(16);
+            queue.add(4, 0x90, 60, 100);
+            queue.add(9, 0x90, 61, 100);
+            expectEquals(queue.next().time, 4);
+
+            queue.add(2, 0x90, 62, 100);
+            expectEquals(int(queue.next().data1), 62);
+            expectEquals(int(queue.next().data1), 61);
+        }
+
+        beginTest("Negative timestamps become 0");
+        {
+            mda::EventQueue queue;
+            queue.reserve(16);
+            queue.add(-5, 0x90, 60, 100);
+            expectEquals(queue.nextEventTime(100), 0);
+            expect(queue.hasEventAt(0));
+        }
+
+        beginTest("nextEventTime and hasEventAt");
+        {
+            mda::EventQueue queue;
+            queue.reserve(16);
+            expectEquals(queue.nextEventTime(64), 64);
+            expect(!queue.hasEventAt(64));
+
+            queue.add(30, 0x90, 60, 100);
+            queue.add(100, 0x80, 60, 0);
+            expectEquals(queue.nextEventTime(64), 30);
+            expect(!queue.hasEventAt(29));
+            expect(queue.hasEventAt(30));
+
+            queue.next();
+            expectEquals(queue.nextEventTime(64), 64);
+            expect(!queue.hasEventAt(64));
+            expect(queue.hasEventAt(100));
+        }
+
+        beginTest("add() doesn't grow the queue past its capacity");
+        {
+            mda::EventQueue queue;
+            queue.reserve(4);
+            for (int i = 0; i < 4; ++i) {
+                expect(queue.add(i, 0x90, 60, 100));
+            }
+            expect(!queue.add(4, 0x90, 61, 100));
+
+            int handled = 0;
+            while (!queue.empty()) {
+                expectEquals(queue.next().time, handled++);
+            }
+            expectEquals(handled, 4);
+        }
+
+        beginTest("No events are lost when a block has more than DEFAULT_CAPACITY");
+        {
+            // This does what the synths do: fill the queue, handle the events
+            // up to the first one that didn't fit, then refill from there.
+            const int count = mda::EventQueue::DEFAULT_CAPACITY * 2 + 100;
+            std::vector<mda::MidiEvent> source;
+            for (int i = 0; i < count; ++i) {
+                source.push_back({ i / 3, 0x90, (unsigned char)(i & 0x7F), 100 });
+            }
+
+            mda::EventQueue queue;
+            queue.reserve(mda::EventQueue::DEFAULT_CAPACITY);
+            size_t pos = 0;
+
+            auto fill = [&]() {
+                queue.clear();
+                while (pos < source.size()) {
+                    const auto &event = source[pos];
+                    if (!queue.add(event.time, event.status, event.data1, event.data2)) { break; }
+                    pos++;
+                }
+            };
+
+            fill();
+            expectEquals(int(pos), mda::EventQueue::DEFAULT_CAPACITY);
+
+            int handled = 0;
+            while (!queue.empty()) {
+                const auto &event = queue.next();
+                expectEquals(event.time, source[size_t(handled)].time);
+                expectEquals(int(event.data1), int(source[size_t(handled)].data1));
+                handled++;
+                if (queue.empty()) {
+                    fill();
+                }
+            }
+            expectEquals(handled, count);
+        }
+
+        beginTest("clear() empties the queue");
+        {
+            mda::EventQueue queue;
+            queue.reserve(16);
+            queue.add(1, 0x90, 60, 100);
+            queue.add(2, 0x90, 61, 100);
+            queue.next();
+            queue.clear();
+            expect(queue.empty());
+
+            queue.add(7, 0x90, 62, 100);
+            expectEquals(queue.next().time, 7);
+        }
+    }
+};
+
+static EventQueueTests eventQueueTests;
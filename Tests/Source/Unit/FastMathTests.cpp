@@ -0,0 +1,57 @@
+#include <JuceHeader.h>
+#include "MDAFastMath.h"
+
+class FastMathTests : public juce::UnitTest
+{
+public:
+    FastMathTests() : juce::UnitTest("FastMath") { }
+
+    void runTest() override
+    {
+        // MDAFastMath.h promises a maximum relative error of 2.4e-7. Allow a
+        // little more, since libm's own exp() is not exact either.
+        const double maxRelativeError = 3e-7;
+
+        beginTest("fastExp2 error bound");
+        {
+            double worst = 0.0;
+            for (int i = 0; i <= 2000000; ++i) {
+                const float x = -126.0f + 253.0f * float(i) / 2000000.0f;
+                const double expected = std::exp2(double(x));
+                const double error = std::abs(double(mda::fastExp2(x)) - expected) / expected;
+                worst = std::max(worst, error);
+            }
+            logMessage("fastExp2 max relative error: " + juce::String(worst * 1e7, 2) + "e-7");
+            expectLessThan(worst, maxRelativeError);
+        }
+
+        beginTest("fastExp error bound");
+        {
+            double worst = 0.0;
+            for (int i = 0; i <= 2000000; ++i) {
+                const float x = -87.0f + 174.5f * float(i) / 2000000.0f;
+                const double expected = std::exp(double(x));
+                const double error = std::abs(double(mda::fastExp(x)) - expected) / expected;
+                worst = std::max(worst, error);
+            }
+            logMessage("fastExp max relative error: " + juce::String(worst * 1e7, 2) + "e-7");
+            expectLessThan(worst, maxRelativeError);
+        }
+
+        beginTest("Inputs outside the range are clamped");
+        {
+            // The documented behavior: no denormals, zeros or infinities.
+            // The polynomial is not exactly 1 at 0, so 2^n is only within
+            // the error bound, like any other result.
+            const double smallest = std::ldexp(1.0, -126);
+            const double largest = std::ldexp(1.0, 127);
+            expectLessThan(std::abs(mda::fastExp2(-1000.0f) / smallest - 1.0), maxRelativeError);
+            expectLessThan(std::abs(mda::fastExp2(1000.0f) / largest - 1.0), maxRelativeError);
+            expect(std::isnormal(mda::fastExp2(-1000.0f)));
+            expect(std::isnormal(mda::fastExp(-1000.0f)));
+            expect(std::isfinite(mda::fastExp(1000.0f)));
+        }
+    }
+};
+
+static FastMathTests fastMathTests;
@@ -0,0 +1,80 @@
+#include <JuceHeader.h>
+#include "TestUtilities.h"
+
+using namespace TestUtilities;
+
+class JX10Tests : public juce::UnitTest
+{
+public:
+    JX10Tests() : juce::UnitTest("JX10") { }
+
+    static std::unique_ptr<juce::AudioProcessor> createMultiTimbral()
+    {
+        auto processor = createPlugin("JX10");
+        setParameter(*processor, "MIDI Mode", 1.0f);
+        return processor;
+    }
+
+    // Plays a note on the given MIDI channels, optionally after a program
+    // change on channel 2.
+    static juce::MidiBuffer makeMidi(std::initializer_list<int> channels, int programOnChannel2)
+    {
+        juce::MidiBuffer midi;
+        if (programOnChannel2 >= 0) {
+            midi.addEvent(juce::MidiMessage::programChange(2, programOnChannel2), 0);
+        }
+        for (int channel : channels) {
+            midi.addEvent(juce::MidiMessage::noteOn(channel, 48 + 7 * channel, juce::uint8(100)), 100);
+            midi.addEvent(juce::MidiMessage::noteOff(channel, 48 + 7 * channel), 15000);
+        }
+        return midi;
+    }
+
+    void runTest() override
+    {
+        const int numFrames = 22050;
+
+        // "Analog Bass", which sounds nothing like the first preset.
+        const int program = 17;
+
+        beginTest("Multi mode: a program change on channel 2 changes part 2");
+        {
+            auto before = createMultiTimbral();
+            auto after = createMultiTimbral();
+            const auto outputBefore = render(*before, makeMidi({ 2 }, -1), numFrames);
+            const auto outputAfter = render(*after, makeMidi({ 2 }, program), numFrames);
+
+            expect(isFinite(outputAfter));
+            expectGreaterThan(rms(outputAfter), 0.001);
+            expect(!isIdentical(outputBefore, outputAfter), "part 2 did not change");
+        }
+
+        beginTest("Multi mode: a program change on channel 2 leaves part 1 alone");
+        {
+            auto before = createMultiTimbral();
+            auto after = createMultiTimbral();
+            const auto outputBefore = render(*before, makeMidi({ 1 }, -1), numFrames);
+            const auto outputAfter = render(*after, makeMidi({ 1 }, program), numFrames);
+
+            expect(isIdentical(outputBefore, outputAfter), "part 1 changed");
+            expectEquals(after->getCurrentProgram(), before->getCurrentProgram());
+        }
+
+        beginTest("Multi mode: the part programs are saved with the state");
+        {
+            auto original = createMultiTimbral();
+            const auto expected = render(*original, makeMidi({ 2 }, program), numFrames);
+
+            juce::MemoryBlock state;
+            original->getStateInformation(state);
+
+            auto restored = createPlugin("JX10");
+            restored->setStateInformation(state.getData(), int(state.getSize()));
+            const auto output = render(*restored, makeMidi({ 2 }, -1), numFrames);
+
+            expect(isIdentical(output, expected), "part 2 did not get its program back");
+        }
+    }
+};
+
+static JX10Tests jx10Tests;
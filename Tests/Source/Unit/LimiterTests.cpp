@@ -0,0 +1,104 @@
+#include <JuceHeader.h>
+#include "TestUtilities.h"
+#include "MDAPeakDetection.h"
+
+using namespace TestUtilities;
+
+class LimiterTests : public juce::UnitTest
+{
+public:
+    LimiterTests() : juce::UnitTest("Limiter") { }
+
+    // A loud sine wave at a quarter of the sample rate, with the samples at 45
+    // degrees. Every sample is at -3 dB of the true peak, so a limiter that only
+    // looks at the samples lets the peaks in between through.
+    static juce::AudioBuffer<float> makeInput(int numFrames)
+    {
+        juce::AudioBuffer<float> input(2, numFrames);
+        for (int i = 0; i < numFrames; ++i) {
+            const double phase = juce::MathConstants<double>::halfPi * double(i) + juce::MathConstants<double>::pi / 4.0;
+            const float x = float(std::sin(phase));
+            input.setSample(0, i, x);
+            input.setSample(1, i, x);
+        }
+        return input;
+    }
+
+    static juce::AudioBuffer<float> renderLimiter(float lookaheadMs, bool truePeak, int numFrames)
+    {
+        auto processor = createPlugin("Limiter");
+        setParameter(*processor, "Thresh", -12.0f);
+        setParameter(*processor, "Output", 0.0f);
+        setParameter(*processor, "Attack", 0.0f);
+        setParameter(*processor, "Lookahead", lookaheadMs);
+        setParameter(*processor, "True Peak", truePeak ? 1.0f : 0.0f);
+        return render(*processor, makeInput(numFrames), juce::MidiBuffer(), numFrames);
+    }
+
+    // The sample peak and the true peak of the second half of the output,
+    // after the gain has settled.
+    static void measure(const juce::AudioBuffer<float> &output, float &samplePeak, float &truePeak)
+    {
+        mda::TruePeakDetector detector;
+        samplePeak = 0.0f;
+        truePeak = 0.0f;
+        const int start = output.getNumSamples() / 2;
+        for (int i = 0; i < output.getNumSamples(); ++i) {
+            const float x = output.getSample(0, i);
+            const float y = detector.process(x);
+            if (i >= start) {
+                samplePeak = std::max(samplePeak, std::abs(x));
+                truePeak = std::max(truePeak, y);
+            }
+        }
+    }
+
+    void runTest() override
+    {
+        const int numFrames = 44100;
+
+        beginTest("True peak mode limits the peaks in between samples");
+        {
+            float samplePeakOff, truePeakOff, samplePeakOn, truePeakOn;
+            measure(renderLimiter(5.0f, false, numFrames), samplePeakOff, truePeakOff);
+            measure(renderLimiter(5.0f, true, numFrames), samplePeakOn, truePeakOn);
+
+            // Without true peak mode, the samples stay under the ceiling but
+            // the waveform in between them goes 3 dB over.
+            const float ceiling = samplePeakOff;
+            expectGreaterThan(juce::Decibels::gainToDecibels(truePeakOff / ceiling), 2.5f);
+
+            // With it, the true peak stays at the same ceiling.
+            expectLessThan(juce::Decibels::gainToDecibels(truePeakOn / ceiling), 0.5f);
+            expect(samplePeakOn < samplePeakOff);
+        }
+
+        beginTest("Lookahead output is delayed by the reported latency");
+        {
+            for (bool truePeak : { false, true }) {
+                auto processor = createPlugin("Limiter");
+                setParameter(*processor, "Thresh", 0.0f);
+                setParameter(*processor, "Output", 0.0f);
+                setParameter(*processor, "Lookahead", 2.0f);
+                setParameter(*processor, "True Peak", truePeak ? 1.0f : 0.0f);
+
+                // A quiet impulse, so the limiter does nothing to it.
+                juce::AudioBuffer<float> input(2, 1024);
+                input.clear();
+                input.setSample(0, 100, 0.01f);
+                input.setSample(1, 100, 0.01f);
+
+                const auto output = render(*processor, input, juce::MidiBuffer(), 1024, 64);
+                int position = -1;
+                for (int i = 0; i < output.getNumSamples(); ++i) {
+                    if (output.getSample(0, i) != 0.0f && position < 0) {
+                        position = i;
+                    }
+                }
+                expectEquals(position - 100, processor->getLatencySamples());
+            }
+        }
+    }
+};
+
+static LimiterTests limiterTests;
@@ -0,0 +1,64 @@
+/*
+  Unit tests for the shared DSP code, and for plug-in features that the golden
+  tests don't reach because no factory program uses them.
+
+  Usage: mda-unit [name ...]
+
+  Runs the tests with the given names, or all of them if there are no names.
+  Every test is a juce::UnitTest in one of the other files in this folder. The
+  name of the test is the first argument to the UnitTest constructor.
+
+  Exit code 0 means all tests passed, 1 means there were failures, and 2 means
+  that one of the names doesn't exist.
+*/
+
+#include <JuceHeader.h>
+
+namespace
+{
+
+const int exitPassed = 0;
+const int exitFailed = 1;
+const int exitUsage = 2;
+
+// The tests that use juce::Random get it from the runner. A fixed seed means
+// that a failure can always be reproduced.
+const juce::int64 randomSeed = 0x6d6461;
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::Array<juce::UnitTest *> selected;
+    if (argc < 2) {
+        for (auto *test : juce::UnitTest::getAllTests()) {
+            selected.add(test);
+        }
+    } else {
+        for (int i = 1; i < argc; ++i) {
+            juce::UnitTest *found = nullptr;
+            for (auto *test : juce::UnitTest::getAllTests()) {
+                if (test->getName() == juce::String(argv[i])) {
+                    found = test;
+                }
+            }
+            if (found == nullptr) {
+                std::fprintf(stderr, "unknown test: %s\n", argv[i]);
+                return exitUsage;
+            }
+            selected.add(found);
+        }
+    }
+
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    runner.runTests(selected, randomSeed);
+
+    int failures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i) {
+        failures += runner.getResult(i)->failures;
+    }
+    return failures == 0 ? exitPassed : exitFailed;
+}
@@ -0,0 +1,129 @@
+#include <JuceHeader.h>
+#include "MDAOversampling.h"
+
+class OversamplingTests : public juce::UnitTest
+{
+public:
+    OversamplingTests() : juce::UnitTest("Oversampling") { }
+
+    // Runs a sine wave at `frequency` (in units of the output sample rate)
+    // through a decimator and returns the output. The latency is counted from
+    // the last of the `factor` input samples that make up an output sample, so
+    // that is where the sine wave's time axis lines up with the output.
+    static std::vector<float> decimateSine(int factor, double frequency, int numFrames)
+    {
+        mda::Decimator decimator;
+        decimator.setFactor(factor);
+
+        std::vector<float> input(size_t(numFrames * factor));
+        for (size_t i = 0; i < input.size(); ++i) {
+            const double t = double(int(i) - factor + 1) / double(factor);
+            input[i] = float(std::sin(juce::MathConstants<double>::twoPi * frequency * t));
+        }
+
+        // Process in uneven chunks, to check that the filter state carries over.
+        std::vector<float> output(static_cast<size_t>(numFrames));
+        int done = 0;
+        int chunk = 1;
+        while (done < numFrames) {
+            const int n = std::min(chunk, numFrames - done);
+            decimator.process(input.data() + done * factor, output.data() + done, n);
+            done += n;
+            chunk = (chunk * 7) % 61 + 1;
+        }
+        return output;
+    }
+
+    // The amplitude after the filters have settled. The output samples don't
+    // necessarily hit the peaks of the sine wave, so this uses the RMS level
+    // instead. All test frequencies, and their aliases, go through a whole
+    // number of periods in the last 3800 samples.
+    static float settledAmplitude(const std::vector<float> &output)
+    {
+        double sum = 0.0;
+        for (size_t i = output.size() - 3800; i < output.size(); ++i) {
+            sum += double(output[i]) * double(output[i]);
+        }
+        return float(std::sqrt(2.0 * sum / 3800.0));
+    }
+
+    void runTest() override
+    {
+        beginTest("Factor 1 copies the input");
+        {
+            mda::Decimator decimator;
+            decimator.setFactor(1);
+            float input[64], output[64];
+            for (int i = 0; i < 64; ++i) {
+                input[i] = float(i) - 31.5f;
+            }
+            decimator.process(input, output, 64);
+            expect(std::memcmp(input, output, sizeof(input)) == 0);
+            expectEquals(decimator.getLatency(), 0.0f);
+        }
+
+        for (int factor : { 2, 4 }) {
+            const juce::String name = juce::String(factor) + "x: ";
+
+            beginTest(name + "passband");
+            {
+                // Up to 0.4 times the sample rate, with less than 0.07 dB droop.
+                for (double frequency : { 0.01, 0.1, 0.25, 0.4 }) {
+                    const float gain = settledAmplitude(decimateSine(factor, frequency, 4000));
+                    expectWithinAbsoluteError(juce::Decibels::gainToDecibels(gain), 0.0f, 0.07f,
+                                              "at " + juce::String(frequency));
+                }
+            }
+
+            beginTest(name + "stopband");
+            {
+                // Anything that would alias into the passband is attenuated by
+                // about 100 dB.
+                std::vector<double> frequencies { 0.61, 0.75, 0.9, 0.99 };
+                if (factor == 4) {
+                    frequencies.insert(frequencies.end(), { 1.1, 1.39, 1.61, 1.8, 1.99 });
+                }
+                for (double frequency : frequencies) {
+                    const float gain = settledAmplitude(decimateSine(factor, frequency, 4000));
+                    expectLessThan(juce::Decibels::gainToDecibels(gain), -95.0f,
+                                   "at " + juce::String(frequency));
+                }
+            }
+
+            beginTest(name + "latency");
+            {
+                // A slow sine comes out delayed by getLatency() samples.
+                mda::Decimator decimator;
+                decimator.setFactor(factor);
+                const double latency = decimator.getLatency();
+                const double frequency = 0.005;
+
+                const auto output = decimateSine(factor, frequency, 2000);
+                float worst = 0.0f;
+                for (size_t i = 200; i < output.size(); ++i) {
+                    const double expected = std::sin(juce::MathConstants<double>::twoPi * frequency * (double(i) - latency));
+                    worst = std::max(worst, float(std::abs(double(output[i]) - expected)));
+                }
+                expectLessThan(worst, 1e-3f);
+            }
+
+            beginTest(name + "reset");
+            {
+                mda::Decimator decimator;
+                decimator.setFactor(factor);
+                std::vector<float> input(size_t(256 * factor), 1.0f);
+                std::vector<float> output(256);
+                decimator.process(input.data(), output.data(), 256);
+
+                decimator.reset();
+                std::fill(input.begin(), input.end(), 0.0f);
+                decimator.process(input.data(), output.data(), 256);
+                for (float y : output) {
+                    expectEquals(y, 0.0f);
+                }
+            }
+        }
+    }
+};
+
+static OversamplingTests oversamplingTests;
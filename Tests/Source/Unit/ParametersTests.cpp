@@ -0,0 +1,138 @@
+#include <JuceHeader.h>
+#include "MDAJuceParameters.h"
+
+class ParametersTests : public juce::UnitTest
+{
+public:
+    ParametersTests() : juce::UnitTest("Parameters") { }
+
+    // The least a plug-in needs for watchAllParameters(): two parameters in
+    // a ValueTreeState, and one that was added without it.
+    struct TestProcessor : public juce::AudioProcessor
+    {
+        TestProcessor()
+        {
+            addParameter(new juce::AudioParameterFloat(juce::ParameterID("Other", 1), "Other", 0.0f, 1.0f, 0.5f));
+        }
+
+        static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout()
+        {
+            juce::AudioProcessorValueTreeState::ParameterLayout layout;
+            layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("A", 1), "A", 0.0f, 1.0f, 0.25f));
+            layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("B", 1), "B", 0.0f, 1.0f, 0.75f));
+            return layout;
+        }
+
+        const juce::String getName() const override { return "Test"; }
+        void prepareToPlay(double, int) override { }
+        void releaseResources() override { }
+        void processBlock(juce::AudioBuffer<float> &, juce::MidiBuffer &) override { }
+        double getTailLengthSeconds() const override { return 0.0; }
+        bool acceptsMidi() const override { return false; }
+        bool producesMidi() const override { return false; }
+        juce::AudioProcessorEditor *createEditor() override { return nullptr; }
+        bool hasEditor() const override { return false; }
+        int getNumPrograms() override { return 1; }
+        int getCurrentProgram() override { return 0; }
+        void setCurrentProgram(int) override { }
+        const juce::String getProgramName(int) override { return {}; }
+        void changeProgramName(int, const juce::String &) override { }
+        void getStateInformation(juce::MemoryBlock &) override { }
+        void setStateInformation(const void *, int) override { }
+
+        juce::AudioProcessorValueTreeState apvts { *this, nullptr, "Parameters", createParameterLayout() };
+    };
+
+    void runTest() override
+    {
+        beginTest("ParameterWatcher only reports actual changes");
+        {
+            std::atomic<float> a { 1.0f }, b { 2.0f };
+            mda::ParameterWatcher watcher;
+            watcher.add(&a);
+            watcher.add(&b);
+
+            // A new watcher starts out invalidated.
+            expect(watcher.changed());
+            expect(!watcher.changed());
+
+            b = 3.0f;
+            expect(watcher.changed());
+            expect(!watcher.changed());
+
+            // Setting the same value again is not a change.
+            a = 1.0f;
+            expect(!watcher.changed());
+
+            watcher.invalidate();
+            expect(watcher.changed());
+            expect(!watcher.changed());
+        }
+
+        beginTest("watchAllParameters watches the parameters of the ValueTreeState");
+        {
+            TestProcessor processor;
+            mda::ParameterWatcher watcher;
+            mda::watchAllParameters(watcher, processor.apvts);
+            expect(watcher.changed());
+            expect(!watcher.changed());
+
+            processor.apvts.getParameter("B")->setValueNotifyingHost(0.5f);
+            expect(watcher.changed());
+
+            // The parameter that isn't part of the ValueTreeState is skipped.
+            processor.getParameters()[0]->setValueNotifyingHost(0.0f);
+            expect(!watcher.changed());
+        }
+
+        beginTest("SmoothedValue jumps after reset, then ramps");
+        {
+            mda::SmoothedValue value;
+            value.prepare(1000.0, 0.01);
+
+            value.setTarget(2.0f);
+            expect(!value.isSmoothing());
+            expectEquals(value.next(), 2.0f);
+
+            value.setTarget(4.0f);
+            expect(value.isSmoothing());
+            float previous = 2.0f;
+            for (int i = 0; i < 9; ++i) {
+                const float x = value.next();
+                expectGreaterThan(x, previous);
+                expectLessThan(x, 4.0f);
+                previous = x;
+            }
+
+            // The last step lands exactly on the target.
+            expectEquals(value.next(), 4.0f);
+            expect(!value.isSmoothing());
+            expectEquals(value.next(), 4.0f);
+
+            value.reset();
+            value.setTarget(-1.0f);
+            expectEquals(value.next(), -1.0f);
+        }
+
+        beginTest("SmoothedValue changing direction halfway");
+        {
+            mda::SmoothedValue value;
+            value.prepare(1000.0, 0.01);
+            value.setTarget(0.0f);
+            value.setTarget(1.0f);
+            for (int i = 0; i < 5; ++i) {
+                value.next();
+            }
+            value.setTarget(0.0f);
+            float previous = value.next();
+            for (int i = 0; i < 9; ++i) {
+                const float x = value.next();
+                expectLessOrEqual(x, previous);
+                previous = x;
+            }
+            expectEquals(previous, 0.0f);
+        }
+    }
+};
+
+static ParametersTests parametersTests;
@@ -0,0 +1,111 @@
+#include <JuceHeader.h>
+#include "MDAPeakDetection.h"
+
+class PeakDetectionTests : public juce::UnitTest
+{
+public:
+    PeakDetectionTests() : juce::UnitTest("PeakDetection") { }
+
+    // The true peak of a sine wave is its amplitude, no matter where the
+    // samples fall. Returns the detector's peak over a run of the sine.
+    static float truePeakOfSine(double frequency, double phase)
+    {
+        mda::TruePeakDetector detector;
+        float peak = 0.0f;
+        for (int i = 0; i < 4000; ++i) {
+            const float x = float(std::sin(juce::MathConstants<double>::twoPi * frequency * double(i) + phase));
+            const float y = detector.process(x);
+            if (i >= 100) {
+                peak = std::max(peak, y);
+            }
+        }
+        return peak;
+    }
+
+    void runTest() override
+    {
+        auto random = getRandom();
+
+        beginTest("SlidingMaximum agrees with a brute-force search");
+        {
+            mda::SlidingMaximum maximum;
+            maximum.setMaxLength(300);
+
+            for (int length : { 1, 2, 5, 64, 300 }) {
+                maximum.setLength(length);
+                expectEquals(maximum.getLength(), length);
+
+                std::vector<float> history;
+                for (int i = 0; i < 5000; ++i) {
+                    // Long runs of the same value and of rising and falling
+                    // values are the tricky cases for a monotonic queue.
+                    float x;
+                    switch ((i / 97) % 4) {
+                        case 0:  x = random.nextFloat(); break;
+                        case 1:  x = 0.5f; break;
+                        case 2:  x = float(i % 97) / 97.0f; break;
+                        default: x = 1.0f - float(i % 97) / 97.0f; break;
+                    }
+                    history.push_back(x);
+
+                    // Before the window is full, it acts as if filled with zeros.
+                    float expected = 0.0f;
+                    for (int k = std::max(0, i - length + 1); k <= i; ++k) {
+                        expected = std::max(expected, history[size_t(k)]);
+                    }
+                    const float actual = maximum.process(x);
+                    if (actual != expected) {
+                        expectEquals(actual, expected, "length " + juce::String(length) + ", sample " + juce::String(i));
+                        break;
+                    }
+                }
+            }
+        }
+
+        beginTest("SlidingMaximum reset");
+        {
+            mda::SlidingMaximum maximum;
+            maximum.setMaxLength(10);
+            maximum.setLength(10);
+            maximum.process(1.0f);
+            maximum.reset();
+            expectEquals(maximum.process(0.25f), 0.25f);
+        }
+
+        beginTest("TruePeakDetector finds peaks in between samples");
+        {
+            // A sine at a quarter of the sample rate, with the samples at 45
+            // degrees: every sample is 0.707 but the true peak is 1.0.
+            const float samplePeak = float(std::sin(juce::MathConstants<double>::pi / 4.0));
+            const float truePeak = truePeakOfSine(0.25, juce::MathConstants<double>::pi / 4.0);
+            expectGreaterThan(truePeak, samplePeak * 1.3f);
+
+            // Within 0.5 dB below the real peak, and never above it, up to
+            // 0.9 times Nyquist.
+            for (double frequency : { 0.01, 0.1, 0.2, 0.3, 0.4, 0.45 }) {
+                for (int i = 0; i < 8; ++i) {
+                    const double phase = juce::MathConstants<double>::twoPi * double(i) / 8.0;
+                    const float db = juce::Decibels::gainToDecibels(truePeakOfSine(frequency, phase));
+                    expectLessThan(db, 0.05f, "overestimated at " + juce::String(frequency));
+                    expectGreaterThan(db, -0.5f, "underestimated at " + juce::String(frequency));
+                }
+            }
+        }
+
+        beginTest("TruePeakDetector latency");
+        {
+            // An impulse shows up getLatency() samples later.
+            mda::TruePeakDetector detector;
+            int firstPeak = -1;
+            for (int i = 0; i < 64; ++i) {
+                const float y = detector.process(i == 10 ? 1.0f : 0.0f);
+                if (y >= 1.0f && firstPeak < 0) {
+                    firstPeak = i;
+                }
+            }
+            expectEquals(firstPeak, 10 + mda::TruePeakDetector::getLatency());
+        }
+    }
+};
+
+static PeakDetectionTests peakDetectionTests;
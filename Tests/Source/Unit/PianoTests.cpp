@@ -0,0 +1,104 @@
+#include <JuceHeader.h>
+#include "TestUtilities.h"
+
+using namespace TestUtilities;
+
+// Piano and EPiano have the same interpolation and voice management code, so
+// these tests run for both.
+class PianoTests : public juce::UnitTest
+{
+public:
+    PianoTests() : juce::UnitTest("Piano") { }
+
+    static juce::MidiBuffer makeChords()
+    {
+        juce::MidiBuffer midi;
+        for (int note : { 36, 55, 64, 72, 79, 88, 96, 103 }) {
+            midi.addEvent(juce::MidiMessage::noteOn(1, note, juce::uint8(100)), 0);
+            midi.addEvent(juce::MidiMessage::noteOff(1, note), 22050);
+        }
+        return midi;
+    }
+
+    static juce::AudioBuffer<float> renderWith(const juce::String &plugin, const juce::String &parameter,
+                                               float value, const juce::MidiBuffer &midi, int numFrames)
+    {
+        auto processor = createPlugin(plugin);
+        setParameter(*processor, parameter, value);
+        return render(*processor, midi, numFrames);
+    }
+
+    // Index of the last sample that isn't silent, or -1.
+    static int lastSound(const juce::AudioBuffer<float> &buffer, float threshold)
+    {
+        int last = -1;
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
+            const float *data = buffer.getReadPointer(channel);
+            for (int i = 0; i < buffer.getNumSamples(); ++i) {
+                if (std::abs(data[i]) > threshold) {
+                    last = std::max(last, i);
+                }
+            }
+        }
+        return last;
+    }
+
+    // The largest jump from one sample to the next, which is what a click is.
+    static float largestStep(const juce::AudioBuffer<float> &buffer, int startFrame)
+    {
+        float step = 0.0f;
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
+            const float *data = buffer.getReadPointer(channel);
+            for (int i = std::max(1, startFrame); i < buffer.getNumSamples(); ++i) {
+                step = std::max(step, std::abs(data[i] - data[i - 1]));
+            }
+        }
+        return step;
+    }
+
+    void runTest() override
+    {
+        const auto chords = makeChords();
+
+        for (const juce::String plugin : { "Piano", "EPiano" }) {
+            beginTest(plugin + ": cubic and sinc interpolation");
+            {
+                const auto linear = renderWith(plugin, "Interpolation", 0.0f, chords, 44100);
+                expect(isFinite(linear));
+
+                for (int method : { 1, 2 }) {
+                    const auto output = renderWith(plugin, "Interpolation", float(method), chords, 44100);
+                    const juce::String name = plugin + (method == 1 ? " cubic" : " sinc");
+
+                    // Same notes at the same level, just a different way of
+                    // reading the waveforms.
+                    expect(isFinite(output), name + " is not finite");
+                    expect(!isIdentical(output, linear), name + " sounds the same as linear");
+                    const double difference = juce::Decibels::gainToDecibels(rms(output) / rms(linear));
+                    expectWithinAbsoluteError(difference, 0.0, 0.5, name + " level in dB");
+                }
+            }
+
+            beginTest(plugin + ": CPU budget lets quiet voices go early");
+            {
+                auto off = renderWith(plugin, "CPU Budget", -90.0f, chords, 4 * 44100);
+                auto budget = renderWith(plugin, "CPU Budget", -30.0f, chords, 4 * 44100);
+
+                // With the budget, the release tails stop sooner.
+                const float silence = juce::Decibels::decibelsToGain(-100.0f);
+                expectLessThan(lastSound(budget, silence), lastSound(off, silence));
+
+                // The voices fade out rather than stop dead, so the release
+                // doesn't click.
+                expectLessOrEqual(largestStep(budget, 22050), largestStep(off, 22050) * 1.1f);
+
+                // While the notes are loud, the output is the same.
+                juce::AudioBuffer<float> offStart(off.getArrayOfWritePointers(), off.getNumChannels(), 2000);
+                juce::AudioBuffer<float> budgetStart(budget.getArrayOfWritePointers(), budget.getNumChannels(), 2000);
+                expect(isIdentical(offStart, budgetStart));
+            }
+        }
+    }
+};
+
+static PianoTests pianoTests;
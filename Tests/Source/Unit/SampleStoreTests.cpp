@@ -0,0 +1,215 @@
+#include <JuceHeader.h>
+#include "MDASampleStore.h"
+
+#include <cstdlib>
+
+class SampleStoreTests : public juce::UnitTest
+{
+public:
+    SampleStoreTests() : juce::UnitTest("SampleStore") { }
+
+    void initialise() override
+    {
+        _folder = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                      .getChildFile("mda-unit-samplestore-" + juce::String(juce::Random::getSystemRandom().nextInt(1000000)));
+        _folder.createDirectory();
+
+        // Two keygroups, each an attack followed by a looped sine wave with a
+        // period of 32 samples. The loop is exactly 4 periods long.
+        for (int g = 0; g < 2; ++g) {
+            mda::Keygroup kg;
+            kg.root = 48 + 12 * g;
+            kg.high = 53 + 12 * g;
+            kg.pos = int(_samples.size());
+            for (int i = 0; i < 200; ++i) {
+                const double phase = juce::MathConstants<double>::twoPi * double(i) / 32.0;
+                _samples.push_back(short(10000.0 * std::sin(phase) * (g == 0 ? 1.0 : -1.0)));
+            }
+            kg.end = int(_samples.size()) - 1;
+            kg.loop = 128;
+            _keygroups.push_back(kg);
+        }
+        _samples.push_back(0);  // the extra sample for the interpolation
+    }
+
+    void shutdown() override
+    {
+        _folder.deleteRecursively();
+    }
+
+    std::string path(const juce::String &name) const
+    {
+        return _folder.getChildFile(name).getFullPathName().toStdString();
+    }
+
+    bool writeFile(const std::string &filePath) const
+    {
+        return mda::SampleStore::write(filePath, _samples.data(), int(_samples.size()),
+                                       _keygroups.data(), int(_keygroups.size()));
+    }
+
+    bool hasOurData(const mda::SampleStore &store) const
+    {
+        return store.numSamples() == int(_samples.size())
+            && store.numKeygroups() == int(_keygroups.size())
+            && std::memcmp(store.samples(), _samples.data(), sizeof(short) * _samples.size()) == 0
+            && std::memcmp(store.keygroups(), _keygroups.data(), sizeof(mda::Keygroup) * _keygroups.size()) == 0;
+    }
+
+    static void setSampleDir(const char *value)
+    {
+#ifdef _WIN32
+        _putenv_s("MDA_SAMPLE_DIR", value != nullptr ? value : "");
+#else
+        if (value != nullptr) {
+            setenv("MDA_SAMPLE_DIR", value, 1);
+        } else {
+            unsetenv("MDA_SAMPLE_DIR");
+        }
+#endif
+    }
+
+    void runTest() override
+    {
+        beginTest("Write and open a sample file");
+        {
+            expect(writeFile(path("roundtrip.samples")));
+            auto store = mda::SampleStore::open(path("roundtrip.samples"));
+            expect(store != nullptr);
+            if (store != nullptr) {
+                expect(hasOurData(*store));
+
+                // The samples start on a 64-byte boundary in the file, and
+                // the mapping is page-aligned, so they're aligned in memory too.
+                expectEquals(int(reinterpret_cast<std::uintptr_t>(store->samples()) % 64), 0);
+            }
+        }
+
+        beginTest("Opening a file twice shares the mapping");
+        {
+            auto first = mda::SampleStore::open(path("roundtrip.samples"));
+            auto second = mda::SampleStore::open(path("roundtrip.samples"));
+            expect(first != nullptr && first == second);
+
+            // Once nobody uses it anymore, it is unmapped and opened again.
+            first.reset();
+            second.reset();
+            auto third = mda::SampleStore::open(path("roundtrip.samples"));
+            expect(third != nullptr && hasOurData(*third));
+        }
+
+        beginTest("Bad files are rejected");
+        {
+            expect(mda::SampleStore::open(path("does-not-exist.samples")) == nullptr);
+
+            _folder.getChildFile("garbage.samples").replaceWithText("this is not a sample file at all");
+            expect(mda::SampleStore::open(path("garbage.samples")) == nullptr);
+
+            // A file that is cut off in the middle of the sample data.
+            juce::MemoryBlock data;
+            _folder.getChildFile("roundtrip.samples").loadFileAsData(data);
+            _folder.getChildFile("truncated.samples").replaceWithData(data.getData(), data.getSize() / 2);
+            expect(mda::SampleStore::open(path("truncated.samples")) == nullptr);
+
+            // Keygroups that point outside the samples are not written.
+            auto keygroups = _keygroups;
+            keygroups[1].end = int(_samples.size()) + 10;
+            expect(!mda::SampleStore::write(path("bad.samples"), _samples.data(), int(_samples.size()),
+                                            keygroups.data(), int(keygroups.size())));
+        }
+
+        beginTest("find() looks in MDA_SAMPLE_DIR, then the given folder");
+        {
+            const auto envFolder = _folder.getChildFile("env");
+            const auto pluginFolder = _folder.getChildFile("plugin");
+            envFolder.createDirectory();
+            pluginFolder.createDirectory();
+
+            // Only in the plug-in's folder.
+            expect(writeFile(pluginFolder.getChildFile("test.samples").getFullPathName().toStdString()));
+            setSampleDir(envFolder.getFullPathName().toRawUTF8());
+            auto store = mda::SampleStore::find("test.samples", pluginFolder.getFullPathName().toStdString());
+            expect(store != nullptr && hasOurData(*store));
+            store.reset();
+
+            // In both: the environment variable wins. That file has only the
+            // first keygroup, to tell them apart.
+            expect(mda::SampleStore::write(envFolder.getChildFile("test.samples").getFullPathName().toStdString(),
+                                           _samples.data(), int(_samples.size()), _keygroups.data(), 1));
+            store = mda::SampleStore::find("test.samples", pluginFolder.getFullPathName().toStdString());
+            expect(store != nullptr && store->numKeygroups() == 1);
+            store.reset();
+
+            // Without the environment variable.
+            setSampleDir(nullptr);
+            store = mda::SampleStore::find("test.samples", pluginFolder.getFullPathName().toStdString());
+            expect(store != nullptr && store->numKeygroups() == 2);
+
+            expect(mda::SampleStore::find("missing.samples", pluginFolder.getFullPathName().toStdString()) == nullptr);
+        }
+
+        beginTest("fromMemory() does not copy");
+        {
+            auto store = mda::SampleStore::fromMemory(_samples.data(), int(_samples.size()),
+                                                      _keygroups.data(), int(_keygroups.size()));
+            expect(store->samples() == _samples.data());
+            expect(store->keygroups() == _keygroups.data());
+        }
+
+        beginTest("upsamplingFactor()");
+        {
+            expectEquals(mda::SampleStore::upsamplingFactor(44100.0, 44100.0), 1);
+            expectEquals(mda::SampleStore::upsamplingFactor(32000.0, 48000.0), 1);
+            expectEquals(mda::SampleStore::upsamplingFactor(22050.0, 44100.0), 2);
+            expectEquals(mda::SampleStore::upsamplingFactor(22050.0, 96000.0), 4);
+            expectEquals(mda::SampleStore::upsamplingFactor(22050.0, 384000.0), 8);
+        }
+
+        beginTest("upsampled() maps the keygroups and interpolates the waveforms");
+        {
+            auto source = mda::SampleStore::fromMemory(_samples.data(), int(_samples.size()),
+                                                       _keygroups.data(), int(_keygroups.size()));
+            expect(mda::SampleStore::upsampled(source, 1) == source);
+
+            for (int factor : { 2, 4 }) {
+                auto store = mda::SampleStore::upsampled(source, factor);
+                expect(store != nullptr);
+                if (store == nullptr) { continue; }
+
+                // Asking again gives the same copy.
+                expect(mda::SampleStore::upsampled(source, factor) == store);
+
+                expectEquals(store->numKeygroups(), source->numKeygroups());
+                int worst = 0;
+                for (int g = 0; g < store->numKeygroups(); ++g) {
+                    const auto &kg = source->keygroups()[g];
+                    const auto &newKg = store->keygroups()[g];
+                    expectEquals(newKg.root, kg.root);
+                    expectEquals(newKg.high, kg.high);
+                    expectEquals(newKg.end - newKg.pos + 1, (kg.end - kg.pos + 1) * factor);
+                    expectEquals(newKg.loop, kg.loop * factor);
+                    expect(newKg.end + 1 < store->numSamples());
+
+                    // New sample j is the sine at j / factor. Skip the start,
+                    // where the filter sees the clamped samples before pos.
+                    for (int j = 16 * factor; j <= newKg.end - newKg.pos; ++j) {
+                        const double phase = juce::MathConstants<double>::twoPi * double(j) / double(32 * factor);
+                        const double expected = 10000.0 * std::sin(phase) * (g == 0 ? 1.0 : -1.0);
+                        worst = std::max(worst, int(std::abs(store->samples()[newKg.pos + j] - expected)));
+                    }
+
+                    // The sample after the end continues the loop.
+                    expectEquals(store->samples()[newKg.end + 1], store->samples()[newKg.end + 1 - newKg.loop]);
+                }
+                expectLessThan(worst, 20, "max error for " + juce::String(factor) + "x");
+            }
+        }
+    }
+
+private:
+    juce::File _folder;
+    std::vector<short> _samples;
+    std::vector<mda::Keygroup> _keygroups;
+};
+
+static SampleStoreTests sampleStoreTests;
@@ -0,0 +1,142 @@
+#include "TestUtilities.h"
+#include "PluginRegistry.h"
+
+namespace TestUtilities
+{
+
+std::unique_ptr<juce::AudioProcessor> createPlugin(const juce::String &name)
+{
+    auto info = findPlugin(name);
+    jassert(info != nullptr);
+    return std::unique_ptr<juce::AudioProcessor>(info->create());
+}
+
+void setParameter(juce::AudioProcessor &processor, const juce::String &id, float value)
+{
+    for (auto *parameter : processor.getParameters()) {
+        auto *ranged = dynamic_cast<juce::RangedAudioParameter *>(parameter);
+        if (ranged != nullptr && ranged->paramID == id) {
+            ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+            return;
+        }
+    }
+    std::fprintf(stderr, "no such parameter: %s\n", id.toRawUTF8());
+    jassertfalse;
+}
+
+juce::AudioBuffer<float> render(juce::AudioProcessor &processor,
+                                const juce::AudioBuffer<float> &input,
+                                const juce::MidiBuffer &midi,
+                                int numFrames,
+                                int blockSize,
+                                double sampleRate)
+{
+    // Several of the plug-ins use std::rand() for noise. Reseed it so that two
+    // renders of the same thing give the same output.
+    std::srand(1);
+
+    const int numInputs = processor.getTotalNumInputChannels();
+    const int numOutputs = processor.getTotalNumOutputChannels();
+    const int numChannels = std::max(numInputs, numOutputs);
+
+    processor.setNonRealtime(true);
+    processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    juce::AudioBuffer<float> buffer(numChannels, blockSize);
+    juce::AudioBuffer<float> output(numOutputs, numFrames);
+    juce::MidiBuffer blockMidi;
+
+    for (int position = 0; position < numFrames; position += blockSize) {
+        const int numSamples = std::min(blockSize, numFrames - position);
+
+        buffer.clear();
+        for (int channel = 0; channel < std::min(numInputs, input.getNumChannels()); ++channel) {
+            const int count = std::min(numSamples, input.getNumSamples() - position);
+            if (count > 0) {
+                buffer.copyFrom(channel, 0, input, channel, position, count);
+            }
+        }
+
+        blockMidi.clear();
+        for (const auto metadata : midi) {
+            if (metadata.samplePosition >= position && metadata.samplePosition < position + numSamples) {
+                blockMidi.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition - position);
+            }
+        }
+
+        juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), numChannels, numSamples);
+        processor.processBlock(block, blockMidi);
+
+        for (int channel = 0; channel < numOutputs; ++channel) {
+            output.copyFrom(channel, position, block, channel, 0, numSamples);
+        }
+    }
+
+    processor.releaseResources();
+    return output;
+}
+
+juce::AudioBuffer<float> render(juce::AudioProcessor &processor,
+                                const juce::MidiBuffer &midi,
+                                int numFrames,
+                                int blockSize,
+                                double sampleRate)
+{
+    return render(processor, juce::AudioBuffer<float>(), midi, numFrames, blockSize, sampleRate);
+}
+
+double rms(const juce::AudioBuffer<float> &buffer, int startFrame)
+{
+    double sum = 0.0;
+    juce::int64 count = 0;
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
+        const float *data = buffer.getReadPointer(channel);
+        for (int i = startFrame; i < buffer.getNumSamples(); ++i) {
+            sum += double(data[i]) * double(data[i]);
+            count += 1;
+        }
+    }
+    return count > 0 ? std::sqrt(sum / double(count)) : 0.0;
+}
+
+float peak(const juce::AudioBuffer<float> &buffer)
+{
+    float result = 0.0f;
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
+        const float *data = buffer.getReadPointer(channel);
+        for (int i = 0; i < buffer.getNumSamples(); ++i) {
+            result = std::max(result, std::abs(data[i]));
+        }
+    }
+    return result;
+}
+
+bool isFinite(const juce::AudioBuffer<float> &buffer)
+{
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
+        const float *data = buffer.getReadPointer(channel);
+        for (int i = 0; i < buffer.getNumSamples(); ++i) {
+            if (!std::isfinite(data[i])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool isIdentical(const juce::AudioBuffer<float> &a, const juce::AudioBuffer<float> &b)
+{
+    if (a.getNumChannels() != b.getNumChannels() || a.getNumSamples() != b.getNumSamples()) {
+        return false;
+    }
+    for (int channel = 0; channel < a.getNumChannels(); ++channel) {
+        if (std::memcmp(a.getReadPointer(channel), b.getReadPointer(channel),
+                        sizeof(float) * size_t(a.getNumSamples())) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace TestUtilities
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Helpers for the tests that drive a whole plug-in. The plug-ins are created
+// through the registry from Benchmark/Source/PluginRegistry.h, so the tests
+// only see the juce::AudioProcessor interface, just like a host.
+namespace TestUtilities
+{
+    // Creates a new instance of the plug-in with the given folder name.
+    std::unique_ptr<juce::AudioProcessor> createPlugin(const juce::String &name);
+
+    // Sets a parameter by its ID. The value is in the parameter's own units,
+    // such as dB or the index of a choice, not normalized to 0 - 1.
+    void setParameter(juce::AudioProcessor &processor, const juce::String &id, float value);
+
+    // Prepares the plug-in and renders `numFrames` samples in blocks of
+    // `blockSize`. The input is read from `input`, which may have fewer
+    // channels or samples than needed; the rest is silence. The timestamps
+    // of the MIDI events are counted from the start of the render. Returns
+    // one channel for every output channel of the plug-in. The plug-in is
+    // told that this is an offline render.
+    juce::AudioBuffer<float> render(juce::AudioProcessor &processor,
+                                    const juce::AudioBuffer<float> &input,
+                                    const juce::MidiBuffer &midi,
+                                    int numFrames,
+                                    int blockSize = 256,
+                                    double sampleRate = 44100.0);
+
+    // Same, for synths that have no audio input.
+    juce::AudioBuffer<float> render(juce::AudioProcessor &processor,
+                                    const juce::MidiBuffer &midi,
+                                    int numFrames,
+                                    int blockSize = 256,
+                                    double sampleRate = 44100.0);
+
+    // The RMS level of all channels together, from `startFrame` to the end.
+    double rms(const juce::AudioBuffer<float> &buffer, int startFrame = 0);
+
+    // The largest absolute value in any channel.
+    float peak(const juce::AudioBuffer<float> &buffer);
+
+    // Are all samples finite, i.e. no NaN or infinity?
+    bool isFinite(const juce::AudioBuffer<float> &buffer);
+
+    // Do the two buffers have the same size and exactly the same samples?
+    bool isIdentical(const juce::AudioBuffer<float> &a, const juce::AudioBuffer<float> &b);
+}
@@ -0,0 +1,81 @@
+#include <JuceHeader.h>
+#include "MDAVoiceTree.h"
+
+class VoiceTreeTests : public juce::UnitTest
+{
+public:
+    VoiceTreeTests() : juce::UnitTest("VoiceTree") { }
+
+    // The linear search that the tree replaces. Ties go to the lowest index.
+    static int linearSearch(const std::vector<float> &levels, int numVoices)
+    {
+        int quietest = 0;
+        for (int v = 1; v < numVoices; ++v) {
+            if (levels[size_t(v)] < levels[size_t(quietest)]) {
+                quietest = v;
+            }
+        }
+        return quietest;
+    }
+
+    void runTest() override
+    {
+        auto random = getRandom();
+
+        beginTest("Agrees with a linear search");
+        {
+            for (int capacity : { 1, 7, 16, 100, 128 }) {
+                mda::QuietestVoiceTree tree(capacity);
+                std::vector<float> levels(static_cast<size_t>(capacity));
+
+                for (int round = 0; round < 50; ++round) {
+                    const int numVoices = 1 + random.nextInt(capacity);
+                    for (int v = 0; v < numVoices; ++v) {
+                        // Few distinct values, so there are lots of ties.
+                        levels[size_t(v)] = float(random.nextInt(8)) * 0.125f;
+                        tree.setLevel(v, levels[size_t(v)]);
+                    }
+                    tree.rebuild(numVoices);
+                    expectEquals(tree.quietest(), linearSearch(levels, numVoices));
+
+                    // Single updates, like stealing voices for a chord.
+                    for (int i = 0; i < 20; ++i) {
+                        const int v = random.nextInt(numVoices);
+                        levels[size_t(v)] = float(random.nextInt(8)) * 0.125f;
+                        tree.update(v, levels[size_t(v)]);
+                        expectEquals(tree.quietest(), linearSearch(levels, numVoices));
+                        expectEquals(tree.quietestLevel(), levels[size_t(tree.quietest())]);
+                    }
+                }
+            }
+        }
+
+        beginTest("Voices past numVoices are never chosen");
+        {
+            mda::QuietestVoiceTree tree(16);
+            for (int v = 0; v < 16; ++v) {
+                tree.setLevel(v, float(16 - v));
+            }
+            tree.rebuild(4);
+            expectEquals(tree.quietest(), 3);
+        }
+
+        beginTest("A stolen voice is not chosen again");
+        {
+            // This is how the synths use it: the voice that was just taken
+            // over gets a high level, so the next note takes another one.
+            mda::QuietestVoiceTree tree(8);
+            for (int v = 0; v < 8; ++v) {
+                tree.setLevel(v, 0.0f);
+            }
+            tree.rebuild(8);
+
+            for (int note = 0; note < 8; ++note) {
+                expectEquals(tree.quietest(), note);
+                tree.update(tree.quietest(), 1.0f);
+            }
+        }
+    }
+};
+
+static VoiceTreeTests voiceTreeTests;